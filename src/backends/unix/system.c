@@ -27,6 +27,7 @@
 #include <dirent.h>
 #include <dlfcn.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -293,6 +294,142 @@ Sys_Nanosleep(int nanosec)
 
 /* ================================================================ */
 
+/* Threads for the shared job pool, see jobs.c. Semaphores are built on
+   a mutex and a condition variable, unnamed POSIX semaphores
+   aren't available everywhere (e.g. on MacOS). */
+
+typedef struct
+{
+	pthread_t thread;
+	int (*func)(void *data);
+	void *data;
+} systhread_t;
+
+typedef struct
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int value;
+} syssemaphore_t;
+
+static void *
+Sys_ThreadMain(void *arg)
+{
+	systhread_t *t = arg;
+
+	t->func(t->data);
+
+	return NULL;
+}
+
+void *
+Sys_CreateThread(int (*func)(void *data), void *data)
+{
+	systhread_t *t;
+
+	if ((t = malloc(sizeof(*t))) == NULL)
+	{
+		return NULL;
+	}
+
+	t->func = func;
+	t->data = data;
+
+	if (pthread_create(&t->thread, NULL, Sys_ThreadMain, t) != 0)
+	{
+		free(t);
+		return NULL;
+	}
+
+	return t;
+}
+
+void
+Sys_WaitThread(void *thread)
+{
+	systhread_t *t = thread;
+
+	pthread_join(t->thread, NULL);
+	free(t);
+}
+
+void *
+Sys_CreateSemaphore(void)
+{
+	syssemaphore_t *s;
+
+	if ((s = malloc(sizeof(*s))) == NULL)
+	{
+		return NULL;
+	}
+
+	s->value = 0;
+
+	if (pthread_mutex_init(&s->mutex, NULL) != 0)
+	{
+		free(s);
+		return NULL;
+	}
+
+	if (pthread_cond_init(&s->cond, NULL) != 0)
+	{
+		pthread_mutex_destroy(&s->mutex);
+		free(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+void
+Sys_DestroySemaphore(void *sem)
+{
+	syssemaphore_t *s = sem;
+
+	pthread_cond_destroy(&s->cond);
+	pthread_mutex_destroy(&s->mutex);
+	free(s);
+}
+
+void
+Sys_SemaphoreWait(void *sem)
+{
+	syssemaphore_t *s = sem;
+
+	pthread_mutex_lock(&s->mutex);
+
+	while (s->value <= 0)
+	{
+		pthread_cond_wait(&s->cond, &s->mutex);
+	}
+
+	s->value--;
+	pthread_mutex_unlock(&s->mutex);
+}
+
+void
+Sys_SemaphorePost(void *sem)
+{
+	syssemaphore_t *s = sem;
+
+	pthread_mutex_lock(&s->mutex);
+	s->value++;
+	pthread_cond_signal(&s->cond);
+	pthread_mutex_unlock(&s->mutex);
+}
+
+int
+Sys_GetNumCores(void)
+{
+	long count;
+
+	count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (count > 0) ? (int)count : 1;
+}
+
+/* ================================================================ */
+
 /* The musthave and canhave arguments are unused in YQ2. We
    can't remove them since Sys_FindFirst() and Sys_FindNext()
    are defined in shared.h and may be used in custom game DLLs. */
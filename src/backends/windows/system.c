@@ -317,6 +317,91 @@ Sys_Nanosleep(int nanosec)
 
 /* ================================================================ */
 
+/* Threads for the shared job pool, see jobs.c. */
+
+typedef struct
+{
+	HANDLE thread;
+	int (*func)(void *data);
+	void *data;
+} systhread_t;
+
+static DWORD WINAPI
+Sys_ThreadMain(LPVOID arg)
+{
+	systhread_t *t = arg;
+
+	return (DWORD)t->func(t->data);
+}
+
+void *
+Sys_CreateThread(int (*func)(void *data), void *data)
+{
+	systhread_t *t;
+
+	if ((t = malloc(sizeof(*t))) == NULL)
+	{
+		return NULL;
+	}
+
+	t->func = func;
+	t->data = data;
+
+	if ((t->thread = CreateThread(NULL, 0, Sys_ThreadMain, t, 0, NULL)) == NULL)
+	{
+		free(t);
+		return NULL;
+	}
+
+	return t;
+}
+
+void
+Sys_WaitThread(void *thread)
+{
+	systhread_t *t = thread;
+
+	WaitForSingleObject(t->thread, INFINITE);
+	CloseHandle(t->thread);
+	free(t);
+}
+
+void *
+Sys_CreateSemaphore(void)
+{
+	return CreateSemaphore(NULL, 0, MAXLONG, NULL);
+}
+
+void
+Sys_DestroySemaphore(void *sem)
+{
+	CloseHandle(sem);
+}
+
+void
+Sys_SemaphoreWait(void *sem)
+{
+	WaitForSingleObject(sem, INFINITE);
+}
+
+void
+Sys_SemaphorePost(void *sem)
+{
+	ReleaseSemaphore(sem, 1, NULL);
+}
+
+int
+Sys_GetNumCores(void)
+{
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+
+	return (info.dwNumberOfProcessors > 0) ? (int)info.dwNumberOfProcessors : 1;
+}
+
+/* ================================================================ */
+
 /* The musthave and canhave arguments are unused in YQ2. We
    can't remove them since Sys_FindFirst() and Sys_FindNext()
    are defined in shared.h and may be used in custom game DLLs. */
@@ -22,6 +22,11 @@
  * This file implements the .cin video codec and the corresponding .pcx
  * bitmap decoder. .cin files are just a bunch of .pcx images.
  *
+ * While a cinematic plays the main thread reads a few frames ahead
+ * into a small ring, and a decoder thread decompresses them. Sound
+ * and palette changes are handed over when a frame is taken out of
+ * the ring, so they stay in step with the picture.
+ *
  * =======================================================================
  */
 
@@ -49,11 +54,33 @@ extern cvar_t *vid_renderer;
 cvar_t *cin_force43;
 int abort_cinematic;
 
+/* frames read ahead of the one that's shown */
+#define CIN_RINGSIZE 4
+#define CIN_MAXCOMPRESSED 0x20000
+
+/* input bits per lookup in the huffman tables,
+   that's 128 KB for all 256 contexts */
+#define HUFF_TABLEBITS 8
+
+/* zeros after the compressed data, the decoder
+   reads up to 8 bytes ahead of its position */
+#define HUFF_PADDING 8
+
 typedef struct
 {
-	byte *data;
-	int count;
-} cblock_t;
+	int command;
+	byte palette[768];
+
+	byte compressed[CIN_MAXCOMPRESSED + HUFF_PADDING];
+	int size;
+	int used; /* bytes of compressed the decoder read */
+
+	/* bytes or shorts, depending on cin.s_width */
+	short samples[22050 / 14 * 2];
+	int numsamples;
+
+	byte *pic;
+} cinframe_t;
 
 typedef struct
 {
@@ -76,6 +103,24 @@ typedef struct
 
 	int h_used[512];
 	int h_count[512];
+
+	/* [256][1 << HUFF_TABLEBITS], see Huff1BuildTable() */
+	unsigned short *hufftable;
+
+	/* frames read ahead, between tail and head */
+	cinframe_t ring[CIN_RINGSIZE];
+	int head, tail, queued;
+	int readframe;
+	qboolean eof;
+
+	/* the picture that went off screen,
+	   to be decoded into again */
+	byte *spare;
+
+	void *thread;
+	void *work, *done;
+	int decoded; /* next slot for the decoder thread */
+	qboolean quit;
 } cinematics_t;
 
 cinematics_t cin;
@@ -185,11 +230,36 @@ SCR_LoadPCX(char *filename, byte **pic, byte **palette, int *width, int *height)
 	FS_FreeFile(pcx);
 }
 
+static void SCR_StopCinematicThread(void);
+
 void
 SCR_StopCinematic(void)
 {
+	int i;
+
 	cl.cinematictime = 0; /* done */
 
+	SCR_StopCinematicThread();
+
+	for (i = 0; i < CIN_RINGSIZE; i++)
+	{
+		if (cin.ring[i].pic)
+		{
+			Z_Free(cin.ring[i].pic);
+			cin.ring[i].pic = NULL;
+		}
+	}
+
+	cin.head = cin.tail = cin.queued = 0;
+	cin.readframe = 0;
+	cin.eof = false;
+
+	if (cin.spare)
+	{
+		Z_Free(cin.spare);
+		cin.spare = NULL;
+	}
+
 	if (cin.pic)
 	{
 		Z_Free(cin.pic);
@@ -220,6 +290,12 @@ SCR_StopCinematic(void)
 		cin.hnodes1 = NULL;
 	}
 
+	if (cin.hufftable)
+	{
+		Z_Free(cin.hufftable);
+		cin.hufftable = NULL;
+	}
+
 	/* switch back down to 11 khz sound if necessary */
 	if (cin.restart_sound)
 	{
@@ -273,11 +349,60 @@ SmallestNode1(int numhnodes)
 	return bestnode;
 }
 
+/*
+ * Fills the lookup table for the tree of one context. The entry
+ * for the next HUFF_TABLEBITS input bits is either a symbol and
+ * how many of the bits its code takes, or the internal node the
+ * bits lead to when the code is longer than that.
+ */
+static void
+Huff1BuildTable(int prev)
+{
+	int *nodebase;
+	unsigned short *table;
+	int bits, node, i;
+
+	nodebase = cin.hnodes1 + prev * 256 * 2;
+	table = cin.hufftable + (prev << HUFF_TABLEBITS);
+
+	for (bits = 0; bits < (1 << HUFF_TABLEBITS); bits++)
+	{
+		node = cin.numhnodes1[prev];
+
+		/* a tree with a single symbol, the encoder never writes
+		   those. Just make sure it can't take us out of bounds. */
+		if (node < 256)
+		{
+			table[bits] = node | (1 << 9);
+			continue;
+		}
+
+		for (i = 0; i < HUFF_TABLEBITS; i++)
+		{
+			node = nodebase[(node - 256) * 2 + ((bits >> i) & 1)];
+
+			if (node < 256)
+			{
+				break;
+			}
+		}
+
+		if (node < 256)
+		{
+			table[bits] = node | ((i + 1) << 9);
+		}
+		else
+		{
+			table[bits] = node | (HUFF_TABLEBITS << 9);
+		}
+	}
+}
+
 /*
  * Reads the 64k counts table and initializes the node trees
  */
 void
-Huff1TableInit(void)
+Huff1TableInit(fileHandle_t file)
 {
 	int prev;
 	int j;
@@ -288,13 +413,15 @@ Huff1TableInit(void)
 	cin.hnodes1 = Z_Malloc(256 * 256 * 2 * 4);
 	memset(cin.hnodes1, 0, 256 * 256 * 2 * 4);
 
+	cin.hufftable = Z_Malloc(256 * (1 << HUFF_TABLEBITS) * sizeof(*cin.hufftable));
+
 	for (prev = 0; prev < 256; prev++)
 	{
 		memset(cin.h_count, 0, sizeof(cin.h_count));
 		memset(cin.h_used, 0, sizeof(cin.h_used));
 
 		/* read a row of counts */
-		FS_Read(counts, sizeof(counts), cl.cinematic_file);
+		FS_Read(counts, sizeof(counts), file);
 
 		for (j = 0; j < 256; j++)
 		{
@@ -330,24 +457,116 @@ Huff1TableInit(void)
 		}
 
 		cin.numhnodes1[prev] = numhnodes - 1;
+
+		Huff1BuildTable(prev);
 	}
 }
 
-cblock_t
-Huff1Decompress(cblock_t in)
+/*
+ * Decompresses insize bytes from in into at most outsize
+ * bytes at out. Codes are read HUFF_TABLEBITS bits at a time
+ * through the lookup table, only longer codes walk the rest of
+ * the tree bit by bit. Doesn't touch anything but its arguments
+ * and the tables, so it can run on the decoder thread. in must
+ * be followed by HUFF_PADDING readable bytes. Returns the number
+ * of bytes read from in.
+ */
+static int
+Huff1Decompress(const byte *in, int insize, byte *out, int outsize)
 {
-	byte *input;
+	const byte *input, *inend;
+	const int *nodebase;
+	unsigned long long bits;
+	int numbits, consumed;
+	int count, entry, node, prev, len;
+	byte *out_p, *out_end;
+
+	/* get decompressed count */
+	count = in[0] + (in[1] << 8) + (in[2] << 16) + (in[3] << 24);
+	count = Q_min(Q_max(count, 0), outsize);
+
+	input = in + 4;
+	inend = in + insize + HUFF_PADDING;
+	out_p = out;
+	out_end = out + count;
+
+	bits = 0;
+	numbits = 0;
+	consumed = 0;
+	prev = 0;
+
+	while (out_p < out_end)
+	{
+		/* top up the bit buffer, beyond the end of
+		   a broken frame we just read zeros */
+		while (numbits <= 56)
+		{
+			if (input < inend)
+			{
+				bits |= (unsigned long long)*input << numbits;
+			}
+
+			input++;
+			numbits += 8;
+		}
+
+		entry = cin.hufftable[(prev << HUFF_TABLEBITS) |
+			(int)(bits & ((1 << HUFF_TABLEBITS) - 1))];
+		len = entry >> 9;
+		bits >>= len;
+		numbits -= len;
+		consumed += len;
+
+		node = entry & 511;
+
+		if (node >= 256)
+		{
+			/* longer code, walk the rest of the tree */
+			nodebase = cin.hnodes1 + prev * 256 * 2;
+
+			while (node >= 256)
+			{
+				if (!numbits)
+				{
+					bits = (input < inend) ? *input : 0;
+					input++;
+					numbits = 8;
+				}
+
+				node = nodebase[(node - 256) * 2 + (int)(bits & 1)];
+				bits >>= 1;
+				numbits--;
+				consumed++;
+			}
+		}
+
+		*out_p++ = node;
+		prev = node;
+	}
+
+	return 4 + (consumed + 7) / 8;
+}
+
+/*
+ * The old decoder that walks the tree one bit at a time.
+ * Only used by cinbench to check the table driven one.
+ */
+static int
+Huff1DecompressTree(const byte *in, byte *out, int outsize)
+{
+	const byte *input;
 	byte *out_p;
 	int nodenum;
 	int count;
-	cblock_t out;
 	int inbyte;
 	int *hnodes, *hnodesbase;
+	int i;
 
 	/* get decompressed count */
-	count = in.data[0] + (in.data[1] << 8) + (in.data[2] << 16) + (in.data[3] << 24);
-	input = in.data + 4;
-	out_p = out.data = Z_Malloc(count);
+	count = in[0] + (in[1] << 8) + (in[2] << 16) + (in[3] << 24);
+	count = Q_min(Q_max(count, 0), outsize);
+	input = in + 4;
+	out_p = out;
 
 	/* read bits */
 	hnodesbase = cin.hnodes1 - 256 * 2; /* nodes 0-255 aren't stored */
@@ -359,8 +578,6 @@ Huff1Decompress(cblock_t in)
 	{
 		inbyte = *input++;
 
-		int i = 0;
-
 		for (i = 0; i < 8; i++)
 		{
 			if (nodenum < 256)
@@ -381,100 +598,258 @@ Huff1Decompress(cblock_t in)
 		}
 	}
 
-	if ((input - in.data != in.count) && (input - in.data != in.count + 1))
-	{
-		Com_Printf("Decompression overread by %i", (int)(input - in.data) - in.count);
-	}
-
-	out.count = out_p - out.data;
-
-	return out;
+	return input - in;
 }
 
-byte *
-SCR_ReadNextFrame(void)
+/*
+ * Reads the next frame, its palette and its sound from
+ * the file. Returns false after the last frame.
+ */
+static qboolean
+SCR_ReadFrameData(fileHandle_t file, int framenum, cinframe_t *f)
 {
 	int r;
 	int command;
-
-	// the samples array is used as bytes or shorts, depending on bitrate (cin.s_width)
-	// so we need to make sure to align it correctly
-	YQ2_ALIGNAS_TYPE(short) byte samples[22050 / 14 * 4];
-
-	byte compressed[0x20000];
 	int size;
-	byte *pic;
-	cblock_t in, huf1;
-	int start, end, count;
+	int start, end;
 
-	/* read the next frame */
-	r = FS_FRead(&command, 4, 1, cl.cinematic_file);
+	r = FS_FRead(&command, 4, 1, file);
 
 	if (r == 0)
 	{
 		/* we'll give it one more chance */
-		r = FS_FRead(&command, 4, 1, cl.cinematic_file);
+		r = FS_FRead(&command, 4, 1, file);
 	}
 
 	if (r != 4)
 	{
-		return NULL;
+		return false;
 	}
 
-	command = LittleLong(command);
+	f->command = LittleLong(command);
 
-	if (command == 2)
+	if (f->command == 2)
 	{
-		return NULL;  /* last frame marker */
+		return false;  /* last frame marker */
 	}
 
-	if (command == 1)
+	if (f->command == 1)
 	{
 		/* read palette */
-		FS_Read(cl.cinematicpalette, sizeof(cl.cinematicpalette),
-				cl.cinematic_file);
-		cl.cinematicpalette_active = 0;
+		FS_Read(f->palette, sizeof(f->palette), file);
 	}
 
-	/* decompress the next frame */
-	FS_Read(&size, 4, cl.cinematic_file);
+	/* read the compressed frame */
+	FS_Read(&size, 4, file);
 	size = LittleLong(size);
 
-	if (((size_t)size > sizeof(compressed)) || (size < 1))
+	if ((size > CIN_MAXCOMPRESSED) || (size < 1))
 	{
 		Com_Error(ERR_DROP, "Bad compressed frame size");
 	}
 
-	FS_Read(compressed, size, cl.cinematic_file);
+	FS_Read(f->compressed, size, file);
+	memset(f->compressed + size, 0, HUFF_PADDING);
+	f->size = size;
 
 	/* read sound */
-	start = cl.cinematicframe * cin.s_rate / 14;
-	end = (cl.cinematicframe + 1) * cin.s_rate / 14;
-	count = end - start;
+	start = framenum * cin.s_rate / 14;
+	end = (framenum + 1) * cin.s_rate / 14;
+	f->numsamples = end - start;
 
-	FS_Read(samples, count * cin.s_width * cin.s_channels,
-			cl.cinematic_file);
+	if (f->numsamples * cin.s_width * cin.s_channels > sizeof(f->samples))
+	{
+		Com_Error(ERR_DROP, "Bad cinematic sound format");
+	}
+
+	FS_Read(f->samples, f->numsamples * cin.s_width * cin.s_channels, file);
 
 	if (cin.s_width == 2)
 	{
-		for (r = 0; r < count * cin.s_channels; r++)
+		for (r = 0; r < f->numsamples * cin.s_channels; r++)
+		{
+			f->samples[r] = LittleShort(f->samples[r]);
+		}
+	}
+
+	return true;
+}
+
+static void
+SCR_DecodeFrame(cinframe_t *f)
+{
+	f->used = Huff1Decompress(f->compressed, f->size,
+			f->pic, cin.width * cin.height);
+}
+
+/*
+ * Decodes the frames the main thread has read, in order.
+ */
+static int
+SCR_CinematicThread(void *data)
+{
+	for (;;)
+	{
+		Sys_SemaphoreWait(cin.work);
+
+		if (cin.quit)
 		{
-			((short *)samples)[r] = LittleShort(((short *)samples)[r]);
+			break;
 		}
+
+		SCR_DecodeFrame(&cin.ring[cin.decoded]);
+		cin.decoded = (cin.decoded + 1) % CIN_RINGSIZE;
+
+		Sys_SemaphorePost(cin.done);
+	}
+
+	return 0;
+}
+
+static void
+SCR_StopCinematicThread(void)
+{
+	if (cin.thread)
+	{
+		cin.quit = true;
+		Sys_SemaphorePost(cin.work);
+		Sys_WaitThread(cin.thread);
+		cin.thread = NULL;
 	}
 
-	S_RawSamples(count, cin.s_rate, cin.s_width, cin.s_channels,
-			samples, Cvar_VariableValue("s_volume"));
+	if (cin.work)
+	{
+		Sys_DestroySemaphore(cin.work);
+		cin.work = NULL;
+	}
+
+	if (cin.done)
+	{
+		Sys_DestroySemaphore(cin.done);
+		cin.done = NULL;
+	}
+
+	cin.quit = false;
+}
+
+/*
+ * Without a thread the frames are
+ * decoded on the main thread instead.
+ */
+static void
+SCR_StartCinematicThread(void)
+{
+	cin.decoded = 0;
+	cin.work = Sys_CreateSemaphore();
+	cin.done = Sys_CreateSemaphore();
+
+	if (cin.work && cin.done)
+	{
+		cin.thread = Sys_CreateThread(SCR_CinematicThread, NULL);
+	}
+
+	if (!cin.thread)
+	{
+		Com_DPrintf("%s: Decoding cinematic on the main thread\n",
+			__func__);
+		SCR_StopCinematicThread();
+	}
+}
+
+/*
+ * Reads frames into all free slots of the ring
+ * and hands them to the decoder thread.
+ */
+static void
+SCR_FillFrameRing(void)
+{
+	cinframe_t *f;
+
+	while (!cin.eof && (cin.queued < CIN_RINGSIZE))
+	{
+		f = &cin.ring[cin.head];
+
+		if (!SCR_ReadFrameData(cl.cinematic_file, cin.readframe, f))
+		{
+			cin.eof = true;
+			break;
+		}
 
-	in.data = compressed;
-	in.count = size;
+		if (!f->pic)
+		{
+			if (cin.spare)
+			{
+				f->pic = cin.spare;
+				cin.spare = NULL;
+			}
+			else
+			{
+				f->pic = Z_Malloc(cin.width * cin.height);
+			}
+		}
 
-	huf1 = Huff1Decompress(in);
+		cin.readframe++;
+		cin.head = (cin.head + 1) % CIN_RINGSIZE;
+		cin.queued++;
 
-	pic = huf1.data;
+		if (cin.thread)
+		{
+			Sys_SemaphorePost(cin.work);
+		}
+		else
+		{
+			SCR_DecodeFrame(f);
+		}
+	}
+}
+
+byte *
+SCR_ReadNextFrame(void)
+{
+	cinframe_t *f;
+	byte *pic;
+
+	SCR_FillFrameRing();
+
+	if (!cin.queued)
+	{
+		return NULL;
+	}
+
+	f = &cin.ring[cin.tail];
+
+	if (cin.thread)
+	{
+		/* frames are decoded in order, so
+		   this one's done after the wait */
+		Sys_SemaphoreWait(cin.done);
+	}
+
+	if (f->command == 1)
+	{
+		memcpy(cl.cinematicpalette, f->palette, sizeof(cl.cinematicpalette));
+		cl.cinematicpalette_active = 0;
+	}
+
+	S_RawSamples(f->numsamples, cin.s_rate, cin.s_width, cin.s_channels,
+			(byte *)f->samples, Cvar_VariableValue("s_volume"));
+
+	if (f->used > f->size + 1)
+	{
+		Com_Printf("Decompression overread by %i", f->used - f->size);
+	}
+
+	pic = f->pic;
+	f->pic = NULL;
+
+	cin.tail = (cin.tail + 1) % CIN_RINGSIZE;
+	cin.queued--;
 
 	cl.cinematicframe++;
 
+	/* keep the decoder busy while this one is shown */
+	SCR_FillFrameRing();
+
 	return pic;
 }
 
@@ -514,9 +889,15 @@ SCR_RunCinematic(void)
 		cl.cinematictime = cls.realtime - cl.cinematicframe * 1000 / 14;
 	}
 
+	/* the next frame gets decoded into the old one */
 	if (cin.pic)
 	{
-		Z_Free(cin.pic);
+		if (cin.spare)
+		{
+			Z_Free(cin.spare);
+		}
+
+		cin.spare = cin.pic;
 	}
 
 	cin.pic = cin.pic_pending;
@@ -534,6 +915,105 @@ SCR_RunCinematic(void)
 	}
 }
 
+/*
+ * Decodes all frames of a cinematic with the table driven
+ * and the old decoder, checks that they agree and prints
+ * how long each of them took.
+ */
+void
+SCR_CinBench_f(void)
+{
+	static cinframe_t f;
+	char name[MAX_OSPATH];
+	fileHandle_t file;
+	int header[5];
+	int frames, mismatches, outsize;
+	byte *tableout, *treeout;
+	long long start, tabletime, treetime;
+
+	if (Cmd_Argc() != 2)
+	{
+		Com_Printf("Usage: %s <name.cin>\n", Cmd_Argv(0));
+		return;
+	}
+
+	if ((cl.cinematictime > 0) || cin.hnodes1)
+	{
+		Com_Printf("Can't run while a cinematic is playing.\n");
+		return;
+	}
+
+	Com_sprintf(name, sizeof(name), "video/%s", Cmd_Argv(1));
+	FS_FOpenFile(name, &file, false);
+
+	if (!file)
+	{
+		Com_Printf("Couldn't open %s.\n", name);
+		return;
+	}
+
+	FS_Read(header, sizeof(header), file);
+	cin.width = LittleLong(header[0]);
+	cin.height = LittleLong(header[1]);
+	cin.s_rate = LittleLong(header[2]);
+	cin.s_width = LittleLong(header[3]);
+	cin.s_channels = LittleLong(header[4]);
+
+	outsize = cin.width * cin.height;
+
+	if ((cin.width <= 0) || (cin.height <= 0) || (outsize > 1024 * 1024))
+	{
+		Com_Printf("%s is not a cinematic.\n", name);
+		FS_FCloseFile(file);
+		return;
+	}
+
+	Huff1TableInit(file);
+
+	tableout = Z_Malloc(outsize);
+	treeout = Z_Malloc(outsize);
+
+	frames = mismatches = 0;
+	tabletime = treetime = 0;
+
+	while (SCR_ReadFrameData(file, frames, &f))
+	{
+		start = Sys_Microseconds();
+		Huff1Decompress(f.compressed, f.size, tableout, outsize);
+		tabletime += Sys_Microseconds() - start;
+
+		start = Sys_Microseconds();
+		Huff1DecompressTree(f.compressed, treeout, outsize);
+		treetime += Sys_Microseconds() - start;
+
+		if (memcmp(tableout, treeout, outsize))
+		{
+			mismatches++;
+		}
+
+		frames++;
+	}
+
+	Com_Printf("%s: %i frames of %ix%i\n", name, frames, cin.width, cin.height);
+
+	if (frames)
+	{
+		Com_Printf("  table: %.1f us/frame\n", (double)tabletime / frames);
+		Com_Printf("  tree:  %.1f us/frame\n", (double)treetime / frames);
+		Com_Printf("  %i frames differ\n", mismatches);
+	}
+
+	Z_Free(tableout);
+	Z_Free(treeout);
+
+	Z_Free(cin.hnodes1);
+	cin.hnodes1 = NULL;
+	Z_Free(cin.hufftable);
+	cin.hufftable = NULL;
+
+	FS_FCloseFile(file);
+}
+
 static int
 SCR_MinimalColor(void)
 {
@@ -787,7 +1267,8 @@ SCR_PlayCinematic(char *arg)
 	FS_Read(&cin.s_channels, 4, cl.cinematic_file);
 	cin.s_channels = LittleLong(cin.s_channels);
 
-	Huff1TableInit();
+	Huff1TableInit(cl.cinematic_file);
+	SCR_StartCinematicThread();
 
 	cl.cinematicframe = 0;
 	cin.pic = SCR_ReadNextFrame();
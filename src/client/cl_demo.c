@@ -0,0 +1,551 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * =======================================================================
+ *
+ * Demo index. While recording, every cl_demoindex seconds the client
+ * state is saved as a keyframe: The configstrings that changed since
+ * the start of the demo, layout, inventory and an uncompressed copy
+ * of the frame the next message is delta compressed against. When
+ * the recording stops the keyframes and an index to them are written
+ * behind the end of the demo, where old readers don't look. The demo
+ * server sends a keyframe and continues with the message behind it to
+ * jump to any of them.
+ *
+ * =======================================================================
+ */
+
+#include <limits.h>
+
+#include "header/client.h"
+
+static qboolean demo_indexing;
+static int demo_servercount;
+static int demo_firsttime;
+static int demo_nexttime;
+static int demo_lastframe;
+
+/* configstrings at the start of the demo and which of them changed */
+static char demo_signon[MAX_CONFIGSTRINGS][MAX_QPATH];
+static byte demo_changed[(MAX_CONFIGSTRINGS + 7) / 8];
+
+static ddemokey_t *demo_keys;
+static int demo_numkeys, demo_maxkeys;
+
+/* keyframe messages, held back until the demo ends */
+static byte *demo_keydata;
+static int demo_keysize, demo_maxkeysize;
+
+static void
+CL_FreeDemoIndex(void)
+{
+	free(demo_keys);
+	demo_keys = NULL;
+	demo_numkeys = demo_maxkeys = 0;
+
+	free(demo_keydata);
+	demo_keydata = NULL;
+	demo_keysize = demo_maxkeysize = 0;
+
+	demo_indexing = false;
+}
+
+/*
+ * Registering empty model, sound or image names is an
+ * error. These are only added during a game, so there's
+ * no need to clear them when going back in time.
+ */
+static qboolean
+CL_SkipDemoConfigstring(int i, const char *s)
+{
+	return !s[0] && (i >= CS_MODELS) && (i < CS_IMAGES + MAX_IMAGES);
+}
+
+static qboolean
+CL_AddKeyMessage(sizebuf_t *buf)
+{
+	int len;
+
+	if (!buf->cursize)
+	{
+		return true;
+	}
+
+	if (demo_keysize + 4 + buf->cursize > demo_maxkeysize)
+	{
+		int newmax = demo_maxkeysize ? demo_maxkeysize * 2 : 65536;
+		byte *data = realloc(demo_keydata, newmax);
+
+		if (!data)
+		{
+			return false;
+		}
+
+		demo_keydata = data;
+		demo_maxkeysize = newmax;
+	}
+
+	len = LittleLong(buf->cursize);
+	memcpy(demo_keydata + demo_keysize, &len, 4);
+	memcpy(demo_keydata + demo_keysize + 4, buf->data, buf->cursize);
+	demo_keysize += 4 + buf->cursize;
+
+	SZ_Clear(buf);
+
+	return true;
+}
+
+static void
+CL_WriteDemoBuffer(sizebuf_t *buf)
+{
+	int len;
+
+	if (!buf->cursize)
+	{
+		return;
+	}
+
+	len = LittleLong(buf->cursize);
+	fwrite(&len, 4, 1, cls.demofile);
+	fwrite(buf->data, buf->cursize, 1, cls.demofile);
+
+	SZ_Clear(buf);
+}
+
+/*
+ * Same format as SV_WritePlayerstateToClient()
+ * without a frame to delta from.
+ */
+static void
+CL_WriteKeyPlayerstate(sizebuf_t *msg, const player_state_t *ps)
+{
+	int statbits;
+	int i;
+
+	MSG_WriteByte(msg, svc_playerinfo);
+	MSG_WriteShort(msg, PS_M_TYPE | PS_M_ORIGIN | PS_M_VELOCITY |
+			PS_M_TIME | PS_M_FLAGS | PS_M_GRAVITY | PS_M_DELTA_ANGLES |
+			PS_VIEWOFFSET | PS_VIEWANGLES | PS_KICKANGLES | PS_BLEND |
+			PS_FOV | PS_WEAPONINDEX | PS_WEAPONFRAME | PS_RDFLAGS);
+
+	MSG_WriteByte(msg, ps->pmove.pm_type);
+
+	for (i = 0; i < 3; i++)
+	{
+		MSG_WriteShort(msg, ps->pmove.origin[i]);
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		MSG_WriteShort(msg, ps->pmove.velocity[i]);
+	}
+
+	MSG_WriteByte(msg, ps->pmove.pm_time);
+	MSG_WriteByte(msg, ps->pmove.pm_flags);
+	MSG_WriteShort(msg, ps->pmove.gravity);
+
+	for (i = 0; i < 3; i++)
+	{
+		MSG_WriteShort(msg, ps->pmove.delta_angles[i]);
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		MSG_WriteChar(msg, ps->viewoffset[i] * 4);
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		MSG_WriteAngle16(msg, ps->viewangles[i]);
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		MSG_WriteChar(msg, ps->kick_angles[i] * 4);
+	}
+
+	MSG_WriteByte(msg, ps->gunindex);
+
+	MSG_WriteByte(msg, ps->gunframe);
+
+	for (i = 0; i < 3; i++)
+	{
+		MSG_WriteChar(msg, ps->gunoffset[i] * 4);
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		MSG_WriteChar(msg, ps->gunangles[i] * 4);
+	}
+
+	for (i = 0; i < 4; i++)
+	{
+		MSG_WriteByte(msg, (int)(ps->blend[i] * 255 + 0.5f));
+	}
+
+	MSG_WriteByte(msg, ps->fov);
+	MSG_WriteByte(msg, ps->rdflags);
+
+	statbits = 0;
+
+	for (i = 0; i < MAX_STATS; i++)
+	{
+		if (ps->stats[i])
+		{
+			statbits |= 1u << i;
+		}
+	}
+
+	MSG_WriteLong(msg, statbits);
+
+	for (i = 0; i < MAX_STATS; i++)
+	{
+		if (statbits & (1u << i))
+		{
+			MSG_WriteShort(msg, ps->stats[i]);
+		}
+	}
+}
+
+/*
+ * Writes frame uncompressed, all entities are
+ * sent as new ones deltaed from their baseline.
+ */
+static void
+CL_WriteKeyFrame(sizebuf_t *msg, const frame_t *frame)
+{
+	entity_state_t state;
+	int i;
+
+	MSG_WriteByte(msg, svc_frame);
+	MSG_WriteLong(msg, frame->serverframe);
+	MSG_WriteLong(msg, -1);
+	MSG_WriteByte(msg, 0);
+
+	MSG_WriteByte(msg, sizeof(frame->areabits));
+	SZ_Write(msg, (void *)frame->areabits, sizeof(frame->areabits));
+
+	CL_WriteKeyPlayerstate(msg, &frame->playerstate);
+
+	MSG_WriteByte(msg, svc_packetentities);
+
+	for (i = 0; i < frame->num_entities; i++)
+	{
+		state = cl_parse_entities[(frame->parse_entities + i) & (MAX_PARSE_ENTITIES - 1)];
+
+		/* events were already played */
+		state.event = 0;
+
+		MSG_WriteDeltaEntity(&cl_entities[state.number].baseline, &state,
+				msg, true, true);
+	}
+
+	MSG_WriteShort(msg, 0);
+}
+
+/*
+ * Saves the state before the message that's about to be
+ * recorded. The configstrings are already updated by it,
+ * but the message sets the same values again on playback.
+ */
+static qboolean
+CL_AddKeyframe(int offset)
+{
+	byte buf_data[MAX_MSGLEN], frame_data[MAX_MSGLEN];
+	sizebuf_t buf, framebuf;
+	const frame_t *frame;
+	ddemokey_t *key;
+	int keyofs;
+	int i;
+
+	frame = NULL;
+
+	if (cl.frame.deltaframe > 0)
+	{
+		frame = &cl.frames[cl.frame.deltaframe & UPDATE_MASK];
+
+		if (!frame->valid || (frame->serverframe != cl.frame.deltaframe) ||
+			(cl.parse_entities - frame->parse_entities > MAX_PARSE_ENTITIES - 128))
+		{
+			return false;
+		}
+	}
+
+	if (demo_numkeys == demo_maxkeys)
+	{
+		int newmax = demo_maxkeys ? demo_maxkeys * 2 : 256;
+
+		key = realloc(demo_keys, newmax * sizeof(*key));
+
+		if (!key)
+		{
+			return false;
+		}
+
+		demo_keys = key;
+		demo_maxkeys = newmax;
+	}
+
+	keyofs = demo_keysize;
+
+	SZ_Init(&buf, buf_data, sizeof(buf_data));
+	buf.allowoverflow = true;
+
+	for (i = 0; i < MAX_CONFIGSTRINGS; i++)
+	{
+		if (!strcmp(cl.configstrings[i], demo_signon[i]))
+		{
+			continue;
+		}
+
+		demo_changed[i >> 3] |= 1 << (i & 7);
+
+		if (CL_SkipDemoConfigstring(i, cl.configstrings[i]))
+		{
+			continue;
+		}
+
+		if (buf.cursize + strlen(cl.configstrings[i]) + 32 > buf.maxsize)
+		{
+			if (!CL_AddKeyMessage(&buf))
+			{
+				goto fail;
+			}
+		}
+
+		MSG_WriteByte(&buf, svc_configstring);
+		MSG_WriteShort(&buf, i);
+		MSG_WriteString(&buf, cl.configstrings[i]);
+	}
+
+	if (buf.cursize + strlen(cl.layout) + 2 > buf.maxsize)
+	{
+		if (!CL_AddKeyMessage(&buf))
+		{
+			goto fail;
+		}
+	}
+
+	MSG_WriteByte(&buf, svc_layout);
+	MSG_WriteString(&buf, cl.layout);
+
+	if (buf.cursize + 1 + MAX_ITEMS * 2 > buf.maxsize)
+	{
+		if (!CL_AddKeyMessage(&buf))
+		{
+			goto fail;
+		}
+	}
+
+	MSG_WriteByte(&buf, svc_inventory);
+
+	for (i = 0; i < MAX_ITEMS; i++)
+	{
+		MSG_WriteShort(&buf, cl.inventory[i]);
+	}
+
+	if (frame)
+	{
+		/* the frame must fit into one message */
+		SZ_Init(&framebuf, frame_data, sizeof(frame_data));
+		framebuf.allowoverflow = true;
+
+		CL_WriteKeyFrame(&framebuf, frame);
+
+		if (framebuf.overflowed)
+		{
+			goto fail;
+		}
+
+		if (buf.cursize + framebuf.cursize > buf.maxsize)
+		{
+			if (!CL_AddKeyMessage(&buf))
+			{
+				goto fail;
+			}
+		}
+
+		SZ_Write(&buf, framebuf.data, framebuf.cursize);
+	}
+
+	if (buf.overflowed || !CL_AddKeyMessage(&buf))
+	{
+		goto fail;
+	}
+
+	key = &demo_keys[demo_numkeys++];
+	key->time = cl.frame.servertime - demo_firsttime;
+	key->offset = offset;
+	key->keyofs = keyofs;
+	key->keylen = demo_keysize - keyofs;
+
+	return true;
+
+fail:
+	demo_keysize = keyofs;
+
+	return false;
+}
+
+/*
+ * Called by CL_Record_f() after the signon messages are written.
+ */
+void
+CL_BeginDemoIndex(void)
+{
+	CL_FreeDemoIndex();
+
+	if (cl_demoindex->value <= 0)
+	{
+		return;
+	}
+
+	demo_indexing = true;
+	demo_servercount = cl.servercount;
+	demo_firsttime = -1;
+	demo_lastframe = -1;
+
+	memcpy(demo_signon, cl.configstrings, sizeof(demo_signon));
+	memset(demo_changed, 0, sizeof(demo_changed));
+}
+
+/*
+ * Called by CL_WriteDemoMessage() with the
+ * offset the current message will be written to.
+ */
+void
+CL_AddDemoKeyframe(long offset)
+{
+	if (!demo_indexing)
+	{
+		return;
+	}
+
+	if ((cl.servercount != demo_servercount) || (offset > INT_MAX))
+	{
+		/* the keyframes know nothing about the new map */
+		Com_DPrintf("%s: Map changed, demo won't be indexed.\n", __func__);
+		CL_FreeDemoIndex();
+		return;
+	}
+
+	/* only messages with a new frame are keyframe worthy */
+	if (!cl.frame.valid || (cl.frame.serverframe == demo_lastframe))
+	{
+		return;
+	}
+
+	demo_lastframe = cl.frame.serverframe;
+
+	if (demo_firsttime < 0)
+	{
+		demo_firsttime = demo_nexttime = cl.frame.servertime;
+	}
+
+	if (cl.frame.servertime < demo_nexttime)
+	{
+		return;
+	}
+
+	/* if it didn't work out try again with the next frame */
+	if (CL_AddKeyframe((int)offset))
+	{
+		demo_nexttime = cl.frame.servertime + (int)(cl_demoindex->value * 1000);
+	}
+}
+
+/*
+ * Called by CL_Stop_f() after the end of demo marker
+ * is written. Appends keyframes, index and trailer.
+ */
+void
+CL_WriteDemoIndex(void)
+{
+	byte buf_data[MAX_MSGLEN];
+	sizebuf_t buf;
+	ddemoindex_t index;
+	ddemotrailer_t trailer;
+	ddemokey_t key;
+	long keybase;
+	int i;
+
+	if (!demo_indexing || !demo_numkeys)
+	{
+		CL_FreeDemoIndex();
+		return;
+	}
+
+	index.ident = LittleLong(IDDEMOHEADER);
+	index.version = LittleLong(DEMOINDEX_VERSION);
+	index.numkeys = LittleLong(demo_numkeys);
+
+	/* configstrings that changed go back to their initial
+	   values before a keyframe sets the ones it needs */
+	index.resetofs = ftell(cls.demofile);
+
+	SZ_Init(&buf, buf_data, sizeof(buf_data));
+
+	for (i = 0; i < MAX_CONFIGSTRINGS; i++)
+	{
+		if (!(demo_changed[i >> 3] & (1 << (i & 7))) ||
+			CL_SkipDemoConfigstring(i, demo_signon[i]))
+		{
+			continue;
+		}
+
+		if (buf.cursize + strlen(demo_signon[i]) + 32 > buf.maxsize)
+		{
+			CL_WriteDemoBuffer(&buf);
+		}
+
+		MSG_WriteByte(&buf, svc_configstring);
+		MSG_WriteShort(&buf, i);
+		MSG_WriteString(&buf, demo_signon[i]);
+	}
+
+	CL_WriteDemoBuffer(&buf);
+
+	keybase = ftell(cls.demofile);
+	index.resetlen = LittleLong(keybase - index.resetofs);
+	index.resetofs = LittleLong(index.resetofs);
+
+	fwrite(demo_keydata, demo_keysize, 1, cls.demofile);
+
+	trailer.indexofs = LittleLong(ftell(cls.demofile));
+	trailer.ident = LittleLong(IDDEMOHEADER);
+
+	fwrite(&index, sizeof(index), 1, cls.demofile);
+
+	for (i = 0; i < demo_numkeys; i++)
+	{
+		key.time = LittleLong(demo_keys[i].time);
+		key.offset = LittleLong(demo_keys[i].offset);
+		key.keyofs = LittleLong(keybase + demo_keys[i].keyofs);
+		key.keylen = LittleLong(demo_keys[i].keylen);
+
+		fwrite(&key, sizeof(key), 1, cls.demofile);
+	}
+
+	fwrite(&trailer, sizeof(trailer), 1, cls.demofile);
+
+	Com_DPrintf("%s: %i keyframes, %i bytes.\n", __func__,
+			demo_numkeys, demo_keysize);
+
+	CL_FreeDemoIndex();
+}
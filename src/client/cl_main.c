@@ -82,6 +82,7 @@ cvar_t	*gl1_stereo_separation;
 cvar_t	*gl1_stereo_convergence;
 
 cvar_t *cl_vwep;
+cvar_t *cl_demoindex;
 
 client_static_t cls;
 client_state_t cl;
@@ -114,6 +115,8 @@ CL_WriteDemoMessage(void)
 {
 	int len, swlen;
 
+	CL_AddDemoKeyframe(ftell(cls.demofile));
+
 	/* the first eight bytes are just packet sequencing stuff */
 	len = net_message.cursize - 8;
 	swlen = LittleLong(len);
@@ -138,6 +141,7 @@ CL_Stop_f(void)
 	len = -1;
 
 	fwrite(&len, 4, 1, cls.demofile);
+	CL_WriteDemoIndex();
 	fclose(cls.demofile);
 	cls.demofile = NULL;
 	cls.demorecording = false;
@@ -261,6 +265,8 @@ CL_Record_f(void)
 	len = LittleLong(buf.cursize);
 	fwrite(&len, 4, 1, cls.demofile);
 	fwrite(buf.data, buf.cursize, 1, cls.demofile);
+
+	CL_BeginDemoIndex();
 }
 
 void
@@ -566,6 +572,7 @@ CL_InitLocal(void)
 	Cvar_Get("spectator", "0", CVAR_USERINFO);
 
 	cl_vwep = Cvar_Get("cl_vwep", "1", CVAR_ARCHIVE);
+	cl_demoindex = Cvar_Get("cl_demoindex", "10", CVAR_ARCHIVE);
 
 #ifdef USE_CURL
 	cl_http_proxy = Cvar_Get("cl_http_proxy", "", 0);
@@ -606,6 +613,10 @@ CL_InitLocal(void)
 
 	Cmd_AddCommand("currentmap", CL_CurrentMap_f);
 
+	Cmd_AddCommand("particlestress", CL_ParticleStress_f);
+
+	Cmd_AddCommand("cinbench", SCR_CinBench_f);
+
 	/* forward to server commands
 	 * the only thing this does is allow command completion
 	 * to work -- all unknown commands are automatically
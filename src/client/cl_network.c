@@ -80,6 +80,16 @@ CL_ForwardToServer_f(void)
 	}
 }
 
+/*
+ * True while the client neither talks
+ * to a server nor tries to connect.
+ */
+qboolean
+CL_Disconnected(void)
+{
+	return cls.state <= ca_disconnected;
+}
+
 /*
  * Called after an ERR_DROP was thrown
  */
@@ -308,6 +318,8 @@ CL_Disconnect(void)
 					cl.timedemo_frames, time / 1000.0,
 					cl.timedemo_frames * 1000.0 / time);
 		}
+
+		V_TimedemoStats();
 	}
 
 	VectorClear(cl.refdef.blend);
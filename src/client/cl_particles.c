@@ -26,27 +26,252 @@
 
 #include "header/client.h"
 
-cparticle_t *active_particles, *free_particles;
-cparticle_t particles[MAX_PARTICLES];
-int cl_numparticles = MAX_PARTICLES;
+/*
+ * The particles are simulated as a structure of arrays, so that the
+ * loops in CL_UpdateParticlePool() can be vectorized by the compiler.
+ * Effects don't write into the pool directly, they get a cparticle_t
+ * from CL_AllocParticle() which is moved into the pool by the next
+ * CL_AddParticles().
+ */
+typedef struct
+{
+	int numparticles;
+	int maxparticles;
+
+	float *time;
+	float *org[3];
+	float *vel[3];
+	float *accel[3];
+	float *alpha;
+	float *alphavel;
+	float *color;
+
+	/* results of the last CL_UpdateParticlePool() */
+	float *curorg[3];
+	float *curalpha;
+
+	void *data;
+} cparticlepool_t;
+
+#define PARTICLEPOOL_ARRAYS 18
+
+static cparticlepool_t cl_particles;
+
+static cparticle_t new_particles[MAX_PARTICLES];
+static int num_new_particles;
+
+static void
+CL_InitParticlePool(cparticlepool_t *pool, int maxparticles)
+{
+	float *data;
+	int i;
+
+	/* pad the arrays to a multiple of 4, so they stay 16 byte aligned */
+	maxparticles = (maxparticles + 3) & ~3;
+
+	data = calloc(PARTICLEPOOL_ARRAYS * maxparticles, sizeof(float));
+
+	if (!data)
+	{
+		Com_Error(ERR_FATAL, "Couldn't allocate %i particles", maxparticles);
+	}
+
+	pool->data = data;
+	pool->numparticles = 0;
+	pool->maxparticles = maxparticles;
+
+	pool->time = data;
+	data += maxparticles;
+
+	for (i = 0; i < 3; i++)
+	{
+		pool->org[i] = data;
+		data += maxparticles;
+		pool->vel[i] = data;
+		data += maxparticles;
+		pool->accel[i] = data;
+		data += maxparticles;
+		pool->curorg[i] = data;
+		data += maxparticles;
+	}
+
+	pool->alpha = data;
+	data += maxparticles;
+	pool->alphavel = data;
+	data += maxparticles;
+	pool->color = data;
+	data += maxparticles;
+	pool->curalpha = data;
+}
+
+static void
+CL_FreeParticlePool(cparticlepool_t *pool)
+{
+	free(pool->data);
+	memset(pool, 0, sizeof(*pool));
+}
+
+/*
+ * Moves new particles into the pool. Instant particles get the
+ * current time, so they don't move before they're drawn.
+ */
+static void
+CL_InsertParticles(cparticlepool_t *pool, const cparticle_t *particles,
+		int count, float time)
+{
+	int i, j, n;
+
+	if (count > pool->maxparticles - pool->numparticles)
+	{
+		count = pool->maxparticles - pool->numparticles;
+	}
+
+	n = pool->numparticles;
+
+	for (i = 0; i < count; i++, n++)
+	{
+		const cparticle_t *p = &particles[i];
+
+		pool->time[n] = (p->alphavel == INSTANT_PARTICLE) ? time : p->time;
+
+		for (j = 0; j < 3; j++)
+		{
+			pool->org[j][n] = p->org[j];
+			pool->vel[j][n] = p->vel[j];
+			pool->accel[j][n] = p->accel[j];
+		}
+
+		pool->alpha[n] = p->alpha;
+		pool->alphavel[n] = p->alphavel;
+		pool->color[n] = p->color;
+	}
+
+	pool->numparticles = n;
+}
+
+/*
+ * No branches and no aliasing in these two, so their
+ * loops can be vectorized. Instant particles are drawn
+ * in the frame they were inserted, so their time is 0
+ * and alphavel doesn't matter.
+ */
+static void
+CL_ParticleOrigins(int num, float time, const float *restrict ptime,
+		const float *restrict org, const float *restrict vel,
+		const float *restrict accel, float *restrict curorg)
+{
+	int i;
+
+	for (i = 0; i < num; i++)
+	{
+		float t = (time - ptime[i]) * 0.001f;
+
+		curorg[i] = org[i] + vel[i] * t + accel[i] * t * t;
+	}
+}
+
+static void
+CL_ParticleAlphas(int num, float time, const float *restrict ptime,
+		const float *restrict alpha, const float *restrict alphavel,
+		float *restrict curalpha)
+{
+	int i;
+
+	for (i = 0; i < num; i++)
+	{
+		curalpha[i] = alpha[i] + (time - ptime[i]) * 0.001f * alphavel[i];
+	}
+}
+
+/*
+ * Calculates the position and alpha of all particles at
+ * the given time into curorg and curalpha, and removes
+ * the particles that have faded out from the pool.
+ */
+static void
+CL_UpdateParticlePool(cparticlepool_t *pool, float time)
+{
+	const int num = pool->numparticles;
+	int i, j, live;
+
+	/* the arrays are padded to a multiple of 4, so the
+	   vectorized loops don't need a scalar remainder */
+	const int padded = (num + 3) & ~3;
+
+	for (j = 0; j < 3; j++)
+	{
+		CL_ParticleOrigins(padded, time, pool->time, pool->org[j],
+				pool->vel[j], pool->accel[j], pool->curorg[j]);
+	}
+
+	CL_ParticleAlphas(padded, time, pool->time, pool->alpha,
+			pool->alphavel, pool->curalpha);
+
+	/* compact the arrays, dropping the dead particles */
+	for (i = 0, live = 0; i < num; i++)
+	{
+		if ((pool->curalpha[i] <= 0) && (pool->alphavel[i] != INSTANT_PARTICLE))
+		{
+			/* faded out */
+			continue;
+		}
+
+		if (live != i)
+		{
+			pool->time[live] = pool->time[i];
+
+			for (j = 0; j < 3; j++)
+			{
+				pool->org[j][live] = pool->org[j][i];
+				pool->vel[j][live] = pool->vel[j][i];
+				pool->accel[j][live] = pool->accel[j][i];
+				pool->curorg[j][live] = pool->curorg[j][i];
+			}
+
+			pool->alpha[live] = pool->alpha[i];
+			pool->alphavel[live] = pool->alphavel[i];
+			pool->color[live] = pool->color[i];
+			pool->curalpha[live] = pool->curalpha[i];
+		}
+
+		/* instant particles are only drawn once */
+		if (pool->alphavel[live] == INSTANT_PARTICLE)
+		{
+			pool->alphavel[live] = 0.0;
+			pool->alpha[live] = 0.0;
+		}
+
+		live++;
+	}
+
+	pool->numparticles = live;
+}
 
 void
 CL_ClearParticles(void)
 {
-	if (cl_numparticles == 0)
-		return;
-		
-	int i;
+	if (!cl_particles.maxparticles)
+	{
+		CL_InitParticlePool(&cl_particles, MAX_PARTICLES);
+	}
 
-	free_particles = &particles[0];
-	active_particles = NULL;
+	cl_particles.numparticles = 0;
+	num_new_particles = 0;
+}
 
-	for (i = 0; i < cl_numparticles; i++)
+/*
+ * Returns a new particle for the caller to set up,
+ * or NULL if there are already too many.
+ */
+cparticle_t *
+CL_AllocParticle(void)
+{
+	if (cl_particles.numparticles + num_new_particles >= MAX_PARTICLES)
 	{
-		particles[i].next = &particles[i + 1];
+		return NULL;
 	}
 
-	particles[cl_numparticles - 1].next = NULL;
+	return &new_particles[num_new_particles++];
 }
 
 void
@@ -58,16 +283,11 @@ CL_ParticleEffect(vec3_t org, vec3_t dir, int color, int count)
 
 	for (i = 0; i < count; i++)
 	{
-		if (!free_particles)
+		if (!(p = CL_AllocParticle()))
 		{
 			return;
 		}
 
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
 		p->time = cl.time;
 		p->color = color + (randk() & 7);
 		d = randk() & 31;
@@ -98,16 +318,11 @@ CL_ParticleEffect2(vec3_t org, vec3_t dir, int color, int count)
 
 	for (i = 0; i < count; i++)
 	{
-		if (!free_particles)
+		if (!(p = CL_AllocParticle()))
 		{
 			return;
 		}
 
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
 		p->time = time;
 		p->color = color + (randk() & 7);
 
@@ -139,16 +354,11 @@ CL_ParticleEffect3(vec3_t org, vec3_t dir, int color, int count)
 
 	for (i = 0; i < count; i++)
 	{
-		if (!free_particles)
+		if (!(p = CL_AllocParticle()))
 		{
 			return;
 		}
 
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
 		p->time = time;
 		p->color = color;
 
@@ -171,74 +381,83 @@ CL_ParticleEffect3(vec3_t org, vec3_t dir, int color, int count)
 void
 CL_AddParticles(void)
 {
-	cparticle_t *p, *next;
-	float alpha;
-	float time, time2;
-	vec3_t org;
-	int color;
-	cparticle_t *active, *tail;
+	particle_t *p;
+	int i, count;
+
+	CL_InsertParticles(&cl_particles, new_particles, num_new_particles, cl.time);
+	num_new_particles = 0;
+
+	CL_UpdateParticlePool(&cl_particles, cl.time);
 
-	active = NULL;
-	tail = NULL;
+	p = V_AllocParticles(cl_particles.numparticles, &count);
 
-	for (p = active_particles; p; p = next)
+	for (i = 0; i < count; i++, p++)
 	{
-		next = p->next;
+		p->origin[0] = cl_particles.curorg[0][i];
+		p->origin[1] = cl_particles.curorg[1][i];
+		p->origin[2] = cl_particles.curorg[2][i];
+		p->color = (int)cl_particles.color[i];
+		p->alpha = Q_min(cl_particles.curalpha[i], 1.0f);
+	}
+}
 
-		if (p->alphavel != INSTANT_PARTICLE)
-		{
-			time = (cl.time - p->time) * 0.001;
-			alpha = p->alpha + time * p->alphavel;
+/*
+ * Simulates lots of particles, to see how
+ * long CL_UpdateParticlePool() takes
+ */
+void
+CL_ParticleStress_f(void)
+{
+	cparticlepool_t pool;
+	cparticle_t p;
+	long long start, total;
+	int i, j, count, frames;
 
-			if (alpha <= 0)
-			{
-				/* faded out */
-				p->next = free_particles;
-				free_particles = p;
-				continue;
-			}
-		}
-		else
-		{
-			time = 0.0f;
-			alpha = p->alpha;
-		}
+	count = (Cmd_Argc() > 1) ? (int)strtol(Cmd_Argv(1), NULL, 10) : 100000;
+	frames = (Cmd_Argc() > 2) ? (int)strtol(Cmd_Argv(2), NULL, 10) : 100;
 
-		p->next = NULL;
+	if ((count <= 0) || (frames <= 0))
+	{
+		Com_Printf("Usage: %s [particles] [frames]\n", Cmd_Argv(0));
+		return;
+	}
 
-		if (!tail)
-		{
-			active = tail = p;
-		}
+	CL_InitParticlePool(&pool, count);
 
-		else
-		{
-			tail->next = p;
-			tail = p;
-		}
+	/* like CL_ParticleEffect(), but living long enough
+	   to survive all frames at 10 frames per second */
+	for (i = 0; i < count; i++)
+	{
+		p.time = 0;
+		p.color = 0xe0 + (randk() & 7);
 
-		if (alpha > 1.0f)
+		for (j = 0; j < 3; j++)
 		{
-			alpha = 1;
+			p.org[j] = crandk() * 64;
+			p.vel[j] = crandk() * 20;
+			p.accel[j] = 0;
 		}
 
-		color = p->color;
-		time2 = time * time;
+		p.accel[2] = -PARTICLE_GRAVITY;
+		p.alpha = 1.0;
+		p.alphavel = -1.0f / (frames * 0.1f + 1.0f + frandk());
 
-		org[0] = p->org[0] + p->vel[0] * time + p->accel[0] * time2;
-		org[1] = p->org[1] + p->vel[1] * time + p->accel[1] * time2;
-		org[2] = p->org[2] + p->vel[2] * time + p->accel[2] * time2;
+		CL_InsertParticles(&pool, &p, 1, 0);
+	}
 
-		V_AddParticle(org, color, alpha);
+	total = 0;
 
-		if (p->alphavel == INSTANT_PARTICLE)
-		{
-			p->alphavel = 0.0;
-			p->alpha = 0.0;
-		}
+	for (i = 0; i < frames; i++)
+	{
+		start = Sys_Microseconds();
+		CL_UpdateParticlePool(&pool, i * 100.0f);
+		total += Sys_Microseconds() - start;
 	}
 
-	active_particles = active;
+	Com_Printf("%i particles, %i frames: %.3f ms per update, %i left\n",
+			count, frames, total / (frames * 1000.0), pool.numparticles);
+
+	CL_FreeParticlePool(&pool);
 }
 
 void
@@ -254,16 +473,11 @@ CL_GenericParticleEffect(vec3_t org, vec3_t dir, int color,
 
 	for (i = 0; i < count; i++)
 	{
-		if (!free_particles)
+		if (!(p = CL_AllocParticle()))
 		{
 			return;
 		}
 
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
-
 		p->time = time;
 
 		if (numcolors > 1)
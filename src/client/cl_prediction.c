@@ -215,14 +215,51 @@ CL_PMpointcontents(vec3_t point)
 	return contents;
 }
 
+/*
+ * Compares two pmove states member by member,
+ * the struct may contain padding.
+ */
+static qboolean
+CL_PmoveStateEqual(const pmove_state_t *a, const pmove_state_t *b)
+{
+	int i;
+
+	if ((a->pm_type != b->pm_type) || (a->pm_flags != b->pm_flags) ||
+		(a->pm_time != b->pm_time) || (a->gravity != b->gravity))
+	{
+		return false;
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		if ((a->origin[i] != b->origin[i]) ||
+			(a->velocity[i] != b->velocity[i]) ||
+			(a->delta_angles[i] != b->delta_angles[i]))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
 /*
  * Sets cl.predicted_origin and cl.predicted_angles
+ *
+ * The pmove state after each sent command is cached in
+ * cl.predicted_states. As long as the server agrees with
+ * our prediction for the last acknowledged command only
+ * the commands sent since the last call and the command
+ * currently being built are run through Pmove(). Once the
+ * server disagrees, everything is replayed from the last
+ * acknowledged command.
  */
 void
 CL_PredictMovement(void)
 {
 	int ack, current;
 	int frame;
+	int sequence;
 	usercmd_t *cmd;
 	pmove_t pm;
 	int i;
@@ -249,6 +286,8 @@ CL_PredictMovement(void)
 					cl.frame.playerstate.pmove.delta_angles[i]);
 		}
 
+		cl.predicted_valid = false;
+
 		return;
 	}
 
@@ -263,28 +302,76 @@ CL_PredictMovement(void)
 			Com_Printf("exceeded CMD_BACKUP\n");
 		}
 
+		cl.predicted_valid = false;
+
 		return;
 	}
 
-	/* copy current state to pmove */
+	/* the cache must cover the acknowledged cmd and
+	   must not contain the cmd currently being built */
+	if ((cl.predicted_sequence < ack) || (cl.predicted_sequence >= current))
+	{
+		cl.predicted_valid = false;
+	}
+
+	/* a new server frame arrived, check if it matches
+	   what we predicted for the acknowledged command */
+	frame = ack & (CMD_BACKUP - 1);
+
+	if (!cl.predicted_valid ||
+		(cl.predicted_serverframe != cl.frame.serverframe))
+	{
+		if (!cl.predicted_valid ||
+			!CL_PmoveStateEqual(&cl.predicted_states[frame],
+				&cl.frame.playerstate.pmove))
+		{
+			/* mispredicted, replay from the acknowledged cmd */
+			cl.predicted_states[frame] = cl.frame.playerstate.pmove;
+			cl.predicted_sequence = ack;
+			VectorClear(cl.predicted_states_angles);
+		}
+
+		cl.predicted_serverframe = cl.frame.serverframe;
+		cl.predicted_valid = true;
+	}
+
+	/* copy last cached state to pmove */
 	memset (&pm, 0, sizeof(pm));
 	pm.trace = CL_PMTrace;
 	pm.pointcontents = CL_PMpointcontents;
 	pm_airaccelerate = atof(cl.configstrings[CS_AIRACCEL]);
-	pm.s = cl.frame.playerstate.pmove;
+	pm.s = cl.predicted_states[cl.predicted_sequence & (CMD_BACKUP - 1)];
+	VectorCopy(cl.predicted_states_angles, pm.viewangles);
 
-	/* run frames */
-	while (++ack <= current)
+	/* run and cache cmds sent since the last call */
+	for (sequence = cl.predicted_sequence + 1; sequence < current; sequence++)
 	{
-		frame = ack & (CMD_BACKUP - 1);
+		frame = sequence & (CMD_BACKUP - 1);
 		cmd = &cl.cmds[frame];
 
 		// Ignore null entries
-		if (!cmd->msec)
+		if (cmd->msec)
 		{
-			continue;
+			pm.cmd = *cmd;
+			Pmove(&pm);
+
+			/* save for debug checking */
+			VectorCopy(pm.s.origin, cl.predicted_origins[frame]);
 		}
 
+		cl.predicted_states[frame] = pm.s;
+	}
+
+	cl.predicted_sequence = current - 1;
+	VectorCopy(pm.viewangles, cl.predicted_states_angles);
+
+	/* the cmd currently being built changes
+	   every frame, so it's never cached */
+	frame = current & (CMD_BACKUP - 1);
+	cmd = &cl.cmds[frame];
+
+	if (cmd->msec)
+	{
 		pm.cmd = *cmd;
 		Pmove(&pm);
 
@@ -312,4 +399,3 @@ CL_PredictMovement(void)
 
 	VectorCopy(pm.viewangles, cl.predicted_angles);
 }
-
@@ -100,6 +100,28 @@ V_AddParticle(vec3_t org, unsigned int color, float alpha)
 	p->alpha = alpha;
 }
 
+/*
+ * Reserves up to count particles in the refdef, so they can be
+ * filled in directly. Returns the first one, *added is set to
+ * the number of particles actually reserved.
+ */
+particle_t *
+V_AllocParticles(int count, int *added)
+{
+	particle_t *p;
+
+	if (count > MAX_PARTICLES - r_numparticles)
+	{
+		count = MAX_PARTICLES - r_numparticles;
+	}
+
+	p = &r_particles[r_numparticles];
+	r_numparticles += count;
+	*added = count;
+
+	return p;
+}
+
 void
 V_AddLight(vec3_t org, float intensity, float r, float g, float b)
 {
@@ -136,6 +158,75 @@ V_AddLightStyle(int style, float r, float g, float b)
 	ls->rgb[2] = b;
 }
 
+/*
+ * Frame times of the running timedemo, in microseconds
+ */
+static int *timedemo_times;
+static int timedemo_numtimes;
+static int timedemo_maxtimes;
+static long long timedemo_last;
+
+static void
+V_TimedemoFrame(void)
+{
+	long long now = Sys_Microseconds();
+
+	if (timedemo_numtimes == timedemo_maxtimes)
+	{
+		int *times;
+		int maxtimes = timedemo_maxtimes ? timedemo_maxtimes * 2 : 4096;
+
+		times = realloc(timedemo_times, maxtimes * sizeof(int));
+
+		if (!times)
+		{
+			return;
+		}
+
+		timedemo_times = times;
+		timedemo_maxtimes = maxtimes;
+	}
+
+	timedemo_times[timedemo_numtimes++] = (int)(now - timedemo_last);
+	timedemo_last = now;
+}
+
+static int
+V_CompareTimes(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * Prints the average and 99th percentile
+ * frame time of the last timedemo
+ */
+void
+V_TimedemoStats(void)
+{
+	long long total = 0;
+	int i;
+
+	if (!timedemo_numtimes)
+	{
+		return;
+	}
+
+	for (i = 0; i < timedemo_numtimes; i++)
+	{
+		total += timedemo_times[i];
+	}
+
+	qsort(timedemo_times, timedemo_numtimes, sizeof(int), V_CompareTimes);
+
+	Com_Printf("frame time: %.2f ms avg, %.2f ms p99, %.2f ms max\n",
+			total / (timedemo_numtimes * 1000.0),
+			timedemo_times[(timedemo_numtimes - 1) * 99 / 100] / 1000.0,
+			timedemo_times[timedemo_numtimes - 1] / 1000.0);
+
+	timedemo_numtimes = 0;
+}
+
 /*
  *If cl_testparticles is set, create 4096 particles in the view
  */
@@ -458,6 +549,12 @@ V_RenderView(float stereo_separation)
 		if (!cl.timedemo_start)
 		{
 			cl.timedemo_start = Sys_Milliseconds();
+			timedemo_numtimes = 0;
+			timedemo_last = Sys_Microseconds();
+		}
+		else
+		{
+			V_TimedemoFrame();
 		}
 
 		cl.timedemo_frames++;
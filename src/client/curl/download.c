@@ -55,6 +55,14 @@ static int abortDownloads = HTTPDL_ABORT_NONE;
 static qboolean downloadingPak = false;
 static qboolean	httpDown = false;
 
+// Filelists are kept in memory and can't be bigger.
+#define HTTP_MAX_FILELIST 262144
+
+// Receive buffer of each transfer. Bigger than cURLs
+// default, so that big files are written to disk in
+// fewer and larger chunks.
+#define HTTP_BUFFER_SIZE 65536
+
 #if defined(CURLOPT_XFERINFODATA)
 typedef curl_off_t CL_Progresstype;
 #define PROGRESSDATA CURLOPT_XFERINFODATA
@@ -79,34 +87,43 @@ static size_t CL_HTTP_Recv(void *ptr, size_t size, size_t nmemb, void *stream)
 	dlhandle_t *dl = (dlhandle_t *)stream;
 	size_t bytes = size * nmemb;
 
-	if (!dl->fileSize)
+	// Filelists are used for paklists only, so we assume
+	// that they cannot be longer then 256k. Everything else
+	// is considered malicious or a broken server.
+	if (dl->position + bytes > HTTP_MAX_FILELIST)
+	{
+		return 0;
+	}
+
+	if (dl->position + bytes >= dl->fileSize)
 	{
-		double length = 0;
+		curl_off_t length = -1;
+		size_t newSize;
 
+		// Allocate what the server announced in one go. If it
+		// didn't tell us (chunked transfer) grow in big steps.
 		qcurl_easy_getinfo(dl->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
 
-		// Mkay, the remote file should be at least one byte long.
-		// Since this is used for paclists only we assume that the
-		// file cannot be longer then 256k. Everythings else is
-		// considered malicious or a broken server.
-		if (length < 1 || length > 262144)
+		if (length > 0 && (size_t)length >= dl->position + bytes)
 		{
-			length = 262144.0f;
+			newSize = (size_t)length + 1;
+		}
+		else
+		{
+			newSize = Q_max(dl->fileSize * 2, 16384);
 		}
 
-		dl->fileSize = ceil(length) + 1;
-		dl->tempBuffer = malloc(dl->fileSize);
-	}
-	else if (dl->position + bytes >= dl->fileSize)
-	{
-		dl->fileSize *= 2;
-		char *tempBuffer = realloc(dl->tempBuffer, dl->fileSize);
+		newSize = Q_max(newSize, dl->position + bytes + 1);
+		newSize = Q_min(newSize, HTTP_MAX_FILELIST + 1);
+
+		char *tempBuffer = realloc(dl->tempBuffer, newSize);
 		if (!tempBuffer) {
 			free(dl->tempBuffer);
 			dl->tempBuffer = 0;
 			return 0;
 		}
 		dl->tempBuffer = tempBuffer;
+		dl->fileSize = newSize;
 	}
 
 	memcpy (dl->tempBuffer + dl->position, ptr, bytes);
@@ -264,6 +281,8 @@ static void CL_StartHTTPDownload (dlqueue_t *entry, dlhandle_t *dl)
 	}
 
 	// Make sure that the download handle is in empty state.
+	// A failed filelist may have left its buffer behind.
+	free(dl->tempBuffer);
 	dl->tempBuffer = NULL;
 	dl->fileSize = 0;
 	dl->position = 0;
@@ -302,6 +321,19 @@ static void CL_StartHTTPDownload (dlqueue_t *entry, dlhandle_t *dl)
 	qcurl_easy_setopt(dl->curl, CURLOPT_USERAGENT, Cvar_VariableString ("version"));
 	qcurl_easy_setopt(dl->curl, CURLOPT_REFERER, cls.downloadReferer);
 	qcurl_easy_setopt(dl->curl, CURLOPT_URL, dl->URL);
+	qcurl_easy_setopt(dl->curl, CURLOPT_BUFFERSIZE, (long)HTTP_BUFFER_SIZE);
+
+	// The connections are kept in the multihandles cache
+	// and reused by the next transfer to the same host,
+	// that's what saves the handshakes between files.
+	// TCP keepalive only sends probes on idle connections,
+	// so a dead server is noticed while waiting on it.
+	// PIPEWAIT waits for a HTTP/2 connection to become
+	// ready instead of opening a new one next to it.
+	qcurl_easy_setopt(dl->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+#if LIBCURL_VERSION_NUM >= 0x072b00
+	qcurl_easy_setopt(dl->curl, CURLOPT_PIPEWAIT, 1L);
+#endif
 
 	size_t ret;
 
@@ -790,6 +822,21 @@ static void CL_FinishHTTPDownload(void)
 	}
 }
 
+/*
+ * Returns the number of parallel downloads.
+ */
+static int CL_HTTPMaxConnections(void)
+{
+	int max = (int)cl_http_max_connections->value;
+
+	if (max < 1)
+	{
+		return 1;
+	}
+
+	return Q_min(max, MAX_HTTP_HANDLES);
+}
+
 /*
  * Returns a free download handle.
  */
@@ -809,9 +856,10 @@ static dlhandle_t *CL_GetFreeDLHandle(void)
 }
 
 /*
- * Starts the next download.
+ * Starts the next download. Returns false if
+ * there's nothing left to start.
  */
-static void CL_StartNextHTTPDownload(void)
+static qboolean CL_StartNextHTTPDownload(void)
 {
 	dlqueue_t *q = &cls.downloadQueue;
 
@@ -825,7 +873,7 @@ static void CL_StartNextHTTPDownload(void)
 
 			if (!dl)
 			{
-				return;
+				return false;
 			}
 
 			CL_StartHTTPDownload(q, dl);
@@ -840,9 +888,11 @@ static void CL_StartNextHTTPDownload(void)
 				downloadingPak = true;
 			}
 
-			break;
+			return true;
 		}
 	}
+
+	return false;
 }
 
 // --------
@@ -1019,6 +1069,14 @@ void CL_SetHTTPServer (const char *URL)
 	}
 
 	multi = qcurl_multi_init();
+
+	// Servers speaking HTTP/2 get all downloads multiplexed
+	// over one connection. The limit for HTTP/1.1 keep-alive
+	// connections is set in CL_RunHTTPDownloads().
+#ifdef CURLPIPE_MULTIPLEX
+	qcurl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+	cl_http_max_connections->modified = true;
 }
 
 /*
@@ -1208,12 +1266,21 @@ void CL_RunHTTPDownloads(void)
 		CL_CancelHTTPDownloads(true);
 	}
 
+	if (cl_http_max_connections->modified)
+	{
+		cl_http_max_connections->modified = false;
+		qcurl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)CL_HTTPMaxConnections());
+	}
+
 	// Not enough downloads running, start some more.
-	if (pendingCount && abortDownloads == HTTPDL_ABORT_NONE &&
-			handleCount < cl_http_max_connections->value &&
+	while (pendingCount && abortDownloads == HTTPDL_ABORT_NONE &&
+			handleCount < CL_HTTPMaxConnections() &&
 			!downloadingPak)
 	{
-		CL_StartNextHTTPDownload();
+		if (!CL_StartNextHTTPDownload())
+		{
+			break;
+		}
 	}
 }
 
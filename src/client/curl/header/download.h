@@ -29,8 +29,8 @@
 #ifndef DOWNLOAD_H
 #define DOWNLOAD_H
 
-// Number of max. parallel downloads.
-#define MAX_HTTP_HANDLES 4
+// Upper limit for cl_http_max_connections.
+#define MAX_HTTP_HANDLES 32
 
 #include <curl/curl.h>
 #include "../../../common/header/common.h"
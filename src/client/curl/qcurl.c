@@ -60,6 +60,7 @@ CURLMsg *(*qcurl_multi_info_read)(CURLM *multi_handle, int *msgs_in_queue);
 CURLM *(*qcurl_multi_init)(void);
 CURLMcode (*qcurl_multi_perform)(CURLM *multi_handle, int *running_handles);
 CURLMcode (*qcurl_multi_remove_handle)(CURLM *multi_handle, CURL *curl_handle);
+CURLMcode (*qcurl_multi_setopt)(CURLM *multi_handle, CURLMoption option, ...);
 const char *(*qcurl_multi_strerror)(CURLMcode);
 
 // --------
@@ -166,6 +167,7 @@ qboolean qcurlInit(void)
 	CONCURL(qcurl_multi_init, "curl_multi_init");
 	CONCURL(qcurl_multi_perform, "curl_multi_perform");
 	CONCURL(qcurl_multi_remove_handle, "curl_multi_remove_handle");
+	CONCURL(qcurl_multi_setopt, "curl_multi_setopt");
 	CONCURL(qcurl_multi_strerror, "curl_multi_strerror");
 
 	#undef CONCURL
@@ -216,6 +218,7 @@ void qcurlShutdown(void)
 	qcurl_multi_init = NULL;
 	qcurl_multi_perform = NULL;
 	qcurl_multi_remove_handle = NULL;
+	qcurl_multi_setopt = NULL;
 
 	if (curlhandle)
 	{
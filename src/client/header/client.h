@@ -123,6 +123,12 @@ typedef struct
 	int			cmd_time[CMD_BACKUP]; /* time sent, for calculating pings */
 	short		predicted_origins[CMD_BACKUP][3]; /* for debug comparing against server */
 
+	pmove_state_t	predicted_states[CMD_BACKUP]; /* pmove state after each sent cmd */
+	vec3_t		predicted_states_angles; /* viewangles after predicted_sequence */
+	int			predicted_sequence; /* last sent cmd with a cached state */
+	int			predicted_serverframe; /* server frame the cache was checked against */
+	qboolean	predicted_valid;
+
 	float		predicted_step; /* for stair up smoothing */
 	unsigned	predicted_step_time;
 
@@ -309,6 +315,7 @@ extern  cvar_t  *cl_audiopaused;
 extern  cvar_t  *cl_unpaused_scvis;
 extern	cvar_t	*cl_timedemo;
 extern	cvar_t	*cl_vwep;
+extern	cvar_t	*cl_demoindex;
 extern	cvar_t  *horplus;
 extern	cvar_t	*cin_force43;
 extern	cvar_t	*vid_fullscreen;
@@ -372,11 +379,10 @@ void CL_ParticleEffect2 (vec3_t org, vec3_t dir, int color, int count);
 void CL_ParticleEffect3 (vec3_t org, vec3_t dir, int color, int count);
 
 
+/* a new particle, as set up by the effects. They're moved
+   into the particle pool by CL_AddParticles(), see there */
 typedef struct particle_s
 {
-
-	struct particle_s	*next;
-
 	float		time;
 
 	vec3_t		org;
@@ -388,6 +394,9 @@ typedef struct particle_s
 	float		alphavel;
 } cparticle_t;
 
+cparticle_t *CL_AllocParticle (void);
+void CL_ParticleStress_f (void);
+
 void CL_ClearEffects (void);
 void CL_ClearTEnts (void);
 void CL_BlasterTrail (vec3_t start, vec3_t end);
@@ -498,6 +507,10 @@ void CL_WriteDemoMessage (void);
 void CL_Stop_f (void);
 void CL_Record_f (void);
 
+void CL_BeginDemoIndex (void);
+void CL_AddDemoKeyframe (long offset);
+void CL_WriteDemoIndex (void);
+
 extern	char *svc_strings[256];
 
 void CL_ParseServerMessage (void);
@@ -514,6 +527,8 @@ void V_Init (void);
 void V_RenderView( float stereo_separation );
 void V_AddEntity (entity_t *ent);
 void V_AddParticle (vec3_t org, unsigned int color, float alpha);
+particle_t *V_AllocParticles (int count, int *added);
+void V_TimedemoStats (void);
 void V_AddLight (vec3_t org, float intensity, float r, float g, float b);
 void V_AddLightStyle (int style, float r, float g, float b);
 
@@ -64,6 +64,7 @@ qboolean SCR_DrawCinematic(void);
 void SCR_RunCinematic(void);
 void SCR_StopCinematic(void);
 void SCR_FinishCinematic(void);
+void SCR_CinBench_f(void);
 
 void SCR_DrawCrosshair(void);
 
@@ -0,0 +1,429 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * =======================================================================
+ *
+ * On disk cache of decoded images. Decoding big png and jpg textures
+ * takes most of the time when loading a map with retexturing enabled,
+ * so the RGBA result is stored in one file in the gamedir and loaded
+ * from there the next time the same image is seen. Entries are found
+ * by a hash of the source file's contents, so it doesn't matter where
+ * the file comes from. Every entry is a 32 byte header followed by
+ * the pixels, all 4 byte aligned, so the file could be mapped as is.
+ * When the cache grows beyond r_imagecache_size megabytes it's thrown
+ * away and filled again from scratch.
+ *
+ * =======================================================================
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../ref_shared.h"
+
+#define IMGCACHE_IDENT (('C' << 24) + ('G' << 16) + ('M' << 8) + 'I')
+#define IMGCACHE_VERSION 1
+#define IMGCACHE_BUCKETS 1024
+#define IMGCACHE_MAXSIZE 16384 /* sanity check for width and height */
+
+typedef struct
+{
+	uint32_t ident;
+	uint32_t version;
+} imgcachefile_t;
+
+typedef struct
+{
+	uint64_t srchash; /* of the encoded file */
+	uint32_t srclen;
+	uint32_t params; /* how it was decoded */
+	uint32_t width;
+	uint32_t height;
+	uint32_t datahash; /* of the pixels */
+	uint32_t ident;
+} imgcacheentry_t;
+
+typedef struct
+{
+	uint64_t srchash;
+	uint32_t srclen;
+	uint32_t params;
+	long offset;
+	int next;
+} imgcacheindex_t;
+
+static cvar_t *r_imagecache;
+static cvar_t *r_imagecache_size;
+
+static char cachepath[MAX_OSPATH];
+static qboolean cacheindexed;
+static long cachesize;
+
+static imgcacheindex_t *cacheindex;
+static int numcacheindex, maxcacheindex;
+static int cachebuckets[IMGCACHE_BUCKETS];
+
+static uint64_t
+ImgCache_Hash(const byte *data, size_t size)
+{
+	uint64_t h = 0xcbf29ce484222325ULL ^ size;
+	size_t i;
+
+	for (i = 0; i + 8 <= size; i += 8)
+	{
+		uint64_t w;
+
+		memcpy(&w, data + i, 8);
+		h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 29;
+	}
+
+	for ( ; i < size; i++)
+	{
+		h = (h ^ data[i]) * 0x100000001b3ULL;
+	}
+
+	return h ^ (h >> 32);
+}
+
+static long
+ImgCache_EntrySize(uint32_t width, uint32_t height)
+{
+	return sizeof(imgcacheentry_t) + (long)width * height * 4;
+}
+
+static void
+ImgCache_FreeIndex(void)
+{
+	free(cacheindex);
+	cacheindex = NULL;
+	numcacheindex = maxcacheindex = 0;
+	memset(cachebuckets, 0xff, sizeof(cachebuckets));
+	cachesize = 0;
+}
+
+static void
+ImgCache_Clear(void)
+{
+	ImgCache_FreeIndex();
+	remove(cachepath);
+}
+
+static qboolean
+ImgCache_AddIndex(const imgcacheentry_t *entry, long offset)
+{
+	imgcacheindex_t *idx;
+	int bucket;
+
+	if (numcacheindex == maxcacheindex)
+	{
+		int newmax = maxcacheindex ? maxcacheindex * 2 : 256;
+
+		idx = realloc(cacheindex, newmax * sizeof(*idx));
+
+		if (!idx)
+		{
+			return false;
+		}
+
+		cacheindex = idx;
+		maxcacheindex = newmax;
+	}
+
+	bucket = entry->srchash & (IMGCACHE_BUCKETS - 1);
+
+	idx = &cacheindex[numcacheindex];
+	idx->srchash = entry->srchash;
+	idx->srclen = entry->srclen;
+	idx->params = entry->params;
+	idx->offset = offset;
+	idx->next = cachebuckets[bucket];
+	cachebuckets[bucket] = numcacheindex++;
+
+	return true;
+}
+
+/*
+ * Reads all entry headers of the cache file. If anything
+ * looks wrong the whole file is considered corrupt.
+ */
+static qboolean
+ImgCache_ReadIndex(void)
+{
+	imgcachefile_t header;
+	imgcacheentry_t entry;
+	long filelen, offset;
+	FILE *f;
+
+	ImgCache_FreeIndex();
+
+	f = fopen(cachepath, "rb");
+
+	if (!f)
+	{
+		/* nothing cached yet */
+		return true;
+	}
+
+	fseek(f, 0, SEEK_END);
+	filelen = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+		header.ident != IMGCACHE_IDENT || header.version != IMGCACHE_VERSION)
+	{
+		fclose(f);
+		return false;
+	}
+
+	offset = sizeof(header);
+
+	while (offset < filelen)
+	{
+		if (fread(&entry, sizeof(entry), 1, f) != 1 ||
+			entry.ident != IMGCACHE_IDENT ||
+			!entry.width || entry.width > IMGCACHE_MAXSIZE ||
+			!entry.height || entry.height > IMGCACHE_MAXSIZE ||
+			offset + ImgCache_EntrySize(entry.width, entry.height) > filelen ||
+			!ImgCache_AddIndex(&entry, offset))
+		{
+			fclose(f);
+			return false;
+		}
+
+		offset += ImgCache_EntrySize(entry.width, entry.height);
+		fseek(f, offset, SEEK_SET);
+	}
+
+	fclose(f);
+	cachesize = filelen;
+
+	return true;
+}
+
+/*
+ * Returns true if the cache is enabled, (re)building
+ * the index if this is the first use or the gamedir
+ * changed since the last one.
+ */
+static qboolean
+ImgCache_Open(void)
+{
+	char path[MAX_OSPATH];
+
+	if (!r_imagecache)
+	{
+		r_imagecache = ri.Cvar_Get("r_imagecache", "0", CVAR_ARCHIVE);
+		r_imagecache_size = ri.Cvar_Get("r_imagecache_size", "256", CVAR_ARCHIVE);
+	}
+
+	if (!r_imagecache->value)
+	{
+		return false;
+	}
+
+	Com_sprintf(path, sizeof(path), "%s/imagecache.bin", ri.FS_Gamedir());
+
+	if (cacheindexed && !strcmp(path, cachepath))
+	{
+		return true;
+	}
+
+	Q_strlcpy(cachepath, path, sizeof(cachepath));
+
+	if (!ImgCache_ReadIndex())
+	{
+		R_Printf(PRINT_ALL, "%s: %s is corrupt, clearing it\n",
+			__func__, cachepath);
+		ImgCache_Clear();
+	}
+
+	cacheindexed = true;
+
+	return true;
+}
+
+/*
+ * Looks up the decoded version of the image file in raw.
+ * Returns the pixels in a malloc()ed buffer or NULL.
+ */
+byte *
+R_FindCachedImage(const byte *raw, int rawsize, int params,
+	int *width, int *height)
+{
+	imgcacheentry_t entry;
+	uint64_t srchash;
+	byte *pic;
+	size_t size;
+	FILE *f;
+	int i;
+
+	if (!ImgCache_Open())
+	{
+		return NULL;
+	}
+
+	srchash = ImgCache_Hash(raw, rawsize);
+
+	for (i = cachebuckets[srchash & (IMGCACHE_BUCKETS - 1)]; i >= 0;
+		i = cacheindex[i].next)
+	{
+		if (cacheindex[i].srchash == srchash &&
+			cacheindex[i].srclen == rawsize &&
+			cacheindex[i].params == params)
+		{
+			break;
+		}
+	}
+
+	if (i < 0)
+	{
+		return NULL;
+	}
+
+	f = fopen(cachepath, "rb");
+
+	if (!f)
+	{
+		/* somebody deleted it */
+		ImgCache_FreeIndex();
+		return NULL;
+	}
+
+	pic = NULL;
+
+	if (fseek(f, cacheindex[i].offset, SEEK_SET) == 0 &&
+		fread(&entry, sizeof(entry), 1, f) == 1 &&
+		entry.srchash == srchash && entry.srclen == rawsize &&
+		entry.params == params)
+	{
+		size = (size_t)entry.width * entry.height * 4;
+		pic = malloc(size);
+
+		if (pic && (fread(pic, size, 1, f) != 1 ||
+			(uint32_t)ImgCache_Hash(pic, size) != entry.datahash))
+		{
+			free(pic);
+			pic = NULL;
+		}
+	}
+
+	fclose(f);
+
+	if (!pic)
+	{
+		R_Printf(PRINT_ALL, "%s: %s is corrupt, clearing it\n",
+			__func__, cachepath);
+		ImgCache_Clear();
+		return NULL;
+	}
+
+	*width = entry.width;
+	*height = entry.height;
+
+	return pic;
+}
+
+/*
+ * Adds the decoded pixels of the image file in raw to the cache.
+ */
+void
+R_StoreCachedImage(const byte *raw, int rawsize, int params,
+	const byte *pic, int width, int height)
+{
+	imgcacheentry_t entry;
+	imgcachefile_t header;
+	long size, limit;
+	qboolean ok;
+	FILE *f;
+
+	if (!ImgCache_Open())
+	{
+		return;
+	}
+
+	if (width <= 0 || width > IMGCACHE_MAXSIZE ||
+		height <= 0 || height > IMGCACHE_MAXSIZE)
+	{
+		return;
+	}
+
+	size = ImgCache_EntrySize(width, height);
+	limit = (long)(Q_min(r_imagecache_size->value, 1024) * 1024 * 1024);
+
+	if (sizeof(header) + size > limit)
+	{
+		/* wouldn't fit even into an empty cache */
+		return;
+	}
+
+	if (cachesize + size > limit)
+	{
+		R_Printf(PRINT_DEVELOPER, "%s: %s is full, clearing it\n",
+			__func__, cachepath);
+		ImgCache_Clear();
+	}
+
+	f = fopen(cachepath, cachesize ? "ab" : "wb");
+
+	if (!f)
+	{
+		return;
+	}
+
+	entry.srchash = ImgCache_Hash(raw, rawsize);
+	entry.srclen = rawsize;
+	entry.params = params;
+	entry.width = width;
+	entry.height = height;
+	entry.datahash = (uint32_t)ImgCache_Hash(pic, (size_t)width * height * 4);
+	entry.ident = IMGCACHE_IDENT;
+
+	ok = true;
+
+	if (!cachesize)
+	{
+		header.ident = IMGCACHE_IDENT;
+		header.version = IMGCACHE_VERSION;
+		ok = fwrite(&header, sizeof(header), 1, f) == 1;
+		cachesize = sizeof(header);
+	}
+
+	ok = ok && fwrite(&entry, sizeof(entry), 1, f) == 1 &&
+		fwrite(pic, (size_t)width * height * 4, 1, f) == 1;
+
+	if (fclose(f) != 0 || !ok || !ImgCache_AddIndex(&entry, cachesize))
+	{
+		/* disk full or the like, don't leave half an entry behind */
+		ImgCache_Clear();
+		return;
+	}
+
+	cachesize += size;
+}
+
+void
+R_ShutdownImageCache(void)
+{
+	ImgCache_FreeIndex();
+	cacheindexed = false;
+	r_imagecache = NULL;
+	r_imagecache_size = NULL;
+}
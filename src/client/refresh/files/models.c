@@ -327,39 +327,6 @@ Mod_SetParent(mnode_t *node, mnode_t *parent)
 	Mod_SetParent (node->children[1], node);
 }
 
-/*
-=================
-Mod_NumberLeafs
-=================
-*/
-static void
-Mod_NumberLeafs(mleaf_t *leafs, mnode_t *node, int *r_leaftovis, int *r_vistoleaf,
-	int *numvisleafs)
-{
-	if (node->contents != CONTENTS_NODE)
-	{
-		mleaf_t *leaf;
-		int leafnum;
-
-		leaf = (mleaf_t *)node;
-		leafnum = leaf - leafs;
-		if (leaf->contents & CONTENTS_SOLID)
-		{
-			return;
-		}
-
-		r_leaftovis[leafnum] = *numvisleafs;
-		r_vistoleaf[*numvisleafs] = leafnum;
-		(*numvisleafs) ++;
-		return;
-	}
-
-	Mod_NumberLeafs(leafs, node->children[0], r_leaftovis, r_vistoleaf,
-		numvisleafs);
-	Mod_NumberLeafs(leafs, node->children[1], r_leaftovis, r_vistoleaf,
-		numvisleafs);
-}
-
 /*
 =================
 Mod_LoadNodes
@@ -367,23 +334,12 @@ Mod_LoadNodes
 */
 void
 Mod_LoadNodes(const char *name, cplane_t *planes, int numplanes, mleaf_t *leafs,
-	int numleafs, mnode_t **nodes, int *numnodes, const byte *mod_base,
-	const lump_t *l)
+	int numleafs, mnode_t **nodes, int *numnodes, const dqnode_t *in,
+	int count)
 {
-	int	r_leaftovis[MAX_MAP_LEAFS], r_vistoleaf[MAX_MAP_LEAFS];
-	int	i, count, numvisleafs;
-	dnode_t	*in;
+	int	i;
 	mnode_t	*out;
 
-	in = (void *)(mod_base + l->fileofs);
-
-	if (l->filelen % sizeof(*in))
-	{
-		ri.Sys_Error(ERR_DROP, "%s: funny lump size in %s",
-				__func__, name);
-	}
-
-	count = l->filelen / sizeof(*in);
 	out = Hunk_Alloc(count * sizeof(*out));
 
 	*nodes = out;
@@ -395,11 +351,11 @@ Mod_LoadNodes(const char *name, cplane_t *planes, int numplanes, mleaf_t *leafs,
 
 		for (j = 0; j < 3; j++)
 		{
-			out->minmaxs[j] = LittleShort(in->mins[j]);
-			out->minmaxs[3 + j] = LittleShort(in->maxs[j]);
+			out->minmaxs[j] = in->mins[j];
+			out->minmaxs[3 + j] = in->maxs[j];
 		}
 
-		planenum = LittleLong(in->planenum);
+		planenum = in->planenum;
 		if (planenum  < 0 || planenum >= numplanes)
 		{
 			ri.Sys_Error(ERR_DROP, "%s: Incorrect %d < %d planenum.",
@@ -407,15 +363,15 @@ Mod_LoadNodes(const char *name, cplane_t *planes, int numplanes, mleaf_t *leafs,
 		}
 		out->plane = planes + planenum;
 
-		out->firstsurface = LittleShort(in->firstface);
-		out->numsurfaces = LittleShort(in->numfaces);
+		out->firstsurface = in->firstface;
+		out->numsurfaces = in->numfaces;
 		out->contents = CONTENTS_NODE; /* differentiate from leafs */
 
 		for (j = 0; j < 2; j++)
 		{
 			int leafnum;
 
-			leafnum = LittleLong(in->children[j]);
+			leafnum = in->children[j];
 
 			if (leafnum >= 0)
 			{
@@ -442,9 +398,6 @@ Mod_LoadNodes(const char *name, cplane_t *planes, int numplanes, mleaf_t *leafs,
 	}
 
 	Mod_SetParent(*nodes, NULL); /* sets nodes and leafs */
-
-	numvisleafs = 0;
-	Mod_NumberLeafs (leafs, *nodes, r_leaftovis, r_vistoleaf, &numvisleafs);
 }
 
 /*
@@ -470,6 +423,12 @@ Mod_LoadVisibility (dvis_t **vis, const byte *mod_base, const lump_t *l)
 
 	out->numclusters = LittleLong(out->numclusters);
 
+	/* the PVS rows are decompressed into fixed buffers */
+	if (out->numclusters > MAX_MAP_LEAFS)
+	{
+		ri.Sys_Error(ERR_DROP, "%s: too many clusters", __func__);
+	}
+
 	for (i = 0; i < out->numclusters; i++)
 	{
 		out->bitofs[i][0] = LittleLong(out->bitofs[i][0]);
@@ -631,20 +590,11 @@ extra is used for skybox, which adds 6 surfaces
 */
 void
 Mod_LoadEdges(const char *name, medge_t **edges, int *numedges,
-	const byte *mod_base, const lump_t *l, int extra)
+	const dqedge_t *in, int count, int extra)
 {
-	dedge_t *in;
 	medge_t *out;
-	int 	i, count;
-
-	in = (void *)(mod_base + l->fileofs);
-	if (l->filelen % sizeof(*in))
-	{
-		ri.Sys_Error(ERR_DROP, "%s: funny lump size in %s",
-				__func__, name);
-	}
+	int 	i;
 
-	count = l->filelen / sizeof(*in);
 	out = Hunk_Alloc((count + extra) * sizeof(*out));
 
 	*edges = out;
@@ -652,8 +602,8 @@ Mod_LoadEdges(const char *name, medge_t **edges, int *numedges,
 
 	for ( i=0 ; i<count ; i++, in++, out++)
 	{
-		out->v[0] = (unsigned short)LittleShort(in->v[0]);
-		out->v[1] = (unsigned short)LittleShort(in->v[1]);
+		out->v[0] = in->v[0];
+		out->v[1] = in->v[1];
 	}
 }
 
@@ -764,6 +714,261 @@ Mod_CalcLumpHunkSize(const lump_t *l, int inSize, int outSize, int extra)
 	return size;
 }
 
+/* The converted lumps of the map that's loaded. They're kept
+   here and not by the caller, a Sys_Error() while loading the
+   map would lose them otherwise. */
+static void *mod_qbsplumps[HEADER_LUMPS];
+
+/*
+=================
+Mod_FreeQBSPLumps
+
+Lets go of the lumps from Mod_LoadQBSPLump(). Called when the
+map is loaded, leftovers of a map that failed to load go with
+the next one or when the renderer shuts down.
+=================
+*/
+void
+Mod_FreeQBSPLumps(void)
+{
+	int i;
+
+	for (i = 0; i < HEADER_LUMPS; i++)
+	{
+		free(mod_qbsplumps[i]);
+		mod_qbsplumps[i] = NULL;
+	}
+}
+
+/*
+=================
+Mod_LoadQBSPLump
+
+The lumps that are laid out differently in IBSP and QBSP maps,
+read into the QBSP layout in native byte order. That's one
+format for the renderers to deal with. The result stays valid
+until Mod_FreeQBSPLumps().
+=================
+*/
+void *
+Mod_LoadQBSPLump(const char *name, const byte *mod_base, const lump_t *l,
+	int lump, qboolean qbsp, int *count)
+{
+	size_t insize, outsize;
+	const byte *in;
+	byte *out;
+	int i, j;
+
+	switch (lump)
+	{
+		case LUMP_NODES:
+			insize = qbsp ? sizeof(dqnode_t) : sizeof(dnode_t);
+			outsize = sizeof(dqnode_t);
+			break;
+		case LUMP_FACES:
+			insize = qbsp ? sizeof(dqface_t) : sizeof(dface_t);
+			outsize = sizeof(dqface_t);
+			break;
+		case LUMP_LEAFS:
+			insize = qbsp ? sizeof(dqleaf_t) : sizeof(dleaf_t);
+			outsize = sizeof(dqleaf_t);
+			break;
+		case LUMP_LEAFFACES:
+			insize = qbsp ? sizeof(unsigned int) : sizeof(unsigned short);
+			outsize = sizeof(unsigned int);
+			break;
+		case LUMP_EDGES:
+			insize = qbsp ? sizeof(dqedge_t) : sizeof(dedge_t);
+			outsize = sizeof(dqedge_t);
+			break;
+		default:
+			ri.Sys_Error(ERR_DROP, "%s: lump %d is the same in both formats",
+					__func__, lump);
+			return NULL;
+	}
+
+	if (l->filelen % insize)
+	{
+		ri.Sys_Error(ERR_DROP, "%s: funny lump size in %s",
+				__func__, name);
+	}
+
+	*count = l->filelen / insize;
+
+	free(mod_qbsplumps[lump]);
+	mod_qbsplumps[lump] = out = malloc(*count * outsize + 1);
+
+	if (!out)
+	{
+		ri.Sys_Error(ERR_FATAL, "%s: can't allocate %d records of lump %d",
+			__func__, *count, lump);
+		return NULL;
+	}
+
+	in = mod_base + l->fileofs;
+
+	for (i = 0; i < *count; i++, in += insize)
+	{
+		switch (lump)
+		{
+			case LUMP_NODES:
+			{
+				dqnode_t *n = (dqnode_t *)out + i;
+
+				if (qbsp)
+				{
+					const dqnode_t *src = (const dqnode_t *)in;
+
+					n->planenum = LittleLong(src->planenum);
+					n->children[0] = LittleLong(src->children[0]);
+					n->children[1] = LittleLong(src->children[1]);
+
+					for (j = 0; j < 3; j++)
+					{
+						n->mins[j] = LittleFloat(src->mins[j]);
+						n->maxs[j] = LittleFloat(src->maxs[j]);
+					}
+
+					n->firstface = LittleLong(src->firstface);
+					n->numfaces = LittleLong(src->numfaces);
+				}
+				else
+				{
+					const dnode_t *src = (const dnode_t *)in;
+
+					n->planenum = LittleLong(src->planenum);
+					n->children[0] = LittleLong(src->children[0]);
+					n->children[1] = LittleLong(src->children[1]);
+
+					for (j = 0; j < 3; j++)
+					{
+						n->mins[j] = LittleShort(src->mins[j]);
+						n->maxs[j] = LittleShort(src->maxs[j]);
+					}
+
+					n->firstface = LittleShort(src->firstface) & 0xFFFF;
+					n->numfaces = LittleShort(src->numfaces) & 0xFFFF;
+				}
+
+				break;
+			}
+			case LUMP_FACES:
+			{
+				dqface_t *f = (dqface_t *)out + i;
+
+				if (qbsp)
+				{
+					const dqface_t *src = (const dqface_t *)in;
+
+					f->planenum = LittleLong(src->planenum);
+					f->side = LittleLong(src->side);
+					f->firstedge = LittleLong(src->firstedge);
+					f->numedges = LittleLong(src->numedges);
+					f->texinfo = LittleLong(src->texinfo);
+					memcpy(f->styles, src->styles, sizeof(f->styles));
+					f->lightofs = LittleLong(src->lightofs);
+				}
+				else
+				{
+					const dface_t *src = (const dface_t *)in;
+
+					f->planenum = LittleShort(src->planenum) & 0xFFFF;
+					f->side = LittleShort(src->side);
+					f->firstedge = LittleLong(src->firstedge);
+					f->numedges = LittleShort(src->numedges);
+					f->texinfo = LittleShort(src->texinfo);
+					memcpy(f->styles, src->styles, sizeof(f->styles));
+					f->lightofs = LittleLong(src->lightofs);
+				}
+
+				break;
+			}
+			case LUMP_LEAFS:
+			{
+				dqleaf_t *lf = (dqleaf_t *)out + i;
+
+				if (qbsp)
+				{
+					const dqleaf_t *src = (const dqleaf_t *)in;
+
+					lf->contents = LittleLong(src->contents);
+					lf->cluster = LittleLong(src->cluster);
+					lf->area = LittleLong(src->area);
+
+					for (j = 0; j < 3; j++)
+					{
+						lf->mins[j] = LittleFloat(src->mins[j]);
+						lf->maxs[j] = LittleFloat(src->maxs[j]);
+					}
+
+					lf->firstleafface = LittleLong(src->firstleafface);
+					lf->numleaffaces = LittleLong(src->numleaffaces);
+					lf->firstleafbrush = LittleLong(src->firstleafbrush);
+					lf->numleafbrushes = LittleLong(src->numleafbrushes);
+				}
+				else
+				{
+					const dleaf_t *src = (const dleaf_t *)in;
+
+					lf->contents = LittleLong(src->contents);
+					lf->cluster = LittleShort(src->cluster);
+					lf->area = LittleShort(src->area);
+
+					for (j = 0; j < 3; j++)
+					{
+						lf->mins[j] = LittleShort(src->mins[j]);
+						lf->maxs[j] = LittleShort(src->maxs[j]);
+					}
+
+					/* make unsigned long from signed short */
+					lf->firstleafface = LittleShort(src->firstleafface) & 0xFFFF;
+					lf->numleaffaces = LittleShort(src->numleaffaces) & 0xFFFF;
+					lf->firstleafbrush = LittleShort(src->firstleafbrush) & 0xFFFF;
+					lf->numleafbrushes = LittleShort(src->numleafbrushes) & 0xFFFF;
+				}
+
+				break;
+			}
+			case LUMP_LEAFFACES:
+			{
+				if (qbsp)
+				{
+					((unsigned int *)out)[i] = LittleLong(*(const unsigned int *)in);
+				}
+				else
+				{
+					((unsigned int *)out)[i] = LittleShort(*(const short *)in) & 0xFFFF;
+				}
+
+				break;
+			}
+			case LUMP_EDGES:
+			{
+				dqedge_t *e = (dqedge_t *)out + i;
+
+				if (qbsp)
+				{
+					const dqedge_t *src = (const dqedge_t *)in;
+
+					e->v[0] = LittleLong(src->v[0]);
+					e->v[1] = LittleLong(src->v[1]);
+				}
+				else
+				{
+					const dedge_t *src = (const dedge_t *)in;
+
+					e->v[0] = LittleShort(src->v[0]) & 0xFFFF;
+					e->v[1] = LittleShort(src->v[1]) & 0xFFFF;
+				}
+
+				break;
+			}
+		}
+	}
+
+	return out;
+}
+
 /*
 ===============
 Mod_PointInLeaf
@@ -19,7 +19,7 @@
  *
  * =======================================================================
  *
- * The PVS Decompress
+ * The PVS Decompress and the per map PVS cache
  *
  * =======================================================================
  */
@@ -75,6 +75,228 @@ Mod_DecompressVis(const byte *in, int row)
 	return decompressed;
 }
 
+/* must be a power of two, rows are mapped by cluster & (PVS_CACHED_ROWS - 1) */
+#define PVS_CACHED_ROWS 64
+
+struct pvscache_s
+{
+	const dvis_t *vis;
+	int numclusters;
+	int rowbytes; /* rounded up to a multiple of 4 */
+
+	/* the leafs of every cluster, the leafs of
+	   cluster c are clusterleafs[clusterfirst[c]]
+	   to clusterleafs[clusterfirst[c + 1] - 1] */
+	int *clusterfirst;
+	mleaf_t **clusterleafs;
+
+	/* recently decompressed rows */
+	int rowcluster[PVS_CACHED_ROWS];
+	byte *rows;
+	byte *novis;
+	byte *fatvis;
+};
+
+/*
+===================
+Mod_CreatePVSCache
+
+Sorts the leafs by cluster and sets up the row cache. Returns
+NULL if the map has no visibility info.
+===================
+*/
+pvscache_t *
+Mod_CreatePVSCache(const dvis_t *vis, mleaf_t *leafs, int numleafs)
+{
+	pvscache_t *cache;
+	int i;
+
+	if (!vis || vis->numclusters <= 0)
+	{
+		return NULL;
+	}
+
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+	{
+		ri.Sys_Error(ERR_FATAL, "%s: can't allocate cache", __func__);
+		return NULL;
+	}
+
+	cache->vis = vis;
+	cache->numclusters = vis->numclusters;
+	cache->rowbytes = ((vis->numclusters + 31) >> 5) << 2;
+
+	cache->clusterfirst = calloc(cache->numclusters + 1, sizeof(int));
+	cache->clusterleafs = malloc((numleafs + 1) * sizeof(mleaf_t *));
+	cache->rows = malloc(cache->rowbytes * (PVS_CACHED_ROWS + 2));
+
+	if (!cache->clusterfirst || !cache->clusterleafs || !cache->rows)
+	{
+		ri.Sys_Error(ERR_FATAL, "%s: can't allocate %d clusters",
+			__func__, cache->numclusters);
+		return NULL;
+	}
+
+	cache->novis = cache->rows + cache->rowbytes * PVS_CACHED_ROWS;
+	cache->fatvis = cache->novis + cache->rowbytes;
+	memset(cache->novis, 0xff, cache->rowbytes);
+
+	for (i = 0; i < PVS_CACHED_ROWS; i++)
+	{
+		cache->rowcluster[i] = -1;
+	}
+
+	/* counting sort, leafs outside of any
+	   cluster can never be seen */
+	for (i = 0; i < numleafs; i++)
+	{
+		if ((leafs[i].cluster >= 0) && (leafs[i].cluster < cache->numclusters))
+		{
+			cache->clusterfirst[leafs[i].cluster + 1]++;
+		}
+	}
+
+	for (i = 0; i < cache->numclusters; i++)
+	{
+		cache->clusterfirst[i + 1] += cache->clusterfirst[i];
+	}
+
+	for (i = 0; i < numleafs; i++)
+	{
+		if ((leafs[i].cluster >= 0) && (leafs[i].cluster < cache->numclusters))
+		{
+			cache->clusterleafs[cache->clusterfirst[leafs[i].cluster]++] = &leafs[i];
+		}
+	}
+
+	/* the sort moved every start to the next cluster */
+	for (i = cache->numclusters; i > 0; i--)
+	{
+		cache->clusterfirst[i] = cache->clusterfirst[i - 1];
+	}
+
+	cache->clusterfirst[0] = 0;
+
+	return cache;
+}
+
+void
+Mod_FreePVSCache(pvscache_t *cache)
+{
+	if (!cache)
+	{
+		return;
+	}
+
+	free(cache->clusterfirst);
+	free(cache->clusterleafs);
+	free(cache->rows);
+	free(cache);
+}
+
+/*
+===================
+Mod_CachedClusterPVS
+
+Like Mod_DecompressVis, but keeps the last rows around. The
+result is valid until the next call.
+===================
+*/
+const byte *
+Mod_CachedClusterPVS(pvscache_t *cache, int cluster)
+{
+	byte *row;
+	int slot;
+
+	if ((cluster < 0) || (cluster >= cache->numclusters))
+	{
+		return cache->novis;
+	}
+
+	slot = cluster & (PVS_CACHED_ROWS - 1);
+	row = cache->rows + cache->rowbytes * slot;
+
+	if (cache->rowcluster[slot] != cluster)
+	{
+		memcpy(row, Mod_DecompressVis((byte *)cache->vis +
+				cache->vis->bitofs[cluster][DVIS_PVS],
+				(cache->numclusters + 7) >> 3), cache->rowbytes);
+		cache->rowcluster[slot] = cluster;
+	}
+
+	return row;
+}
+
+/*
+===================
+Mod_MarkVisibleLeaves
+
+Marks the leafs that are in the PVS of cluster and cluster2 and all
+their parents with visframe. Only the leafs of the visible clusters
+are touched, not all the leafs in the map.
+===================
+*/
+void
+Mod_MarkVisibleLeaves(pvscache_t *cache, int cluster, int cluster2, int visframe)
+{
+	const byte *vis;
+	int i, c;
+
+	vis = Mod_CachedClusterPVS(cache, cluster);
+
+	/* may have to combine two clusters because of solid water boundaries */
+	if (cluster2 != cluster)
+	{
+		memcpy(cache->fatvis, vis, cache->rowbytes);
+		vis = Mod_CachedClusterPVS(cache, cluster2);
+
+		for (i = 0; i < cache->rowbytes / 4; i++)
+		{
+			((int *)cache->fatvis)[i] |= ((int *)vis)[i];
+		}
+
+		vis = cache->fatvis;
+	}
+
+	for (c = 0; c < cache->numclusters; c++)
+	{
+		mleaf_t **leaf, **last;
+
+		if (!vis[c >> 3])
+		{
+			/* skip the whole byte */
+			c |= 7;
+			continue;
+		}
+
+		if (!(vis[c >> 3] & (1 << (c & 7))))
+		{
+			continue;
+		}
+
+		leaf = cache->clusterleafs + cache->clusterfirst[c];
+		last = cache->clusterleafs + cache->clusterfirst[c + 1];
+
+		for ( ; leaf < last; leaf++)
+		{
+			mnode_t *node = (mnode_t *)*leaf;
+
+			do
+			{
+				if (node->visframe == visframe)
+				{
+					break;
+				}
+
+				node->visframe = visframe;
+				node = node->parent;
+			}
+			while (node);
+		}
+	}
+}
+
 float
 Mod_RadiusFromBounds(const vec3_t mins, const vec3_t maxs)
 {
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * =======================================================================
+ *
+ * Name lookup for the models and images of the renderers. They keep
+ * them in fixed arrays and used to search these with strcmp() for
+ * every registration and every pic drawn by the HUD. The registry
+ * chains the array slots into a hash by name, the slot number is the
+ * handle. It doesn't copy anything, names and registration sequences
+ * are read from the renderers own structs, so there's only one place
+ * where they're kept.
+ *
+ * =======================================================================
+ */
+
+#include "../ref_shared.h"
+
+#define REG_NAME(reg, handle) \
+	((const char *)((reg)->base + (size_t)(handle) * (reg)->size + (reg)->nameofs))
+#define REG_SEQUENCE(reg, handle) \
+	(*(const int *)((reg)->base + (size_t)(handle) * (reg)->size + (reg)->seqofs))
+
+static unsigned
+Reg_HashName(const char *name)
+{
+	unsigned hash = 0;
+
+	while (*name)
+	{
+		hash = hash * 31 + (unsigned char)*name++;
+	}
+
+	return hash & (REG_HASH_SIZE - 1);
+}
+
+/*
+ * Returns the handle of the slot with that name or -1.
+ */
+int
+Reg_Find(const registry_t *reg, const char *name)
+{
+	int handle;
+
+	if (!reg->next)
+	{
+		return -1;
+	}
+
+	for (handle = reg->hash[Reg_HashName(name)]; handle;
+		handle = reg->next[handle - 1])
+	{
+		if (!strcmp(REG_NAME(reg, handle - 1), name))
+		{
+			return handle - 1;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Removes the slot from the registry. Must be
+ * called before its name is cleared.
+ */
+void
+Reg_Remove(registry_t *reg, int handle)
+{
+	int *link;
+
+	if (!reg->next || (handle < 0) || (handle >= reg->count) ||
+		(reg->next[handle] < 0))
+	{
+		return;
+	}
+
+	link = &reg->hash[Reg_HashName(REG_NAME(reg, handle))];
+
+	while (*link && (*link != handle + 1))
+	{
+		link = &reg->next[*link - 1];
+	}
+
+	if (*link)
+	{
+		*link = reg->next[handle];
+	}
+
+	reg->next[handle] = -1;
+}
+
+/*
+ * Adds the slot under the name it has now.
+ */
+void
+Reg_Add(registry_t *reg, int handle)
+{
+	unsigned hash;
+	int i;
+
+	if ((handle < 0) || (handle >= reg->count))
+	{
+		return;
+	}
+
+	if (!reg->next)
+	{
+		reg->next = malloc(reg->count * sizeof(int));
+
+		if (!reg->next)
+		{
+			ri.Sys_Error(ERR_FATAL, "%s: can't allocate %d handles",
+				__func__, reg->count);
+			return;
+		}
+
+		/* -1 is not in the registry, 0 ends a chain */
+		for (i = 0; i < reg->count; i++)
+		{
+			reg->next[i] = -1;
+		}
+	}
+
+	Reg_Remove(reg, handle);
+
+	hash = Reg_HashName(REG_NAME(reg, handle));
+	reg->next[handle] = reg->hash[hash];
+	reg->hash[hash] = handle + 1;
+}
+
+/*
+ * Calls free_handle for every slot that wasn't touched during
+ * this registration sequence. free_handle decides whether to
+ * really free it and has to Reg_Remove() it if so. Free slots
+ * aren't looked at, they're not in the registry.
+ */
+void
+Reg_Purge(registry_t *reg, int sequence, regfree_t free_handle)
+{
+	int i, handle, next;
+
+	if (!reg->next)
+	{
+		return;
+	}
+
+	for (i = 0; i < REG_HASH_SIZE; i++)
+	{
+		for (handle = reg->hash[i]; handle; handle = next)
+		{
+			/* free_handle unlinks it */
+			next = reg->next[handle - 1];
+
+			if (REG_SEQUENCE(reg, handle - 1) != sequence)
+			{
+				free_handle(handle - 1);
+			}
+		}
+	}
+}
+
+/*
+ * Empties the registry, the slots are left alone.
+ */
+void
+Reg_Clear(registry_t *reg)
+{
+	free(reg->next);
+	reg->next = NULL;
+
+	memset(reg->hash, 0, sizeof(reg->hash));
+}
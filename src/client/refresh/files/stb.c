@@ -86,12 +86,18 @@ LoadSTB(const char *origname, const char* type, byte **pic, int *width, int *hei
 
 	int w, h, bytesPerPixel;
 	byte* data = NULL;
-	data = stbi_load_from_memory(rawdata, rawsize, &w, &h, &bytesPerPixel, STBI_rgb_alpha);
+	data = R_FindCachedImage(rawdata, rawsize, STBI_rgb_alpha, &w, &h);
 	if (data == NULL)
 	{
-		R_Printf(PRINT_ALL, "%s couldn't load data from %s: %s!\n", __func__, filename, stbi_failure_reason());
-		ri.FS_FreeFile(rawdata);
-		return false;
+		data = stbi_load_from_memory(rawdata, rawsize, &w, &h, &bytesPerPixel, STBI_rgb_alpha);
+		if (data == NULL)
+		{
+			R_Printf(PRINT_ALL, "%s couldn't load data from %s: %s!\n", __func__, filename, stbi_failure_reason());
+			ri.FS_FreeFile(rawdata);
+			return false;
+		}
+
+		R_StoreCachedImage(rawdata, rawsize, STBI_rgb_alpha, data, w, h);
 	}
 
 	ri.FS_FreeFile(rawdata);
@@ -28,6 +28,7 @@
 
 image_t gltextures[MAX_GLTEXTURES];
 int numgltextures;
+static registry_t image_reg = REG_INIT(gltextures, image_t);
 static int image_max = 0;
 int base_textureid; /* gltextures[i] = base_textureid+i */
 extern qboolean scrap_dirty;
@@ -969,6 +970,7 @@ R_LoadPic(const char *name, byte *pic, int width, int realwidth,
 
 	strcpy(image->name, name);
 	image->registration_sequence = registration_sequence;
+	Reg_Add(&image_reg, i);
 
 	image->width = width;
 	image->height = height;
@@ -1138,13 +1140,13 @@ R_FindImage(const char *name, imagetype_t type)
 	}
 
 	/* look for it */
-	for (i = 0, image = gltextures; i < numgltextures; i++, image++)
+	i = Reg_Find(&image_reg, name);
+
+	if (i >= 0)
 	{
-		if (!strcmp(name, image->name))
-		{
-			image->registration_sequence = registration_sequence;
-			return image;
-		}
+		image = &gltextures[i];
+		image->registration_sequence = registration_sequence;
+		return image;
 	}
 
 	//
@@ -1167,6 +1169,22 @@ RI_RegisterSkin(char *name)
 	return R_FindImage(name, it_skin);
 }
 
+static void
+R_FreeUnusedImage(int handle)
+{
+	image_t *image = &gltextures[handle];
+
+	if (image->type == it_pic)
+	{
+		return; /* don't free pics */
+	}
+
+	/* free it */
+	glDeleteTextures(1, (GLuint *)&image->texnum);
+	Reg_Remove(&image_reg, handle);
+	memset(image, 0, sizeof(*image));
+}
+
 /*
  * Any image that was not touched on
  * this registration sequence
@@ -1175,34 +1193,11 @@ RI_RegisterSkin(char *name)
 void
 R_FreeUnusedImages(void)
 {
-	int i;
-	image_t *image;
-
 	/* never free r_notexture or particle texture */
 	r_notexture->registration_sequence = registration_sequence;
 	r_particletexture->registration_sequence = registration_sequence;
 
-	for (i = 0, image = gltextures; i < numgltextures; i++, image++)
-	{
-		if (image->registration_sequence == registration_sequence)
-		{
-			continue; /* used this sequence */
-		}
-
-		if (!image->registration_sequence)
-		{
-			continue; /* free image_t slot */
-		}
-
-		if (image->type == it_pic)
-		{
-			continue; /* don't free pics */
-		}
-
-		/* free it */
-		glDeleteTextures(1, (GLuint *)&image->texnum);
-		memset(image, 0, sizeof(*image));
-	}
+	Reg_Purge(&image_reg, registration_sequence, R_FreeUnusedImage);
 }
 
 qboolean
@@ -1301,5 +1296,7 @@ R_ShutdownImages(void)
 		glDeleteTextures(1, (GLuint *)&image->texnum);
 		memset(image, 0, sizeof(*image));
 	}
+
+	Reg_Clear(&image_reg);
 }
 
@@ -30,7 +30,8 @@ int r_dlightframecount;
 vec3_t pointcolor;
 cplane_t *lightplane; /* used as shadow plane */
 vec3_t lightspot;
-static float s_blocklights[34 * 34 * 3];
+/* one per job thread, see R_RegenAllLightmaps() */
+static float s_blocklights[MAX_JOB_THREADS + 1][34 * 34 * 3];
 
 void
 R_RenderDlight(dlight_t *light)
@@ -336,8 +337,8 @@ R_LightPoint(entity_t *currententity, vec3_t p, vec3_t color)
 	VectorScale(color, r_modulate->value, color);
 }
 
-void
-R_AddDynamicLights(msurface_t *surf)
+static void
+R_AddDynamicLights(msurface_t *surf, float *blocklights)
 {
 	int lnum;
 	int sd, td;
@@ -389,7 +390,7 @@ R_AddDynamicLights(msurface_t *surf)
 		local[1] = DotProduct(impact,
 				   tex->vecs[1]) + tex->vecs[1][3] - surf->texturemins[1];
 
-		pfBL = s_blocklights;
+		pfBL = blocklights;
 
 		for (t = 0, ftacc = 0; t < tmax; t++, ftacc += 16)
 		{
@@ -443,10 +444,12 @@ R_SetCacheState(msurface_t *surf)
 }
 
 /*
- * Combine and scale multiple lightmaps into the floating format in blocklights
+ * Combine and scale multiple lightmaps into the floating format in blocklights.
+ * Every job thread has its own blocklights. The errors can't happen on them,
+ * all lightmaps were already built once when the map was loaded.
  */
 void
-R_BuildLightMap(msurface_t *surf, byte *dest, int stride)
+R_BuildLightMapThread(msurface_t *surf, byte *dest, int stride, int thread)
 {
 	int smax, tmax;
 	int r, g, b, a, max;
@@ -455,6 +458,7 @@ R_BuildLightMap(msurface_t *surf, byte *dest, int stride)
 	float scale[4];
 	int nummaps;
 	float *bl;
+	float *blocklights = s_blocklights[thread];
 
 	if (surf->texinfo->flags &
 		(SURF_SKY | SURF_TRANS33 | SURF_TRANS66 | SURF_WARP))
@@ -466,7 +470,7 @@ R_BuildLightMap(msurface_t *surf, byte *dest, int stride)
 	tmax = (surf->extents[1] >> 4) + 1;
 	size = smax * tmax;
 
-	if (size > (sizeof(s_blocklights) >> 4))
+	if (size > (sizeof(s_blocklights[0]) >> 4))
 	{
 		ri.Sys_Error(ERR_DROP, "Bad s_blocklights size");
 	}
@@ -476,7 +480,7 @@ R_BuildLightMap(msurface_t *surf, byte *dest, int stride)
 	{
 		for (i = 0; i < size * 3; i++)
 		{
-			s_blocklights[i] = 255;
+			blocklights[i] = 255;
 		}
 
 		goto store;
@@ -497,7 +501,7 @@ R_BuildLightMap(msurface_t *surf, byte *dest, int stride)
 
 		for (maps = 0; maps < MAXLIGHTMAPS && surf->styles[maps] != 255; maps++)
 		{
-			bl = s_blocklights;
+			bl = blocklights;
 
 			for (i = 0; i < 3; i++)
 			{
@@ -533,11 +537,11 @@ R_BuildLightMap(msurface_t *surf, byte *dest, int stride)
 	{
 		int maps;
 
-		memset(s_blocklights, 0, sizeof(s_blocklights[0]) * size * 3);
+		memset(blocklights, 0, sizeof(blocklights[0]) * size * 3);
 
 		for (maps = 0; maps < MAXLIGHTMAPS && surf->styles[maps] != 255; maps++)
 		{
-			bl = s_blocklights;
+			bl = blocklights;
 
 			for (i = 0; i < 3; i++)
 			{
@@ -573,13 +577,13 @@ R_BuildLightMap(msurface_t *surf, byte *dest, int stride)
 	/* add all the dynamic lights */
 	if (surf->dlightframe == r_framecount)
 	{
-		R_AddDynamicLights(surf);
+		R_AddDynamicLights(surf, blocklights);
 	}
 
 store:
 
 	stride -= (smax << 2);
-	bl = s_blocklights;
+	bl = blocklights;
 
 	for (i = 0; i < tmax; i++, dest += stride)
 	{
@@ -649,3 +653,9 @@ store:
 	}
 }
 
+
+void
+R_BuildLightMap(msurface_t *surf, byte *dest, int stride)
+{
+	R_BuildLightMapThread(surf, dest, stride, 0);
+}
@@ -48,6 +48,10 @@ LM_FreeLightmapBuffers(void)
 		free(gl_lms.allocated);
 		gl_lms.allocated = NULL;
 	}
+
+	free(gl_lms.builds);
+	gl_lms.builds = NULL;
+	gl_lms.num_builds = gl_lms.max_builds = 0;
 }
 
 static void
@@ -125,6 +129,112 @@ LM_UploadBlock(qboolean dynamic)
 	}
 }
 
+static int
+LM_RectArea(const lmrect_t *r)
+{
+	return (r->right - r->left) * (r->bottom - r->top);
+}
+
+/*
+ * Marks a part of a lightmap as changed. Rectangles close to each
+ * other are merged, so that the upload doesn't have to be split
+ * into hundreds of tiny glTexSubImage2D() calls.
+ */
+void
+LM_AddDirtyRect(int lightmap, int left, int top, int right, int bottom)
+{
+	lmrect_t *rects = gl_lms.dirty_rects[lightmap];
+	int *numrects = &gl_lms.num_dirty_rects[lightmap];
+	lmrect_t merged;
+	int i, area, growth;
+	int best = -1, bestgrowth = 0;
+
+	area = (right - left) * (bottom - top);
+
+	for (i = 0; i < *numrects; i++)
+	{
+		merged.left = Q_min(left, rects[i].left);
+		merged.top = Q_min(top, rects[i].top);
+		merged.right = Q_max(right, rects[i].right);
+		merged.bottom = Q_max(bottom, rects[i].bottom);
+
+		growth = LM_RectArea(&merged) - LM_RectArea(&rects[i]);
+
+		if ((best < 0) || (growth < bestgrowth))
+		{
+			best = i;
+			bestgrowth = growth;
+		}
+	}
+
+	/* merge if that uploads at most as many extra texels
+	   as the new rectangle has, or if we're out of slots */
+	if ((best >= 0) &&
+		((bestgrowth <= area) || (*numrects == MAX_LIGHTMAP_DIRTY_RECTS)))
+	{
+		rects[best].left = Q_min(left, rects[best].left);
+		rects[best].top = Q_min(top, rects[best].top);
+		rects[best].right = Q_max(right, rects[best].right);
+		rects[best].bottom = Q_max(bottom, rects[best].bottom);
+
+		return;
+	}
+
+	rects[*numrects].left = left;
+	rects[*numrects].top = top;
+	rects[*numrects].right = right;
+	rects[*numrects].bottom = bottom;
+	(*numrects)++;
+}
+
+/*
+ * Uploads all parts of the lightmaps marked by LM_AddDirtyRect()
+ * from their buffers (multitexture path only).
+ */
+void
+LM_UploadDirtyRects(void)
+{
+	qboolean pixelstore_set = false;
+	int i, j;
+
+	for (i = 1; i < gl_state.max_lightmaps; i++)
+	{
+		if (!gl_lms.num_dirty_rects[i])
+		{
+			continue;
+		}
+
+		if (!pixelstore_set)
+		{
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, gl_state.block_width);
+			pixelstore_set = true;
+		}
+
+		R_Bind(gl_state.lightmap_textures + i);
+
+		for (j = 0; j < gl_lms.num_dirty_rects[i]; j++)
+		{
+			const lmrect_t *r = &gl_lms.dirty_rects[i][j];
+			byte *base;
+
+			base = gl_lms.lightmap_buffer[i];
+			base += (r->top * gl_state.block_width + r->left) * LIGHTMAP_BYTES;
+
+			glTexSubImage2D(GL_TEXTURE_2D, 0, r->left, r->top,
+					r->right - r->left, r->bottom - r->top,
+					GL_LIGHTMAP_FORMAT, GL_UNSIGNED_BYTE, base);
+			c_lightmap_uploads++;
+		}
+
+		gl_lms.num_dirty_rects[i] = 0;
+	}
+
+	if (pixelstore_set)
+	{
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	}
+}
+
 /*
  * returns a texture number and the position inside it
  */
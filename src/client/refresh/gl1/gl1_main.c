@@ -1048,6 +1048,7 @@ R_RenderView(refdef_t *fd)
 	{
 		c_brush_polys = 0;
 		c_alias_polys = 0;
+		c_lightmap_uploads = 0;
 	}
 
 	R_PushDlights();
@@ -1080,9 +1081,9 @@ R_RenderView(refdef_t *fd)
 
 	if (r_speeds->value)
 	{
-		R_Printf(PRINT_ALL, "%4i wpoly %4i epoly %i tex %i lmaps\n",
+		R_Printf(PRINT_ALL, "%4i wpoly %4i epoly %i tex %i lmaps %i lmupl\n",
 				c_brush_polys, c_alias_polys, c_visible_textures,
-				c_visible_lightmaps);
+				c_visible_lightmaps, c_lightmap_uploads);
 	}
 
 	switch (gl_state.stereo_mode) {
@@ -1658,6 +1659,7 @@ RI_Shutdown(void)
 	Mod_FreeAll();
 
 	R_ShutdownImages();
+	R_ShutdownImageCache();
 
 	/* shutdown OS specific OpenGL stuff like contexts, etc.  */
 	RI_ShutdownContext();
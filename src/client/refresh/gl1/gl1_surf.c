@@ -30,6 +30,7 @@
 
 int c_visible_lightmaps;
 int c_visible_textures;
+int c_lightmap_uploads;
 static vec3_t modelorg; /* relative to viewpoint */
 msurface_t *r_alpha_surfaces;
 
@@ -38,9 +39,12 @@ gllightmapstate_t gl_lms;
 void LM_InitBlock(void);
 void LM_UploadBlock(qboolean dynamic);
 qboolean LM_AllocBlock(int w, int h, int *x, int *y);
+void LM_AddDirtyRect(int lightmap, int left, int top, int right, int bottom);
+void LM_UploadDirtyRects(void);
 
 void R_SetCacheState(msurface_t *surf);
 void R_BuildLightMap(msurface_t *surf, byte *dest, int stride);
+void R_BuildLightMapThread(msurface_t *surf, byte *dest, int stride, int thread);
 
 static void
 R_DrawGLPoly(msurface_t *fa)
@@ -448,6 +452,7 @@ R_RenderBrushPoly(entity_t *currententity, msurface_t *fa)
 
 			glTexSubImage2D(GL_TEXTURE_2D, 0, fa->light_s, fa->light_t,
 					smax, tmax, GL_LIGHTMAP_FORMAT, GL_UNSIGNED_BYTE, temp);
+			c_lightmap_uploads++;
 
 			fa->lightmapchain = gl_lms.lightmap_surfaces[fa->lightmaptexturenum];
 			gl_lms.lightmap_surfaces[fa->lightmaptexturenum] = fa;
@@ -599,12 +604,56 @@ R_RenderLightmappedPoly(entity_t *currententity, msurface_t *surf)
 	}
 }
 
-/* Upload dynamic lights to each lightmap texture (multitexture path only) */
+/*
+ * Returns false if there's no memory to queue
+ * the surface, it must be built right away then.
+ */
+static qboolean
+R_QueueLightmapBuild(msurface_t *surf, byte *dest)
+{
+	if (gl_lms.num_builds == gl_lms.max_builds)
+	{
+		lmbuild_t *builds;
+		int max;
+
+		max = gl_lms.max_builds ? gl_lms.max_builds * 2 : 256;
+		builds = realloc(gl_lms.builds, max * sizeof(lmbuild_t));
+
+		if (!builds)
+		{
+			return false;
+		}
+
+		gl_lms.builds = builds;
+		gl_lms.max_builds = max;
+	}
+
+	gl_lms.builds[gl_lms.num_builds].surf = surf;
+	gl_lms.builds[gl_lms.num_builds].dest = dest;
+	gl_lms.num_builds++;
+
+	return true;
+}
+
+static void
+R_LightmapBuildJob(void *job, int thread)
+{
+	const lmbuild_t *build = job;
+
+	R_BuildLightMapThread(build->surf, build->dest,
+			gl_state.block_width * LIGHTMAP_BYTES, thread);
+}
+
+/*
+ * Upload dynamic lights to each lightmap texture (multitexture path only).
+ * The changed areas of all lightmaps are collected first, so that there
+ * are only a few uploads per lightmap, no matter how many surfaces changed.
+ * The lightmaps themselves are built on the job threads.
+ */
 static void
 R_RegenAllLightmaps()
 {
-	int i, map, smax, tmax, top, bottom, left, right, bt, bb, bl, br;
-	qboolean affected_lightmap, pixelstore_set = false;
+	int i, map, smax, tmax;
 	msurface_t *surf;
 	byte *base;
 
@@ -620,11 +669,6 @@ R_RegenAllLightmaps()
 			continue;
 		}
 
-		affected_lightmap = false;
-		bt = gl_state.block_height;
-		bl = gl_state.block_width;
-		bb = br = 0;
-
 		for (surf = gl_lms.lightmap_surfaces[i];
 			 surf != 0;
 			 surf = surf->lightmapchain)
@@ -634,63 +678,32 @@ R_RegenAllLightmaps()
 				continue;
 			}
 
-			affected_lightmap = true;
 			smax = (surf->extents[0] >> 4) + 1;
 			tmax = (surf->extents[1] >> 4) + 1;
 
-			left = surf->light_s;
-			right = surf->light_s + smax;
-			top = surf->light_t;
-			bottom = surf->light_t + tmax;
-
 			base = gl_lms.lightmap_buffer[i];
-			base += (top * gl_state.block_width + left) * LIGHTMAP_BYTES;
-
-			R_BuildLightMap(surf, base, gl_state.block_width * LIGHTMAP_BYTES);
-			R_UpdateSurfCache(surf, map);
+			base += (surf->light_t * gl_state.block_width + surf->light_s) * LIGHTMAP_BYTES;
 
-			if (left < bl)
+			if (!R_QueueLightmapBuild(surf, base))
 			{
-				bl = left;
-			}
-			if (right > br)
-			{
-				br = right;
-			}
-			if (top < bt)
-			{
-				bt = top;
-			}
-			if (bottom > bb)
-			{
-				bb = bottom;
+				R_BuildLightMap(surf, base, gl_state.block_width * LIGHTMAP_BYTES);
 			}
-		}
 
-		if (!affected_lightmap)
-		{
-			continue;
-		}
+			R_UpdateSurfCache(surf, map);
 
-		if (!pixelstore_set)
-		{
-			glPixelStorei(GL_UNPACK_ROW_LENGTH, gl_state.block_width);
-			pixelstore_set = true;
+			LM_AddDirtyRect(i, surf->light_s, surf->light_t,
+					surf->light_s + smax, surf->light_t + tmax);
 		}
-
-		base = gl_lms.lightmap_buffer[i];
-		base += (bt * gl_state.block_width + bl) * LIGHTMAP_BYTES;
-
-		// upload changes
-		R_Bind(gl_state.lightmap_textures + i);
-		glTexSubImage2D(GL_TEXTURE_2D, 0, bl, bt, br - bl, bb - bt,
-						GL_LIGHTMAP_FORMAT, GL_UNSIGNED_BYTE, base);
 	}
 
-	if (pixelstore_set)
-	{
-		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-	}
+	// the surfaces are at different places of the
+	// buffers, so they can be built in parallel
+	ri.Com_RunJobs(R_LightmapBuildJob, gl_lms.builds, gl_lms.num_builds,
+			sizeof(lmbuild_t));
+	gl_lms.num_builds = 0;
+
+	// upload changes
+	LM_UploadDirtyRects();
 }
 
 static void
@@ -1206,12 +1219,7 @@ R_DrawWorld(void)
 void
 R_MarkLeaves(void)
 {
-	const byte *vis;
-	YQ2_ALIGNAS_TYPE(int) byte fatvis[MAX_MAP_LEAFS / 8];
-	mnode_t *node;
-	int i, c;
-	mleaf_t *leaf;
-	int cluster;
+	int i;
 
 	if ((r_oldviewcluster == r_viewcluster) &&
 		(r_oldviewcluster2 == r_viewcluster2) &&
@@ -1232,7 +1240,7 @@ R_MarkLeaves(void)
 	r_oldviewcluster = r_viewcluster;
 	r_oldviewcluster2 = r_viewcluster2;
 
-	if (r_novis->value || (r_viewcluster == -1) || !r_worldmodel->vis)
+	if (r_novis->value || (r_viewcluster == -1) || !r_worldmodel->pvscache)
 	{
 		/* mark everything */
 		for (i = 0; i < r_worldmodel->numleafs; i++)
@@ -1248,49 +1256,6 @@ R_MarkLeaves(void)
 		return;
 	}
 
-	vis = Mod_ClusterPVS(r_viewcluster, r_worldmodel);
-
-	/* may have to combine two clusters because of solid water boundaries */
-	if (r_viewcluster2 != r_viewcluster)
-	{
-		memcpy(fatvis, vis, (r_worldmodel->numleafs + 7) / 8);
-		vis = Mod_ClusterPVS(r_viewcluster2, r_worldmodel);
-		c = (r_worldmodel->numleafs + 31) / 32;
-
-		for (i = 0; i < c; i++)
-		{
-			((int *)fatvis)[i] |= ((int *)vis)[i];
-		}
-
-		vis = fatvis;
-	}
-
-	for (i = 0, leaf = r_worldmodel->leafs;
-		 i < r_worldmodel->numleafs;
-		 i++, leaf++)
-	{
-		cluster = leaf->cluster;
-
-		if (cluster == -1)
-		{
-			continue;
-		}
-
-		if (vis[cluster >> 3] & (1 << (cluster & 7)))
-		{
-			node = (mnode_t *)leaf;
-
-			do
-			{
-				if (node->visframe == r_visframecount)
-				{
-					break;
-				}
-
-				node->visframe = r_visframecount;
-				node = node->parent;
-			}
-			while (node);
-		}
-	}
+	Mod_MarkVisibleLeaves(r_worldmodel->pvscache, r_viewcluster,
+		r_viewcluster2, r_visframecount);
 }
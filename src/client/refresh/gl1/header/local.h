@@ -226,6 +226,7 @@ extern int gl_tex_alpha_format;
 
 extern int c_visible_lightmaps;
 extern int c_visible_textures;
+extern int c_lightmap_uploads;
 
 extern float r_world_matrix[16];
 
@@ -410,6 +411,20 @@ typedef struct
 		scrap_height;
 } glstate_t;
 
+#define MAX_LIGHTMAP_DIRTY_RECTS 8
+
+typedef struct
+{
+	int left, top, right, bottom;
+} lmrect_t;
+
+/* a lightmap rebuilt by R_RegenAllLightmaps() on the job threads */
+typedef struct
+{
+	msurface_t *surf;
+	byte *dest;
+} lmbuild_t;
+
 typedef struct
 {
 	int internal_format;
@@ -422,6 +437,14 @@ typedef struct
 	/* the lightmap texture data needs to be kept in
 	   main memory so texsubimage can update properly */
 	byte *lightmap_buffer[MAX_LIGHTMAPS];
+
+	/* parts of the lightmaps changed this frame,
+	   see LM_AddDirtyRect() and LM_UploadDirtyRects() */
+	lmrect_t dirty_rects[MAX_LIGHTMAPS][MAX_LIGHTMAP_DIRTY_RECTS];
+	int num_dirty_rects[MAX_LIGHTMAPS];
+
+	lmbuild_t *builds;
+	int num_builds, max_builds;
 } gllightmapstate_t;
 
 extern glconfig_t gl_config;
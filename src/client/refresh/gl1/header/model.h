@@ -131,6 +131,7 @@ typedef struct model_s
 	msurface_t **marksurfaces;
 
 	dvis_t *vis;
+	pvscache_t *pvscache;
 
 	byte *lightdata;
 
@@ -47,6 +47,7 @@ int gl_filter_max = GL_LINEAR;
 
 gl3image_t gl3textures[MAX_GL3TEXTURES];
 int numgl3textures = 0;
+static registry_t image_reg = REG_INIT(gl3textures, gl3image_t);
 static int image_max = 0;
 
 void
@@ -422,6 +423,7 @@ GL3_LoadPic(char *name, byte *pic, int width, int realwidth,
 
 	strcpy(image->name, name);
 	image->registration_sequence = registration_sequence;
+	Reg_Add(&image_reg, i);
 
 	image->width = width;
 	image->height = height;
@@ -640,13 +642,13 @@ GL3_FindImage(const char *name, imagetype_t type)
 	}
 
 	/* look for it */
-	for (i = 0, image = gl3textures; i < numgl3textures; i++, image++)
+	i = Reg_Find(&image_reg, name);
+
+	if (i >= 0)
 	{
-		if (!strcmp(name, image->name))
-		{
-			image->registration_sequence = registration_sequence;
-			return image;
-		}
+		image = &gl3textures[i];
+		image->registration_sequence = registration_sequence;
+		return image;
 	}
 
 	//
@@ -669,6 +671,22 @@ GL3_RegisterSkin(char *name)
 	return GL3_FindImage(name, it_skin);
 }
 
+static void
+GL3_FreeUnusedImage(int handle)
+{
+	gl3image_t *image = &gl3textures[handle];
+
+	if (image->type == it_pic)
+	{
+		return; /* don't free pics */
+	}
+
+	/* free it */
+	glDeleteTextures(1, &image->texnum);
+	Reg_Remove(&image_reg, handle);
+	memset(image, 0, sizeof(*image));
+}
+
 /*
  * Any image that was not touched on
  * this registration sequence
@@ -677,34 +695,11 @@ GL3_RegisterSkin(char *name)
 void
 GL3_FreeUnusedImages(void)
 {
-	int i;
-	gl3image_t *image;
-
 	/* never free r_notexture or particle texture */
 	gl3_notexture->registration_sequence = registration_sequence;
 	gl3_particletexture->registration_sequence = registration_sequence;
 
-	for (i = 0, image = gl3textures; i < numgl3textures; i++, image++)
-	{
-		if (image->registration_sequence == registration_sequence)
-		{
-			continue; /* used this sequence */
-		}
-
-		if (!image->registration_sequence)
-		{
-			continue; /* free image_t slot */
-		}
-
-		if (image->type == it_pic)
-		{
-			continue; /* don't free pics */
-		}
-
-		/* free it */
-		glDeleteTextures(1, &image->texnum);
-		memset(image, 0, sizeof(*image));
-	}
+	Reg_Purge(&image_reg, registration_sequence, GL3_FreeUnusedImage);
 }
 
 qboolean
@@ -751,6 +746,8 @@ GL3_ShutdownImages(void)
 		glDeleteTextures(1, &image->texnum);
 		memset(image, 0, sizeof(*image));
 	}
+
+	Reg_Clear(&image_reg);
 }
 
 static qboolean IsNPOT(int v)
@@ -657,6 +657,8 @@ GL3_Init(void)
 
 	GL3_SurfInit();
 
+	GL3_InitMeshes();
+
 	glGenFramebuffers(1, &gl3state.ppFBO);
 	// the rest for the FBO is done dynamically in GL3_RenderView() so it can
 	// take the viewsize into account (enforce that by setting invalid size)
@@ -681,6 +683,7 @@ GL3_Shutdown(void)
 		GL3_Mod_FreeAll();
 		GL3_ShutdownMeshes();
 		GL3_ShutdownImages();
+		R_ShutdownImageCache();
 		GL3_SurfShutdown();
 		GL3_Draw_ShutdownLocal();
 		GL3_ShutdownShaders();
@@ -1510,7 +1513,7 @@ SetupGL(void)
 	glEnable(GL_DEPTH_TEST);
 }
 
-extern int c_visible_lightmaps, c_visible_textures;
+extern int c_visible_lightmaps, c_visible_textures, c_world_draws;
 
 /*
  * gl3_newrefdef must be set before the first call
@@ -1677,9 +1680,9 @@ GL3_RenderView(refdef_t *fd)
 
 	if (r_speeds->value)
 	{
-		R_Printf(PRINT_ALL, "%4i wpoly %4i epoly %i tex %i lmaps\n",
+		R_Printf(PRINT_ALL, "%4i wpoly %4i epoly %i tex %i lmaps %i wdraws\n",
 				c_brush_polys, c_alias_polys, c_visible_textures,
-				c_visible_lightmaps);
+				c_visible_lightmaps, c_world_draws);
 	}
 
 #if 0 // TODO: stereo stuff
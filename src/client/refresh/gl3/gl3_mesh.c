@@ -70,6 +70,294 @@ GL3_ShutdownMeshes(void)
 	da_free(idxBuf);
 
 	da_free(shadowModels);
+
+	if (gl3state.aliasNormalTex != 0)
+	{
+		glDeleteTextures(1, &gl3state.aliasNormalTex);
+		gl3state.aliasNormalTex = 0;
+	}
+}
+
+/*
+ * Uploads r_avertexnormals and r_avertexnormal_dots as a texture
+ * for the model vertex shader: texel (x, y) contains the normal
+ * with index x in rgb and r_avertexnormal_dots[y][x] in alpha.
+ */
+void
+GL3_InitMeshes(void)
+{
+	GLfloat *table;
+	int i, j;
+
+	table = malloc(SHADEDOT_QUANT * 256 * 4 * sizeof(GLfloat));
+
+	if (!table)
+	{
+		ri.Sys_Error(ERR_FATAL, "%s: Couldn't malloc normal table", __func__);
+		return;
+	}
+
+	for (i = 0; i < SHADEDOT_QUANT; i++)
+	{
+		for (j = 0; j < 256; j++)
+		{
+			GLfloat *texel = &table[(i * 256 + j) * 4];
+
+			if (j < NUMVERTEXNORMALS)
+			{
+				VectorCopy(r_avertexnormals[j], texel);
+			}
+			else
+			{
+				VectorClear(texel);
+			}
+
+			texel[3] = r_avertexnormal_dots[i][j];
+		}
+	}
+
+	glGenTextures(1, &gl3state.aliasNormalTex);
+
+	GL3_SelectTMU(GL_TEXTURE5);
+	glBindTexture(GL_TEXTURE_2D, gl3state.aliasNormalTex);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, 256, SHADEDOT_QUANT, 0, GL_RGBA, GL_FLOAT, table);
+	GL3_SelectTMU(GL_TEXTURE0);
+
+	free(table);
+}
+
+/*
+ * Uploads all frames of an alias model into a static VBO, so drawing
+ * it doesn't need any vertex uploads. The triangle fans and strips
+ * from the glcmds are converted to triangles in an index buffer,
+ * glcmd vertices with the same position and texcoord are merged.
+ *
+ * VBO layout: aliasNumVerts texcoords (2 floats), followed by
+ * aliasNumVerts dtrivertx_t for each frame.
+ */
+void
+GL3_CreateAliasBuffers(gl3model_t *mod)
+{
+	dmdl_t *paliashdr = (dmdl_t *)mod->extradata;
+	UShortArray_t indices = {0};
+	int *order, *start;
+	int *vtxXyz, *vtxNext, *xyzFirst, *cmdVtx;
+	GLfloat *vtxST;
+	byte *data;
+	size_t stSize, frameSize;
+	int count, total, numVerts;
+	int i, v;
+
+	start = (int *)((byte *)paliashdr + paliashdr->ofs_glcmds);
+
+	/* count the glcmd vertices, an upper bound for the merged ones */
+	total = 0;
+
+	for (order = start; (count = *order++) != 0; order += 3 * abs(count))
+	{
+		total += abs(count);
+	}
+
+	if (!total || total > 0xFFFF)
+	{
+		R_Printf(PRINT_ALL, "%s: %s has %d vertices, not drawing it\n",
+				__func__, mod->name, total);
+		return;
+	}
+
+	vtxXyz = malloc(total * sizeof(int));
+	vtxNext = malloc(total * sizeof(int));
+	cmdVtx = malloc(total * sizeof(int));
+	vtxST = malloc(total * 2 * sizeof(GLfloat));
+	xyzFirst = malloc(paliashdr->num_xyz * sizeof(int));
+
+	if (!vtxXyz || !vtxNext || !cmdVtx || !vtxST || !xyzFirst)
+	{
+		ri.Sys_Error(ERR_FATAL, "%s: Couldn't malloc vertex data for %s",
+				__func__, mod->name);
+		return;
+	}
+
+	for (i = 0; i < paliashdr->num_xyz; i++)
+	{
+		xyzFirst[i] = -1;
+	}
+
+	numVerts = 0;
+	order = start;
+
+	while ((count = *order++) != 0)
+	{
+		qboolean fan = (count < 0);
+		GLushort *add;
+
+		count = abs(count);
+
+		for (i = 0; i < count; i++, order += 3)
+		{
+			GLfloat s = ((float *)order)[0];
+			GLfloat t = ((float *)order)[1];
+			int xyz = order[2];
+
+			if ((xyz < 0) || (xyz >= paliashdr->num_xyz))
+			{
+				xyz = 0;
+			}
+
+			for (v = xyzFirst[xyz]; v != -1; v = vtxNext[v])
+			{
+				if ((vtxST[v * 2] == s) && (vtxST[v * 2 + 1] == t))
+				{
+					break;
+				}
+			}
+
+			if (v == -1)
+			{
+				v = numVerts++;
+
+				vtxXyz[v] = xyz;
+				vtxST[v * 2] = s;
+				vtxST[v * 2 + 1] = t;
+				vtxNext[v] = xyzFirst[xyz];
+				xyzFirst[xyz] = v;
+			}
+
+			cmdVtx[i] = v;
+		}
+
+		// translate triangle fan/strip to just triangle indices
+		if (fan)
+		{
+			for (i = 1; i < count - 1; ++i)
+			{
+				add = da_addn_uninit(indices, 3);
+
+				add[0] = cmdVtx[0];
+				add[1] = cmdVtx[i];
+				add[2] = cmdVtx[i + 1];
+			}
+		}
+		else // triangle strip
+		{
+			for (i = 1; i < count - 2; i += 2)
+			{
+				// add two triangles at once, because the vertex order is different
+				// for odd vs even triangles
+				add = da_addn_uninit(indices, 6);
+
+				add[0] = cmdVtx[i - 1];
+				add[1] = cmdVtx[i];
+				add[2] = cmdVtx[i + 1];
+
+				add[3] = cmdVtx[i];
+				add[4] = cmdVtx[i + 2];
+				add[5] = cmdVtx[i + 1];
+			}
+			// add remaining triangle, if any
+			if (i < count - 1)
+			{
+				add = da_addn_uninit(indices, 3);
+
+				add[0] = cmdVtx[i - 1];
+				add[1] = cmdVtx[i];
+				add[2] = cmdVtx[i + 1];
+			}
+		}
+	}
+
+	stSize = numVerts * 2 * sizeof(GLfloat);
+	frameSize = numVerts * sizeof(dtrivertx_t);
+	data = malloc(stSize + paliashdr->num_frames * frameSize);
+
+	if (!data)
+	{
+		ri.Sys_Error(ERR_FATAL, "%s: Couldn't malloc vertex data for %s",
+				__func__, mod->name);
+		return;
+	}
+
+	memcpy(data, vtxST, stSize);
+
+	for (i = 0; i < paliashdr->num_frames; i++)
+	{
+		daliasframe_t *frame = (daliasframe_t *)((byte *)paliashdr
+				+ paliashdr->ofs_frames + i * paliashdr->framesize);
+		dtrivertx_t *out = (dtrivertx_t *)(data + stSize + i * frameSize);
+
+		for (v = 0; v < numVerts; v++)
+		{
+			out[v] = frame->verts[vtxXyz[v]];
+		}
+	}
+
+	mod->aliasNumVerts = numVerts;
+	mod->aliasNumIndices = da_count(indices);
+
+	glGenVertexArrays(1, &mod->aliasVAO);
+	GL3_BindVAO(mod->aliasVAO);
+
+	glGenBuffers(1, &mod->aliasVBO);
+	GL3_BindVBO(mod->aliasVBO);
+	glBufferData(GL_ARRAY_BUFFER, stSize + paliashdr->num_frames * frameSize, data, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &mod->aliasEBO);
+	GL3_BindEBO(mod->aliasEBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mod->aliasNumIndices * sizeof(GLushort), indices.p, GL_STATIC_DRAW);
+
+	glEnableVertexAttribArray(GL3_ATTRIB_TEXCOORD);
+	qglVertexAttribPointer(GL3_ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE, 2*sizeof(GLfloat), 0);
+
+	// DrawAliasFrameLerp() points these to the frames it needs
+	glEnableVertexAttribArray(GL3_ATTRIB_FRAMEVERT);
+	qglVertexAttribPointer(GL3_ATTRIB_FRAMEVERT, 4, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(dtrivertx_t), stSize);
+
+	glEnableVertexAttribArray(GL3_ATTRIB_OLDFRAMEVERT);
+	qglVertexAttribPointer(GL3_ATTRIB_OLDFRAMEVERT, 4, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(dtrivertx_t), stSize);
+
+	mod->aliasFrame = mod->aliasOldFrame = 0;
+
+	free(data);
+	free(xyzFirst);
+	free(vtxST);
+	free(cmdVtx);
+	free(vtxNext);
+	free(vtxXyz);
+	da_free(indices);
+}
+
+void
+GL3_FreeAliasBuffers(gl3model_t *mod)
+{
+	if (mod->aliasVAO == 0)
+	{
+		return;
+	}
+
+	// deleted names get reused, so they mustn't be remembered as bound
+	if (gl3state.currentVAO == mod->aliasVAO)
+	{
+		gl3state.currentVAO = 0;
+	}
+
+	if (gl3state.currentVBO == mod->aliasVBO)
+	{
+		gl3state.currentVBO = 0;
+	}
+
+	if (gl3state.currentEBO == mod->aliasEBO)
+	{
+		gl3state.currentEBO = 0;
+	}
+
+	glDeleteBuffers(1, &mod->aliasEBO);
+	glDeleteBuffers(1, &mod->aliasVBO);
+	glDeleteVertexArrays(1, &mod->aliasVAO);
+
+	mod->aliasVAO = mod->aliasVBO = mod->aliasEBO = 0;
+	mod->aliasNumVerts = mod->aliasNumIndices = 0;
 }
 
 static void
@@ -106,42 +394,38 @@ LerpVerts(qboolean powerUpEffect, int nverts, dtrivertx_t *v, dtrivertx_t *ov,
 
 /*
  * Interpolates between two frames and origins
+ *
+ * All frames of the model are in a static VBO (see GL3_CreateAliasBuffers()),
+ * the lerping, shell offset and shading happens in the vertex shader.
  */
 static void
 DrawAliasFrameLerp(dmdl_t *paliashdr, entity_t* entity, vec3_t shadelight)
 {
-	GLenum type;
-	float l;
 	daliasframe_t *frame, *oldframe;
-	dtrivertx_t *v, *ov, *verts;
-	int *order;
-	int count;
 	float alpha;
 	vec3_t move, delta, vectors[3];
-	vec3_t frontv, backv;
 	int i;
-	int index_xyz;
 	float backlerp = entity->backlerp;
 	float frontlerp = 1.0 - backlerp;
-	float *lerp;
+	gl3model_t* model = entity->model;
+	gl3ShaderInfo_t* shaderInfo;
+	// [0]: move, shell scale; [1]: frontv, shadedots row; [2]: backv, unused; [3]: shadelight, alpha
+	GLfloat params[4][4];
 	// draw without texture? used for quad damage effect etc, I think
 	qboolean colorOnly = 0 != (entity->flags &
 			(RF_SHELL_RED | RF_SHELL_GREEN | RF_SHELL_BLUE | RF_SHELL_DOUBLE |
 			 RF_SHELL_HALF_DAM));
 
-	// TODO: maybe we could somehow store the non-rotated normal and do the dot in shader?
-	float* shadedots = r_avertexnormal_dots[((int)(entity->angles[1] *
-				(SHADEDOT_QUANT / 360.0))) & (SHADEDOT_QUANT - 1)];
+	if (model->aliasVAO == 0)
+	{
+		return; /* see GL3_CreateAliasBuffers() */
+	}
 
 	frame = (daliasframe_t *)((byte *)paliashdr + paliashdr->ofs_frames
 							  + entity->frame * paliashdr->framesize);
-	verts = v = frame->verts;
 
 	oldframe = (daliasframe_t *)((byte *)paliashdr + paliashdr->ofs_frames
 				+ entity->oldframe * paliashdr->framesize);
-	ov = oldframe->verts;
-
-	order = (int *)((byte *)paliashdr + paliashdr->ofs_glcmds);
 
 	if (entity->flags & RF_TRANSLUCENT)
 	{
@@ -154,13 +438,15 @@ DrawAliasFrameLerp(dmdl_t *paliashdr, entity_t* entity, vec3_t shadelight)
 
 	if (colorOnly)
 	{
-		GL3_UseProgram(gl3state.si3DaliasColor.shaderProgram);
+		shaderInfo = &gl3state.si3DaliasColor;
 	}
 	else
 	{
-		GL3_UseProgram(gl3state.si3Dalias.shaderProgram);
+		shaderInfo = &gl3state.si3Dalias;
 	}
 
+	GL3_UseProgram(shaderInfo->shaderProgram);
+
 	if(gl3_colorlight->value == 0.0f)
 	{
 		float avg = 0.333333f * (shadelight[0]+shadelight[1]+shadelight[2]);
@@ -179,150 +465,42 @@ DrawAliasFrameLerp(dmdl_t *paliashdr, entity_t* entity, vec3_t shadelight)
 
 	for (i = 0; i < 3; i++)
 	{
-		move[i] = backlerp * move[i] + frontlerp * frame->translate[i];
-
-		frontv[i] = frontlerp * frame->scale[i];
-		backv[i] = backlerp * oldframe->scale[i];
+		params[0][i] = backlerp * move[i] + frontlerp * frame->translate[i];
+		params[1][i] = frontlerp * frame->scale[i];
+		params[2][i] = backlerp * oldframe->scale[i];
+		params[3][i] = shadelight[i];
 	}
 
-	lerp = s_lerped[0];
-
-	LerpVerts(colorOnly, paliashdr->num_xyz, v, ov, verts, lerp, move, frontv, backv);
+	params[0][3] = colorOnly ? POWERSUIT_SCALE : 0.0f;
+	// shadedots row in r_avertexnormal_dots according to rotation around Z axis
+	params[1][3] = ((int)(entity->angles[1] * (SHADEDOT_QUANT / 360.0))) & (SHADEDOT_QUANT - 1);
+	params[2][3] = 0.0f;
+	params[3][3] = alpha;
 
-	YQ2_STATIC_ASSERT(sizeof(gl3_alias_vtx_t) == 9*sizeof(GLfloat), "invalid gl3_alias_vtx_t size");
+	glUniform4fv(shaderInfo->uniAliasParams, 4, params[0]);
 
-	// all the triangle fans and triangle strips of this model will be converted to
-	// just triangles: the vertices stay the same and are batched in vtxBuf,
-	// but idxBuf will contain indices to draw them all as GL_TRIANGLE
-	// this way there's only one draw call (and two glBufferData() calls)
-	// instead of (at least) dozens. *greatly* improves performance.
+	GL3_BindVAO(model->aliasVAO);
+	GL3_BindVBO(model->aliasVBO);
 
-	// so first clear out the data from last call to this function
-	// (the buffers are static global so we don't have malloc()/free() for each rendered model)
-	da_clear(vtxBuf);
-	da_clear(idxBuf);
-
-	while (1)
+	// point the VAO to the frames, unless the last entity drawn
+	// with this model used the same ones (happens a lot for idle monsters)
+	if (model->aliasFrame != entity->frame)
 	{
-		GLushort nextVtxIdx = da_count(vtxBuf);
+		GLintptr ofs = model->aliasNumVerts * (2 * sizeof(GLfloat) + entity->frame * sizeof(dtrivertx_t));
 
-		/* get the vertex count and primitive type */
-		count = *order++;
-
-		if (!count)
-		{
-			break; /* done */
-		}
-
-		if (count < 0)
-		{
-			count = -count;
-
-			type = GL_TRIANGLE_FAN;
-		}
-		else
-		{
-			type = GL_TRIANGLE_STRIP;
-		}
-
-		gl3_alias_vtx_t* buf = da_addn_uninit(vtxBuf, count);
-
-		if (colorOnly)
-		{
-			int i;
-			for(i=0; i<count; ++i)
-			{
-				int j=0;
-				gl3_alias_vtx_t* cur = &buf[i];
-				index_xyz = order[2];
-				order += 3;
-
-				for(j=0; j<3; ++j)
-				{
-					cur->pos[j] = s_lerped[index_xyz][j];
-					cur->color[j] = shadelight[j];
-				}
-				cur->color[3] = alpha;
-			}
-		}
-		else
-		{
-			int i;
-			for(i=0; i<count; ++i)
-			{
-				int j=0;
-				gl3_alias_vtx_t* cur = &buf[i];
-				/* texture coordinates come from the draw list */
-				cur->texCoord[0] = ((float *) order)[0];
-				cur->texCoord[1] = ((float *) order)[1];
-
-				index_xyz = order[2];
-
-				order += 3;
-
-				/* normals and vertexes come from the frame list */
-				// shadedots is set above according to rotation (around Z axis I think)
-				// to one of 16 (SHADEDOT_QUANT) presets in r_avertexnormal_dots
-				l = shadedots[verts[index_xyz].lightnormalindex];
-
-				for(j=0; j<3; ++j)
-				{
-					cur->pos[j] = s_lerped[index_xyz][j];
-					cur->color[j] = l * shadelight[j];
-				}
-				cur->color[3] = alpha;
-			}
-		}
-
-		// translate triangle fan/strip to just triangle indices
-		if(type == GL_TRIANGLE_FAN)
-		{
-			GLushort i;
-			for(i=1; i < count-1; ++i)
-			{
-				GLushort* add = da_addn_uninit(idxBuf, 3);
-
-				add[0] = nextVtxIdx;
-				add[1] = nextVtxIdx+i;
-				add[2] = nextVtxIdx+i+1;
-			}
-		}
-		else // triangle strip
-		{
-			GLushort i;
-			for(i=1; i < count-2; i+=2)
-			{
-				// add two triangles at once, because the vertex order is different
-				// for odd vs even triangles
-				GLushort* add = da_addn_uninit(idxBuf, 6);
-
-				add[0] = nextVtxIdx + i-1;
-				add[1] = nextVtxIdx + i;
-				add[2] = nextVtxIdx + i+1;
+		qglVertexAttribPointer(GL3_ATTRIB_FRAMEVERT, 4, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(dtrivertx_t), ofs);
+		model->aliasFrame = entity->frame;
+	}
 
-				add[3] = nextVtxIdx + i;
-				add[4] = nextVtxIdx + i+2;
-				add[5] = nextVtxIdx + i+1;
-			}
-			// add remaining triangle, if any
-			if(i < count-1)
-			{
-				GLushort* add = da_addn_uninit(idxBuf, 3);
+	if (model->aliasOldFrame != entity->oldframe)
+	{
+		GLintptr ofs = model->aliasNumVerts * (2 * sizeof(GLfloat) + entity->oldframe * sizeof(dtrivertx_t));
 
-				add[0] = nextVtxIdx + i-1;
-				add[1] = nextVtxIdx + i;
-				add[2] = nextVtxIdx + i+1;
-			}
-		}
+		qglVertexAttribPointer(GL3_ATTRIB_OLDFRAMEVERT, 4, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(dtrivertx_t), ofs);
+		model->aliasOldFrame = entity->oldframe;
 	}
 
-	GL3_BindVAO(gl3state.vaoAlias);
-	GL3_BindVBO(gl3state.vboAlias);
-
-	glBufferData(GL_ARRAY_BUFFER, da_count(vtxBuf)*sizeof(gl3_alias_vtx_t), vtxBuf.p, GL_STREAM_DRAW);
-	GL3_BindEBO(gl3state.eboAlias);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, da_count(idxBuf)*sizeof(GLushort), idxBuf.p, GL_STREAM_DRAW);
-	glDrawElements(GL_TRIANGLES, da_count(idxBuf), GL_UNSIGNED_SHORT, NULL);
+	glDrawElements(GL_TRIANGLES, model->aliasNumIndices, GL_UNSIGNED_SHORT, NULL);
 }
 
 static void
@@ -963,7 +1141,7 @@ void GL3_DrawAliasShadows(void)
 	hmm_mat4 oldMat = gl3state.uni3DData.transModelMat4;
 
 	glEnable(GL_BLEND);
-	GL3_UseProgram(gl3state.si3DaliasColor.shaderProgram);
+	GL3_UseProgram(gl3state.si3DaliasShadow.shaderProgram);
 
 	if (gl3config.stencil)
 	{
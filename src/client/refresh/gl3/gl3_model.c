@@ -32,6 +32,7 @@ enum { MAX_MOD_KNOWN = 512 };
 YQ2_ALIGNAS_TYPE(int) static byte mod_novis[MAX_MAP_LEAFS / 8];
 gl3model_t mod_known[MAX_MOD_KNOWN];
 static int mod_numknown;
+static registry_t mod_reg = REG_INIT(mod_known, gl3model_t);
 static int mod_max = 0;
 int registration_sequence;
 
@@ -72,6 +73,11 @@ GL3_Mod_ClusterPVS(int cluster, const gl3model_t *model)
 		return mod_novis;
 	}
 
+	if (model->pvscache)
+	{
+		return Mod_CachedClusterPVS(model->pvscache, cluster);
+	}
+
 	return Mod_DecompressVis((byte *)model->vis +
 			model->vis->bitofs[cluster][DVIS_PVS],
 			(model->vis->numclusters + 7) >> 3);
@@ -242,12 +248,11 @@ Mod_CalcSurfaceExtents(gl3model_t *loadmodel, msurface_t *s)
 extern void
 GL3_SubdivideSurface(msurface_t *fa, gl3model_t* loadmodel);
 
-static int calcTexinfoAndFacesSize(byte *mod_base, const lump_t *fl, const lump_t *tl)
+static int calcTexinfoAndFacesSize(byte *mod_base, const dqface_t *face_in, int face_count, const lump_t *tl)
 {
-	dface_t* face_in = (void *)(mod_base + fl->fileofs);
 	texinfo_t* texinfo_in = (void *)(mod_base + tl->fileofs);
 
-	if (fl->filelen % sizeof(*face_in) || tl->filelen % sizeof(*texinfo_in))
+	if (tl->filelen % sizeof(*texinfo_in))
 	{
 		// will error out when actually loading it
 		return 0;
@@ -255,7 +260,6 @@ static int calcTexinfoAndFacesSize(byte *mod_base, const lump_t *fl, const lump_
 
 	int ret = 0;
 
-	int face_count = fl->filelen / sizeof(*face_in);
 	int texinfo_count = tl->filelen / sizeof(*texinfo_in);
 
 	{
@@ -273,8 +277,8 @@ static int calcTexinfoAndFacesSize(byte *mod_base, const lump_t *fl, const lump_
 
 	for (int surfnum = 0; surfnum < face_count; surfnum++, face_in++)
 	{
-		int numverts = LittleShort(face_in->numedges);
-		int ti = LittleShort(face_in->texinfo);
+		int numverts = face_in->numedges;
+		int ti = face_in->texinfo;
 		if ((ti < 0) || (ti >= texinfo_count))
 		{
 			return 0; // will error out
@@ -318,23 +322,13 @@ static int calcTexinfoAndFacesSize(byte *mod_base, const lump_t *fl, const lump_
 }
 
 static void
-Mod_LoadFaces(gl3model_t *loadmodel, byte *mod_base, lump_t *l)
+Mod_LoadFaces(gl3model_t *loadmodel, const dqface_t *in, int count)
 {
-	dface_t *in;
 	msurface_t *out;
-	int i, count, surfnum;
+	int i, surfnum;
 	int planenum, side;
 	int ti;
 
-	in = (void *)(mod_base + l->fileofs);
-
-	if (l->filelen % sizeof(*in))
-	{
-		ri.Sys_Error(ERR_DROP, "%s: funny lump size in %s",
-				__func__, loadmodel->name);
-	}
-
-	count = l->filelen / sizeof(*in);
 	out = Hunk_Alloc(count * sizeof(*out));
 
 	loadmodel->surfaces = out;
@@ -344,13 +338,13 @@ Mod_LoadFaces(gl3model_t *loadmodel, byte *mod_base, lump_t *l)
 
 	for (surfnum = 0; surfnum < count; surfnum++, in++, out++)
 	{
-		out->firstedge = LittleLong(in->firstedge);
-		out->numedges = LittleShort(in->numedges);
+		out->firstedge = in->firstedge;
+		out->numedges = in->numedges;
 		out->flags = 0;
 		out->polys = NULL;
 
-		planenum = LittleShort(in->planenum);
-		side = LittleShort(in->side);
+		planenum = in->planenum;
+		side = in->side;
 
 		if (side)
 		{
@@ -364,7 +358,7 @@ Mod_LoadFaces(gl3model_t *loadmodel, byte *mod_base, lump_t *l)
 		}
 		out->plane = loadmodel->planes + planenum;
 
-		ti = LittleShort(in->texinfo);
+		ti = in->texinfo;
 
 		if ((ti < 0) || (ti >= loadmodel->numtexinfo))
 		{
@@ -382,7 +376,7 @@ Mod_LoadFaces(gl3model_t *loadmodel, byte *mod_base, lump_t *l)
 			out->styles[i] = in->styles[i];
 		}
 
-		i = LittleLong(in->lightofs);
+		i = in->lightofs;
 
 		if (i == -1)
 		{
@@ -431,21 +425,11 @@ Mod_LoadFaces(gl3model_t *loadmodel, byte *mod_base, lump_t *l)
 }
 
 static void
-Mod_LoadLeafs(gl3model_t *loadmodel, byte *mod_base, lump_t *l)
+Mod_LoadLeafs(gl3model_t *loadmodel, const dqleaf_t *in, int count)
 {
-	dleaf_t *in;
 	mleaf_t *out;
-	int i, j, count, p;
-
-	in = (void *)(mod_base + l->fileofs);
-
-	if (l->filelen % sizeof(*in))
-	{
-		ri.Sys_Error(ERR_DROP, "%s: funny lump size in %s",
-				__func__, loadmodel->name);
-	}
+	int i, j, p;
 
-	count = l->filelen / sizeof(*in);
 	out = Hunk_Alloc(count * sizeof(*out));
 
 	loadmodel->leafs = out;
@@ -457,19 +441,18 @@ Mod_LoadLeafs(gl3model_t *loadmodel, byte *mod_base, lump_t *l)
 
 		for (j = 0; j < 3; j++)
 		{
-			out->minmaxs[j] = LittleShort(in->mins[j]);
-			out->minmaxs[3 + j] = LittleShort(in->maxs[j]);
+			out->minmaxs[j] = in->mins[j];
+			out->minmaxs[3 + j] = in->maxs[j];
 		}
 
-		p = LittleLong(in->contents);
+		p = in->contents;
 		out->contents = p;
 
-		out->cluster = LittleShort(in->cluster);
-		out->area = LittleShort(in->area);
+		out->cluster = in->cluster;
+		out->area = in->area;
 
-		// make unsigned long from signed short
-		firstleafface = LittleShort(in->firstleafface) & 0xFFFF;
-		out->nummarksurfaces = LittleShort(in->numleaffaces) & 0xFFFF;
+		firstleafface = in->firstleafface;
+		out->nummarksurfaces = in->numleaffaces;
 
 		out->firstmarksurface = loadmodel->marksurfaces + firstleafface;
 		if ((firstleafface + out->nummarksurfaces) > loadmodel->nummarksurfaces)
@@ -481,21 +464,11 @@ Mod_LoadLeafs(gl3model_t *loadmodel, byte *mod_base, lump_t *l)
 }
 
 static void
-Mod_LoadMarksurfaces(gl3model_t *loadmodel, byte *mod_base, lump_t *l)
+Mod_LoadMarksurfaces(gl3model_t *loadmodel, const unsigned int *in, int count)
 {
-	int i, j, count;
-	short *in;
+	int i, j;
 	msurface_t **out;
 
-	in = (void *)(mod_base + l->fileofs);
-
-	if (l->filelen % sizeof(*in))
-	{
-		ri.Sys_Error(ERR_DROP, "%s: funny lump size in %s",
-				__func__, loadmodel->name);
-	}
-
-	count = l->filelen / sizeof(*in);
 	out = Hunk_Alloc(count * sizeof(*out));
 
 	loadmodel->marksurfaces = out;
@@ -503,7 +476,7 @@ Mod_LoadMarksurfaces(gl3model_t *loadmodel, byte *mod_base, lump_t *l)
 
 	for (i = 0; i < count; i++)
 	{
-		j = LittleShort(in[i]);
+		j = in[i];
 
 		if ((j < 0) || (j >= loadmodel->numsurfaces))
 		{
@@ -520,6 +493,13 @@ Mod_LoadBrushModel(gl3model_t *mod, void *buffer, int modfilelen)
 	int i;
 	dheader_t *header;
 	byte *mod_base;
+	dqface_t *faces;
+	dqleaf_t *leafs;
+	dqnode_t *nodes;
+	dqedge_t *edges;
+	unsigned int *leaffaces;
+	int numfaces, numleafs, numnodes, numedges, numleaffaces;
+	qboolean qbsp;
 
 	if (mod != mod_known)
 	{
@@ -528,6 +508,9 @@ Mod_LoadBrushModel(gl3model_t *mod, void *buffer, int modfilelen)
 
 	header = (dheader_t *)buffer;
 
+	/* QBSP maps have the same version, but wider lumps */
+	qbsp = (LittleLong(header->ident) == QBSPHEADER);
+
 	i = LittleLong(header->version);
 
 	if (i != BSPVERSION)
@@ -544,21 +527,32 @@ Mod_LoadBrushModel(gl3model_t *mod, void *buffer, int modfilelen)
 		((int *)header)[i] = LittleLong(((int *)header)[i]);
 	}
 
+
+	/* the lumps that differ, in the QBSP layout for both */
+	faces = Mod_LoadQBSPLump(mod->name, mod_base, &header->lumps[LUMP_FACES],
+		LUMP_FACES, qbsp, &numfaces);
+	leaffaces = Mod_LoadQBSPLump(mod->name, mod_base, &header->lumps[LUMP_LEAFFACES],
+		LUMP_LEAFFACES, qbsp, &numleaffaces);
+	leafs = Mod_LoadQBSPLump(mod->name, mod_base, &header->lumps[LUMP_LEAFS],
+		LUMP_LEAFS, qbsp, &numleafs);
+	nodes = Mod_LoadQBSPLump(mod->name, mod_base, &header->lumps[LUMP_NODES],
+		LUMP_NODES, qbsp, &numnodes);
+	edges = Mod_LoadQBSPLump(mod->name, mod_base, &header->lumps[LUMP_EDGES],
+		LUMP_EDGES, qbsp, &numedges);
+
 	// calculate the needed hunksize from the lumps
 	int hunkSize = 0;
 	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_VERTEXES], sizeof(dvertex_t), sizeof(mvertex_t), 0);
-	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_EDGES], sizeof(dedge_t), sizeof(medge_t), 0);
+	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_EDGES], qbsp ? sizeof(dqedge_t) : sizeof(dedge_t), sizeof(medge_t), 0);
 	hunkSize += sizeof(medge_t) + 31; // for count+1 in Mod_LoadEdges()
-	int surfEdgeCount = (header->lumps[LUMP_SURFEDGES].filelen+sizeof(int)-1)/sizeof(int);
-	if(surfEdgeCount < MAX_MAP_SURFEDGES) // else it errors out later anyway
-		hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_SURFEDGES], sizeof(int), sizeof(int), 0);
+	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_SURFEDGES], sizeof(int), sizeof(int), 0);
 	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_LIGHTING], 1, 1, 0);
 	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_PLANES], sizeof(dplane_t), sizeof(cplane_t)*2, 0);
-	hunkSize += calcTexinfoAndFacesSize(mod_base, &header->lumps[LUMP_FACES], &header->lumps[LUMP_TEXINFO]);
-	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_LEAFFACES], sizeof(short), sizeof(msurface_t *), 0); // yes, out is indeed a pointer!
+	hunkSize += calcTexinfoAndFacesSize(mod_base, faces, numfaces, &header->lumps[LUMP_TEXINFO]);
+	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_LEAFFACES], qbsp ? sizeof(int) : sizeof(short), sizeof(msurface_t *), 0); // yes, out is indeed a pointer!
 	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_VISIBILITY], 1, 1, 0);
-	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_LEAFS], sizeof(dleaf_t), sizeof(mleaf_t), 0);
-	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_NODES], sizeof(dnode_t), sizeof(mnode_t), 0);
+	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_LEAFS], qbsp ? sizeof(dqleaf_t) : sizeof(dleaf_t), sizeof(mleaf_t), 0);
+	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_NODES], qbsp ? sizeof(dqnode_t) : sizeof(dnode_t), sizeof(mnode_t), 0);
 	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_MODELS], sizeof(dmodel_t), sizeof(gl3model_t), 0);
 
 	mod->extradata = Hunk_Begin(hunkSize);
@@ -568,7 +562,7 @@ Mod_LoadBrushModel(gl3model_t *mod, void *buffer, int modfilelen)
 	Mod_LoadVertexes(mod->name, &mod->vertexes, &mod->numvertexes, mod_base,
 		&header->lumps[LUMP_VERTEXES], 0);
 	Mod_LoadEdges(mod->name, &mod->edges, &mod->numedges,
-		mod_base, &header->lumps[LUMP_EDGES], 1);
+		edges, numedges, 1);
 	Mod_LoadSurfedges(mod->name, &mod->surfedges, &mod->numsurfedges,
 		mod_base, &header->lumps[LUMP_SURFEDGES], 0);
 	Mod_LoadLighting(&mod->lightdata, mod_base, &header->lumps[LUMP_LIGHTING]);
@@ -577,20 +571,30 @@ Mod_LoadBrushModel(gl3model_t *mod, void *buffer, int modfilelen)
 	Mod_LoadTexinfo (mod->name, &mod->texinfo, &mod->numtexinfo,
 		mod_base, &header->lumps[LUMP_TEXINFO], (findimage_t)GL3_FindImage,
 		gl3_notexture, 0);
-	Mod_LoadFaces(mod, mod_base, &header->lumps[LUMP_FACES]);
-	Mod_LoadMarksurfaces(mod, mod_base, &header->lumps[LUMP_LEAFFACES]);
+	Mod_LoadFaces(mod, faces, numfaces);
+	Mod_LoadMarksurfaces(mod, leaffaces, numleaffaces);
 	Mod_LoadVisibility(&mod->vis, mod_base, &header->lumps[LUMP_VISIBILITY]);
-	Mod_LoadLeafs(mod, mod_base, &header->lumps[LUMP_LEAFS]);
+	Mod_LoadLeafs(mod, leafs, numleafs);
 	Mod_LoadNodes(mod->name, mod->planes, mod->numplanes, mod->leafs,
-		mod->numleafs, &mod->nodes, &mod->numnodes, mod_base,
-		&header->lumps[LUMP_NODES]);
+		mod->numleafs, &mod->nodes, &mod->numnodes, nodes,
+		numnodes);
 	Mod_LoadSubmodels (mod, mod_base, &header->lumps[LUMP_MODELS]);
+
+	Mod_FreeQBSPLumps();
 	mod->numframes = 2; /* regular and alternate animation */
+
+	mod->pvscache = Mod_CreatePVSCache(mod->vis, mod->leafs, mod->numleafs);
+
+	GL3_CreateBrushBuffers(mod);
 }
 
 static void
 Mod_Free(gl3model_t *mod)
 {
+	Reg_Remove(&mod_reg, mod - mod_known);
+	GL3_FreeAliasBuffers(mod);
+	GL3_FreeBrushBuffers(mod);
+	Mod_FreePVSCache(mod->pvscache);
 	Hunk_Free(mod->extradata);
 	memset(mod, 0, sizeof(*mod));
 }
@@ -607,6 +611,16 @@ GL3_Mod_FreeAll(void)
 			Mod_Free(&mod_known[i]);
 		}
 	}
+
+	Reg_Clear(&mod_reg);
+	Mod_FreeQBSPLumps();
+}
+
+static void
+Mod_FreeUnused(int handle)
+{
+	/* don't need this model */
+	Mod_Free(&mod_known[handle]);
 }
 
 /*
@@ -639,23 +653,19 @@ Mod_ForName (char *name, gl3model_t *parent_model, qboolean crash)
 	}
 
 	/* search the currently loaded models */
-	for (i = 0, mod = mod_known; i < mod_numknown; i++, mod++)
-	{
-		if (!mod->name[0])
-		{
-			continue;
-		}
+	i = Reg_Find(&mod_reg, name);
 
-		if (!strcmp(mod->name, name))
-		{
-			return mod;
-		}
+	if (i >= 0)
+	{
+		return &mod_known[i];
 	}
 
-	/* find a free model slot spot */
+	/* find a free model slot spot. A load that errored
+	   out left its name behind, but never finished its
+	   hunk or got registered, so that's free too */
 	for (i = 0, mod = mod_known; i < mod_numknown; i++, mod++)
 	{
-		if (!mod->name[0])
+		if (!mod->name[0] || !mod->extradatasize)
 		{
 			break; /* free spot */
 		}
@@ -671,6 +681,7 @@ Mod_ForName (char *name, gl3model_t *parent_model, qboolean crash)
 		mod_numknown++;
 	}
 
+	memset(mod, 0, sizeof(*mod));
 	strcpy(mod->name, name);
 
 	/* load the file */
@@ -702,6 +713,8 @@ Mod_ForName (char *name, gl3model_t *parent_model, qboolean crash)
 					ri.Sys_Error(ERR_DROP, "%s: Failed to load %s",
 						__func__, mod->name);
 				}
+
+				GL3_CreateAliasBuffers(mod);
 			};
 			break;
 
@@ -719,6 +732,7 @@ Mod_ForName (char *name, gl3model_t *parent_model, qboolean crash)
 			break;
 
 		case IDBSPHEADER:
+		case QBSPHEADER:
 			Mod_LoadBrushModel(mod, buf, modfilelen);
 			break;
 
@@ -729,6 +743,7 @@ Mod_ForName (char *name, gl3model_t *parent_model, qboolean crash)
 	}
 
 	mod->extradatasize = Hunk_End();
+	Reg_Add(&mod_reg, mod - mod_known);
 
 	ri.FS_FreeFile(buf);
 
@@ -801,28 +816,13 @@ GL3_RegisterModel(char *name)
 void
 GL3_EndRegistration(void)
 {
-	int i;
-	gl3model_t *mod;
-
 	if (Mod_HasFreeSpace() && GL3_ImageHasFreeSpace())
 	{
 		// should be enough space for load next maps
 		return;
 	}
 
-	for (i = 0, mod = mod_known; i < mod_numknown; i++, mod++)
-	{
-		if (!mod->name[0])
-		{
-			continue;
-		}
-
-		if (mod->registration_sequence != registration_sequence)
-		{
-			/* don't need this model */
-			Mod_Free(mod);
-		}
-	}
+	Reg_Purge(&mod_reg, registration_sequence, Mod_FreeUnused);
 
 	GL3_FreeUnusedImages();
 }
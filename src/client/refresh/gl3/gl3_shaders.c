@@ -117,6 +117,8 @@ CreateShaderProgram(int numShaders, const GLuint* shaders)
 	glBindAttribLocation(shaderProgram, GL3_ATTRIB_COLOR, "vertColor");
 	glBindAttribLocation(shaderProgram, GL3_ATTRIB_NORMAL, "normal");
 	glBindAttribLocation(shaderProgram, GL3_ATTRIB_LIGHTFLAGS, "lightFlags");
+	glBindAttribLocation(shaderProgram, GL3_ATTRIB_FRAMEVERT, "frameVert");
+	glBindAttribLocation(shaderProgram, GL3_ATTRIB_OLDFRAMEVERT, "oldFrameVert");
 
 	// the following line is not necessary/implicit (as there's only one output)
 	// glBindFragDataLocation(shaderProgram, 0, "outColor"); XXX would this even be here?
@@ -776,6 +778,41 @@ static const char* vertexSrcAlias = MULTILINE_STRING(
 
 		// it gets attributes and uniforms from vertexCommon3D
 
+		in vec4 frameVert;    // GL3_ATTRIB_FRAMEVERT, dtrivertx_t as (x, y, z, lightnormalindex)
+		in vec4 oldFrameVert; // GL3_ATTRIB_OLDFRAMEVERT
+
+		// rgb: r_avertexnormals[x], a: r_avertexnormal_dots[y][x]
+		// (highp, because GLES3 defaults to lowp samplers in vertex shaders)
+		uniform highp sampler2D normalTable;
+
+		// [0]: move, shell scale; [1]: frontv, shadedots row;
+		// [2]: backv, unused; [3]: shadelight, alpha
+		uniform vec4 aliasParams[4];
+
+		out vec4 passColor;
+
+		void main()
+		{
+			vec4 normalDot = texelFetch(normalTable, ivec2(int(frameVert.w), int(aliasParams[1].w)), 0);
+			float shellScale = aliasParams[0].w;
+
+			// same as LerpVerts() in the other renderers
+			vec3 pos = aliasParams[0].xyz + oldFrameVert.xyz * aliasParams[2].xyz
+			         + frameVert.xyz * aliasParams[1].xyz + normalDot.xyz * shellScale;
+
+			// shells are drawn in a flat color
+			float l = (shellScale > 0.0) ? 1.0 : normalDot.a;
+
+			passColor = vec4(aliasParams[3].rgb * l, aliasParams[3].a) * overbrightbits;
+			passTexCoord = texCoord;
+			gl_Position = transProjView * transModel * vec4(pos, 1.0);
+		}
+);
+
+static const char* vertexSrcAliasShadow = MULTILINE_STRING(
+
+		// it gets attributes and uniforms from vertexCommon3D
+
 		out vec4 passColor;
 
 		void main()
@@ -913,6 +950,7 @@ initShader2D(gl3ShaderInfo_t* shaderInfo, const char* vertSrc, const char* fragS
 	shaderInfo->shaderProgram = 0;
 	shaderInfo->uniLmScalesOrTime = -1;
 	shaderInfo->uniVblend = -1;
+	shaderInfo->uniAliasParams = -1;
 
 	shaders2D[0] = CompileShader(GL_VERTEX_SHADER, vertSrc, NULL);
 	if(shaders2D[0] == 0)  return false;
@@ -1016,6 +1054,7 @@ initShader3D(gl3ShaderInfo_t* shaderInfo, const char* vertSrc, const char* fragS
 	shaderInfo->shaderProgram = 0;
 	shaderInfo->uniLmScalesOrTime = -1;
 	shaderInfo->uniVblend = -1;
+	shaderInfo->uniAliasParams = -1;
 
 	shaders3D[0] = CompileShader(GL_VERTEX_SHADER, vertexCommon3D, vertSrc);
 	if(shaders3D[0] == 0)  return false;
@@ -1114,6 +1153,15 @@ initShader3D(gl3ShaderInfo_t* shaderInfo, const char* vertSrc, const char* fragS
 		}
 	}
 
+	// .. and the normal table of the model shaders uses GL_TEXTURE5
+	GLint normalTableLoc = glGetUniformLocation(prog, "normalTable");
+	if(normalTableLoc != -1)
+	{
+		glUniform1i(normalTableLoc, 5);
+	}
+
+	shaderInfo->uniAliasParams = glGetUniformLocation(prog, "aliasParams");
+
 	GLint lmScalesLoc = glGetUniformLocation(prog, "lmScales");
 	shaderInfo->uniLmScalesOrTime = lmScalesLoc;
 	if(lmScalesLoc != -1)
@@ -1276,6 +1324,11 @@ static qboolean createShaders(void)
 		R_Printf(PRINT_ALL, "WARNING: Failed to create shader program for rendering flat-colored models!\n");
 		return false;
 	}
+	if(!initShader3D(&gl3state.si3DaliasShadow, vertexSrcAliasShadow, fragmentSrcAliasColor))
+	{
+		R_Printf(PRINT_ALL, "WARNING: Failed to create shader program for rendering model shadows!\n");
+		return false;
+	}
 
 	const char* particleFrag = fragmentSrcParticles;
 	if(gl3_particle_square->value != 0.0f)
@@ -30,8 +30,11 @@
 
 #include "header/local.h"
 
+#include "header/DG_dynarr.h"
+
 int c_visible_lightmaps;
 int c_visible_textures;
+int c_world_draws;
 static vec3_t modelorg; /* relative to viewpoint */
 static msurface_t *gl3_alpha_surfaces;
 
@@ -42,6 +45,23 @@ gl3lightmapstate_t gl3_lms;
 extern gl3image_t gl3textures[MAX_GL3TEXTURES];
 extern int numgl3textures;
 
+// world surfaces of one texture that can be drawn with a single draw call
+typedef struct
+{
+	int lightmap;
+	byte styles[MAX_LIGHTMAPS_PER_SURFACE];
+	qboolean flowing;
+	msurface_t *surfaces; // chained through msurface_t::batchchain
+} gl3worldbatch_t;
+
+DA_TYPEDEF(gl3worldbatch_t, WorldBatchArray_t);
+DA_TYPEDEF(GLsizei, SizeiArray_t);
+DA_TYPEDEF(GLintptr, IntptrArray_t);
+// reused for each frame so we don't have to malloc()/free() all the time
+static WorldBatchArray_t worldBatches = {0};
+static SizeiArray_t batchCounts = {0};
+static IntptrArray_t batchOffsets = {0};
+
 void GL3_SurfInit(void)
 {
 	// init the VAO and VBO for the standard vertexdata: 10 floats and 1 uint
@@ -130,6 +150,189 @@ void GL3_SurfShutdown(void)
 	gl3state.vboAlias = 0;
 	glDeleteVertexArrays(1, &gl3state.vaoAlias);
 	gl3state.vaoAlias = 0;
+
+	da_free(worldBatches);
+	da_free(batchCounts);
+	da_free(batchOffsets);
+}
+
+static qboolean
+SurfaceIsBatchable(const msurface_t *surf)
+{
+	// same as the ones RenderBrushPoly() draws with a lightmap
+	return surf->polys && !(surf->flags & SURF_DRAWTURB) &&
+		!(surf->texinfo->flags & (SURF_SKY | SURF_TRANS33 | SURF_TRANS66 | SURF_WARP));
+}
+
+static int
+SurfaceBufferOrder(const void *a, const void *b)
+{
+	const msurface_t *sa = *(const msurface_t **)a;
+	const msurface_t *sb = *(const msurface_t **)b;
+
+	if (sa->texinfo->image != sb->texinfo->image)
+	{
+		return (sa->texinfo->image < sb->texinfo->image) ? -1 : 1;
+	}
+
+	if (sa->lightmaptexturenum != sb->lightmaptexturenum)
+	{
+		return sa->lightmaptexturenum - sb->lightmaptexturenum;
+	}
+
+	return memcmp(sa->styles, sb->styles, sizeof(sa->styles));
+}
+
+/*
+ * Uploads the polygons of all lightmapped surfaces of a brush model into
+ * a static VBO, with an index buffer of triangles. Surfaces are ordered
+ * by texture, lightmap and lightstyles, so surfaces drawn together by
+ * DrawWorldBatch() are often next to each other in the index buffer.
+ */
+void
+GL3_CreateBrushBuffers(gl3model_t *mod)
+{
+	msurface_t **sorted;
+	gl3_3D_vtx_t *verts;
+	GLuint *indices;
+	int numSorted, numVerts, numIndices;
+	int i, j;
+
+	sorted = malloc(mod->numsurfaces * sizeof(msurface_t *));
+
+	if (!sorted)
+	{
+		ri.Sys_Error(ERR_FATAL, "%s: Couldn't malloc surface list for %s",
+				__func__, mod->name);
+		return;
+	}
+
+	numSorted = numVerts = numIndices = 0;
+
+	for (i = 0; i < mod->numsurfaces; i++)
+	{
+		msurface_t *surf = &mod->surfaces[i];
+
+		surf->firstIndex = -1;
+		surf->numIndices = 0;
+		surf->batchchain = NULL;
+
+		if (SurfaceIsBatchable(surf) && (surf->polys->numverts >= 3))
+		{
+			sorted[numSorted++] = surf;
+			numVerts += surf->polys->numverts;
+			numIndices += (surf->polys->numverts - 2) * 3;
+		}
+	}
+
+	if (!numSorted)
+	{
+		free(sorted);
+		return;
+	}
+
+	qsort(sorted, numSorted, sizeof(msurface_t *), SurfaceBufferOrder);
+
+	verts = malloc(numVerts * sizeof(gl3_3D_vtx_t));
+	indices = malloc(numIndices * sizeof(GLuint));
+
+	if (!verts || !indices)
+	{
+		ri.Sys_Error(ERR_FATAL, "%s: Couldn't malloc vertex data for %s",
+				__func__, mod->name);
+		return;
+	}
+
+	numVerts = numIndices = 0;
+
+	for (i = 0; i < numSorted; i++)
+	{
+		msurface_t *surf = sorted[i];
+		glpoly_t *p = surf->polys;
+
+		memcpy(&verts[numVerts], p->vertices, p->numverts * sizeof(gl3_3D_vtx_t));
+
+		// dynamic lights are handled by drawing the surface the old way
+		for (j = 0; j < p->numverts; j++)
+		{
+			verts[numVerts + j].lightFlags = 0;
+		}
+
+		surf->firstIndex = numIndices;
+		surf->numIndices = (p->numverts - 2) * 3;
+
+		// triangle fan to triangles
+		for (j = 1; j < p->numverts - 1; j++)
+		{
+			indices[numIndices++] = numVerts;
+			indices[numIndices++] = numVerts + j;
+			indices[numIndices++] = numVerts + j + 1;
+		}
+
+		numVerts += p->numverts;
+	}
+
+	glGenVertexArrays(1, &mod->brushVAO);
+	GL3_BindVAO(mod->brushVAO);
+
+	glGenBuffers(1, &mod->brushVBO);
+	GL3_BindVBO(mod->brushVBO);
+	glBufferData(GL_ARRAY_BUFFER, numVerts * sizeof(gl3_3D_vtx_t), verts, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &mod->brushEBO);
+	GL3_BindEBO(mod->brushEBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(GLuint), indices, GL_STATIC_DRAW);
+
+	// same layout as vao3D
+	glEnableVertexAttribArray(GL3_ATTRIB_POSITION);
+	qglVertexAttribPointer(GL3_ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(gl3_3D_vtx_t), 0);
+
+	glEnableVertexAttribArray(GL3_ATTRIB_TEXCOORD);
+	qglVertexAttribPointer(GL3_ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE, sizeof(gl3_3D_vtx_t), offsetof(gl3_3D_vtx_t, texCoord));
+
+	glEnableVertexAttribArray(GL3_ATTRIB_LMTEXCOORD);
+	qglVertexAttribPointer(GL3_ATTRIB_LMTEXCOORD, 2, GL_FLOAT, GL_FALSE, sizeof(gl3_3D_vtx_t), offsetof(gl3_3D_vtx_t, lmTexCoord));
+
+	glEnableVertexAttribArray(GL3_ATTRIB_NORMAL);
+	qglVertexAttribPointer(GL3_ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(gl3_3D_vtx_t), offsetof(gl3_3D_vtx_t, normal));
+
+	glEnableVertexAttribArray(GL3_ATTRIB_LIGHTFLAGS);
+	qglVertexAttribIPointer(GL3_ATTRIB_LIGHTFLAGS, 1, GL_UNSIGNED_INT, sizeof(gl3_3D_vtx_t), offsetof(gl3_3D_vtx_t, lightFlags));
+
+	free(indices);
+	free(verts);
+	free(sorted);
+}
+
+void
+GL3_FreeBrushBuffers(gl3model_t *mod)
+{
+	if (mod->brushVAO == 0)
+	{
+		return;
+	}
+
+	// deleted names get reused, so they mustn't be remembered as bound
+	if (gl3state.currentVAO == mod->brushVAO)
+	{
+		gl3state.currentVAO = 0;
+	}
+
+	if (gl3state.currentVBO == mod->brushVBO)
+	{
+		gl3state.currentVBO = 0;
+	}
+
+	if (gl3state.currentEBO == mod->brushEBO)
+	{
+		gl3state.currentEBO = 0;
+	}
+
+	glDeleteBuffers(1, &mod->brushEBO);
+	glDeleteBuffers(1, &mod->brushVBO);
+	glDeleteVertexArrays(1, &mod->brushVAO);
+
+	mod->brushVAO = mod->brushVBO = mod->brushEBO = 0;
 }
 
 static void
@@ -175,14 +378,11 @@ GL3_DrawGLPoly(msurface_t *fa)
 	GL3_BufferAndDraw3D(p->vertices, p->numverts, GL_TRIANGLE_FAN);
 }
 
-void
-GL3_DrawGLFlowingPoly(msurface_t *fa)
+static void
+UpdateFlowingScroll(void)
 {
-	glpoly_t *p;
 	float scroll;
 
-	p = fa->polys;
-
 	scroll = -64.0f * ((gl3_newrefdef.time / 40.0f) - (int)(gl3_newrefdef.time / 40.0f));
 
 	if (scroll == 0.0f)
@@ -195,6 +395,16 @@ GL3_DrawGLFlowingPoly(msurface_t *fa)
 		gl3state.uni3DData.scroll = scroll;
 		GL3_UpdateUBO3D();
 	}
+}
+
+void
+GL3_DrawGLFlowingPoly(msurface_t *fa)
+{
+	glpoly_t *p;
+
+	p = fa->polys;
+
+	UpdateFlowingScroll();
 
 	GL3_BindVAO(gl3state.vao3D);
 	GL3_BindVBO(gl3state.vbo3D);
@@ -400,14 +610,153 @@ GL3_DrawAlphaSurfaces(void)
 	gl3_alpha_surfaces = NULL;
 }
 
+/*
+ * Adds a world surface to the batch for its texture (the caller
+ * collects one texture at a time), lightmap and lightstyles.
+ * Returns false if it has to be drawn with RenderBrushPoly().
+ */
+static qboolean
+AddToWorldBatch(msurface_t *surf)
+{
+	gl3worldbatch_t *batch;
+	qboolean flowing;
+	int i;
+
+	if ((surf->firstIndex < 0) || !gl3_worldmodel->brushVAO)
+	{
+		return false;
+	}
+
+	// dynamic lights need per-frame lightFlags in the vertices
+	if ((surf->dlightframe == gl3_framecount) && surf->dlightbits)
+	{
+		return false;
+	}
+
+	flowing = (surf->texinfo->flags & SURF_FLOWING) != 0;
+
+	for (i = 0; i < da_count(worldBatches); i++)
+	{
+		batch = &worldBatches.p[i];
+
+		if ((batch->lightmap == surf->lightmaptexturenum) && (batch->flowing == flowing) &&
+			!memcmp(batch->styles, surf->styles, sizeof(batch->styles)))
+		{
+			break;
+		}
+	}
+
+	if (i == da_count(worldBatches))
+	{
+		batch = da_addn_uninit(worldBatches, 1);
+
+		batch->lightmap = surf->lightmaptexturenum;
+		batch->flowing = flowing;
+		memcpy(batch->styles, surf->styles, sizeof(batch->styles));
+		batch->surfaces = NULL;
+	}
+
+	surf->batchchain = batch->surfaces;
+	batch->surfaces = surf;
+
+	return true;
+}
+
+/*
+ * Draws all surfaces of a batch from the static world VBO
+ * with one draw call, the texture must already be bound.
+ */
+static void
+DrawWorldBatch(gl3worldbatch_t *batch)
+{
+	gl3ShaderInfo_t *si;
+	msurface_t *s;
+	int map;
+
+	hmm_vec4 lmScales[MAX_LIGHTMAPS_PER_SURFACE] = {0};
+	lmScales[0] = HMM_Vec4(1.0f, 1.0f, 1.0f, 1.0f);
+
+	for (map = 0; map < MAX_LIGHTMAPS_PER_SURFACE && batch->styles[map] != 255; map++)
+	{
+		lmScales[map].R = gl3_newrefdef.lightstyles[batch->styles[map]].rgb[0];
+		lmScales[map].G = gl3_newrefdef.lightstyles[batch->styles[map]].rgb[1];
+		lmScales[map].B = gl3_newrefdef.lightstyles[batch->styles[map]].rgb[2];
+		lmScales[map].A = 1.0f;
+	}
+
+	GL3_BindLightmap(batch->lightmap);
+
+	if (batch->flowing)
+	{
+		si = &gl3state.si3DlmFlow;
+		UpdateFlowingScroll();
+	}
+	else
+	{
+		si = &gl3state.si3Dlm;
+	}
+
+	GL3_UseProgram(si->shaderProgram);
+	UpdateLMscales(lmScales, si);
+
+	da_clear(batchCounts);
+	da_clear(batchOffsets);
+
+	for (s = batch->surfaces; s != NULL; s = s->batchchain)
+	{
+		int last = da_count(batchCounts) - 1;
+
+		c_brush_polys++;
+
+		// merge with the previous range if they're adjacent in the index buffer
+		if (last >= 0)
+		{
+			GLintptr lastFirst = batchOffsets.p[last] / sizeof(GLuint);
+
+			if (lastFirst + batchCounts.p[last] == s->firstIndex)
+			{
+				batchCounts.p[last] += s->numIndices;
+				continue;
+			}
+			else if (s->firstIndex + s->numIndices == lastFirst)
+			{
+				batchOffsets.p[last] = s->firstIndex * sizeof(GLuint);
+				batchCounts.p[last] += s->numIndices;
+				continue;
+			}
+		}
+
+		da_push(batchCounts, s->numIndices);
+		da_push(batchOffsets, s->firstIndex * sizeof(GLuint));
+	}
+
+	GL3_BindVAO(gl3_worldmodel->brushVAO);
+
+#ifdef YQ2_GL3_GLES3
+	// no glMultiDrawElements() in GLES3, but at least
+	// there's no vertex upload and no state change
+	for (map = 0; map < da_count(batchCounts); map++)
+	{
+		glDrawElements(GL_TRIANGLES, batchCounts.p[map], GL_UNSIGNED_INT,
+				(const void *)batchOffsets.p[map]);
+		c_world_draws++;
+	}
+#else
+	glMultiDrawElements(GL_TRIANGLES, batchCounts.p, GL_UNSIGNED_INT,
+			(const void * const *)batchOffsets.p, da_count(batchCounts));
+	c_world_draws++;
+#endif
+}
+
 static void
 DrawTextureChains(entity_t *currententity)
 {
-	int i;
+	int i, j;
 	msurface_t *s;
 	gl3image_t *image;
 
 	c_visible_textures = 0;
+	c_world_draws = 0;
 
 	for (i = 0, image = gl3textures; i < numgl3textures; i++, image++)
 	{
@@ -425,10 +774,26 @@ DrawTextureChains(entity_t *currententity)
 
 		c_visible_textures++;
 
+		da_clear(worldBatches);
+
 		for ( ; s; s = s->texturechain)
 		{
-			SetLightFlags(s);
-			RenderBrushPoly(currententity, s);
+			if (!AddToWorldBatch(s))
+			{
+				SetLightFlags(s);
+				RenderBrushPoly(currententity, s);
+				c_world_draws++;
+			}
+		}
+
+		if (da_count(worldBatches))
+		{
+			GL3_Bind(image->texnum);
+
+			for (j = 0; j < da_count(worldBatches); j++)
+			{
+				DrawWorldBatch(&worldBatches.p[j]);
+			}
 		}
 
 		image->texturechain = NULL;
@@ -794,12 +1159,7 @@ GL3_DrawWorld(void)
 void
 GL3_MarkLeaves(void)
 {
-	const byte *vis;
-	YQ2_ALIGNAS_TYPE(int) byte fatvis[MAX_MAP_LEAFS / 8];
-	mnode_t *node;
-	int i, c;
-	mleaf_t *leaf;
-	int cluster;
+	int i;
 
 	if ((gl3_oldviewcluster == gl3_viewcluster) &&
 		(gl3_oldviewcluster2 == gl3_viewcluster2) &&
@@ -820,7 +1180,7 @@ GL3_MarkLeaves(void)
 	gl3_oldviewcluster = gl3_viewcluster;
 	gl3_oldviewcluster2 = gl3_viewcluster2;
 
-	if (r_novis->value || (gl3_viewcluster == -1) || !gl3_worldmodel->vis)
+	if (r_novis->value || (gl3_viewcluster == -1) || !gl3_worldmodel->pvscache)
 	{
 		/* mark everything */
 		for (i = 0; i < gl3_worldmodel->numleafs; i++)
@@ -836,50 +1196,7 @@ GL3_MarkLeaves(void)
 		return;
 	}
 
-	vis = GL3_Mod_ClusterPVS(gl3_viewcluster, gl3_worldmodel);
-
-	/* may have to combine two clusters because of solid water boundaries */
-	if (gl3_viewcluster2 != gl3_viewcluster)
-	{
-		memcpy(fatvis, vis, (gl3_worldmodel->numleafs + 7) / 8);
-		vis = GL3_Mod_ClusterPVS(gl3_viewcluster2, gl3_worldmodel);
-		c = (gl3_worldmodel->numleafs + 31) / 32;
-
-		for (i = 0; i < c; i++)
-		{
-			((int *)fatvis)[i] |= ((int *)vis)[i];
-		}
-
-		vis = fatvis;
-	}
-
-	for (i = 0, leaf = gl3_worldmodel->leafs;
-		 i < gl3_worldmodel->numleafs;
-		 i++, leaf++)
-	{
-		cluster = leaf->cluster;
-
-		if (cluster == -1)
-		{
-			continue;
-		}
-
-		if (vis[cluster >> 3] & (1 << (cluster & 7)))
-		{
-			node = (mnode_t *)leaf;
-
-			do
-			{
-				if (node->visframe == gl3_visframecount)
-				{
-					break;
-				}
-
-				node->visframe = gl3_visframecount;
-				node = node->parent;
-			}
-			while (node);
-		}
-	}
+	Mod_MarkVisibleLeaves(gl3_worldmodel->pvscache, gl3_viewcluster,
+		gl3_viewcluster2, gl3_visframecount);
 }
 
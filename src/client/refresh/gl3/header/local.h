@@ -91,7 +91,9 @@ enum {
 	GL3_ATTRIB_LMTEXCOORD = 2, // for lightmap
 	GL3_ATTRIB_COLOR      = 3, // per-vertex color
 	GL3_ATTRIB_NORMAL     = 4, // vertex normal
-	GL3_ATTRIB_LIGHTFLAGS = 5  // uint, each set bit means "dyn light i affects this surface"
+	GL3_ATTRIB_LIGHTFLAGS = 5, // uint, each set bit means "dyn light i affects this surface"
+	GL3_ATTRIB_FRAMEVERT  = 6, // dtrivertx_t of the current frame of a model
+	GL3_ATTRIB_OLDFRAMEVERT = 7 // dtrivertx_t of the old frame of a model
 };
 
 // always using RGBA now, GLES3 on RPi4 doesn't work otherwise
@@ -132,6 +134,7 @@ typedef struct
 	GLuint shaderProgram;
 	GLint uniVblend;
 	GLint uniLmScalesOrTime; // for 3D it's lmScales, for 2D underwater PP it's time
+	GLint uniAliasParams; // only for model shaders, see DrawAliasFrameLerp()
 	hmm_vec4 lmScales[4];
 } gl3ShaderInfo_t;
 
@@ -246,6 +249,7 @@ typedef struct
 
 	gl3ShaderInfo_t si3Dalias;      // for models
 	gl3ShaderInfo_t si3DaliasColor; // for models w/ flat colors
+	gl3ShaderInfo_t si3DaliasShadow; // for model shadows, using the streamed vertices of vaoAlias
 
 	// NOTE: make sure siParticle is always the last shaderInfo (or adapt GL3_ShutdownShaders())
 	gl3ShaderInfo_t siParticle; // for particles. surprising, right?
@@ -256,7 +260,8 @@ typedef struct
 	int vbo3Dsize;
 	int vbo3DcurOffset;
 
-	GLuint vaoAlias, vboAlias, eboAlias; // for models, using 9 floats as (x,y,z, s,t, r,g,b,a)
+	GLuint vaoAlias, vboAlias, eboAlias; // for model shadows, using 9 floats as (x,y,z, s,t, r,g,b,a)
+	GLuint aliasNormalTex; // r_avertexnormals and r_avertexnormal_dots for the model shaders, bound to GL_TEXTURE5
 	GLuint vaoParticle, vboParticle; // for particles, using 9 floats (x,y,z, size,distance, r,g,b,a)
 
 	// UBOs and their data
@@ -485,6 +490,8 @@ extern void GL3_AddSkySurface(msurface_t *fa);
 // gl3_surf.c
 extern void GL3_SurfInit(void);
 extern void GL3_SurfShutdown(void);
+extern void GL3_CreateBrushBuffers(gl3model_t *mod);
+extern void GL3_FreeBrushBuffers(gl3model_t *mod);
 extern void GL3_DrawGLPoly(msurface_t *fa);
 extern void GL3_DrawGLFlowingPoly(msurface_t *fa);
 extern void GL3_DrawTriangleOutlines(void);
@@ -494,6 +501,9 @@ extern void GL3_DrawWorld(void);
 extern void GL3_MarkLeaves(void);
 
 // gl3_mesh.c
+extern void GL3_InitMeshes(void);
+extern void GL3_CreateAliasBuffers(gl3model_t *mod);
+extern void GL3_FreeAliasBuffers(gl3model_t *mod);
 extern void GL3_DrawAliasModel(entity_t *e);
 extern void GL3_ResetShadowAliasModels(void);
 extern void GL3_DrawAliasShadows(void);
@@ -73,6 +73,7 @@ typedef struct msurface_s
 
 	glpoly_t *polys;                /* multiple if warped */
 	struct  msurface_s *texturechain;
+	struct  msurface_s *batchchain; /* for batched world drawing */
 	// struct  msurface_s *lightmapchain; not used/needed anymore
 
 	mtexinfo_t *texinfo;
@@ -86,6 +87,10 @@ typedef struct msurface_s
 	// I think cached_light is not used/needed anymore
 	//float cached_light[MAXLIGHTMAPS];       /* values currently used in lightmap */
 	byte *samples;                          /* [numstyles*surfsize] */
+
+	/* triangles in the static VBO of the model, see GL3_CreateBrushBuffers() */
+	int firstIndex; /* -1 if not in it */
+	int numIndices;
 } msurface_t;
 
 /* Whole model */
@@ -147,15 +152,25 @@ typedef struct model_s
 	msurface_t **marksurfaces;
 
 	dvis_t *vis;
+	pvscache_t *pvscache;
 
 	byte *lightdata;
 
+	/* for brush models: polygons of lightmapped surfaces in a static VBO */
+	GLuint brushVAO, brushVBO, brushEBO;
+
 	/* for alias models and skins */
 	gl3image_t *skins[MAX_MD2SKINS];
 
 	int extradatasize;
 	void *extradata;
 
+	/* for alias models: all frames in a static VBO, see GL3_CreateAliasBuffers() */
+	GLuint aliasVAO, aliasVBO, aliasEBO;
+	int aliasNumVerts; /* vertices per frame */
+	int aliasNumIndices;
+	int aliasFrame, aliasOldFrame; /* frames the VAO currently points to */
+
 	// submodules
 	vec3_t		origin;	// for sounds or lights
 } gl3model_t;
@@ -27,6 +27,8 @@
 #ifndef SRC_CLIENT_REFRESH_REF_SHARED_H_
 #define SRC_CLIENT_REFRESH_REF_SHARED_H_
 
+#include <stddef.h>
+
 #include "../vid/header/ref.h"
 
 #ifdef _MSC_VER
@@ -97,6 +99,12 @@ extern void SmoothColorImage(unsigned *dst, size_t size, size_t rstep);
 extern void scale2x(const byte *src, byte *dst, int width, int height);
 extern void scale3x(const byte *src, byte *dst, int width, int height);
 
+extern byte *R_FindCachedImage(const byte *raw, int rawsize, int params,
+	int *width, int *height);
+extern void R_StoreCachedImage(const byte *raw, int rawsize, int params,
+	const byte *pic, int width, int height);
+extern void R_ShutdownImageCache(void);
+
 extern float Mod_RadiusFromBounds(const vec3_t mins, const vec3_t maxs);
 extern const byte* Mod_DecompressVis(const byte *in, int row);
 
@@ -124,7 +132,7 @@ typedef struct mvertex_s
 
 typedef struct medge_s
 {
-	unsigned short	v[2];
+	unsigned int	v[2];
 	unsigned int	cachededgeoffset;
 } medge_t;
 
@@ -152,8 +160,8 @@ typedef struct mnode_s
 	cplane_t	*plane;
 	struct mnode_s	*children[2];
 
-	unsigned short	firstsurface;
-	unsigned short	numsurfaces;
+	unsigned int	firstsurface;
+	unsigned int	numsurfaces;
 } mnode_t;
 
 typedef struct mleaf_s
@@ -175,6 +183,41 @@ typedef struct mleaf_s
 	int		key;	/* BSP sequence number for leaf's contents */
 } mleaf_t;
 
+/* Per map PVS cache, see pvs.c */
+typedef struct pvscache_s pvscache_t;
+
+extern pvscache_t *Mod_CreatePVSCache(const dvis_t *vis, mleaf_t *leafs, int numleafs);
+extern void Mod_FreePVSCache(pvscache_t *cache);
+extern const byte *Mod_CachedClusterPVS(pvscache_t *cache, int cluster);
+extern void Mod_MarkVisibleLeaves(pvscache_t *cache, int cluster, int cluster2, int visframe);
+
+/* Hashed lookup of models and images by name, see registry.c.
+   Handles are indices into the array the registry was set up for. */
+#define REG_HASH_SIZE 512
+
+typedef struct
+{
+	byte *base;	/* the renderers array of models or images */
+	int count;
+	size_t size;	/* of one element */
+	size_t nameofs;	/* of its name */
+	size_t seqofs;	/* of its registration_sequence */
+	int hash[REG_HASH_SIZE];	/* first handle + 1 */
+	int *next;	/* next handle + 1 for each one, -1 if not in it */
+} registry_t;
+
+#define REG_INIT(array, type) \
+	{ (byte *)(array), sizeof(array) / sizeof((array)[0]), sizeof(type), \
+	  offsetof(type, name), offsetof(type, registration_sequence) }
+
+typedef void (*regfree_t)(int handle);
+
+extern int Reg_Find(const registry_t *reg, const char *name);
+extern void Reg_Add(registry_t *reg, int handle);
+extern void Reg_Remove(registry_t *reg, int handle);
+extern void Reg_Purge(registry_t *reg, int sequence, regfree_t free_handle);
+extern void Reg_Clear(registry_t *reg);
+
 /* Shared models func */
 typedef struct image_s* (*findimage_t)(const char *name, imagetype_t type);
 extern void *Mod_LoadMD2 (const char *mod_name, const void *buffer, int modfilelen,
@@ -192,7 +235,7 @@ extern struct image_s* R_LoadImage(const char *name, const char* namewe, const c
 	imagetype_t type, qboolean r_retexturing, loadimage_t load_image);
 extern void Mod_LoadNodes(const char *name, cplane_t *planes, int numplanes,
 	mleaf_t *leafs, int numleafs, mnode_t **nodes, int *numnodes,
-	const byte *mod_base, const lump_t *l);
+	const dqnode_t *in, int count);
 extern void Mod_LoadVertexes(const char *name, mvertex_t **vertexes, int *numvertexes,
 	const byte *mod_base, const lump_t *l, int extra);
 extern void Mod_LoadVisibility(dvis_t **vis, const byte *mod_base, const lump_t *l);
@@ -201,12 +244,15 @@ extern void Mod_LoadTexinfo(const char *name, mtexinfo_t **texinfo, int *numtexi
 	const byte *mod_base, const lump_t *l, findimage_t find_image,
 	struct image_s *notexture, int extra);
 extern void Mod_LoadEdges(const char *name, medge_t **edges, int *numedges,
-	const byte *mod_base, const lump_t *l, int extra);
+	const dqedge_t *in, int count, int extra);
 extern void Mod_LoadPlanes (const char *name, cplane_t **planes, int *numplanes,
 	const byte *mod_base, const lump_t *l, int extra);
 extern void Mod_LoadSurfedges (const char *name, int **surfedges, int *numsurfedges,
 	const byte *mod_base, const lump_t *l, int extra);
 extern int Mod_CalcLumpHunkSize(const lump_t *l, int inSize, int outSize, int extra);
+extern void *Mod_LoadQBSPLump(const char *name, const byte *mod_base, const lump_t *l,
+	int lump, qboolean qbsp, int *count);
+extern void Mod_FreeQBSPLumps(void);
 extern mleaf_t *Mod_PointInLeaf(const vec3_t p, mnode_t *node);
 
 /* Surface logic */
@@ -235,6 +235,8 @@ typedef struct
 	int		surfmip; // mipmapped ratio of surface texels / world pixels
 	int		surfwidth; // in mipmapped texels
 	int		surfheight; // in mipmapped texels
+	light_t		*blocklights, *blocklight_max; // lightmap buffer, one per thread
+	qboolean	outoflights; // blocklights was too small
 } drawsurf_t;
 
 // clipped bmodel edges
@@ -260,6 +262,9 @@ typedef struct surfcache_s
 	struct surfcache_s	**owner; // NULL is an empty chunk of memory
 	int			lightadj[MAXLIGHTMAPS]; // checked for strobe flush
 	int			dlight;
+	int			referenced; // used since the rover passed, see D_SCAlloc()
+	int			builtframe; // r_framecount when the surface was built
+	int			prefetched; // built by D_BuildQueuedSurfaces(), not used yet
 	int			size; // including header
 	unsigned		width;
 	unsigned		height; // DEBUG only needed for debug
@@ -351,6 +356,8 @@ void D_WarpScreen(void);
 // callbacks to Quake
 
 extern int		c_surf;
+extern int		c_surfhits;
+extern int		c_surfevictions;
 
 extern pixel_t		*r_warpbuffer;
 
@@ -366,6 +373,9 @@ void TurbulentPow2(espan_t *pspan, float d_ziorigin, float d_zistepu, float d_zi
 void NonTurbulentPow2(espan_t *pspan, float d_ziorigin, float d_zistepu, float d_zistepv);
 
 surfcache_t *D_CacheSurface(const entity_t *currententity, msurface_t *surface, int miplevel);
+void D_QueueSurface(const entity_t *currententity, msurface_t *surface, int miplevel);
+void D_BuildQueuedSurfaces(void);
+void D_FreeSurfaceQueue(void);
 
 extern int	d_vrectx, d_vrecty, d_vrectright_particle, d_vrectbottom_particle;
 
@@ -497,6 +507,7 @@ extern int	bbextents, bbextentt;
 extern int	r_currentkey;
 
 void R_DrawParticles (void);
+void R_ShutdownParticles (void);
 
 extern int	r_amodels_drawn;
 extern int	r_numallocatededges;
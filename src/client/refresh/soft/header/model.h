@@ -135,6 +135,7 @@ typedef struct model_s
 	msurface_t	**marksurfaces;
 
 	dvis_t		*vis;
+	pvscache_t	*pvscache;
 
 	byte		*lightdata;
 
@@ -57,6 +57,22 @@ static const float	r_avertexnormals[NUMVERTEXNORMALS][3] = {
 #include "../constants/anorms.h"
 };
 
+// shaded light for each vertex normal of the current model
+static light3_t	r_normallight[NUMVERTEXNORMALS];
+
+#define ALIAS_BATCH	8
+
+typedef struct
+{
+	float	oldv[3][ALIAS_BATCH];
+	float	newv[3][ALIAS_BATCH];
+	float	normal[3][ALIAS_BATCH];
+	float	x[ALIAS_BATCH], y[ALIAS_BATCH], z[ALIAS_BATCH];	// lerped, model space
+	float	xyz[3][ALIAS_BATCH];	// eye space
+	float	zi[ALIAS_BATCH];
+	float	u[ALIAS_BATCH], v[ALIAS_BATCH];
+} aliasbatch_t;
+
 
 static void R_AliasTransformVector(const vec3_t in, vec3_t out, const float xf[3][4]);
 static void R_AliasTransformFinalVerts(const entity_t *currententity, int numpoints, finalvert_t *fv, dtrivertx_t *oldv, dtrivertx_t *newv );
@@ -389,42 +405,21 @@ R_AliasSetUpTransform(const entity_t *currententity)
 
 /*
 ================
-R_AliasTransformFinalVerts
+R_AliasSetupLightTable
+
+Shades every vertex normal once per model instead of once per vertex
 ================
 */
 static void
-R_AliasTransformFinalVerts(const entity_t *currententity, int numpoints, finalvert_t *fv, dtrivertx_t *oldv, dtrivertx_t *newv )
+R_AliasSetupLightTable(void)
 {
 	int i;
 
-	for ( i = 0; i < numpoints; i++, fv++, oldv++, newv++ )
+	for (i = 0; i < NUMVERTEXNORMALS; i++)
 	{
 		float	lightcos;
-		const float	*plightnormal;
-		vec3_t  lerped_vert;
-
-		lerped_vert[0] = r_lerp_move[0] + oldv->v[0]*r_lerp_backv[0] + newv->v[0]*r_lerp_frontv[0];
-		lerped_vert[1] = r_lerp_move[1] + oldv->v[1]*r_lerp_backv[1] + newv->v[1]*r_lerp_frontv[1];
-		lerped_vert[2] = r_lerp_move[2] + oldv->v[2]*r_lerp_backv[2] + newv->v[2]*r_lerp_frontv[2];
 
-		plightnormal = r_avertexnormals[newv->lightnormalindex];
-
-		// added double damage shell
-		if ( currententity->flags & ( RF_SHELL_RED | RF_SHELL_GREEN | RF_SHELL_BLUE | RF_SHELL_DOUBLE | RF_SHELL_HALF_DAM) )
-		{
-			lerped_vert[0] += plightnormal[0] * POWERSUIT_SCALE;
-			lerped_vert[1] += plightnormal[1] * POWERSUIT_SCALE;
-			lerped_vert[2] += plightnormal[2] * POWERSUIT_SCALE;
-		}
-
-		fv->xyz[0] = DotProduct(lerped_vert, aliastransform[0]) + aliastransform[0][3];
-		fv->xyz[1] = DotProduct(lerped_vert, aliastransform[1]) + aliastransform[1][3];
-		fv->xyz[2] = DotProduct(lerped_vert, aliastransform[2]) + aliastransform[2][3];
-
-		fv->flags = 0;
-
-		// lighting
-		lightcos = DotProduct (plightnormal, r_plightvec);
+		lightcos = DotProduct (r_avertexnormals[i], r_plightvec);
 
 		if (lightcos < 0)
 		{
@@ -443,22 +438,163 @@ R_AliasTransformFinalVerts(const entity_t *currententity, int numpoints, finalve
 				if (temp < 0)
 					temp = 0;
 
-				fv->cv.l[j] = temp;
+				r_normallight[i][j] = temp;
 			}
 		}
 		else
-			memcpy(fv->cv.l, r_ambientlight, sizeof(light3_t));
+			memcpy(r_normallight[i], r_ambientlight, sizeof(light3_t));
+	}
+}
+
+/*
+================
+R_AliasTransformBatch
 
-		if ( fv->xyz[2] < ALIAS_Z_CLIP_PLANE )
+Lerps, transforms and projects ALIAS_BATCH vertices at once. All the
+arrays have a fixed length so the compiler can keep the loops in vector
+registers; the operations are done in the same order as the scalar
+code used to, so the results are identical.
+================
+*/
+static void
+R_AliasTransformBatch(aliasbatch_t *b, qboolean shell)
+{
+	float	xf[3][4];
+	vec3_t	move, frontv, backv;
+	float	xscale, yscale, xcenter, ycenter, ziscale;
+	int	i;
+
+	memcpy(xf, aliastransform, sizeof(xf));
+	VectorCopy(r_lerp_move, move);
+	VectorCopy(r_lerp_frontv, frontv);
+	VectorCopy(r_lerp_backv, backv);
+	xscale = aliasxscale;
+	yscale = aliasyscale;
+	xcenter = aliasxcenter;
+	ycenter = aliasycenter;
+	ziscale = s_ziscale;
+
+	for (i = 0; i < ALIAS_BATCH; i++)
+	{
+		b->x[i] = move[0] + b->oldv[0][i]*backv[0] + b->newv[0][i]*frontv[0];
+		b->y[i] = move[1] + b->oldv[1][i]*backv[1] + b->newv[1][i]*frontv[1];
+		b->z[i] = move[2] + b->oldv[2][i]*backv[2] + b->newv[2][i]*frontv[2];
+	}
+
+	if (shell)
+	{
+		for (i = 0; i < ALIAS_BATCH; i++)
 		{
-			fv->flags |= ALIAS_Z_CLIP;
+			b->x[i] += b->normal[0][i] * POWERSUIT_SCALE;
+			b->y[i] += b->normal[1][i] * POWERSUIT_SCALE;
+			b->z[i] += b->normal[2][i] * POWERSUIT_SCALE;
 		}
-		else
+	}
+
+	for (i = 0; i < ALIAS_BATCH; i++)
+	{
+		float	x, y, z;
+
+		x = b->x[i];
+		y = b->y[i];
+		z = b->z[i];
+
+		b->xyz[0][i] = x*xf[0][0] + y*xf[0][1] + z*xf[0][2] + xf[0][3];
+		b->xyz[1][i] = x*xf[1][0] + y*xf[1][1] + z*xf[1][2] + xf[1][3];
+		b->xyz[2][i] = x*xf[2][0] + y*xf[2][1] + z*xf[2][2] + xf[2][3];
+	}
+
+	// project; lanes behind the z clip plane are computed but never used
+	for (i = 0; i < ALIAS_BATCH; i++)
+	{
+		float	zi;
+
+		zi = 1.0 / b->xyz[2][i];
+
+		b->zi[i] = zi * ziscale;
+		b->u[i] = (b->xyz[0][i] * xscale * zi) + xcenter;
+		b->v[i] = (b->xyz[1][i] * yscale * zi) + ycenter;
+	}
+}
+
+/*
+================
+R_AliasTransformFinalVerts
+================
+*/
+static void
+R_AliasTransformFinalVerts(const entity_t *currententity, int numpoints, finalvert_t *fv, dtrivertx_t *oldv, dtrivertx_t *newv )
+{
+	aliasbatch_t	b;
+	qboolean	shell;
+	int	first;
+
+	// added double damage shell
+	shell = (currententity->flags & ( RF_SHELL_RED | RF_SHELL_GREEN | RF_SHELL_BLUE | RF_SHELL_DOUBLE | RF_SHELL_HALF_DAM)) != 0;
+
+	memset(&b, 0, sizeof(b));
+
+	for (first = 0; first < numpoints; first += ALIAS_BATCH)
+	{
+		int	count, i;
+
+		count = numpoints - first;
+		if (count > ALIAS_BATCH)
+			count = ALIAS_BATCH;
+
+		// gather into structure of arrays form, the tail of the last
+		// batch keeps stale but harmless values
+		for (i = 0; i < count; i++)
 		{
-			R_AliasProjectAndClipTestFinalVert( fv );
+			const float	*plightnormal;
+			int	j;
+
+			plightnormal = r_avertexnormals[newv[i].lightnormalindex];
+
+			for (j = 0; j < 3; j++)
+			{
+				b.oldv[j][i] = oldv[i].v[j];
+				b.newv[j][i] = newv[i].v[j];
+				b.normal[j][i] = plightnormal[j];
+			}
 		}
-	}
 
+		R_AliasTransformBatch(&b, shell);
+
+		for (i = 0; i < count; i++, fv++)
+		{
+			fv->xyz[0] = b.xyz[0][i];
+			fv->xyz[1] = b.xyz[1][i];
+			fv->xyz[2] = b.xyz[2][i];
+
+			fv->flags = 0;
+
+			// lighting
+			memcpy(fv->cv.l, r_normallight[newv[i].lightnormalindex], sizeof(light3_t));
+
+			if ( fv->xyz[2] < ALIAS_Z_CLIP_PLANE )
+			{
+				fv->flags |= ALIAS_Z_CLIP;
+				continue;
+			}
+
+			fv->cv.zi = b.zi[i];
+			fv->cv.u = b.u[i];
+			fv->cv.v = b.v[i];
+
+			if (fv->cv.u < r_refdef.aliasvrect.x)
+				fv->flags |= ALIAS_LEFT_CLIP;
+			if (fv->cv.v < r_refdef.aliasvrect.y)
+				fv->flags |= ALIAS_TOP_CLIP;
+			if (fv->cv.u > r_refdef.aliasvrectright)
+				fv->flags |= ALIAS_RIGHT_CLIP;
+			if (fv->cv.v > r_refdef.aliasvrectbottom)
+				fv->flags |= ALIAS_BOTTOM_CLIP;
+		}
+
+		oldv += count;
+		newv += count;
+	}
 }
 
 /*
@@ -627,6 +763,8 @@ R_AliasSetupLighting(entity_t *currententity)
 	r_plightvec[0] =  DotProduct( lightvec, s_alias_forward );
 	r_plightvec[1] = -DotProduct( lightvec, s_alias_right );
 	r_plightvec[2] =  DotProduct( lightvec, s_alias_up );
+
+	R_AliasSetupLightTable();
 }
 
 
@@ -927,6 +927,23 @@ D_SkySurf (surf_t *s)
 	D_DrawZSpans (s->spans, -0.9, 0, 0);
 }
 
+static int
+D_SurfMipLevel (const surf_t *s)
+{
+	mtexinfo_t *texinfo = s->msurf->texinfo;
+	float len1, len2, mipadjust;
+
+	len1 = VectorLength (texinfo->vecs[0]);
+	len2 = VectorLength (texinfo->vecs[1]);
+	mipadjust = sqrt(len1*len1 + len2*len2);
+	if (mipadjust < 0.01)
+	{
+		mipadjust = 0.01;
+	}
+
+	return D_MipLevelForScale(s->nearzi * scale_for_mip * mipadjust);
+}
+
 /*
 ==============
 D_SolidSurf
@@ -937,8 +954,6 @@ Normal surface cached, texture mapped surface
 static void
 D_SolidSurf (entity_t *currententity, surf_t *s)
 {
-	float len1, len2, mipadjust;
-
 	if (s->insubmodel)
 	{
 		vec3_t local_modelorg;
@@ -954,15 +969,7 @@ D_SolidSurf (entity_t *currententity, surf_t *s)
 	}
 
 	pface = s->msurf;
-
-	len1 = VectorLength (pface->texinfo->vecs[0]);
-	len2 = VectorLength (pface->texinfo->vecs[1]);
-	mipadjust = sqrt(len1*len1 + len2*len2);
-	if (mipadjust < 0.01)
-	{
-		mipadjust = 0.01;
-	}
-	miplevel = D_MipLevelForScale(s->nearzi * scale_for_mip * mipadjust);
+	miplevel = D_SurfMipLevel(s);
 
 	// FIXME: make this passed in to D_CacheSurface
 	pcurrentcache = D_CacheSurface (currententity, pface, miplevel);
@@ -1038,6 +1045,22 @@ D_DrawSurfaces (entity_t *currententity, surf_t *surface)
 	{
 		surf_t *s;
 
+		// build the missing surfaces on the job threads first
+		if (ri.Com_NumJobThreads() > 1)
+		{
+			for (s = &surfaces[1] ; s<surface ; s++)
+			{
+				if (!s->spans ||
+					(s->flags & (SURF_DRAWSKY|SURF_DRAWBACKGROUND|SURF_DRAWTURB)))
+					continue;
+
+				D_QueueSurface (s->insubmodel ? s->entity : currententity,
+					s->msurf, D_SurfMipLevel(s));
+			}
+
+			D_BuildQueuedSurfaces ();
+		}
+
 		for (s = &surfaces[1] ; s<surface ; s++)
 		{
 			if (!s->spans)
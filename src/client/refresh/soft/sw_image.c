@@ -24,6 +24,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 static image_t		*r_whitetexture_mip = NULL;
 static image_t		r_images[MAX_RIMAGES];
 static int		numr_images;
+static registry_t	image_reg = REG_INIT(r_images, image_t);
 static int		image_max = 0;
 
 
@@ -262,6 +263,7 @@ R_LoadPic8 (char *name, byte *pic, int width, int realwidth, int height, int rea
 		ri.Sys_Error(ERR_DROP, "%s: '%s' is too long", __func__, name);
 	strcpy (image->name, name);
 	image->registration_sequence = registration_sequence;
+	Reg_Add(&image_reg, image - r_images);
 
 	image->width = width;
 	image->height = height;
@@ -533,13 +535,12 @@ R_FindImage(const char *name, imagetype_t type)
 	}
 
 	// look for it
-	for (i=0, image=r_images ; i<numr_images ; i++,image++)
+	i = Reg_Find(&image_reg, name);
+	if (i >= 0)
 	{
-		if (!strcmp(name, image->name))
-		{
-			image->registration_sequence = registration_sequence;
-			return image;
-		}
+		image = &r_images[i];
+		image->registration_sequence = registration_sequence;
+		return image;
 	}
 
 	//
@@ -564,26 +565,23 @@ Any image that was not touched on this registration sequence
 will be freed.
 ================
 */
+static void
+R_FreeUnusedImage (int handle)
+{
+	image_t	*image = &r_images[handle];
+
+	if (image->type == it_pic)
+		return; // don't free pics
+	// free it
+	free (image->pixels[0]); // the other mip levels just follow
+	Reg_Remove(&image_reg, handle);
+	memset(image, 0, sizeof(*image));
+}
+
 void
 R_FreeUnusedImages (void)
 {
-	int		i;
-	image_t	*image;
-
-	for (i=0, image=r_images ; i<numr_images ; i++, image++)
-	{
-		if (image->registration_sequence == registration_sequence)
-		{
-			continue; // used this sequence
-		}
-		if (!image->registration_sequence)
-			continue; // free texture
-		if (image->type == it_pic)
-			continue; // don't free pics
-		// free it
-		free (image->pixels[0]); // the other mip levels just follow
-		memset(image, 0, sizeof(*image));
-	}
+	Reg_Purge(&image_reg, registration_sequence, R_FreeUnusedImage);
 }
 
 qboolean
@@ -737,6 +735,8 @@ R_ShutdownImages (void)
 		memset(image, 0, sizeof(*image));
 	}
 
+	Reg_Clear(&image_reg);
+
 	if (d_16to8table)
 		free(d_16to8table);
 }
@@ -256,9 +256,9 @@ R_AddDynamicLights (drawsurf_t* drawsurf)
 	tmax = (surf->extents[1]>>4)+1;
 	tex = surf->texinfo;
 
-	if (blocklight_max <= blocklights + smax*tmax*3)
+	if (drawsurf->blocklight_max <= drawsurf->blocklights + smax*tmax*3)
 	{
-		r_outoflights = true;
+		drawsurf->outoflights = true;
 		return;
 	}
 
@@ -270,7 +270,7 @@ R_AddDynamicLights (drawsurf_t* drawsurf)
 		int		i;
 		dlight_t	*dl;
 		int		negativeLight;
-		light_t *plightdest = blocklights;
+		light_t *plightdest = drawsurf->blocklights;
 
 		if (!(surf->dlightbits & (1<<lnum)))
 			continue;	// not lit by this light
@@ -365,7 +365,9 @@ R_AddDynamicLights (drawsurf_t* drawsurf)
 ===============
 R_BuildLightMap
 
-Combine and scale multiple lightmaps into the 8.8 format in blocklights
+Combine and scale multiple lightmaps into the 8.8 format in
+drawsurf->blocklights. May run on the job threads, each with
+its own buffer.
 ===============
 */
 void
@@ -382,14 +384,14 @@ R_BuildLightMap (drawsurf_t* drawsurf)
 	tmax = (surf->extents[1]>>4)+1;
 	size = smax*tmax*3;
 
-	if (blocklight_max <= blocklights + size)
+	if (drawsurf->blocklight_max <= drawsurf->blocklights + size)
 	{
-		r_outoflights = true;
+		drawsurf->outoflights = true;
 		return;
 	}
 
 	// clear to no light
-	memset(blocklights, 0, size * sizeof(light_t));
+	memset(drawsurf->blocklights, 0, size * sizeof(light_t));
 
 	if (r_fullbright->value || !r_worldmodel->lightdata)
 	{
@@ -408,8 +410,8 @@ R_BuildLightMap (drawsurf_t* drawsurf)
 			unsigned scale;
 			light_t  *curr_light, *max_light;
 
-			curr_light = blocklights;
-			max_light = blocklights + size;
+			curr_light = drawsurf->blocklights;
+			max_light = drawsurf->blocklights + size;
 
 			scale = drawsurf->lightadj[maps];	// 8.8 fraction
 
@@ -459,8 +461,8 @@ R_BuildLightMap (drawsurf_t* drawsurf)
 	{
 		light_t  *curr_light, *max_light;
 
-		curr_light = blocklights;
-		max_light = blocklights + size;
+		curr_light = drawsurf->blocklights;
+		max_light = drawsurf->blocklights + size;
 
 		do
 		{
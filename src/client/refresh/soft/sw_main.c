@@ -48,6 +48,11 @@ static int	vid_minu, vid_minv, vid_maxu, vid_maxv;
 static int	vid_zminu, vid_zminv, vid_zmaxu, vid_zmaxv;
 static qboolean IsHighDPIaware;
 
+/* With sw_headless there's no SDL renderer, frames are only
+   kept in the swap buffers and can be dumped to disk. */
+static qboolean	headless = false;
+static int	headless_frames = 0;
+
 // last position  on map
 static vec3_t	lastvieworg;
 static vec3_t	lastviewangles;
@@ -97,6 +102,8 @@ qboolean	r_dowarp;
 mvertex_t	*r_pcurrentvertbase;
 
 int		c_surf;
+int		c_surfhits;
+int		c_surfevictions;
 static int	r_cnumsurfs;
 int	r_clipflags;
 
@@ -157,6 +164,8 @@ cvar_t	*r_scale8bittextures;
 cvar_t	*sw_gunzposition;
 cvar_t	*r_validation;
 static cvar_t	*sw_partialrefresh;
+static cvar_t	*sw_headless;
+static cvar_t	*sw_headless_dump;
 
 cvar_t	*r_drawworld;
 static cvar_t	*r_drawentities;
@@ -218,7 +227,6 @@ zvalue_t	*d_pzbuffer;
 
 static void RE_BeginFrame( float camera_separation );
 static void Draw_BuildGammaTable(void);
-static void RE_FlushFrame(int vmin, int vmax);
 static void RE_CleanFrame(void);
 static void RE_EndFrame(void);
 static void R_DrawBeam(const entity_t *e);
@@ -367,6 +375,7 @@ R_InitTurb (int width)
 
 void R_ImageList_f(void);
 static void R_ScreenShot_f(void);
+static void R_PresentBench_f(void);
 
 static void
 R_RegisterVariables (void)
@@ -398,6 +407,10 @@ R_RegisterVariables (void)
 	sw_partialrefresh = ri.Cvar_Get("sw_partialrefresh", "1", CVAR_ARCHIVE);
 #endif
 
+	// render into memory only, for benchmarks on machines without a GPU
+	sw_headless = ri.Cvar_Get("sw_headless", "0", 0);
+	sw_headless_dump = ri.Cvar_Get("sw_headless_dump", "0", 0);
+
 	r_mode = ri.Cvar_Get( "r_mode", "0", CVAR_ARCHIVE );
 
 	r_lefthand = ri.Cvar_Get( "hand", "0", CVAR_USERINFO | CVAR_ARCHIVE );
@@ -427,6 +440,7 @@ R_RegisterVariables (void)
 	ri.Cmd_AddCommand("modellist", Mod_Modellist_f);
 	ri.Cmd_AddCommand("screenshot", R_ScreenShot_f);
 	ri.Cmd_AddCommand("imagelist", R_ImageList_f);
+	ri.Cmd_AddCommand("sw_presentbench", R_PresentBench_f);
 
 	r_mode->modified = true; // force us to do mode specific stuff later
 	vid_gamma->modified = true; // force us to rebuild the gamma table later
@@ -441,6 +455,7 @@ R_UnRegister (void)
 	ri.Cmd_RemoveCommand( "screenshot" );
 	ri.Cmd_RemoveCommand( "modellist" );
 	ri.Cmd_RemoveCommand( "imagelist" );
+	ri.Cmd_RemoveCommand( "sw_presentbench" );
 }
 
 static void RE_ShutdownContext(void);
@@ -516,6 +531,7 @@ RE_Shutdown (void)
 		free (sc_base);
 		sc_base = NULL;
 	}
+	D_FreeSurfaceQueue ();
 
 	// free colormap
 	if (vid_colormap)
@@ -524,9 +540,11 @@ RE_Shutdown (void)
 		vid_colormap = NULL;
 	}
 
+	R_ShutdownParticles ();
 	R_UnRegister ();
 	Mod_FreeAll ();
 	R_ShutdownImages ();
+	R_ShutdownImageCache ();
 
 	RE_ShutdownContext();
 }
@@ -755,10 +773,7 @@ cluster
 static void
 R_MarkLeaves (void)
 {
-	const byte	*vis;
-	mnode_t	*node;
 	int		i;
-	mleaf_t	*leaf;
 
 	if (r_oldviewcluster == r_viewcluster && !r_novis->value && r_viewcluster != -1)
 		return;
@@ -771,7 +786,7 @@ R_MarkLeaves (void)
 	r_visframecount++;
 	r_oldviewcluster = r_viewcluster;
 
-	if (r_novis->value || r_viewcluster == -1 || !r_worldmodel->vis)
+	if (r_novis->value || r_viewcluster == -1 || !r_worldmodel->pvscache)
 	{
 		// mark everything
 		for (i=0 ; i<r_worldmodel->numleafs ; i++)
@@ -781,27 +796,8 @@ R_MarkLeaves (void)
 		return;
 	}
 
-	vis = Mod_ClusterPVS (r_viewcluster, r_worldmodel);
-
-	for (i=0,leaf=r_worldmodel->leafs ; i<r_worldmodel->numleafs ; i++, leaf++)
-	{
-		int cluster;
-
-		cluster = leaf->cluster;
-		if (cluster == -1)
-			continue;
-		if (vis[cluster>>3] & (1<<(cluster&7)))
-		{
-			node = (mnode_t *)leaf;
-			do
-			{
-				if (node->visframe == r_visframecount)
-					break;
-				node->visframe = r_visframecount;
-				node = node->parent;
-			} while (node);
-		}
-	}
+	Mod_MarkVisibleLeaves (r_worldmodel->pvscache, r_viewcluster,
+		r_viewcluster, r_visframecount);
 }
 
 /*
@@ -1774,7 +1770,7 @@ void R_Printf(int level, const char* msg, ...)
 static qboolean
 RE_IsVsyncActive(void)
 {
-	if (r_vsync->value)
+	if (r_vsync->value && !headless)
 	{
 		return true;
 	}
@@ -1787,6 +1783,14 @@ RE_IsVsyncActive(void)
 static int RE_PrepareForWindow(void)
 {
 	int flags = SDL_SWSURFACE;
+
+	// the client still needs a window for input,
+	// but there's nothing to see in it
+	if (sw_headless->value)
+	{
+		flags |= SDL_WINDOW_HIDDEN;
+	}
+
 	return flags;
 }
 
@@ -1907,6 +1911,23 @@ RE_InitContext(void *win)
 	snprintf(title, sizeof(title), "Yamagi Quake II %s - Soft Render", YQ2VERSION);
 	SDL_SetWindowTitle(window, title);
 
+	headless = (sw_headless->value != 0);
+	headless_frames = 0;
+
+	if (headless)
+	{
+		R_Printf(PRINT_ALL, "Rendering headless, %dx%d\n", vid.width, vid.height);
+
+		IsHighDPIaware = false;
+		vid_buffer_height = vid.height;
+		vid_buffer_width = vid.width;
+
+		R_InitGraphics(vid_buffer_width, vid_buffer_height);
+		SWimp_CreateRender(vid_buffer_width, vid_buffer_height);
+
+		return true;
+	}
+
 	if (r_vsync->value)
 	{
 #ifdef USE_SDL3
@@ -1977,6 +1998,13 @@ RE_InitContext(void *win)
  */
 void RE_GetDrawableSize(int* width, int* height)
 {
+	if (headless)
+	{
+		*width = vid.width;
+		*height = vid.height;
+		return;
+	}
+
 #ifdef USE_SDL3
 	SDL_GetCurrentRenderOutputSize(renderer, width, height);
 #else
@@ -2106,82 +2134,104 @@ point math used in R_ScanEdges() overflows at width 2048 !!
 */
 char shift_size;
 
+// at most that many separate uploads per frame
+#define MAX_DIRTY_SPANS 8
+// unchanged rows between two changed ones that are uploaded anyway
+#define DIRTY_SPAN_GAP 16
+
+typedef struct
+{
+	int ymin, ymax;
+} dirtyspan_t;
+
+/*
+ * Converts a row of 8 bit pixels to 32 bit, unrolled as
+ * there's no vector instruction for a palette lookup that
+ * is faster than doing it one by one.
+ */
 static void
-RE_CopyFrame (Uint32 * pixels, int pitch, int vmin, int vmax)
+RE_CopyRow(Uint32 *restrict dst, const pixel_t *restrict src, int width,
+	const Uint32 *restrict palette)
 {
-	Uint32 *sdl_palette = (Uint32 *)sw_state.currentpalette;
+	int x = 0;
 
-	// no gaps between images rows
-	if (pitch == vid_buffer_width)
+	for (; x <= width - 8; x += 8)
+	{
+		dst[x + 0] = palette[src[x + 0]];
+		dst[x + 1] = palette[src[x + 1]];
+		dst[x + 2] = palette[src[x + 2]];
+		dst[x + 3] = palette[src[x + 3]];
+		dst[x + 4] = palette[src[x + 4]];
+		dst[x + 5] = palette[src[x + 5]];
+		dst[x + 6] = palette[src[x + 6]];
+		dst[x + 7] = palette[src[x + 7]];
+	}
+
+	for (; x < width; x++)
 	{
-		const Uint32	*max_pixels;
-		Uint32	*pixels_pos;
-		pixel_t	*buffer_pos;
+		dst[x] = palette[src[x]];
+	}
+}
 
-		max_pixels = pixels + vmax;
-		buffer_pos = vid_buffer + vmin;
+/*
+ * Copies the rows ymin to ymax of src, pixels points to row ymin
+ */
+static void
+RE_CopyFrame(Uint32 *pixels, int pitch, const pixel_t *src, int width,
+	int ymin, int ymax, const Uint32 *palette)
+{
+	int y;
 
-		pixels_pos = pixels + vmin;
+	src += ymin * width;
 
-		while ( pixels_pos < max_pixels)
-		{
-			*pixels_pos = sdl_palette[*buffer_pos];
-			buffer_pos++;
-			pixels_pos++;
-		}
-	}
-	else
+	// no gaps between images rows
+	if (pitch == width)
 	{
-		int y,x, buffer_pos, ymin, ymax;
-
-		ymin = vmin / vid_buffer_width;
-		ymax = vmax / vid_buffer_width;
+		RE_CopyRow(pixels, src, width * (ymax - ymin), palette);
+		return;
+	}
 
-		buffer_pos = ymin * vid_buffer_width;
-		pixels += ymin * pitch;
-		for (y=ymin; y < ymax;  y++)
-		{
-			for (x=0; x < vid_buffer_width; x ++)
-			{
-				pixels[x] = sdl_palette[vid_buffer[buffer_pos + x]];
-			}
-			pixels += pitch;
-			buffer_pos += vid_buffer_width;
-		}
+	for (y = ymin; y < ymax; y++)
+	{
+		RE_CopyRow(pixels, src, width, palette);
+		pixels += pitch;
+		src += width;
 	}
 }
 
+/*
+ * Finds the rows between ymin and ymax that differ in front
+ * and back. Changed rows close to each other are merged into
+ * one span, returns the number of spans.
+ */
 static int
-RE_BufferDifferenceStart(int vmin, int vmax)
+RE_FindDirtyRows(const pixel_t *front, const pixel_t *back, int width,
+	int ymin, int ymax, dirtyspan_t *spans)
 {
-	int *front_buffer, *back_buffer, *back_max;
+	int y, numspans = 0;
 
-	back_buffer = (int*)(swap_frames[0] + vmin);
-	front_buffer = (int*)(swap_frames[1] + vmin);
-	back_max = (int*)(swap_frames[0] + vmax);
+	for (y = ymin; y < ymax; y++)
+	{
+		// memcmp() is vectorized by every libc
+		if (!memcmp(front + y * width, back + y * width, width))
+		{
+			continue;
+		}
 
-	while (back_buffer < back_max && *back_buffer == *front_buffer) {
-		back_buffer ++;
-		front_buffer ++;
+		if (numspans && ((y - spans[numspans - 1].ymax < DIRTY_SPAN_GAP) ||
+			(numspans == MAX_DIRTY_SPANS)))
+		{
+			spans[numspans - 1].ymax = y + 1;
+		}
+		else
+		{
+			spans[numspans].ymin = y;
+			spans[numspans].ymax = y + 1;
+			numspans++;
+		}
 	}
-	return (pixel_t*)back_buffer - swap_frames[0];
-}
 
-static int
-RE_BufferDifferenceEnd(int vmin, int vmax)
-{
-	int *front_buffer, *back_buffer, *back_min;
-
-	back_buffer = (int*)(swap_frames[0] + vmax);
-	front_buffer = (int*)(swap_frames[1] + vmax);
-	back_min = (int*)(swap_frames[0] + vmin);
-
-	do {
-		back_buffer --;
-		front_buffer --;
-	} while (back_buffer > back_min && *back_buffer == *front_buffer);
-	// +1 for fully cover changes
-	return (pixel_t*)back_buffer - swap_frames[0] + sizeof(int);
+	return numspans;
 }
 
 static void
@@ -2193,6 +2243,12 @@ RE_CleanFrame(void)
 	memset(swap_buffers, 0,
 		vid_buffer_height * vid_buffer_width * sizeof(pixel_t) * 2);
 
+	if (headless)
+	{
+		VID_NoDamageBuffer();
+		return;
+	}
+
 	if (SDL_LockTexture(texture, NULL, (void**)&pixels, &pitch))
 	{
 		Com_Printf("Can't lock texture: %s\n", SDL_GetError());
@@ -2208,34 +2264,135 @@ RE_CleanFrame(void)
 }
 
 static void
-RE_FlushFrame(int vmin, int vmax)
+RE_FlushSpan(const dirtyspan_t *span)
 {
-	int pitch;
+	const Uint32 *palette = (const Uint32 *)sw_state.currentpalette;
+	SDL_Rect rect;
+	int pitch, y;
 	Uint32 *pixels;
 
-	if (SDL_LockTexture(texture, NULL, (void**)&pixels, &pitch))
+	// only the locked rows are uploaded to the texture
+	rect.x = 0;
+	rect.y = span->ymin;
+	rect.w = vid_buffer_width;
+	rect.h = span->ymax - span->ymin;
+
+	if (SDL_LockTexture(texture, &rect, (void**)&pixels, &pitch))
 	{
 		Com_Printf("Can't lock texture: %s\n", SDL_GetError());
 		return;
 	}
+
+	pitch /= sizeof(Uint32);
+
+	RE_CopyFrame(pixels, pitch, vid_buffer, vid_buffer_width,
+		span->ymin, span->ymax, palette);
+
+	if ((sw_anisotropic->value > 0) && !fastmoving)
+	{
+		if (pitch == vid_buffer_width)
+		{
+			SmoothColorImage(pixels, rect.w * rect.h, sw_anisotropic->value);
+		}
+		else
+		{
+			for (y = 0; y < rect.h; y++)
+			{
+				SmoothColorImage(pixels + y * pitch, rect.w, sw_anisotropic->value);
+			}
+		}
+	}
+
+	SDL_UnlockTexture(texture);
+}
+
+/*
+ * Writes the current frame as binary PPM to the screenshot directory,
+ * so runs of different builds can be compared frame by frame.
+ */
+static void
+RE_DumpFrame(int frame)
+{
+	const unsigned char *palette = sw_state.currentpalette;
+	char name[MAX_OSPATH];
+	byte *buffer;
+	FILE *f;
+	int i;
+
+	buffer = malloc(vid_buffer_width * vid_buffer_height * 3);
+
+	if (!buffer)
+	{
+		R_Printf(PRINT_ALL, "%s: Couldn't malloc %d bytes\n", __func__,
+			vid_buffer_width * vid_buffer_height * 3);
+		return;
+	}
+
+	for (i = 0; i < vid_buffer_width * vid_buffer_height; i++)
+	{
+		buffer[i * 3 + 0] = palette[vid_buffer[i] * 4 + 2]; // red
+		buffer[i * 3 + 1] = palette[vid_buffer[i] * 4 + 1]; // green
+		buffer[i * 3 + 2] = palette[vid_buffer[i] * 4 + 0]; // blue
+	}
+
+	snprintf(name, sizeof(name), "%s/scrnshot/frame_%06d.ppm", ri.FS_Gamedir(), frame);
+	ri.FS_CreatePath(name);
+
+	f = fopen(name, "wb");
+
+	if (!f)
+	{
+		R_Printf(PRINT_ALL, "%s: Couldn't write %s\n", __func__, name);
+		free(buffer);
+		return;
+	}
+
+	fprintf(f, "P6\n%d %d\n255\n", vid_buffer_width, vid_buffer_height);
+	fwrite(buffer, 1, vid_buffer_width * vid_buffer_height * 3, f);
+	fclose(f);
+
+	free(buffer);
+}
+
+static void
+RE_FlushFrame(const dirtyspan_t *spans, int numspans)
+{
+	int i;
+
+	if (headless)
+	{
+		int dump = sw_headless_dump->value;
+
+		if ((dump > 0) && ((headless_frames % dump) == 0))
+		{
+			RE_DumpFrame(headless_frames);
+		}
+
+		headless_frames++;
+
+		swap_current ++;
+		vid_buffer = swap_frames[swap_current&1];
+
+		VID_NoDamageBuffer();
+		return;
+	}
+
 	if (sw_partialrefresh->value)
 	{
-		RE_CopyFrame (pixels, pitch / sizeof(Uint32), vmin, vmax);
+		for (i = 0; i < numspans; i++)
+		{
+			RE_FlushSpan(&spans[i]);
+		}
 	}
 	else
 	{
 		// On MacOS texture is cleaned up after render,
 		// code have to copy a whole screen to the texture
-		RE_CopyFrame (pixels, pitch / sizeof(Uint32), 0, vid_buffer_height * vid_buffer_width);
-	}
+		dirtyspan_t whole = {0, vid_buffer_height};
 
-	if ((sw_anisotropic->value > 0) && !fastmoving)
-	{
-		SmoothColorImage(pixels + vmin, vmax - vmin, sw_anisotropic->value);
+		RE_FlushSpan(&whole);
 	}
 
-	SDL_UnlockTexture(texture);
-
 #ifdef USE_SDL3
 	SDL_RenderTexture(renderer, texture, NULL, NULL);
 #else
@@ -2261,56 +2418,118 @@ RE_FlushFrame(int vmin, int vmax)
 static void
 RE_EndFrame (void)
 {
-	int vmin, vmax;
+	dirtyspan_t spans[MAX_DIRTY_SPANS];
+	int numspans, ymin, ymax;
+
+	// damaged rows, vid_maxv is the last one
+	ymin = vid_minv;
+	ymax = vid_maxv + 1;
 
 	// fix possible issue with min/max
-	if (vid_minu < 0)
-	{
-		vid_minu = 0;
-	}
-	if (vid_minv < 0)
+	if (ymin < 0)
 	{
-		vid_minv = 0;
+		ymin = 0;
 	}
-	if (vid_maxu > vid_buffer_width)
+	if (ymax > vid_buffer_height)
 	{
-		vid_maxu = vid_buffer_width;
+		ymax = vid_buffer_height;
 	}
-	if (vid_maxv > vid_buffer_height)
-	{
-		vid_maxv = vid_buffer_height;
-	}
-
-	vmin = vid_minu + vid_minv  * vid_buffer_width;
-	vmax = vid_maxu + vid_maxv  * vid_buffer_width;
 
-	// fix to correct limit
-	if (vmax > (vid_buffer_height * vid_buffer_width))
+	// every frame counts, even if nothing changed
+	if (headless)
 	{
-		vmax = vid_buffer_height * vid_buffer_width;
+		RE_FlushFrame(NULL, 0);
+		return;
 	}
 
 	// if palette changed need to flush whole buffer
 	if (!palette_changed)
 	{
-		// search real begin/end of difference
-		vmin = RE_BufferDifferenceStart(vmin, vmax);
+		// search the rows that really changed
+		numspans = RE_FindDirtyRows(swap_frames[0], swap_frames[1],
+			vid_buffer_width, ymin, ymax, spans);
 
 		// no differences found
-		if (vmin >= vmax)
+		if (!numspans)
+		{
+			return;
+		}
+	}
+	else
+	{
+		spans[0].ymin = ymin;
+		spans[0].ymax = ymax;
+		numspans = (ymin < ymax) ? 1 : 0;
+	}
+
+	RE_FlushFrame(spans, numspans);
+}
+
+/*
+ * Times the conversion and the search for changed rows on
+ * random frames in common resolutions, as done by RE_EndFrame()
+ */
+static void
+R_PresentBench_f(void)
+{
+	static const int sizes[][2] = {
+		{1920, 1080}, {2560, 1440}, {3840, 2160}
+	};
+	const Uint32 *palette = (const Uint32 *)sw_state.currentpalette;
+	const int frames = 20;
+	int i, j, k;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		const int width = sizes[i][0];
+		const int height = sizes[i][1];
+		dirtyspan_t spans[MAX_DIRTY_SPANS];
+		pixel_t *front, *back;
+		Uint32 *pixels;
+		Uint64 start, copy = 0, diff = 0;
+
+		front = malloc(width * height * sizeof(pixel_t));
+		back = malloc(width * height * sizeof(pixel_t));
+		pixels = malloc(width * height * sizeof(Uint32));
+
+		if (!front || !back || !pixels)
 		{
+			free(front);
+			free(back);
+			free(pixels);
+			R_Printf(PRINT_ALL, "%s: Couldn't allocate %dx%d frame\n",
+				__func__, width, height);
 			return;
 		}
 
-		// search difference end
-		vmax = RE_BufferDifferenceEnd(vmin, vmax);
-		if (vmax > (vid_buffer_height * vid_buffer_width))
+		for (k = 0; k < width * height; k++)
 		{
-			vmax = vid_buffer_height * vid_buffer_width;
+			front[k] = back[k] = randk() & 0xff;
 		}
-	}
 
-	RE_FlushFrame(vmin, vmax);
+		for (j = 0; j < frames; j++)
+		{
+			// a status bar sized change at the bottom
+			memset(back + (height - height / 8 - j) * width, j, width * height / 16);
+
+			start = SDL_GetPerformanceCounter();
+			RE_FindDirtyRows(front, back, width, 0, height, spans);
+			diff += SDL_GetPerformanceCounter() - start;
+
+			start = SDL_GetPerformanceCounter();
+			RE_CopyFrame(pixels, width, back, width, 0, height, palette);
+			copy += SDL_GetPerformanceCounter() - start;
+		}
+
+		R_Printf(PRINT_ALL, "%dx%d: %.3f ms diff, %.3f ms copy per frame\n",
+			width, height,
+			diff * 1000.0 / SDL_GetPerformanceFrequency() / frames,
+			copy * 1000.0 / SDL_GetPerformanceFrequency() / frames);
+
+		free(front);
+		free(back);
+		free(pixels);
+	}
 }
 
 /*
@@ -91,9 +91,12 @@ R_PrintTimes (void)
 
 	ms = r_time2 - r_time1;
 
-	R_Printf(PRINT_ALL,"%5i ms %3i/%3i/%3i poly %3i surf\n",
-				ms, c_faceclip, r_polycount, r_drawnpolycount, c_surf);
+	R_Printf(PRINT_ALL,"%5i ms %3i/%3i/%3i poly %3i surf %3i cached %3i evicted\n",
+				ms, c_faceclip, r_polycount, r_drawnpolycount, c_surf,
+				c_surfhits, c_surfevictions);
 	c_surf = 0;
+	c_surfhits = 0;
+	c_surfevictions = 0;
 }
 
 
@@ -32,6 +32,7 @@ static YQ2_ALIGNAS_TYPE(int) byte	mod_novis[MAX_MAP_LEAFS/8];
 #define	MAX_MOD_KNOWN	512
 static model_t	mod_known[MAX_MOD_KNOWN];
 static int	mod_numknown;
+static registry_t	mod_reg = REG_INIT(mod_known, model_t);
 static int	mod_max = 0;
 
 int	registration_sequence;
@@ -152,16 +153,18 @@ Mod_ForName (char *name, model_t *parent_model, qboolean crash)
 	//
 	// search the currently loaded models
 	//
-	for (i=0 , mod=mod_known ; i<mod_numknown ; i++, mod++)
-		if (!strcmp (mod->name, name) )
-			return mod;
+	i = Reg_Find(&mod_reg, name);
+	if (i >= 0)
+		return &mod_known[i];
 
 	//
-	// find a free model slot spot
+	// find a free model slot spot. A load that errored
+	// out left its name behind, but never finished its
+	// hunk or got registered, so that's free too
 	//
 	for (i=0 , mod=mod_known ; i<mod_numknown ; i++, mod++)
 	{
-		if (!mod->name[0])
+		if (!mod->name[0] || !mod->extradatasize)
 			break;	// free spot
 	}
 	if (i == mod_numknown)
@@ -170,6 +173,7 @@ Mod_ForName (char *name, model_t *parent_model, qboolean crash)
 			ri.Sys_Error(ERR_DROP, "%s: mod_numknown == MAX_MOD_KNOWN", __func__);
 		mod_numknown++;
 	}
+	memset (mod, 0, sizeof(*mod));
 	strcpy (mod->name, name);
 
 	//
@@ -224,6 +228,7 @@ Mod_ForName (char *name, model_t *parent_model, qboolean crash)
 		break;
 
 	case IDBSPHEADER:
+	case QBSPHEADER:
 		Mod_LoadBrushModel(mod, buf, modfilelen);
 		break;
 
@@ -234,6 +239,7 @@ Mod_ForName (char *name, model_t *parent_model, qboolean crash)
 	}
 
 	mod->extradatasize = Hunk_End();
+	Reg_Add(&mod_reg, mod - mod_known);
 
 	ri.FS_FreeFile(buf);
 
@@ -250,6 +256,8 @@ Mod_ClusterPVS (int cluster, const model_t *model)
 {
 	if (cluster == -1 || !model->vis)
 		return mod_novis;
+	if (model->pvscache)
+		return Mod_CachedClusterPVS (model->pvscache, cluster);
 	return Mod_DecompressVis ( (byte *)model->vis +
 		model->vis->bitofs[cluster][DVIS_PVS],
 		(model->vis->numclusters+7)>>3);
@@ -396,21 +404,11 @@ Mod_LoadFaces
 =================
 */
 static void
-Mod_LoadFaces (model_t *loadmodel, byte *mod_base, lump_t *l)
+Mod_LoadFaces (model_t *loadmodel, const dqface_t *in, int count)
 {
-	dface_t		*in;
 	msurface_t 	*out;
-	int			i, count, surfnum;
+	int			i, surfnum;
 
-	in = (void *)(mod_base + l->fileofs);
-
-	if (l->filelen % sizeof(*in))
-	{
-		ri.Sys_Error(ERR_DROP, "%s: funny lump size in %s",
-				__func__, loadmodel->name);
-	}
-
-	count = l->filelen / sizeof(*in);
 	out = Hunk_Alloc((count+6)*sizeof(*out));	// extra for skybox
 
 	loadmodel->surfaces = out;
@@ -420,8 +418,8 @@ Mod_LoadFaces (model_t *loadmodel, byte *mod_base, lump_t *l)
 	{
 		int planenum, side, ti;
 
-		out->firstedge = LittleLong(in->firstedge);
-		out->numedges = LittleShort(in->numedges);
+		out->firstedge = in->firstedge;
+		out->numedges = in->numedges;
 		if (out->numedges < 3)
 		{
 			ri.Sys_Error(ERR_DROP, "%s: Surface with %d edges",
@@ -429,8 +427,8 @@ Mod_LoadFaces (model_t *loadmodel, byte *mod_base, lump_t *l)
 		}
 		out->flags = 0;
 
-		planenum = LittleShort(in->planenum);
-		side = LittleShort(in->side);
+		planenum = in->planenum;
+		side = in->side;
 		if (side)
 			out->flags |= SURF_PLANEBACK;
 
@@ -441,7 +439,7 @@ Mod_LoadFaces (model_t *loadmodel, byte *mod_base, lump_t *l)
 		}
 		out->plane = loadmodel->planes + planenum;
 
-		ti = LittleShort(in->texinfo);
+		ti = in->texinfo;
 		if (ti < 0 || ti >= loadmodel->numtexinfo)
 		{
 			ri.Sys_Error(ERR_DROP, "%s: bad texinfo number", __func__);
@@ -456,7 +454,7 @@ Mod_LoadFaces (model_t *loadmodel, byte *mod_base, lump_t *l)
 			out->styles[i] = in->styles[i];
 		}
 
-		i = LittleLong(in->lightofs);
+		i = in->lightofs;
 
 		if (i == -1)
 		{
@@ -514,21 +512,11 @@ Mod_LoadLeafs
 =================
 */
 static void
-Mod_LoadLeafs (model_t *loadmodel, byte *mod_base, lump_t *l)
+Mod_LoadLeafs (model_t *loadmodel, const dqleaf_t *in, int count)
 {
-	dleaf_t 	*in;
 	mleaf_t 	*out;
-	int			i, j, count;
+	int			i, j;
 
-	in = (void *)(mod_base + l->fileofs);
-
-	if (l->filelen % sizeof(*in))
-	{
-		ri.Sys_Error(ERR_DROP, "%s: funny lump size in %s",
-				__func__, loadmodel->name);
-	}
-
-	count = l->filelen / sizeof(*in);
 	out = Hunk_Alloc(count*sizeof(*out));
 
 	loadmodel->leafs = out;
@@ -540,17 +528,16 @@ Mod_LoadLeafs (model_t *loadmodel, byte *mod_base, lump_t *l)
 
 		for (j=0 ; j<3 ; j++)
 		{
-			out->minmaxs[j] = LittleShort (in->mins[j]);
-			out->minmaxs[3+j] = LittleShort (in->maxs[j]);
+			out->minmaxs[j] = in->mins[j];
+			out->minmaxs[3+j] = in->maxs[j];
 		}
 
-		out->contents = LittleLong(in->contents);
-		out->cluster = LittleShort(in->cluster);
-		out->area = LittleShort(in->area);
+		out->contents = in->contents;
+		out->cluster = in->cluster;
+		out->area = in->area;
 
-		// make unsigned long from signed short
-		firstleafface = LittleShort(in->firstleafface) & 0xFFFF;
-		out->nummarksurfaces = LittleShort(in->numleaffaces) & 0xFFFF;
+		firstleafface = in->firstleafface;
+		out->nummarksurfaces = in->numleaffaces;
 
 		out->firstmarksurface = loadmodel->marksurfaces + firstleafface;
 		if ((firstleafface + out->nummarksurfaces) > loadmodel->nummarksurfaces)
@@ -568,21 +555,11 @@ Mod_LoadMarksurfaces
 =================
 */
 static void
-Mod_LoadMarksurfaces (model_t *loadmodel, byte *mod_base, lump_t *l)
+Mod_LoadMarksurfaces (model_t *loadmodel, const unsigned int *in, int count)
 {
-	int		i, count;
-	short		*in;
+	int		i;
 	msurface_t **out;
 
-	in = (void *)(mod_base + l->fileofs);
-
-	if (l->filelen % sizeof(*in))
-	{
-		ri.Sys_Error(ERR_DROP, "%s: funny lump size in %s",
-				__func__, loadmodel->name);
-	}
-
-	count = l->filelen / sizeof(*in);
 	out = Hunk_Alloc(count*sizeof(*out));
 
 	loadmodel->marksurfaces = out;
@@ -591,8 +568,8 @@ Mod_LoadMarksurfaces (model_t *loadmodel, byte *mod_base, lump_t *l)
 	for ( i=0 ; i<count ; i++)
 	{
 		int j;
-		j = LittleShort(in[i]);
-		if (j >= loadmodel->numsurfaces)
+		j = in[i];
+		if ((j < 0) || (j >= loadmodel->numsurfaces))
 		{
 			ri.Sys_Error(ERR_DROP, "%s: bad surface number", __func__);
 		}
@@ -611,12 +588,22 @@ Mod_LoadBrushModel(model_t *mod, void *buffer, int modfilelen)
 	int		i;
 	dheader_t	*header;
 	byte	*mod_base;
+	dqface_t	*faces;
+	dqleaf_t	*leafs;
+	dqnode_t	*nodes;
+	dqedge_t	*edges;
+	unsigned int	*leaffaces;
+	int		numfaces, numleafs, numnodes, numedges, numleaffaces;
+	qboolean	qbsp;
 
 	if (mod != mod_known)
 		ri.Sys_Error(ERR_DROP, "%s: Loaded a brush model after the world", __func__);
 
 	header = (dheader_t *)buffer;
 
+	/* QBSP maps have the same version, but wider lumps */
+	qbsp = (LittleLong(header->ident) == QBSPHEADER);
+
 	i = LittleLong (header->version);
 	if (i != BSPVERSION)
 	{
@@ -630,13 +617,24 @@ Mod_LoadBrushModel(model_t *mod, void *buffer, int modfilelen)
 	for (i=0 ; i<sizeof(dheader_t)/4 ; i++)
 		((int *)header)[i] = LittleLong ( ((int *)header)[i]);
 
+
+	/* the lumps that differ, in the QBSP layout for both */
+	faces = Mod_LoadQBSPLump(mod->name, mod_base, &header->lumps[LUMP_FACES],
+		LUMP_FACES, qbsp, &numfaces);
+	leaffaces = Mod_LoadQBSPLump(mod->name, mod_base, &header->lumps[LUMP_LEAFFACES],
+		LUMP_LEAFFACES, qbsp, &numleaffaces);
+	leafs = Mod_LoadQBSPLump(mod->name, mod_base, &header->lumps[LUMP_LEAFS],
+		LUMP_LEAFS, qbsp, &numleafs);
+	nodes = Mod_LoadQBSPLump(mod->name, mod_base, &header->lumps[LUMP_NODES],
+		LUMP_NODES, qbsp, &numnodes);
+	edges = Mod_LoadQBSPLump(mod->name, mod_base, &header->lumps[LUMP_EDGES],
+		LUMP_EDGES, qbsp, &numedges);
+
 	// calculate the needed hunksize from the lumps
 	int hunkSize = 0;
 	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_VERTEXES], sizeof(dvertex_t), sizeof(mvertex_t), 8);
-	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_EDGES], sizeof(dedge_t), sizeof(medge_t), 13);
-	float surfEdgeCount = (float)header->lumps[LUMP_SURFEDGES].filelen / sizeof(int);
-	if(surfEdgeCount < MAX_MAP_SURFEDGES) // else it errors out later anyway
-		hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_SURFEDGES], sizeof(int), sizeof(int), 24);
+	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_EDGES], qbsp ? sizeof(dqedge_t) : sizeof(dedge_t), sizeof(medge_t), 13);
+	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_SURFEDGES], sizeof(int), sizeof(int), 24);
 
 	// lighting is a special case, because we keep only 1 byte out of 3
 	// (=> no colored lighting in soft renderer by default)
@@ -649,11 +647,11 @@ Mod_LoadBrushModel(model_t *mod, void *buffer, int modfilelen)
 
 	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_PLANES], sizeof(dplane_t), sizeof(cplane_t)*2, 6);
 	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_TEXINFO], sizeof(texinfo_t), sizeof(mtexinfo_t), 6);
-	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_FACES], sizeof(dface_t), sizeof(msurface_t), 6);
-	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_LEAFFACES], sizeof(short), sizeof(msurface_t *), 0); // yes, out is indeed a pointer!
+	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_FACES], qbsp ? sizeof(dqface_t) : sizeof(dface_t), sizeof(msurface_t), 6);
+	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_LEAFFACES], qbsp ? sizeof(int) : sizeof(short), sizeof(msurface_t *), 0); // yes, out is indeed a pointer!
 	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_VISIBILITY], 1, 1, 0);
-	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_LEAFS], sizeof(dleaf_t), sizeof(mleaf_t), 0);
-	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_NODES], sizeof(dnode_t), sizeof(mnode_t), 0);
+	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_LEAFS], qbsp ? sizeof(dqleaf_t) : sizeof(dleaf_t), sizeof(mleaf_t), 0);
+	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_NODES], qbsp ? sizeof(dqnode_t) : sizeof(dnode_t), sizeof(mnode_t), 0);
 	hunkSize += Mod_CalcLumpHunkSize(&header->lumps[LUMP_MODELS], sizeof(dmodel_t), sizeof(model_t), 0);
 
 	hunkSize += 1048576; // 1MB extra just in case
@@ -666,7 +664,7 @@ Mod_LoadBrushModel(model_t *mod, void *buffer, int modfilelen)
 	Mod_LoadVertexes (mod->name, &mod->vertexes, &mod->numvertexes, mod_base,
 		&header->lumps[LUMP_VERTEXES], 8);
 	Mod_LoadEdges (mod->name, &mod->edges, &mod->numedges,
-		mod_base, &header->lumps[LUMP_EDGES], 13);
+		edges, numedges, 13);
 	Mod_LoadSurfedges (mod->name, &mod->surfedges, &mod->numsurfedges,
 		mod_base, &header->lumps[LUMP_SURFEDGES], 24);
 	Mod_LoadLighting (&mod->lightdata, mod_base, &header->lumps[LUMP_LIGHTING]);
@@ -675,15 +673,19 @@ Mod_LoadBrushModel(model_t *mod, void *buffer, int modfilelen)
 	Mod_LoadTexinfo (mod->name, &mod->texinfo, &mod->numtexinfo,
 		mod_base, &header->lumps[LUMP_TEXINFO], (findimage_t)R_FindImage,
 		r_notexture_mip, 6);
-	Mod_LoadFaces (mod, mod_base, &header->lumps[LUMP_FACES]);
-	Mod_LoadMarksurfaces (mod, mod_base, &header->lumps[LUMP_LEAFFACES]);
+	Mod_LoadFaces (mod, faces, numfaces);
+	Mod_LoadMarksurfaces (mod, leaffaces, numleaffaces);
 	Mod_LoadVisibility (&mod->vis, mod_base, &header->lumps[LUMP_VISIBILITY]);
-	Mod_LoadLeafs (mod, mod_base, &header->lumps[LUMP_LEAFS]);
+	Mod_LoadLeafs (mod, leafs, numleafs);
 	Mod_LoadNodes (mod->name, mod->planes, mod->numplanes, mod->leafs,
-		mod->numleafs, &mod->nodes, &mod->numnodes, mod_base,
-		&header->lumps[LUMP_NODES]);
+		mod->numleafs, &mod->nodes, &mod->numnodes, nodes,
+		numnodes);
 	Mod_LoadSubmodels (mod, mod_base, &header->lumps[LUMP_MODELS]);
 
+	Mod_FreeQBSPLumps();
+
+	mod->pvscache = Mod_CreatePVSCache (mod->vis, mod->leafs, mod->numleafs);
+
 	R_InitSkyBox (mod);
 }
 
@@ -757,28 +759,23 @@ RE_EndRegistration
 
 =====================
 */
+static void
+Mod_FreeUnused (int handle)
+{
+	// don't need this model
+	Mod_Free (&mod_known[handle]);
+}
+
 void
 RE_EndRegistration (void)
 {
-	int	i;
-	model_t	*mod;
-
 	if (Mod_HasFreeSpace() && R_ImageHasFreeSpace())
 	{
 		// should be enough space for load next maps
 		return;
 	}
 
-	for (i=0, mod=mod_known ; i<mod_numknown ; i++, mod++)
-	{
-		if (!mod->name[0])
-			continue;
-		if (mod->registration_sequence != registration_sequence)
-		{
-			// don't need this model
-			Mod_Free (mod);
-		}
-	}
+	Reg_Purge(&mod_reg, registration_sequence, Mod_FreeUnused);
 
 	R_FreeUnusedImages ();
 }
@@ -794,6 +791,8 @@ Mod_Free
 void
 Mod_Free (model_t *mod)
 {
+	Reg_Remove(&mod_reg, mod - mod_known);
+	Mod_FreePVSCache (mod->pvscache);
 	Hunk_Free (mod->extradata);
 	memset (mod, 0, sizeof(*mod));
 }
@@ -813,4 +812,7 @@ Mod_FreeAll (void)
 		if (mod_known[i].extradatasize)
 			Mod_Free (&mod_known[i]);
 	}
+
+	Reg_Clear(&mod_reg);
+	Mod_FreeQBSPLumps();
 }
@@ -26,229 +26,561 @@ extern cvar_t	*sw_custom_particles;
 #define PARTICLE_66     1
 #define PARTICLE_OPAQUE 2
 
+// with more than one thread particles are binned into square screen
+// tiles and every row of tiles is rasterized on its own, so no two
+// threads ever touch the same pixel
+#define PARTICLE_TILE_SHIFT	6
+#define PARTICLE_TILE_SIZE	(1 << PARTICLE_TILE_SHIFT)
+
+// below this binning costs more than it saves
+#define MIN_BINNED_PARTICLES	2048
+
+typedef struct
+{
+	int		u, v;	// top left corner on screen
+	int		pix;	// size of the square
+	zvalue_t	izi;
+	int		color;
+	int		level;
+} projparticle_t;
+
+static int	r_numallocatedparticles;
+static float	*r_partx, *r_party, *r_partz;	// view space, later projected
+static projparticle_t	*r_projparticles;
+static projparticle_t	*r_particlebins;
+static int	r_numallocatedbins;
+static int	*r_tilefirst;
+static int	r_numallocatedtiles;
+
+// the frame the workers are drawing
+static int	r_tilesw, r_tilesh, r_custom_particle;
+
+static void R_DrawParticleRect (const projparticle_t *p, int x0, int y0,
+	int x1, int y1, int custom_particle);
+
 /*
-** R_DrawParticle
+** R_DrawParticleTileRow
 **
-** Yes, this is amazingly slow, but it's the C reference
-** implementation and should be both robust and vaguely
-** understandable.  The only time this path should be
-** executed is if we're debugging on x86 or if we're
-** recompiling and deploying on a non-x86 platform.
-**
-** To minimize error and improve readability I went the
-** function pointer route.  This exacts some overhead, but
-** it pays off in clean and easy to understand code.
+** Draws a row of tiles, runs on the engines worker threads.
+** The jobs are the rows of r_tilefirst, the row number is
+** where the job starts in there.
 */
 static void
-R_DrawParticle(particle_t *pparticle, int level)
+R_DrawParticleTileRow (void *job, int thread)
 {
-	vec3_t		local, transformed;
-	float		zi;
-	byte		*pdest;
-	zvalue_t	*pz;
-	int		color = pparticle->color;
-	int		i, pix, count, u, v;
-	zvalue_t	izi;
-	int 		custom_particle = (int)sw_custom_particles->value;
+	int ty = (int)(((int *)job - r_tilefirst) / r_tilesw);
+	int tx;
 
-	/*
-	** transform the particle
-	*/
-	VectorSubtract (pparticle->origin, r_origin, local);
+	for (tx = 0; tx < r_tilesw; tx++)
+	{
+		int tile = ty * r_tilesw + tx;
+		int first = tile ? r_tilefirst[tile - 1] : 0;
+		int x0 = tx << PARTICLE_TILE_SHIFT;
+		int y0 = ty << PARTICLE_TILE_SHIFT;
+		int i;
 
-	transformed[0] = DotProduct(local, r_pright);
-	transformed[1] = DotProduct(local, r_pup);
-	transformed[2] = DotProduct(local, r_ppn);
+		for (i = first; i < r_tilefirst[tile]; i++)
+		{
+			R_DrawParticleRect(&r_particlebins[i],
+				x0, y0, x0 + PARTICLE_TILE_SIZE, y0 + PARTICLE_TILE_SIZE,
+				r_custom_particle);
+		}
+	}
+}
 
-	if (transformed[2] < PARTICLE_Z_CLIP)
-		return;
+/*
+** R_ShutdownParticles
+*/
+void
+R_ShutdownParticles (void)
+{
+	free(r_partx);
+	free(r_party);
+	free(r_partz);
+	free(r_projparticles);
+	free(r_particlebins);
+	free(r_tilefirst);
 
-	/*
-	** project the point
-	*/
-	// FIXME: preadjust xcenter and ycenter
-	zi = 1.0 / transformed[2];
-	u = (int)(xcenter + zi * transformed[0] + 0.5);
-	v = (int)(ycenter - zi * transformed[1] + 0.5);
+	r_partx = r_party = r_partz = NULL;
+	r_projparticles = NULL;
+	r_particlebins = NULL;
+	r_tilefirst = NULL;
+	r_numallocatedparticles = 0;
+	r_numallocatedbins = 0;
+	r_numallocatedtiles = 0;
+}
 
-	if ((v > d_vrectbottom_particle) ||
-		(u > d_vrectright_particle) ||
-		(v < d_vrecty) ||
-		(u < d_vrectx))
+/*
+** R_AllocParticleBuffers
+**
+** Grows the per frame buffers, returns false if we're out of memory
+*/
+static qboolean
+R_AllocParticleBuffers (int numparticles, int numtiles)
+{
+	if (numparticles > r_numallocatedparticles)
 	{
-		return;
-	}
+		int	size;
 
-	/*
-	** compute addresses of zbuffer, framebuffer, and
-	** compute the Z-buffer reference value.
-	*/
-	pz = d_pzbuffer + (vid_buffer_width * v) + u;
-	pdest = d_viewbuffer + vid_buffer_width * v + u;
-	izi = (int)(zi * 0x8000);
+		// padded to a multiple of 4 for the projection loop
+		size = (numparticles * 2 + 3) & ~3;
 
-	/*
-	** determine the screen area covered by the particle,
-	** which also means clamping to a min and max
-	*/
-	pix = (izi * d_pix_mul) >> 7;
-	if (pix < d_pix_min)
-		pix = d_pix_min;
-	else if (pix > d_pix_max)
-		pix = d_pix_max;
+		free(r_partx);
+		free(r_party);
+		free(r_partz);
+		free(r_projparticles);
 
-	/*
-	** render the appropriate pixels
-	*/
-	count = pix;
-	if ((pz[(vid_buffer_width * count / 2) + (count / 2)]) > izi)
-	{
-		// looks like under some object
-		return;
-	}
+		r_partx = malloc(size * sizeof(float));
+		r_party = malloc(size * sizeof(float));
+		r_partz = malloc(size * sizeof(float));
+		r_projparticles = malloc(size * sizeof(projparticle_t));
 
-	// zbuffer particles damage
-	VID_DamageZBuffer(u, v);
-	VID_DamageZBuffer(u + count, v + count);
+		if (!r_partx || !r_party || !r_partz || !r_projparticles)
+		{
+			R_Printf(PRINT_ALL, "%s: Couldn't malloc %d particles\n",
+				 __func__, size);
+			R_ShutdownParticles();
+			return false;
+		}
 
-	if (custom_particle == 0)
+		r_numallocatedparticles = size;
+	}
+
+	if (numtiles + 1 > r_numallocatedtiles)
 	{
-		switch (level) {
-		case PARTICLE_33 :
-			for ( ; count ; count--, pz += vid_buffer_width, pdest += vid_buffer_width)
-			{
-				//FIXME--do it in blocks of 8?
-				for (i=0 ; i<pix ; i++)
-				{
-					if (pz[i] <= izi)
-					{
-						pz[i]	= izi;
-						pdest[i] = vid_alphamap[color + ((int)pdest[i]<<8)];
-					}
-				}
-			}
-			break;
+		free(r_tilefirst);
 
-		case PARTICLE_66 :
+		r_tilefirst = malloc((numtiles + 1) * sizeof(int));
+		if (!r_tilefirst)
 		{
-			int color_part = (color<<8);
-			for ( ; count ; count--, pz += vid_buffer_width, pdest += vid_buffer_width)
-			{
-				for (i=0 ; i<pix ; i++)
-				{
-					if (pz[i] <= izi)
-					{
-						pz[i]	= izi;
-						pdest[i] = vid_alphamap[color_part + (int)pdest[i]];
-					}
-				}
-			}
-			break;
+			R_Printf(PRINT_ALL, "%s: Couldn't malloc %d tiles\n",
+				 __func__, numtiles + 1);
+			R_ShutdownParticles();
+			return false;
 		}
 
-		default:  //100
-			for ( ; count ; count--, pz += vid_buffer_width, pdest += vid_buffer_width)
-			{
-				for (i=0 ; i<pix ; i++)
-				{
-					if (pz[i] <= izi)
-					{
-						pz[i]	= izi;
-						pdest[i] = color;
-					}
-				}
-			}
-			break;
-		}
+		r_numallocatedtiles = numtiles + 1;
 	}
-	else
+
+	return true;
+}
+
+/*
+** R_ProjectParticles
+**
+** Transforms and projects count particles that were copied into
+** r_partx, r_party and r_partz. count must be a multiple of 4, the
+** loop is written so the compiler can vectorize it.
+*/
+static void
+R_ProjectParticles (int count, float *restrict px, float *restrict py,
+	float *restrict pz)
+{
+	vec3_t	right, up, pn, origin;
+	float	x_center, y_center;
+	int	i;
+
+	VectorCopy(r_pright, right);
+	VectorCopy(r_pup, up);
+	VectorCopy(r_ppn, pn);
+	VectorCopy(r_origin, origin);
+	x_center = xcenter;
+	y_center = ycenter;
+
+	for (i = 0; i < count; i++)
+	{
+		float	lx, ly, lz, tx, ty, tz, zi;
+
+		lx = px[i] - origin[0];
+		ly = py[i] - origin[1];
+		lz = pz[i] - origin[2];
+
+		tx = lx * right[0] + ly * right[1] + lz * right[2];
+		ty = lx * up[0] + ly * up[1] + lz * up[2];
+		tz = lx * pn[0] + ly * pn[1] + lz * pn[2];
+
+		// particles behind the clip plane are rejected later on
+		zi = 1.0 / tz;
+
+		px[i] = x_center + zi * tx;
+		py[i] = y_center - zi * ty;
+		pz[i] = zi;
+
+		// keep the depth sign, so the clip test still works
+		if (tz < PARTICLE_Z_CLIP)
+			pz[i] = -1.0f;
+	}
+}
+
+/*
+** R_ParticleRowSpan
+**
+** Narrows the columns of a row to the ones that are drawn. Custom
+** particles only draw the pixels with min_int <= i + count <= max_int.
+*/
+static inline qboolean
+R_ParticleRowSpan (int count, int min_int, int max_int, int i0, int i1,
+	int *first, int *last)
+{
+	*first = (min_int - count > i0) ? min_int - count : i0;
+	*last = (max_int - count + 1 < i1) ? max_int - count + 1 : i1;
+
+	return *first < *last;
+}
+
+/*
+** R_DrawParticleRect
+**
+** Draws the part of a particle that falls inside of the tile
+** [x0, x1) x [y0, y1). Rows and columns are numbered as if the whole
+** particle were drawn, so custom particles keep their shape.
+*/
+static void
+R_DrawParticleRect (const projparticle_t *p, int x0, int y0, int x1, int y1,
+	int custom_particle)
+{
+	int		i, row, i0, i1, r0, r1, first, last;
+	int		pix = p->pix;
+	int		color = p->color;
+	zvalue_t	izi = p->izi;
+	int		min_int, max_int;
+	zvalue_t	*pz;
+	byte		*pdest;
+
+	i0 = x0 - p->u;
+	if (i0 < 0)
+		i0 = 0;
+	i1 = x1 - p->u;
+	if (i1 > pix)
+		i1 = pix;
+	r0 = y0 - p->v;
+	if (r0 < 0)
+		r0 = 0;
+	r1 = y1 - p->v;
+	if (r1 > pix)
+		r1 = pix;
+
+	if (i0 >= i1 || r0 >= r1)
+		return;
+
+	if (custom_particle)
 	{
-		int min_int, max_int;
 		min_int = pix / 2;
 		max_int = (pix * 2) - min_int;
+	}
+	else
+	{
+		// every pixel passes
+		min_int = 0;
+		max_int = pix * 2;
+	}
 
-		switch (level) {
-		case PARTICLE_33 :
-			for ( ; count ; count--, pz += vid_buffer_width, pdest += vid_buffer_width)
+	pz = d_pzbuffer + vid_buffer_width * (p->v + r0) + p->u;
+	pdest = d_viewbuffer + vid_buffer_width * (p->v + r0) + p->u;
+
+	// the original loops counted the rows down from pix
+	switch (p->level) {
+	case PARTICLE_33 :
+		for (row = r0; row < r1; row++, pz += vid_buffer_width, pdest += vid_buffer_width)
+		{
+			if (!R_ParticleRowSpan(pix - row, min_int, max_int, i0, i1, &first, &last))
+				continue;
+
+			for (i = first; i < last; i++)
 			{
-				//FIXME--do it in blocks of 8?
-				for (i=0 ; i<pix ; i++)
+				if (pz[i] <= izi)
 				{
-					int pos = i + count;
-					if (pos >= min_int && pos <= max_int && pz[i] <= izi)
-					{
-						pz[i]	= izi;
-						pdest[i] = vid_alphamap[color + ((int)pdest[i]<<8)];
-					}
+					pz[i]	= izi;
+					pdest[i] = vid_alphamap[color + ((int)pdest[i]<<8)];
 				}
 			}
-			break;
+		}
+		break;
 
-		case PARTICLE_66 :
+	case PARTICLE_66 :
+	{
+		int color_part = (color<<8);
+		for (row = r0; row < r1; row++, pz += vid_buffer_width, pdest += vid_buffer_width)
 		{
-			int color_part = (color<<8);
-			for ( ; count ; count--, pz += vid_buffer_width, pdest += vid_buffer_width)
+			if (!R_ParticleRowSpan(pix - row, min_int, max_int, i0, i1, &first, &last))
+				continue;
+
+			for (i = first; i < last; i++)
 			{
-				for (i=0 ; i<pix ; i++)
+				if (pz[i] <= izi)
 				{
-					int pos = i + count;
-					if (pos >= min_int && pos <= max_int && pz[i] <= izi)
-					{
-						pz[i]	= izi;
-						pdest[i] = vid_alphamap[color_part + (int)pdest[i]];
-					}
+					pz[i]	= izi;
+					pdest[i] = vid_alphamap[color_part + (int)pdest[i]];
 				}
 			}
-			break;
 		}
+		break;
+	}
 
-		default:  //100
-			for ( ; count ; count--, pz += vid_buffer_width, pdest += vid_buffer_width)
+	default:  //100
+		for (row = r0; row < r1; row++, pz += vid_buffer_width, pdest += vid_buffer_width)
+		{
+			if (!R_ParticleRowSpan(pix - row, min_int, max_int, i0, i1, &first, &last))
+				continue;
+
+			for (i = first; i < last; i++)
 			{
-				for (i=0 ; i<pix ; i++)
+				if (pz[i] <= izi)
 				{
-					int pos = i + count;
-					if (pos >= min_int && pos <= max_int && pz[i] <= izi)
-					{
-						pz[i]	= izi;
-						pdest[i] = color;
-					}
+					pz[i]	= izi;
+					pdest[i] = color;
 				}
 			}
-			break;
 		}
+		break;
+	}
+}
+
+/*
+** R_CullParticle
+**
+** Rejects and sizes a projected particle, zi is negative
+** for particles behind the clip plane
+*/
+static qboolean
+R_CullParticle (const particle_t *p, float x, float y, float zi,
+	projparticle_t *proj)
+{
+	int		u, v, pix;
+	zvalue_t	izi;
+
+	if (zi < 0)
+		return false;
+
+	u = (int)(x + 0.5);
+	v = (int)(y + 0.5);
+
+	if ((v > d_vrectbottom_particle) ||
+		(u > d_vrectright_particle) ||
+		(v < d_vrecty) ||
+		(u < d_vrectx))
+	{
+		return false;
 	}
+
+	izi = (int)(zi * 0x8000);
+
+	/*
+	** determine the screen area covered by the particle,
+	** which also means clamping to a min and max
+	*/
+	pix = (izi * d_pix_mul) >> 7;
+	if (pix < d_pix_min)
+		pix = d_pix_min;
+	else if (pix > d_pix_max)
+		pix = d_pix_max;
+
+	proj->u = u;
+	proj->v = v;
+	proj->pix = pix;
+	proj->izi = izi;
+	proj->color = p->color;
+
+	if ( p->alpha > 0.66 )
+		proj->level = PARTICLE_OPAQUE;
+	else if ( p->alpha > 0.33 )
+		proj->level = PARTICLE_66;
+	else
+		proj->level = PARTICLE_33;
+
+	return true;
+}
+
+/*
+** R_ParticleOccluded
+*/
+static qboolean
+R_ParticleOccluded (const projparticle_t *proj)
+{
+	const zvalue_t *pz = d_pzbuffer + (vid_buffer_width * proj->v) + proj->u;
+
+	// looks like under some object
+	return (pz[(vid_buffer_width * proj->pix / 2) + (proj->pix / 2)]) > proj->izi;
 }
 
 /*
 ** R_DrawParticles
 **
 ** Responsible for drawing all of the particles in the particle list
-** throughout the world.  Doesn't care if we're using the C path or
-** if we're using the asm path, it simply assigns a function pointer
-** and goes.
+** throughout the world. With one thread they're drawn one after the
+** other. With enough particles and more than one thread they're all
+** projected at once, sorted into screen tiles and the tiles are drawn
+** in parallel. The bins keep the particles in list order, so the
+** blending looks the same either way.
 */
 void
 R_DrawParticles (void)
 {
-	particle_t *p;
-	int         i;
+	particle_t	*p;
+	int		i, padded, numvisible, numbins, tilesw, tilesh, numtiles;
+	int		tx, ty;
+	int		custom_particle = (int)sw_custom_particles->value;
+
+	if (r_newrefdef.num_particles <= 0)
+		return;
 
 	VectorScale( vright, xscaleshrink, r_pright );
 	VectorScale( vup, yscaleshrink, r_pup );
 	VectorCopy( vpn, r_ppn );
 
+	if ((ri.Com_NumJobThreads() < 2) || r_newrefdef.num_particles < MIN_BINNED_PARTICLES)
+	{
+		projparticle_t	proj;
+
+		for (p=r_newrefdef.particles, i=0 ; i<r_newrefdef.num_particles ; i++,p++)
+		{
+			vec3_t	local, transformed;
+			float	zi;
+
+			/*
+			** transform the particle, the same math as
+			** R_ProjectParticles
+			*/
+			VectorSubtract (p->origin, r_origin, local);
+
+			transformed[0] = DotProduct(local, r_pright);
+			transformed[1] = DotProduct(local, r_pup);
+			transformed[2] = DotProduct(local, r_ppn);
+
+			if (transformed[2] < PARTICLE_Z_CLIP)
+				continue;
+
+			zi = 1.0 / transformed[2];
+
+			if (!R_CullParticle(p, xcenter + zi * transformed[0],
+					ycenter - zi * transformed[1], zi, &proj) ||
+				R_ParticleOccluded(&proj))
+			{
+				continue;
+			}
+
+			// zbuffer particles damage
+			VID_DamageZBuffer(proj.u, proj.v);
+			VID_DamageZBuffer(proj.u + proj.pix, proj.v + proj.pix);
+
+			R_DrawParticleRect(&proj, proj.u, proj.v,
+				proj.u + proj.pix, proj.v + proj.pix, custom_particle);
+		}
+
+		return;
+	}
+
+	tilesw = (r_refdef.vrectright + PARTICLE_TILE_SIZE - 1) >> PARTICLE_TILE_SHIFT;
+	tilesh = (r_refdef.vrectbottom + PARTICLE_TILE_SIZE - 1) >> PARTICLE_TILE_SHIFT;
+	numtiles = tilesw * tilesh;
+
+	if (!R_AllocParticleBuffers(r_newrefdef.num_particles, numtiles))
+		return;
+
+	/*
+	** project everything in one go
+	*/
+	padded = (r_newrefdef.num_particles + 3) & ~3;
+
+	for (p=r_newrefdef.particles, i=0 ; i<r_newrefdef.num_particles ; i++,p++)
+	{
+		r_partx[i] = p->origin[0];
+		r_party[i] = p->origin[1];
+		r_partz[i] = p->origin[2];
+	}
+	for ( ; i<padded ; i++)
+	{
+		// lands on the viewer and gets clipped
+		r_partx[i] = r_origin[0];
+		r_party[i] = r_origin[1];
+		r_partz[i] = r_origin[2];
+	}
+
+	R_ProjectParticles(padded, r_partx, r_party, r_partz);
+
+	/*
+	** reject, size and count the tiles every particle touches
+	*/
+	memset(r_tilefirst, 0, (numtiles + 1) * sizeof(int));
+
+	numvisible = 0;
+	numbins = 0;
+
 	for (p=r_newrefdef.particles, i=0 ; i<r_newrefdef.num_particles ; i++,p++)
 	{
-		int level;
+		projparticle_t	*proj = &r_projparticles[numvisible];
+
+		// tested against the scene before any particle is drawn,
+		// so a particle is no longer dropped because an earlier
+		// one covers its center. The per pixel test still sorts
+		// the particles among each other.
+		if (!R_CullParticle(p, r_partx[i], r_party[i], r_partz[i], proj) ||
+			R_ParticleOccluded(proj))
+			continue;
+
+		numvisible++;
+
+		// zbuffer particles damage
+		VID_DamageZBuffer(proj->u, proj->v);
+		VID_DamageZBuffer(proj->u + proj->pix, proj->v + proj->pix);
+
+		for (ty = proj->v >> PARTICLE_TILE_SHIFT; ty <= (proj->v + proj->pix - 1) >> PARTICLE_TILE_SHIFT; ty++)
+		{
+			for (tx = proj->u >> PARTICLE_TILE_SHIFT; tx <= (proj->u + proj->pix - 1) >> PARTICLE_TILE_SHIFT; tx++)
+			{
+				r_tilefirst[ty * tilesw + tx + 1]++;
+				numbins++;
+			}
+		}
+	}
+
+	if (!numvisible)
+		return;
+
+	if (numbins > r_numallocatedbins)
+	{
+		free(r_particlebins);
+
+		r_numallocatedbins = numbins * 2;
+		r_particlebins = malloc(r_numallocatedbins * sizeof(projparticle_t));
+		if (!r_particlebins)
+		{
+			R_Printf(PRINT_ALL, "%s: Couldn't malloc %d bins\n",
+				 __func__, r_numallocatedbins);
+			r_numallocatedbins = 0;
+			return;
+		}
+	}
 
-		if ( p->alpha > 0.66 )
-			level = PARTICLE_OPAQUE;
-		else if ( p->alpha > 0.33 )
-			level = PARTICLE_66;
-		else
-			level = PARTICLE_33;
+	/*
+	** counting sort into the tiles, stable so each tile
+	** still sees its particles in list order. The particles
+	** are copied, so a tile is drawn from one linear block.
+	*/
+	for (i = 0; i < numtiles; i++)
+		r_tilefirst[i + 1] += r_tilefirst[i];
 
-		R_DrawParticle(p, level);
+	for (i = 0; i < numvisible; i++)
+	{
+		const projparticle_t *proj = &r_projparticles[i];
+
+		for (ty = proj->v >> PARTICLE_TILE_SHIFT; ty <= (proj->v + proj->pix - 1) >> PARTICLE_TILE_SHIFT; ty++)
+		{
+			for (tx = proj->u >> PARTICLE_TILE_SHIFT; tx <= (proj->u + proj->pix - 1) >> PARTICLE_TILE_SHIFT; tx++)
+			{
+				r_particlebins[r_tilefirst[ty * tilesw + tx]++] = *proj;
+			}
+		}
 	}
+
+	/*
+	** r_tilefirst[tile] now points at the end of the tile's
+	** bin, which is the start of the next one
+	*/
+	r_tilesw = tilesw;
+	r_tilesh = tilesh;
+	r_custom_particle = custom_particle;
+
+	ri.Com_RunJobs(R_DrawParticleTileRow, r_tilefirst, tilesh,
+		tilesw * sizeof(int));
 }
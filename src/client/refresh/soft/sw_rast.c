@@ -115,10 +115,6 @@ R_InitSkyBox (model_t *loadmodel)
 	loadmodel->numedges += 12;
 	r_skysurfedges = loadmodel->surfedges + loadmodel->numsurfedges;
 	loadmodel->numsurfedges += 24;
-	if (loadmodel->numsurfaces > MAX_MAP_FACES
-		|| loadmodel->numvertexes > MAX_MAP_VERTS
-		|| loadmodel->numedges > MAX_MAP_EDGES)
-		ri.Sys_Error (ERR_DROP, "InitSkyBox: map overflow");
 
 	memset (r_skyfaces, 0, 6*sizeof(*r_skyfaces));
 	for (i=0 ; i<6 ; i++)
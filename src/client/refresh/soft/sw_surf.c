@@ -21,14 +21,19 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "header/local.h"
 
-static int		sourcetstep;
-static void		*prowdestbase;
-static unsigned char	*pbasesource;
-static int		r_stepback;
-static int		r_lightwidth;
-static int		r_numvblocks;
-static unsigned char	*r_source, *r_sourcemax;
-static unsigned		*r_lightptr;
+// state of R_DrawSurface(), local so that surfaces can
+// be built on several threads, see D_BuildQueuedSurfaces()
+typedef struct
+{
+	int		sourcetstep;
+	void		*prowdestbase;
+	unsigned char	*pbasesource;
+	int		stepback;
+	int		lightwidth;
+	int		numvblocks;
+	unsigned char	*sourcemax;
+	unsigned	*lightptr;
+} surfblock_t;
 
 void R_BuildLightMap (drawsurf_t *drawsurf);
 
@@ -120,28 +125,28 @@ R_DrawSurfaceBlock8_anymip
 ================
 */
 static void
-R_DrawSurfaceBlock8_anymip (int level, int surfrowbytes)
+R_DrawSurfaceBlock8_anymip (surfblock_t *sb, int level, int surfrowbytes)
 {
 	int		v, i, size;
 	pixel_t	*psource, *prowdest;
 
 	size = 1 << level;
-	psource = pbasesource;
-	prowdest = prowdestbase;
+	psource = sb->pbasesource;
+	prowdest = sb->prowdestbase;
 
-	for (v=0 ; v<r_numvblocks ; v++)
+	for (v=0 ; v<sb->numvblocks ; v++)
 	{
 		light3_t	lightleft, lightright;
 		light3_t	lightleftstep, lightrightstep;
 
 		// FIXME: use delta rather than both right and left, like ASM?
-		memcpy(lightleft, r_lightptr, sizeof(light3_t));
-		memcpy(lightright, r_lightptr + 3, sizeof(light3_t));
-		r_lightptr += r_lightwidth * 3;
+		memcpy(lightleft, sb->lightptr, sizeof(light3_t));
+		memcpy(lightright, sb->lightptr + 3, sizeof(light3_t));
+		sb->lightptr += sb->lightwidth * 3;
 		for(i=0; i<3; i++)
 		{
-			lightleftstep[i] = (r_lightptr[i] - lightleft[i]) >> level;
-			lightrightstep[i] = (r_lightptr[i + 3] - lightright[i]) >> level;
+			lightleftstep[i] = (sb->lightptr[i] - lightleft[i]) >> level;
+			lightrightstep[i] = (sb->lightptr[i + 3] - lightright[i]) >> level;
 		}
 
 		for (i=0 ; i<size ; i++)
@@ -150,7 +155,7 @@ R_DrawSurfaceBlock8_anymip (int level, int surfrowbytes)
 
 			R_DrawSurfaceBlock_Light(prowdest, psource, size, level, lightleft, lightright);
 
-			psource += sourcetstep;
+			psource += sb->sourcetstep;
 
 			for(j=0; j<3; j++)
 			{
@@ -161,8 +166,8 @@ R_DrawSurfaceBlock8_anymip (int level, int surfrowbytes)
 			prowdest += surfrowbytes;
 		}
 
-		if (psource >= r_sourcemax)
-			psource -= r_stepback;
+		if (psource >= sb->sourcemax)
+			psource -= sb->stepback;
 	}
 }
 
@@ -175,7 +180,8 @@ R_DrawSurface
 static void
 R_DrawSurface (drawsurf_t *drawsurf)
 {
-	unsigned char	*basetptr;
+	surfblock_t	sb;
+	unsigned char	*basetptr, *r_source;
 	int		smax, tmax, twidth;
 	int		u;
 	int		soffset, basetoffset, texwidth;
@@ -197,20 +203,20 @@ R_DrawSurface (drawsurf_t *drawsurf)
 	blocksize = 16 >> drawsurf->surfmip;
 	blockdivshift = NUM_MIPS - drawsurf->surfmip;
 
-	r_lightwidth = (drawsurf->surf->extents[0]>>4)+1;
+	sb.lightwidth = (drawsurf->surf->extents[0]>>4)+1;
 
 	r_numhblocks = drawsurf->surfwidth >> blockdivshift;
-	r_numvblocks = drawsurf->surfheight >> blockdivshift;
+	sb.numvblocks = drawsurf->surfheight >> blockdivshift;
 
 	//==============================
 
 	smax = mt->width >> drawsurf->surfmip;
 	twidth = texwidth;
 	tmax = mt->height >> drawsurf->surfmip;
-	sourcetstep = texwidth;
-	r_stepback = tmax * twidth;
+	sb.sourcetstep = texwidth;
+	sb.stepback = tmax * twidth;
 
-	r_sourcemax = r_source + (tmax * smax);
+	sb.sourcemax = r_source + (tmax * smax);
 
 	soffset = drawsurf->surf->texturemins[0];
 	basetoffset = drawsurf->surf->texturemins[1];
@@ -224,19 +230,19 @@ R_DrawSurface (drawsurf_t *drawsurf)
 
 	for (u=0 ; u<r_numhblocks; u++)
 	{
-		r_lightptr = blocklights + u * 3;
+		sb.lightptr = drawsurf->blocklights + u * 3;
 
-		if (r_lightptr >= blocklight_max)
+		if (sb.lightptr >= drawsurf->blocklight_max)
 		{
-			r_outoflights = true;
+			drawsurf->outoflights = true;
 			continue;
 		}
 
-		prowdestbase = pcolumndest;
+		sb.prowdestbase = pcolumndest;
 
-		pbasesource = basetptr + soffset;
+		sb.pbasesource = basetptr + soffset;
 
-		R_DrawSurfaceBlock8_anymip(NUM_MIPS - drawsurf->surfmip, drawsurf->rowbytes);
+		R_DrawSurfaceBlock8_anymip(&sb, NUM_MIPS - drawsurf->surfmip, drawsurf->rowbytes);
 
 		soffset = soffset + blocksize;
 		if (soffset >= smax)
@@ -323,15 +329,63 @@ D_FlushCaches (void)
 	sc_base->size = sc_size;
 }
 
+static void
+D_SCEvict (surfcache_t *block)
+{
+	if (block->owner)
+	{
+		*block->owner = NULL;
+		block->owner = NULL;
+		c_surfevictions++;
+	}
+}
+
+/*
+ * Returns true if the block was used since the rover
+ * passed it the last time, which is forgotten now.
+ */
+static qboolean
+D_SCSecondChance (surfcache_t *block)
+{
+	if (block->owner && block->referenced)
+	{
+		block->referenced = 0;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Moves the rover behind block, or to the start
+ * if there are not size bytes after it.
+ */
+static void
+D_SCAdvanceRover (const surfcache_t *block, int size)
+{
+	sc_rover = block->next;
+
+	if ( !sc_rover || (byte *)sc_rover - (byte *)sc_base > sc_size - size)
+	{
+		sc_rover = sc_base;
+	}
+}
+
 /*
 =================
 D_SCAlloc
+
+The cache is a ring of blocks ordered by address. The rover
+frees blocks until there's enough memory at one place. Blocks
+that were used since the rover passed them the last time are
+skipped once (clock algorithm), so surfaces visible in every
+frame stay in the cache while old ones are thrown out.
 =================
 */
 static surfcache_t *
 D_SCAlloc (int width, int size)
 {
-	surfcache_t	*new;
+	surfcache_t	*new, *next;
 
 	if ((width < 0) || (width > 256))
 	{
@@ -357,24 +411,47 @@ D_SCAlloc (int width, int size)
 		sc_rover = sc_base;
 	}
 
-	// colect and free surfcache_t blocks until the rover block is large enough
-	new = sc_rover;
-	if (sc_rover->owner)
-		*sc_rover->owner = NULL;
-
-	while (new->size < size)
+	// colect and free surfcache_t blocks until the rover block is large enough.
+	// This terminates, each skipped block loses its second chance.
+	for (;;)
 	{
-		// free another
-		sc_rover = sc_rover->next;
-		if (!sc_rover)
+		new = sc_rover;
+
+		if (D_SCSecondChance(new))
+		{
+			D_SCAdvanceRover(new, size);
+			continue;
+		}
+
+		D_SCEvict(new);
+
+		while (new->size < size)
+		{
+			// free another
+			next = new->next;
+			if (!next)
+			{
+				ri.Sys_Error(ERR_FATAL, "%s: hit the end of memory", __func__);
+			}
+
+			if (D_SCSecondChance(next))
+			{
+				break;
+			}
+
+			D_SCEvict(next);
+
+			new->size += next->size;
+			new->next = next->next;
+		}
+
+		if (new->size >= size)
 		{
-			ri.Sys_Error(ERR_FATAL, "%s: hit the end of memory", __func__);
+			break;
 		}
-		if (sc_rover->owner)
-			*sc_rover->owner = NULL;
 
-		new->size += sc_rover->size;
-		new->next = sc_rover->next;
+		// a recently used block is in the way, continue behind it
+		D_SCAdvanceRover(next, size);
 	}
 
 	// create a fragment out of any leftovers
@@ -397,6 +474,7 @@ D_SCAlloc (int width, int size)
 		new->height = (size - sizeof(*new) + sizeof(new->data)) / width;
 
 	new->owner = NULL; // should be set properly after return
+	new->referenced = 1;
 
 	return new;
 }
@@ -405,55 +483,84 @@ D_SCAlloc (int width, int size)
 
 static drawsurf_t	r_drawsurf;
 
+// surfaces allocated by D_QueueSurface(), built by D_BuildQueuedSurfaces()
+typedef struct
+{
+	drawsurf_t	drawsurf;
+	surfcache_t	*cache;
+	int		miplevel;
+} surfbuild_t;
+
+static surfbuild_t	*r_surfqueue;
+static int		r_numqueuedsurfs, r_numallocatedqueue;
+static int		r_queuedbytes;
+
+// lightmap buffers of the job threads, thread 0 uses its own
+static light_t		*r_threadlights[MAX_JOB_THREADS + 1];
+static int		r_numthreadlights;
+
 /*
-================
-D_CacheSurface
-================
-*/
-surfcache_t *
-D_CacheSurface (const entity_t *currententity, msurface_t *surface, int miplevel)
+ * Sets up the image and light styles of the surface in drawsurf
+ * and returns true if the cache already holds it like that.
+ */
+static qboolean
+D_SurfaceCached (const entity_t *currententity, msurface_t *surface,
+	int miplevel, drawsurf_t *drawsurf)
 {
 	surfcache_t	*cache;
-	float		surfscale;
 
 	//
 	// if the surface is animating or flashing, flush the cache
 	//
-	r_drawsurf.image = R_TextureAnimation (currententity, surface->texinfo);
-	r_drawsurf.lightadj[0] = r_newrefdef.lightstyles[surface->styles[0]].white*128;
-	r_drawsurf.lightadj[1] = r_newrefdef.lightstyles[surface->styles[1]].white*128;
-	r_drawsurf.lightadj[2] = r_newrefdef.lightstyles[surface->styles[2]].white*128;
-	r_drawsurf.lightadj[3] = r_newrefdef.lightstyles[surface->styles[3]].white*128;
+	drawsurf->image = R_TextureAnimation (currententity, surface->texinfo);
+	drawsurf->lightadj[0] = r_newrefdef.lightstyles[surface->styles[0]].white*128;
+	drawsurf->lightadj[1] = r_newrefdef.lightstyles[surface->styles[1]].white*128;
+	drawsurf->lightadj[2] = r_newrefdef.lightstyles[surface->styles[2]].white*128;
+	drawsurf->lightadj[3] = r_newrefdef.lightstyles[surface->styles[3]].white*128;
 
 	//
-	// see if the cache holds apropriate data
+	// see if the cache holds apropriate data, a dynamically
+	// lit surface is good for the frame it was built in
 	//
 	cache = surface->cachespots[miplevel];
 
-	if (cache && !cache->dlight && surface->dlightframe != r_framecount
-			&& cache->image == r_drawsurf.image
-			&& cache->lightadj[0] == r_drawsurf.lightadj[0]
-			&& cache->lightadj[1] == r_drawsurf.lightadj[1]
-			&& cache->lightadj[2] == r_drawsurf.lightadj[2]
-			&& cache->lightadj[3] == r_drawsurf.lightadj[3] )
-		return cache;
+	return cache
+		&& (cache->builtframe == r_framecount
+			|| (!cache->dlight && surface->dlightframe != r_framecount))
+		&& cache->image == drawsurf->image
+		&& cache->lightadj[0] == drawsurf->lightadj[0]
+		&& cache->lightadj[1] == drawsurf->lightadj[1]
+		&& cache->lightadj[2] == drawsurf->lightadj[2]
+		&& cache->lightadj[3] == drawsurf->lightadj[3];
+}
+
+/*
+ * Allocates the cache block of the surface set up by
+ * D_SurfaceCached() and prepares drawsurf to build it.
+ */
+static surfcache_t *
+D_SetupSurface (msurface_t *surface, int miplevel, drawsurf_t *drawsurf)
+{
+	surfcache_t	*cache;
+	float		surfscale;
 
 	//
 	// determine shape of surface
 	//
 	surfscale = 1.0 / (1<<miplevel);
-	r_drawsurf.surfmip = miplevel;
-	r_drawsurf.surfwidth = surface->extents[0] >> miplevel;
-	r_drawsurf.rowbytes = r_drawsurf.surfwidth;
-	r_drawsurf.surfheight = surface->extents[1] >> miplevel;
+	drawsurf->surfmip = miplevel;
+	drawsurf->surfwidth = surface->extents[0] >> miplevel;
+	drawsurf->rowbytes = drawsurf->surfwidth;
+	drawsurf->surfheight = surface->extents[1] >> miplevel;
 
 	//
 	// allocate memory if needed
 	//
+	cache = surface->cachespots[miplevel];
 	if (!cache) // if a texture just animated, don't reallocate it
 	{
-		cache = D_SCAlloc (r_drawsurf.surfwidth,
-						   r_drawsurf.surfwidth * r_drawsurf.surfheight);
+		cache = D_SCAlloc (drawsurf->surfwidth,
+						   drawsurf->surfwidth * drawsurf->surfheight);
 		surface->cachespots[miplevel] = cache;
 		cache->owner = &surface->cachespots[miplevel];
 		cache->mipscale = surfscale;
@@ -464,20 +571,57 @@ D_CacheSurface (const entity_t *currententity, msurface_t *surface, int miplevel
 	else
 		cache->dlight = 0;
 
-	r_drawsurf.surfdat = (pixel_t *)cache->data;
+	cache->referenced = 1;
+	cache->builtframe = r_framecount;
+	cache->prefetched = 0;
+
+	drawsurf->surfdat = (pixel_t *)cache->data;
 
-	cache->image = r_drawsurf.image;
-	cache->lightadj[0] = r_drawsurf.lightadj[0];
-	cache->lightadj[1] = r_drawsurf.lightadj[1];
-	cache->lightadj[2] = r_drawsurf.lightadj[2];
-	cache->lightadj[3] = r_drawsurf.lightadj[3];
+	cache->image = drawsurf->image;
+	cache->lightadj[0] = drawsurf->lightadj[0];
+	cache->lightadj[1] = drawsurf->lightadj[1];
+	cache->lightadj[2] = drawsurf->lightadj[2];
+	cache->lightadj[3] = drawsurf->lightadj[3];
+
+	drawsurf->surf = surface;
+	drawsurf->outoflights = false;
+
+	c_surf++;
+
+	return cache;
+}
+
+/*
+================
+D_CacheSurface
+================
+*/
+surfcache_t *
+D_CacheSurface (const entity_t *currententity, msurface_t *surface, int miplevel)
+{
+	surfcache_t	*cache;
+
+	if (D_SurfaceCached(currententity, surface, miplevel, &r_drawsurf))
+	{
+		cache = surface->cachespots[miplevel];
+		cache->referenced = 1;
+
+		// a surface built ahead was a miss, already counted
+		if (cache->prefetched)
+			cache->prefetched = 0;
+		else
+			c_surfhits++;
+
+		return cache;
+	}
+
+	cache = D_SetupSurface(surface, miplevel, &r_drawsurf);
 
 	//
 	// draw and light the surface texture
 	//
-	r_drawsurf.surf = surface;
-
-	c_surf++;
+	r_drawsurf.blocklights = blocklights;
+	r_drawsurf.blocklight_max = blocklight_max;
 
 	// calculate the lightings
 	R_BuildLightMap (&r_drawsurf);
@@ -485,5 +629,162 @@ D_CacheSurface (const entity_t *currententity, msurface_t *surface, int miplevel
 	// rasterize the surface into the cache
 	R_DrawSurface (&r_drawsurf);
 
+	if (r_drawsurf.outoflights)
+		r_outoflights = true;
+
 	return cache;
 }
+
+/*
+================
+D_QueueSurface
+
+Allocates a surface that isn't cached yet, so that
+D_BuildQueuedSurfaces() builds it on the job threads.
+D_CacheSurface() later finds it like any cached surface.
+================
+*/
+void
+D_QueueSurface (const entity_t *currententity, msurface_t *surface, int miplevel)
+{
+	drawsurf_t	drawsurf;
+	surfbuild_t	*build;
+	surfcache_t	*cache;
+
+	if (D_SurfaceCached(currententity, surface, miplevel, &drawsurf))
+		return;
+
+	// another entity has queued the surface with a different
+	// texture frame, don't build both into the same block
+	cache = surface->cachespots[miplevel];
+	if (cache && cache->builtframe == r_framecount)
+		return;
+
+	// leave the rest of the cache to the surfaces already in it,
+	// whatever doesn't fit is built when it's drawn
+	if (r_queuedbytes + (surface->extents[0] >> miplevel) *
+		(surface->extents[1] >> miplevel) > sc_size / 2)
+		return;
+
+	if (r_numqueuedsurfs == r_numallocatedqueue)
+	{
+		surfbuild_t	*queue;
+		int		size;
+
+		size = r_numallocatedqueue ? r_numallocatedqueue * 2 : 256;
+		queue = realloc(r_surfqueue, size * sizeof(surfbuild_t));
+		if (!queue)
+			return;
+
+		r_surfqueue = queue;
+		r_numallocatedqueue = size;
+	}
+
+	build = &r_surfqueue[r_numqueuedsurfs++];
+	build->drawsurf = drawsurf;
+	build->cache = D_SetupSurface(surface, miplevel, &build->drawsurf);
+	build->cache->prefetched = 1;
+	build->miplevel = miplevel;
+
+	r_queuedbytes += build->cache->size;
+}
+
+static void
+D_BuildSurfaceJob (void *job, int thread)
+{
+	surfbuild_t	*build = job;
+	drawsurf_t	*drawsurf = &build->drawsurf;
+
+	if (thread)
+	{
+		drawsurf->blocklights = r_threadlights[thread];
+		drawsurf->blocklight_max = r_threadlights[thread] + r_numthreadlights;
+	}
+	else
+	{
+		drawsurf->blocklights = blocklights;
+		drawsurf->blocklight_max = blocklight_max;
+	}
+
+	R_BuildLightMap (drawsurf);
+	R_DrawSurface (drawsurf);
+}
+
+/*
+================
+D_BuildQueuedSurfaces
+
+Lights and rasterizes the surfaces of D_QueueSurface() on
+the job threads. The surface cache and the statistics are
+only touched on the main thread, before and after.
+================
+*/
+void
+D_BuildQueuedSurfaces (void)
+{
+	int	i, numbuilds, numlights;
+
+	if (!r_numqueuedsurfs)
+		return;
+
+	// later allocations of the queue may have thrown out
+	// earlier ones, those are built again when drawn
+	numbuilds = 0;
+	for (i = 0; i < r_numqueuedsurfs; i++)
+	{
+		surfbuild_t *build = &r_surfqueue[i];
+
+		if (build->drawsurf.surf->cachespots[build->miplevel] != build->cache)
+			continue;
+
+		r_surfqueue[numbuilds++] = *build;
+	}
+
+	numlights = (int)(blocklight_max - blocklights);
+	if (numlights != r_numthreadlights)
+	{
+		for (i = 1; i <= MAX_JOB_THREADS; i++)
+		{
+			free(r_threadlights[i]);
+			r_threadlights[i] = malloc(numlights * sizeof(light_t));
+			if (!r_threadlights[i])
+			{
+				ri.Sys_Error(ERR_FATAL, "%s: Couldn't malloc %d lights",
+					__func__, numlights);
+			}
+		}
+
+		r_numthreadlights = numlights;
+	}
+
+	ri.Com_RunJobs(D_BuildSurfaceJob, r_surfqueue, numbuilds,
+		sizeof(surfbuild_t));
+
+	for (i = 0; i < numbuilds; i++)
+	{
+		if (r_surfqueue[i].drawsurf.outoflights)
+			r_outoflights = true;
+	}
+
+	r_numqueuedsurfs = 0;
+	r_queuedbytes = 0;
+}
+
+void
+D_FreeSurfaceQueue (void)
+{
+	int	i;
+
+	for (i = 0; i <= MAX_JOB_THREADS; i++)
+	{
+		free(r_threadlights[i]);
+		r_threadlights[i] = NULL;
+	}
+
+	free(r_surfqueue);
+	r_surfqueue = NULL;
+	r_numqueuedsurfs = 0;
+	r_numallocatedqueue = 0;
+	r_queuedbytes = 0;
+	r_numthreadlights = 0;
+}
@@ -27,7 +27,8 @@
 #ifndef CL_SOUND_LOCAL_H
 #define CL_SOUND_LOCAL_H
 
-#define MAX_CHANNELS 32
+#define MAX_CHANNELS 128 /* upper limit for s_channels */
+#define MIN_CHANNELS 16 /* OpenAL must give us at least this many sources */
 #define MAX_RAW_SAMPLES 8192
 
 /*
@@ -178,6 +179,7 @@ extern cvar_t* s_underwater_gain_hf;
 extern cvar_t* s_doppler;
 extern cvar_t* s_occlusion_strength;
 extern cvar_t* s_reverb_preset;
+extern cvar_t *s_channels;
 
 /*
  * Globals
@@ -209,6 +211,7 @@ wavinfo_t GetWavinfo(char *name, byte *wav, int wavlength);
  * the cache
  */
 sfxcache_t *S_LoadSound(sfx_t *s);
+int S_NumChannels(void);
 
 /*
  * Plays one sound sample
@@ -245,6 +248,11 @@ void SDL_BackendShutdown(void);
  */
 void SDL_SoundInfo(void);
 
+/*
+ * Benchmarks the SDL backends mixer
+ */
+void SDL_MixBench(void);
+
 /*
  * Alters start position of
  * sound playback
@@ -43,6 +43,6 @@ void OGG_SaveState(void);
 void OGG_Shutdown(void);
 void OGG_Stop(void);
 void OGG_Stream(void);
-void OGG_LoadAsWav(char *filename, wavinfo_t *info, void **buffer);
+short *OGG_DecodeAsWav(const byte *file, int filelen, wavinfo_t *info);
 
 #endif
@@ -807,23 +807,21 @@ OGG_Shutdown(void)
 	ogg_started = false;
 }
 
-void
-OGG_LoadAsWav(char *filename, wavinfo_t *info, void **buffer)
+/*
+ * Decodes an ogg file that's already in memory into
+ * 16 bit samples. Returns a malloc()ed buffer or NULL.
+ * This doesn't touch the filesystem, the zone or the
+ * console, so it can run on a worker thread.
+ */
+short *
+OGG_DecodeAsWav(const byte *file, int filelen, wavinfo_t *info)
 {
-	void * temp_buffer = NULL;
-	int size = FS_LoadFile(filename, &temp_buffer);
 	short *final_buffer = NULL;
 	stb_vorbis * ogg2wav_file = NULL;
 	int res = 0;
 
-	if (!temp_buffer)
-	{
-		/* no such file */
-		return;
-	}
-
 	/* load vorbis file from memory */
-	ogg2wav_file = stb_vorbis_open_memory(temp_buffer, size, &res, NULL);
+	ogg2wav_file = stb_vorbis_open_memory(file, filelen, &res, NULL);
 	if (!res && ogg2wav_file->channels > 0)
 	{
 		int read_samples = 0;
@@ -838,34 +836,28 @@ OGG_LoadAsWav(char *filename, wavinfo_t *info, void **buffer)
 		info->dataofs = 0;
 
 		/* alloc memory for uncompressed wav */
-		final_buffer = Z_Malloc(info->samples * sizeof(short));
+		final_buffer = malloc(info->samples * sizeof(short));
 
-		/* load sampleas to buffer */
-		read_samples = stb_vorbis_get_samples_short_interleaved(
-			ogg2wav_file, info->channels, final_buffer,
-			info->samples);
+		if (final_buffer)
+		{
+			/* load sampleas to buffer */
+			read_samples = stb_vorbis_get_samples_short_interleaved(
+				ogg2wav_file, info->channels, final_buffer,
+				info->samples);
+		}
 
 		if (read_samples > 0)
 		{
-			/* fix sample list size*/
-			if ((read_samples * info->channels) != info->samples)
-			{
-				Com_DPrintf("%s: incorrect size: %d != %d\n",
-					filename, info->samples, read_samples * info->channels);
-
-				info->samples = read_samples * info->channels;
-			}
-
-			/* copy to final result */
-			*buffer = final_buffer;
+			/* fix sample list size, the stream
+			   length in the header may be off */
+			info->samples = read_samples * info->channels;
 		}
 		else
 		{
 			/* something is going wrong */
-			Z_Free(final_buffer);
+			free(final_buffer);
 			final_buffer = NULL;
 		}
-
 	}
 
 	if (ogg2wav_file)
@@ -873,5 +865,5 @@ OGG_LoadAsWav(char *filename, wavinfo_t *info, void **buffer)
 		stb_vorbis_close(ogg2wav_file);
 	}
 
-	FS_FreeFile(temp_buffer);
+	return final_buffer;
 }
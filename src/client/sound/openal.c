@@ -50,10 +50,6 @@
 // see: PutClientInServer(edict_t *ent) bbox
 #define AL_METER_OF_Q2_UNIT 0.0315f
 
-/* The OpenAL implementation should support
-   at least this number of sources */
-#define MIN_CHANNELS 16
-
 #define QAL_EFX_MAX 1
 #define QAL_REVERB_EFFECT 0
 
@@ -1360,7 +1356,7 @@ AL_Init(void)
 	else
 	{
 		/* -1 because we already got one channel for streaming */
-		for (i = 0; i < MAX_CHANNELS - 1; i++)
+		for (i = 0; i < S_NumChannels() - 1; i++)
 		{
 			qalGenSources(1, &s_srcnums[i]);
 
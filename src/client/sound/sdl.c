@@ -46,6 +46,7 @@
 
 /* Defines */
 #define SDL_PAINTBUFFER_SIZE 2048
+#define SDL_MIXBLOCK 16 /* samples mixed or clipped in one go */
 #define SDL_FULLVOLUME 80
 #define SDL_LOOPATTENUATE 0.003
 
@@ -171,6 +172,41 @@ lpf_update_samples(LpfContext* lpf_context,int sample_count, portable_samplepair
 	}
 }
 
+/*
+ * Converts SDL_MIXBLOCK mixed samples to 16 bit. The
+ * fixed length lets the compiler use SSE2 or NEON.
+ */
+static void
+SDL_ClipBlock(short *restrict out, const int *restrict in)
+{
+	int i;
+
+	for (i = 0; i < SDL_MIXBLOCK; i++)
+	{
+		int val = in[i] >> 8;
+
+		out[i] = (val > 0x7fff) ? 0x7fff : ((val < -32768) ? -32768 : val);
+	}
+}
+
+static void
+SDL_ClipSamples(short *out, const int *in, int count)
+{
+	int i;
+
+	for (i = 0; i + SDL_MIXBLOCK <= count; i += SDL_MIXBLOCK)
+	{
+		SDL_ClipBlock(out + i, in + i);
+	}
+
+	for ( ; i < count; i++)
+	{
+		int val = in[i] >> 8;
+
+		out[i] = (val > 0x7fff) ? 0x7fff : ((val < -32768) ? -32768 : val);
+	}
+}
+
 /*
  * Transfers a mixed "paint buffer" to
  * the SDL output buffer and places it
@@ -209,7 +245,6 @@ SDL_TransferPaintBuffer(int endtime)
 
 		while (ls_paintedtime < endtime)
 		{
-			int i;
 			short *snd_out;
 			int snd_linear_count;
 			int lpos;
@@ -227,38 +262,7 @@ SDL_TransferPaintBuffer(int endtime)
 
 			snd_linear_count <<= 1;
 
-			for (i = 0; i < snd_linear_count; i += 2)
-			{
-				val = snd_p[i] >> 8;
-
-				if (val > 0x7fff)
-				{
-					snd_out[i] = 0x7fff;
-				}
-				else if (val < -32768)
-				{
-					snd_out[i] = -32768;
-				}
-				else
-				{
-					snd_out[i] = val;
-				}
-
-				val = snd_p[i + 1] >> 8;
-
-				if (val > 0x7fff)
-				{
-					snd_out[i + 1] = 0x7fff;
-				}
-				else if (val < -32768)
-				{
-					snd_out[i + 1] = -32768;
-				}
-				else
-				{
-					snd_out[i + 1] = val;
-				}
-			}
+			SDL_ClipSamples(snd_out, snd_p, snd_linear_count);
 
 			snd_p += snd_linear_count;
 			ls_paintedtime += (snd_linear_count >> 1);
@@ -366,6 +370,26 @@ SDL_PaintChannelFrom8(channel_t *ch, sfxcache_t *sc, int count, int offset)
 	ch->pos += count;
 }
 
+/*
+ * Mixes SDL_MIXBLOCK 16 bit samples into the interleaved
+ * left / right paint buffer. The volumes are split into
+ * their high and low bytes. (data * vol) >> 8 is exactly
+ * data * high + ((data * low) >> 8), and those are 16 bit
+ * multiplies which SSE2 and NEON can do on 8 samples at once.
+ */
+static void
+SDL_MixBlock16(int *restrict samp, const short *restrict sfx,
+		short lefthigh, short leftlow, short righthigh, short rightlow)
+{
+	int i;
+
+	for (i = 0; i < SDL_MIXBLOCK; i++)
+	{
+		samp[i * 2] += sfx[i] * lefthigh + ((sfx[i] * leftlow) >> 8);
+		samp[i * 2 + 1] += sfx[i] * righthigh + ((sfx[i] * rightlow) >> 8);
+	}
+}
+
 /*
  * Mixes an 16 bit sample into a channel
  */
@@ -375,29 +399,57 @@ SDL_PaintChannelFrom16(channel_t *ch, sfxcache_t *sc, int count, int offset)
 	int leftvol, rightvol;
 	signed short *sfx;
 	int i;
-	portable_samplepair_t *samp;
+	int *samp;
 
 	leftvol = ch->leftvol * snd_vol;
 	rightvol = ch->rightvol * snd_vol;
 	sfx = (signed short *)sc->data + ch->pos;
 
-	samp = &paintbuffer[offset];
+	samp = (int *)&paintbuffer[offset];
 
-	for (i = 0; i < count; i++, samp++)
+	i = 0;
+
+	if (leftvol < (1 << 23) && rightvol < (1 << 23))
+	{
+		for ( ; i + SDL_MIXBLOCK <= count; i += SDL_MIXBLOCK)
+		{
+			SDL_MixBlock16(samp + i * 2, sfx + i, leftvol >> 8, leftvol & 255,
+				rightvol >> 8, rightvol & 255);
+		}
+	}
+
+	for ( ; i < count; i++)
 	{
 		int data;
-		int left, right;
 
 		data = sfx[i];
-		left = (data * leftvol) >> 8;
-		right = (data * rightvol) >> 8;
-		samp->left += left;
-		samp->right += right;
+		samp[i * 2] += (data * leftvol) >> 8;
+		samp[i * 2 + 1] += (data * rightvol) >> 8;
 	}
 
 	ch->pos += count;
 }
 
+/*
+ * A channel is inaudible if even a full scale sample
+ * wouldn't change the output by one step. Those are
+ * skipped, only their position moves on.
+ */
+static qboolean
+SDL_ChannelInaudible(const channel_t *ch, const sfxcache_t *sc)
+{
+	int vol = (ch->leftvol > ch->rightvol) ? ch->leftvol : ch->rightvol;
+
+	if (sc->width == 1)
+	{
+		/* the first row of snd_scaletable is all zero */
+		return (vol >> 3) == 0;
+	}
+
+	/* 32768 * vol * snd_vol >> 16 is below 1 */
+	return vol * snd_vol < 2;
+}
+
 /*
  * Mixes all pending sounds into
  * the available output channels.
@@ -488,7 +540,11 @@ SDL_PaintChannels(int endtime)
 
 				if (count > 0)
 				{
-					if (sc->width == 1)
+					if (SDL_ChannelInaudible(ch, sc))
+					{
+						ch->pos += count;
+					}
+					else if (sc->width == 1)
 					{
 						SDL_PaintChannelFrom8(ch, sc, count, ltime - paintedtime);
 					}
@@ -1253,6 +1309,91 @@ SDL_SoundInfo(void)
 	Com_Printf("%p sound buffer\n", sound.buffer);
 }
 
+/*
+ * Mixes a synthetic 16 bit sound on a growing
+ * number of channels and prints how long the
+ * mixer and the clipping take per output sample.
+ * The mixer state is put back afterwards.
+ */
+void
+SDL_MixBench(void)
+{
+	static channel_t benchchannels[MAX_CHANNELS];
+	static short clipped[SDL_PAINTBUFFER_SIZE * 2];
+	static portable_samplepair_t savedpaint[SDL_PAINTBUFFER_SIZE];
+	const int counts[] = {8, 32, 64, MAX_CHANNELS};
+	const int rounds = 200;
+	sfxcache_t *sc;
+	int i, j, k, savedvol;
+
+	if (sound_started != SS_SDL)
+	{
+		Com_Printf("soundmixbench needs the SDL sound backend.\n");
+		return;
+	}
+
+	memcpy(savedpaint, paintbuffer, sizeof(paintbuffer));
+	savedvol = snd_vol;
+
+	sc = Z_Malloc(sizeof(*sc) + SDL_PAINTBUFFER_SIZE * sizeof(short));
+	sc->length = SDL_PAINTBUFFER_SIZE;
+	sc->width = 2;
+	sc->loopstart = -1;
+
+	for (i = 0; i < SDL_PAINTBUFFER_SIZE; i++)
+	{
+		((short *)sc->data)[i] = (short)(sin(i * 0.05) * 16000);
+	}
+
+	for (i = 0; i < MAX_CHANNELS; i++)
+	{
+		memset(&benchchannels[i], 0, sizeof(benchchannels[i]));
+		benchchannels[i].leftvol = 64 + (i * 37) % 192;
+		benchchannels[i].rightvol = 64 + (i * 91) % 192;
+	}
+
+	snd_vol = (int)(s_volume->value * 256);
+
+	Com_Printf("Mixing %i samples %i times:\n", SDL_PAINTBUFFER_SIZE, rounds);
+
+	for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+	{
+		long long start, mixtime, cliptime;
+
+		mixtime = cliptime = 0;
+
+		for (j = 0; j < rounds; j++)
+		{
+			start = Sys_Microseconds();
+
+			memset(paintbuffer, 0, sizeof(paintbuffer));
+
+			for (k = 0; k < counts[i]; k++)
+			{
+				benchchannels[k].pos = 0;
+				SDL_PaintChannelFrom16(&benchchannels[k], sc,
+					SDL_PAINTBUFFER_SIZE, 0);
+			}
+
+			mixtime += Sys_Microseconds() - start;
+			start = Sys_Microseconds();
+
+			SDL_ClipSamples(clipped, (int *)paintbuffer,
+				SDL_PAINTBUFFER_SIZE * 2);
+
+			cliptime += Sys_Microseconds() - start;
+		}
+
+		Com_Printf("%4i channels: %7.2f ns mixing, %5.2f ns clipping per sample\n",
+			counts[i], mixtime * 1000.0 / (rounds * SDL_PAINTBUFFER_SIZE),
+			cliptime * 1000.0 / (rounds * SDL_PAINTBUFFER_SIZE));
+	}
+
+	memcpy(paintbuffer, savedpaint, sizeof(paintbuffer));
+	snd_vol = savedvol;
+	Z_Free(sc);
+}
+
 /*
  * Callback funktion for SDL. Writes
  * sound data to SDL when requested.
@@ -1460,7 +1601,7 @@ SDL_BackendInit(void)
 	backend->speed = spec.freq;
 	samplesize = (backend->samples * (backend->samplebits / 8));
 	backend->buffer = calloc(1, samplesize);
-	s_numchannels = MAX_CHANNELS;
+	s_numchannels = S_NumChannels();
 
 	s_underwater->modified = true;
 	s_underwater_gain_hf->modified = true;
@@ -1627,7 +1768,7 @@ SDL_BackendInit(void)
 	backend->speed = obtained.freq;
 	samplesize = (backend->samples * (backend->samplebits / 8));
 	backend->buffer = calloc(1, samplesize);
-	s_numchannels = MAX_CHANNELS;
+	s_numchannels = S_NumChannels();
 
 	s_underwater->modified = true;
 	s_underwater_gain_hf->modified = true;
@@ -38,6 +38,7 @@
    because we don't want to free anything until we are
    sure we won't need it. */
 #define MAX_SFX (MAX_SOUNDS * 2)
+#define SFX_HASH_SIZE 1024 /* must be a power of two */
 #define MAX_PLAYSOUNDS 128
 
 /* Maximum length (seconds) of audio data to test for silence. */
@@ -74,6 +75,7 @@ cvar_t* s_underwater_gain_hf;
 cvar_t* s_doppler;
 cvar_t* s_occlusion_strength;
 cvar_t* s_reverb_preset;
+cvar_t *s_channels;
 static cvar_t* s_ps_sorting;
 static cvar_t* s_feedback_kind;
 
@@ -86,9 +88,18 @@ int s_rawend;
 static int s_registration_sequence = 0;
 portable_samplepair_t s_rawsamples[MAX_RAW_SAMPLES];
 static sfx_t known_sfx[MAX_SFX];
+static int sfx_hash[SFX_HASH_SIZE]; /* known_sfx index + 1 of the chain head, 0 if empty */
+static int sfx_hashnext[MAX_SFX];
+static int sfx_free[MAX_SFX]; /* known_sfx slots below num_sfx that are unused */
+static int num_sfx_free;
 sndstarted_t sound_started = SS_NOT;
 sound_t sound;
 static qboolean s_registering;
+
+/* registration statistics, reported by S_EndRegistration() */
+static int s_reg_sounds;
+static int s_reg_new;
+static long long s_reg_lookuptime;
 qboolean s_active;
 
 qboolean snd_is_underwater;
@@ -210,8 +221,11 @@ S_IsSilencedMuzzleFlash(const wavinfo_t* info, const void* raw_data, const char*
 	return true;
 }
 
-static void
-S_LoadVorbis(const char *path, const char* name, wavinfo_t *info, void **buffer)
+/*
+ * Reads the .ogg replacement of a sound, if there's one
+ */
+static int
+S_LoadVorbis(const char *path, void **buffer)
 {
 	int	len;
 	char namewe[256];
@@ -220,21 +234,21 @@ S_LoadVorbis(const char *path, const char* name, wavinfo_t *info, void **buffer)
 
 	if (!path)
 	{
-		return;
+		return -1;
 	}
 
 	ext = COM_FileExtension(path);
 	if(!ext[0])
 	{
 		/* file has no extension */
-		return;
+		return -1;
 	}
 
 	len = strlen(path);
 
 	if (len < 5)
 	{
-		return;
+		return -1;
 	}
 
 	/* Remove the extension */
@@ -247,7 +261,7 @@ S_LoadVorbis(const char *path, const char* name, wavinfo_t *info, void **buffer)
 	/* Add the extension */
 	Q_strlcat(filename, ".ogg", sizeof(filename));
 
-	OGG_LoadAsWav(filename, info, buffer);
+	return FS_LoadFile(filename, buffer);
 }
 
 static void
@@ -440,35 +454,79 @@ S_GetStatistics(const byte *data, int sound_length, int width, int channels,
 }
 
 /*
- * Loads one sample into memory
+ * Loading a sample is split into three stages. Reading the
+ * file and uploading the samples must happen on the main
+ * thread, decoding and analyzing them may run on the worker
+ * threads. That's where most of the time goes with .ogg files.
  */
-sfxcache_t *
-S_LoadSound(sfx_t *s)
+typedef struct
 {
+	sfx_t *sfx;
 	char namebuffer[MAX_QPATH];
-	byte *data = NULL;
+	byte *file; /* from FS_LoadFile() */
+	int filelen;
+	qboolean isogg;
+	byte *samples; /* file or malloc()ed decoded ogg */
 	wavinfo_t info;
-	sfxcache_t *sc;
-	double sound_volume = 0;
-	int begin_length = 0;
-	int attack_length = 0;
-	int fade_length = 0;
-	int end_length = 0;
+	qboolean valid;
+	qboolean is_silenced_muzzle_flash;
+	double sound_volume;
+	int begin_length;
+	int attack_length;
+	int fade_length;
+	int end_length;
+} sfxload_t;
+
+/* how many files are read before they're decoded */
+#define SFX_LOAD_BATCH 64
+
+/*
+ * Reads the .wav of a sample, used when
+ * there's no .ogg or it can't be decoded.
+ */
+static qboolean
+S_ReadWav(sfxload_t *ld)
+{
+	ld->isogg = false;
+	ld->filelen = FS_LoadFile(ld->namebuffer, (void **)&ld->file);
+
+	if (!ld->file)
+	{
+		ld->sfx->cache = NULL;
+		Com_DPrintf("Couldn't load %s\n", ld->namebuffer);
+		return false;
+	}
+
+	/* GetWavinfo() isn't reentrant, keep it on the main thread */
+	ld->info = GetWavinfo(ld->sfx->name, ld->file, ld->filelen);
+	ld->samples = ld->file;
+
+	return true;
+}
+
+/*
+ * Reads the file of a sample, returns false
+ * if there's nothing to do for the sample.
+ */
+static qboolean
+S_ReadSound(sfx_t *s, sfxload_t *ld)
+{
 	char *name;
 
 	if (s->name[0] == '*')
 	{
-		return NULL;
+		return false;
 	}
 
 	/* see if still in memory */
-	sc = s->cache;
-
-	if (sc)
+	if (s->cache)
 	{
-		return sc;
+		return false;
 	}
 
+	memset(ld, 0, sizeof(*ld));
+	ld->sfx = s;
+
 	/* load it */
 	if (s->truename)
 	{
@@ -482,82 +540,227 @@ S_LoadSound(sfx_t *s)
 
 	if (name[0] == '#')
 	{
-		strcpy(namebuffer, &name[1]);
+		Q_strlcpy(ld->namebuffer, &name[1], sizeof(ld->namebuffer));
 	}
 	else
 	{
-		Com_sprintf(namebuffer, sizeof(namebuffer), "sound/%s", name);
+		Com_sprintf(ld->namebuffer, sizeof(ld->namebuffer), "sound/%s", name);
 	}
 
-	S_LoadVorbis(namebuffer, s->name, &info, (void **)&data);
+	ld->filelen = S_LoadVorbis(ld->namebuffer, (void **)&ld->file);
+
+	if (ld->file)
+	{
+		ld->isogg = true;
+		return true;
+	}
 
 	// can't load ogg file
-	if (!data)
+	return S_ReadWav(ld);
+}
+
+/*
+ * Decodes and analyzes a sample. Runs on
+ * the worker threads, see Com_RunJobs().
+ */
+static void
+S_DecodeSound(void *job, int thread)
+{
+	sfxload_t *ld = job;
+
+	if (ld->isogg)
 	{
-		int size = FS_LoadFile(namebuffer, (void **)&data);
+		ld->samples = (byte *)OGG_DecodeAsWav(ld->file, ld->filelen, &ld->info);
 
-		if (data)
+		if (!ld->samples)
 		{
-			info = GetWavinfo(s->name, data, size);
+			return;
 		}
 	}
 
-	if (!data)
+	if (ld->info.channels < 1 || ld->info.channels > 2)
 	{
-		s->cache = NULL;
-		Com_DPrintf("Couldn't load %s\n", namebuffer);
-		return NULL;
+		return;
 	}
 
-	/*
-	Com_Printf("%s: rate:%d\n\twidth:%d\n\tchannels:%d\n\tloopstart:%d\n\tsamples:%d\n\tdataofs:%d\n",
-		s->name, info.rate, info.width, info.channels, info.loopstart, info.samples, info.dataofs);
-	*/
+	ld->valid = true;
+
+	ld->is_silenced_muzzle_flash =
+		S_IsSilencedMuzzleFlash(&ld->info, ld->samples, ld->namebuffer);
+
+	S_GetVolume(ld->samples + ld->info.dataofs, ld->info.samples,
+		ld->info.width, &ld->sound_volume);
+
+	S_GetStatistics(ld->samples + ld->info.dataofs, ld->info.samples,
+		ld->info.width, ld->info.channels, ld->sound_volume,
+		&ld->begin_length, &ld->end_length,
+		&ld->attack_length, &ld->fade_length);
+}
 
-	if (info.channels < 1 || info.channels > 2)
+/*
+ * Hands a decoded sample to the backend
+ * and frees everything loaded for it.
+ */
+static sfxcache_t *
+S_UploadSound(sfxload_t *ld)
+{
+	sfx_t *s = ld->sfx;
+	sfxcache_t *sc = NULL;
+
+	if (ld->isogg && !ld->samples)
+	{
+		/* fall back to the .wav, like a missing .ogg */
+		Com_DPrintf("Couldn't decode %s\n", ld->namebuffer);
+		FS_FreeFile(ld->file);
+
+		if (!S_ReadWav(ld))
+		{
+			return NULL;
+		}
+
+		S_DecodeSound(ld, 0);
+	}
+
+	if (!ld->valid)
 	{
 		Com_Printf("%s has an invalid number of channels\n", s->name);
-		FS_FreeFile(data);
-		return NULL;
 	}
+	else
+	{
+		if (ld->is_silenced_muzzle_flash)
+		{
+			s->is_silenced_muzzle_flash = true;
+		}
+
+#if USE_OPENAL
+		if (sound_started == SS_OAL)
+		{
+			sc = AL_UploadSfx(s, &ld->info, ld->samples + ld->info.dataofs,
+				ld->sound_volume, ld->begin_length, ld->end_length,
+				ld->attack_length, ld->fade_length);
+		}
+		else
+#endif
+		{
+			if (sound_started == SS_SDL)
+			{
+				if (!SDL_Cache(s, &ld->info, ld->samples + ld->info.dataofs,
+						ld->sound_volume, ld->begin_length, ld->end_length,
+						ld->attack_length, ld->fade_length))
+				{
+					Com_Printf("Pansen!\n");
+				}
+			}
+		}
+	}
+
+	if (ld->isogg)
+	{
+		free(ld->samples);
+	}
+
+	FS_FreeFile(ld->file);
+	return sc;
+}
+
+/*
+ * Loads one sample into memory
+ */
+sfxcache_t *
+S_LoadSound(sfx_t *s)
+{
+	sfxload_t ld;
 
-	if (S_IsSilencedMuzzleFlash(&info, data, namebuffer))
+	if (!S_ReadSound(s, &ld))
 	{
-		s->is_silenced_muzzle_flash = true;
+		return s->cache;
 	}
 
-	S_GetVolume(data + info.dataofs, info.samples,
-		info.width, &sound_volume);
+	S_DecodeSound(&ld, 0);
 
-	S_GetStatistics(data + info.dataofs, info.samples,
-		info.width, info.channels, sound_volume, &begin_length, &end_length,
-		&attack_length, &fade_length);
+	return S_UploadSound(&ld);
+}
 
-#if USE_OPENAL
-	if (sound_started == SS_OAL)
+static unsigned
+S_HashName(const char *name)
+{
+	unsigned hash = 0;
+
+	while (*name)
+	{
+		hash = hash * 31 + (unsigned char)*name++;
+	}
+
+	return hash & (SFX_HASH_SIZE - 1);
+}
+
+static void
+S_ClearSfxHash(void)
+{
+	memset(sfx_hash, 0, sizeof(sfx_hash));
+	num_sfx_free = 0;
+}
+
+/*
+ * Returns an unused known_sfx slot,
+ * linked into the hash chain of name.
+ */
+static sfx_t *
+S_AllocSfx(const char *name)
+{
+	unsigned hash;
+	sfx_t *sfx;
+	int i;
+
+	if (num_sfx_free)
 	{
-		sc = AL_UploadSfx(s, &info, data + info.dataofs, sound_volume,
-						  begin_length, end_length,
-						  attack_length, fade_length);
+		i = sfx_free[--num_sfx_free];
 	}
 	else
-#endif
 	{
-		if (sound_started == SS_SDL)
+		if (num_sfx == MAX_SFX)
 		{
-			if (!SDL_Cache(s, &info, data + info.dataofs, sound_volume,
-						  begin_length, end_length,
-						  attack_length, fade_length))
-			{
-				Com_Printf("Pansen!\n");
-				FS_FreeFile(data);
-				return NULL;
-			}
+			Com_Error(ERR_FATAL, "%s: out of sfx_t", __func__);
 		}
+
+		i = num_sfx++;
 	}
 
-	FS_FreeFile(data);
-	return sc;
+	sfx = &known_sfx[i];
+	strcpy(sfx->name, name);
+	sfx->registration_sequence = s_registration_sequence;
+
+	hash = S_HashName(name);
+	sfx_hashnext[i] = sfx_hash[hash];
+	sfx_hash[hash] = i + 1;
+
+	s_reg_new++;
+
+	return sfx;
+}
+
+/*
+ * Unlinks a known_sfx slot from its hash
+ * chain and puts it on the free list.
+ */
+static void
+S_FreeSfx(sfx_t *sfx)
+{
+	int i = sfx - known_sfx;
+	int *link;
+
+	for (link = &sfx_hash[S_HashName(sfx->name)]; *link;
+		link = &sfx_hashnext[*link - 1])
+	{
+		if (*link == i + 1)
+		{
+			*link = sfx_hashnext[i];
+			break;
+		}
+	}
+
+	sfx->name[0] = 0;
+	sfx_free[num_sfx_free++] = i;
 }
 
 /*
@@ -586,11 +789,11 @@ S_FindName(char *name, qboolean create)
 	}
 
 	/* see if already loaded */
-	for (i = 0; i < num_sfx; i++)
+	for (i = sfx_hash[S_HashName(name)]; i; i = sfx_hashnext[i - 1])
 	{
-		if (!strcmp(known_sfx[i].name, name))
+		if (!strcmp(known_sfx[i - 1].name, name))
 		{
-			return &known_sfx[i];
+			return &known_sfx[i - 1];
 		}
 	}
 
@@ -599,29 +802,8 @@ S_FindName(char *name, qboolean create)
 		return NULL;
 	}
 
-	/* find a free sfx */
-	for (i = 0; i < num_sfx; i++)
-	{
-		if (!known_sfx[i].name[0])
-		{
-			break;
-		}
-	}
-
-	if (i == num_sfx)
-	{
-		if (num_sfx == MAX_SFX)
-		{
-			Com_Error(ERR_FATAL, "%s: out of sfx_t", __func__);
-		}
-
-		num_sfx++;
-	}
-
-	sfx = &known_sfx[i];
+	sfx = S_AllocSfx(name);
 	sfx->truename = NULL;
-	strcpy(sfx->name, name);
-	sfx->registration_sequence = s_registration_sequence;
 	sfx->is_silenced_muzzle_flash = false;
 
 	return sfx;
@@ -636,34 +818,12 @@ S_AliasName(char *aliasname, char *truename)
 {
 	sfx_t *sfx;
 	char *s;
-	int i;
 
 	s = Z_Malloc(MAX_QPATH);
 	strcpy(s, truename);
 
-	/* find a free sfx */
-	for (i = 0; i < num_sfx; i++)
-	{
-		if (!known_sfx[i].name[0])
-		{
-			break;
-		}
-	}
-
-	if (i == num_sfx)
-	{
-		if (num_sfx == MAX_SFX)
-		{
-			Com_Error(ERR_FATAL, "%s: out of sfx_t", __func__);
-		}
-
-		num_sfx++;
-	}
-
-	sfx = &known_sfx[i];
+	sfx = S_AllocSfx(aliasname);
 	sfx->cache = NULL;
-	strcpy(sfx->name, aliasname);
-	sfx->registration_sequence = s_registration_sequence;
 	sfx->truename = s;
 
 	return sfx;
@@ -678,6 +838,10 @@ S_BeginRegistration(void)
 {
 	s_registration_sequence++;
 	s_registering = true;
+
+	s_reg_sounds = 0;
+	s_reg_new = 0;
+	s_reg_lookuptime = 0;
 }
 
 /*
@@ -686,6 +850,7 @@ S_BeginRegistration(void)
 sfx_t *
 S_RegisterSound(char *name)
 {
+	long long start;
 	sfx_t *sfx;
 
 	if (sound_started == SS_NOT)
@@ -693,6 +858,8 @@ S_RegisterSound(char *name)
 		return NULL;
 	}
 
+	start = Sys_Microseconds();
+
 	sfx = S_FindName(name, true);
 	sfx->registration_sequence = s_registration_sequence;
 
@@ -700,6 +867,11 @@ S_RegisterSound(char *name)
 	{
 		S_LoadSound(sfx);
 	}
+	else
+	{
+		s_reg_lookuptime += Sys_Microseconds() - start;
+		s_reg_sounds++;
+	}
 
 	return sfx;
 }
@@ -809,9 +981,13 @@ S_HasFreeSpace(void)
 void
 S_EndRegistration(void)
 {
-	int i;
+	int i, j, loaded;
+	long long start;
 	sfx_t *sfx;
 
+	start = Sys_Microseconds();
+	loaded = 0;
+
 	if (!S_HasFreeSpace())
 	{
 		/* free any sounds not from this registration sequence */
@@ -836,27 +1012,63 @@ S_EndRegistration(void)
 				}
 
 				sfx->cache = NULL;
-				sfx->name[0] = 0;
+				S_FreeSfx(sfx);
 			}
 		}
 	}
 
-	/* load everything in */
-	for (i = 0, sfx = known_sfx; i < num_sfx; i++, sfx++)
+	/* load everything in, SFX_LOAD_BATCH
+	   files at a time to bound memory use */
+	for (i = 0, sfx = known_sfx; i < num_sfx; )
 	{
-		if (!sfx->name[0])
+		static sfxload_t batch[SFX_LOAD_BATCH];
+		int count = 0;
+
+		for ( ; i < num_sfx && count < SFX_LOAD_BATCH; i++, sfx++)
 		{
-			continue;
+			if (!sfx->name[0])
+			{
+				continue;
+			}
+
+			if (S_ReadSound(sfx, &batch[count]))
+			{
+				count++;
+			}
 		}
 
-		S_LoadSound(sfx);
+		Com_RunJobs(S_DecodeSound, batch, count, sizeof(batch[0]));
+
+		for (j = 0; j < count; j++)
+		{
+			S_UploadSound(&batch[j]);
+		}
+
+		loaded += count;
 	}
 
 	s_registering = false;
+
+	Com_DPrintf("Sound registration: %i sounds (%i new), %i loaded, "
+		"lookups %.2f ms, loading %.2f ms\n", s_reg_sounds, s_reg_new,
+		loaded, s_reg_lookuptime / 1000.0,
+		(Sys_Microseconds() - start) / 1000.0);
 }
 
 /* ----------------------------------------------------------------- */
 
+/*
+ * Number of channels the backend should
+ * provide, s_channels within sane limits.
+ */
+int
+S_NumChannels(void)
+{
+	int count = (int)s_channels->value;
+
+	return Q_max(MIN_CHANNELS, Q_min(count, MAX_CHANNELS));
+}
+
 /*
  * Picks a free channel
  */
@@ -1623,6 +1835,7 @@ S_Init(void)
 	s_ps_sorting = Cvar_Get("s_ps_sorting", "1", CVAR_ARCHIVE);
 	/* Reverb and occlusion is fully disabled by default */
 	s_reverb_preset = Cvar_Get("s_reverb_preset", "-1", CVAR_ARCHIVE);
+	s_channels = Cvar_Get("s_channels", "64", CVAR_ARCHIVE);
 	s_occlusion_strength = Cvar_Get("s_occlusion_strength", "0", CVAR_ARCHIVE);
 	/* Feedback kind: 0 - rumble, 1 - haptic */
 	s_feedback_kind = Cvar_Get("s_feedback_kind", "0", CVAR_ARCHIVE);
@@ -1631,6 +1844,7 @@ S_Init(void)
 	Cmd_AddCommand("stopsound", S_StopAllSounds);
 	Cmd_AddCommand("soundlist", S_SoundList);
 	Cmd_AddCommand("soundinfo", S_SoundInfo_f);
+	Cmd_AddCommand("soundmixbench", SDL_MixBench);
 
 #if USE_OPENAL
 	cv = Cvar_Get("s_openal", "1", CVAR_ARCHIVE);
@@ -1654,6 +1868,7 @@ S_Init(void)
 	}
 
 	num_sfx = 0;
+	S_ClearSfxHash();
 	paintedtime = 0;
 	sound_max = 0;
 	s_active = true;
@@ -1712,6 +1927,7 @@ S_Shutdown(void)
 
 	memset(known_sfx, 0, sizeof(known_sfx));
 	num_sfx = 0;
+	S_ClearSfxHash();
 
 #if USE_OPENAL
 	if (sound_started == SS_OAL)
@@ -1732,6 +1948,7 @@ S_Shutdown(void)
 
 	Cmd_RemoveCommand("soundlist");
 	Cmd_RemoveCommand("soundinfo");
+	Cmd_RemoveCommand("soundmixbench");
 	Cmd_RemoveCommand("play");
 	Cmd_RemoveCommand("stopsound");
 }
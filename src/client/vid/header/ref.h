@@ -125,7 +125,7 @@ typedef enum {
 } ref_restart_t;
 
 // FIXME: bump API_VERSION?
-#define	API_VERSION		7
+#define	API_VERSION		8
 #define EXPORT
 #define IMPORT
 
@@ -257,6 +257,13 @@ typedef struct
 	qboolean	(IMPORT *GLimp_GetDesktopMode)(int *pwidth, int *pheight);
 
 	void		(IMPORT *Vid_RequestRestart)(ref_restart_t rs);
+
+	// the engines worker threads, see jobs.c
+	int		(IMPORT *Com_NumJobThreads) (void);
+	void	(IMPORT *Com_RunJobs) (jobfunc_t func, void *jobs, int numjobs, size_t jobsize);
+
+	// creates the directories leading to a file
+	void	(IMPORT *FS_CreatePath) (char *path);
 } refimport_t;
 
 // this is the only function actually exported at the linker level
@@ -431,10 +431,13 @@ VID_LoadRenderer(void)
 	ri.Cmd_Argv = Cmd_Argv;
 	ri.Cmd_ExecuteText = Cbuf_ExecuteText;
 	ri.Cmd_RemoveCommand = Cmd_RemoveCommand;
+	ri.Com_NumJobThreads = Com_NumJobThreads;
+	ri.Com_RunJobs = Com_RunJobs;
 	ri.Com_VPrintf = Com_VPrintf;
 	ri.Cvar_Get = Cvar_Get;
 	ri.Cvar_Set = Cvar_Set;
 	ri.Cvar_SetValue = Cvar_SetValue;
+	ri.FS_CreatePath = FS_CreatePath;
 	ri.FS_FreeFile = FS_FreeFile;
 	ri.FS_Gamedir = FS_Gamedir;
 	ri.FS_LoadFile = FS_LoadFile;
@@ -32,23 +32,31 @@
 
 #define MAX_ALIAS_NAME 32
 #define ALIAS_LOOP_COUNT 16
+#define CMD_HASH_SIZE 512 /* must be a power of two */
 
 typedef struct cmd_function_s
 {
 	struct cmd_function_s *next;
+	struct cmd_function_s *hash_next;
 	char *name;
 	xcommand_t function;
 } cmd_function_t;
 
-static cmd_function_t *cmd_functions; /* possible commands to execute */
+/* possible commands to execute, sorted by name. The hash
+   is case insensitive, like Cmd_ExecuteString(). */
+static cmd_function_t *cmd_functions;
+static cmd_function_t *cmd_hash[CMD_HASH_SIZE];
 
 typedef struct cmdalias_s
 {
 	struct cmdalias_s *next;
+	struct cmdalias_s *hash_next;
 	char name[MAX_ALIAS_NAME];
 	char *value;
 } cmdalias_t;
 
+static cmdalias_t *alias_hash[CMD_HASH_SIZE];
+
 char retval[256];
 int alias_count; /* for detecting runaway loops */
 cmdalias_t *cmd_alias;
@@ -73,6 +81,51 @@ Cmd_Wait_f(void)
 	cmd_wait = Sys_Milliseconds();
 }
 
+static unsigned
+Cmd_HashName(const char *name)
+{
+	unsigned hash = 0;
+
+	while (*name)
+	{
+		hash = hash * 31 + tolower((unsigned char)*name++);
+	}
+
+	return hash & (CMD_HASH_SIZE - 1);
+}
+
+static cmd_function_t *
+Cmd_FindCommand(const char *cmd_name)
+{
+	cmd_function_t *cmd;
+
+	for (cmd = cmd_hash[Cmd_HashName(cmd_name)]; cmd; cmd = cmd->hash_next)
+	{
+		if (!strcmp(cmd_name, cmd->name))
+		{
+			return cmd;
+		}
+	}
+
+	return NULL;
+}
+
+static cmdalias_t *
+Cmd_FindAlias(const char *name)
+{
+	cmdalias_t *a;
+
+	for (a = alias_hash[Cmd_HashName(name)]; a; a = a->hash_next)
+	{
+		if (!strcmp(name, a->name))
+		{
+			return a;
+		}
+	}
+
+	return NULL;
+}
+
 void
 Cbuf_Init(void)
 {
@@ -439,6 +492,7 @@ Cmd_Alias_f(void)
 	char cmd[1024];
 	int i, c;
 	char *s;
+	unsigned hash;
 
 	if (Cmd_Argc() == 1)
 	{
@@ -461,23 +515,21 @@ Cmd_Alias_f(void)
 	}
 
 	/* if the alias already exists, reuse it */
-	for (a = cmd_alias; a; a = a->next)
+	if ((a = Cmd_FindAlias(s)) != NULL)
 	{
-		if (!strcmp(s, a->name))
-		{
-			Z_Free(a->value);
-			break;
-		}
+		Z_Free(a->value);
 	}
-
-	if (!a)
+	else
 	{
 		a = Z_Malloc(sizeof(cmdalias_t));
+		strcpy(a->name, s);
 		a->next = cmd_alias;
 		cmd_alias = a;
-	}
 
-	strcpy(a->name, s);
+		hash = Cmd_HashName(s);
+		a->hash_next = alias_hash[hash];
+		alias_hash[hash] = a;
+	}
 
 	/* copy the rest of the command line */
 	cmd[0] = 0; /* start out with a null string */
@@ -704,6 +756,7 @@ Cmd_AddCommand(char *cmd_name, xcommand_t function)
 {
 	cmd_function_t *cmd;
 	cmd_function_t **pos;
+	unsigned hash;
 
 	/* fail if the command is a variable name */
 	if (Cvar_VariableString(cmd_name)[0])
@@ -712,13 +765,10 @@ Cmd_AddCommand(char *cmd_name, xcommand_t function)
 	}
 
 	/* fail if the command already exists */
-	for (cmd = cmd_functions; cmd; cmd = cmd->next)
+	if (Cmd_FindCommand(cmd_name))
 	{
-		if (!strcmp(cmd_name, cmd->name))
-		{
-			Com_Printf("Cmd_AddCommand: %s already defined\n", cmd_name);
-			return;
-		}
+		Com_Printf("Cmd_AddCommand: %s already defined\n", cmd_name);
+		return;
 	}
 
 	cmd = Z_Malloc(sizeof(cmd_function_t));
@@ -733,6 +783,10 @@ Cmd_AddCommand(char *cmd_name, xcommand_t function)
 	}
 	cmd->next = *pos;
 	*pos = cmd;
+
+	hash = Cmd_HashName(cmd->name);
+	cmd->hash_next = cmd_hash[hash];
+	cmd_hash[hash] = cmd;
 }
 
 void
@@ -740,43 +794,33 @@ Cmd_RemoveCommand(char *cmd_name)
 {
 	cmd_function_t *cmd, **back;
 
-	back = &cmd_functions;
+	cmd = Cmd_FindCommand(cmd_name);
 
-	while (1)
+	if (!cmd)
 	{
-		cmd = *back;
+		Com_Printf("Cmd_RemoveCommand: %s not added\n", cmd_name);
+		return;
+	}
 
-		if (!cmd)
-		{
-			Com_Printf("Cmd_RemoveCommand: %s not added\n", cmd_name);
-			return;
-		}
+	for (back = &cmd_hash[Cmd_HashName(cmd_name)]; *back != cmd;
+		back = &(*back)->hash_next)
+	{
+	}
 
-		if (!strcmp(cmd_name, cmd->name))
-		{
-			*back = cmd->next;
-			Z_Free(cmd);
-			return;
-		}
+	*back = cmd->hash_next;
 
-		back = &cmd->next;
+	for (back = &cmd_functions; *back != cmd; back = &(*back)->next)
+	{
 	}
+
+	*back = cmd->next;
+	Z_Free(cmd);
 }
 
 qboolean
 Cmd_Exists(char *cmd_name)
 {
-	cmd_function_t *cmd;
-
-	for (cmd = cmd_functions; cmd; cmd = cmd->next)
-	{
-		if (!strcmp(cmd_name, cmd->name))
-		{
-			return true;
-		}
-	}
-
-	return false;
+	return Cmd_FindCommand(cmd_name) != NULL;
 }
 
 char *
@@ -989,25 +1033,12 @@ Cmd_CompleteMapCommand(char *partial)
 qboolean
 Cmd_IsComplete(char *command)
 {
-	cmd_function_t *cmd;
-	cmdalias_t *a;
 	cvar_t *cvar;
 
 	/* check for exact match */
-	for (cmd = cmd_functions; cmd; cmd = cmd->next)
+	if (Cmd_FindCommand(command) || Cmd_FindAlias(command))
 	{
-		if (!strcmp(command, cmd->name))
-		{
-			return true;
-		}
-	}
-
-	for (a = cmd_alias; a; a = a->next)
-	{
-		if (!strcmp(command, a->name))
-		{
-			return true;
-		}
+		return true;
 	}
 
 	for (cvar = cvar_vars; cvar; cvar = cvar->next)
@@ -1030,8 +1061,9 @@ qboolean doneWithDefaultCfg;
 void
 Cmd_ExecuteString(char *text)
 {
-	cmd_function_t *cmd;
+	cmd_function_t *cmd, *found;
 	cmdalias_t *a;
+	unsigned hash;
 
 	Cmd_TokenizeString(text, true);
 
@@ -1047,27 +1079,38 @@ Cmd_ExecuteString(char *text)
 		doneWithDefaultCfg = true;
 	}
 
-	/* check functions */
-	for (cmd = cmd_functions; cmd; cmd = cmd->next)
+	/* check functions. If several differ only in case, the
+	   one that comes first in cmd_functions wins. */
+	hash = Cmd_HashName(cmd_argv[0]);
+	found = NULL;
+
+	for (cmd = cmd_hash[hash]; cmd; cmd = cmd->hash_next)
 	{
-		if (!Q_strcasecmp(cmd_argv[0], cmd->name))
+		if (!Q_strcasecmp(cmd_argv[0], cmd->name) &&
+			(!found || (strcmp(cmd->name, found->name) < 0)))
 		{
-			if (!cmd->function)
-			{
-				/* forward to server command */
-				Cmd_ExecuteString(va("cmd %s", text));
-			}
-			else
-			{
-				cmd->function();
-			}
+			found = cmd;
+		}
+	}
 
-			return;
+	if (found)
+	{
+		if (!found->function)
+		{
+			/* forward to server command */
+			Cmd_ExecuteString(va("cmd %s", text));
+		}
+		else
+		{
+			found->function();
 		}
+
+		return;
 	}
 
-	/* check alias */
-	for (a = cmd_alias; a; a = a->next)
+	/* check alias, the chains are newest
+	   first just like cmd_alias */
+	for (a = alias_hash[hash]; a; a = a->hash_next)
 	{
 		if (!Q_strcasecmp(cmd_argv[0], a->name))
 		{
@@ -1110,6 +1153,165 @@ Cmd_List_f(void)
 	Com_Printf("%i commands\n", i);
 }
 
+static void
+Cmd_ExecBenchNop_f(void)
+{
+}
+
+/*
+ * Returns the line number that the execbench cvar or
+ * alias name was made for, or -1 for other names.
+ */
+static int
+Cmd_ExecBenchLine(const char *name, int kind, int lines)
+{
+	char check[64];
+	int i;
+
+	if (strncmp(name, "execbench_", 10))
+	{
+		return -1;
+	}
+
+	i = (int)strtol(name + 10, NULL, 10);
+
+	if ((i < 0) || (i >= lines) || ((i & 3) != kind))
+	{
+		return -1;
+	}
+
+	/* execbench_01 is not one of ours */
+	Com_sprintf(check, sizeof(check), "execbench_%i", i);
+
+	return strcmp(name, check) ? -1 : i;
+}
+
+/*
+ * Runs a generated config through Cmd_ExecuteString() and
+ * prints how long that took. Of every four lines one creates
+ * a cvar, one defines an alias, one sets a cvar by its name
+ * and one runs a command. The aliases and cvars that didn't
+ * exist before are removed afterwards, the others get their
+ * old values back.
+ */
+static void
+Cmd_ExecBench_f(void)
+{
+	char line[128];
+	char **saved;
+	cmdalias_t *a, **back, **link;
+	cvar_t *var;
+	long long start, total;
+	int i, lines;
+
+	lines = (Cmd_Argc() > 1) ? (int)strtol(Cmd_Argv(1), NULL, 10) : 10000;
+
+	if ((lines <= 0) || (lines > 0x1000000))
+	{
+		Com_Printf("Usage: %s [lines]\n", Cmd_Argv(0));
+		return;
+	}
+
+	/* values of the names the bench is going to overwrite */
+	saved = Z_Malloc(lines * sizeof(char *));
+
+	for (var = cvar_vars; var; var = var->next)
+	{
+		if ((i = Cmd_ExecBenchLine(var->name, 0, lines)) >= 0)
+		{
+			saved[i] = CopyString(var->string);
+		}
+	}
+
+	for (a = cmd_alias; a; a = a->next)
+	{
+		if ((i = Cmd_ExecBenchLine(a->name, 1, lines)) >= 0)
+		{
+			saved[i] = CopyString(a->value);
+		}
+	}
+
+	Cmd_AddCommand("execbench_nop", Cmd_ExecBenchNop_f);
+
+	total = 0;
+
+	for (i = 0; i < lines; i++)
+	{
+		switch (i & 3)
+		{
+			case 0:
+				Com_sprintf(line, sizeof(line), "set execbench_%i %i", i, i);
+				break;
+			case 1:
+				Com_sprintf(line, sizeof(line),
+					"alias execbench_%i \"execbench_nop %i\"", i, i);
+				break;
+			case 2:
+				Com_sprintf(line, sizeof(line), "execbench_%i %i", i - 2, i);
+				break;
+			default:
+				Com_sprintf(line, sizeof(line), "execbench_nop %i", i);
+				break;
+		}
+
+		start = Sys_Microseconds();
+		Cmd_ExecuteString(line);
+		total += Sys_Microseconds() - start;
+	}
+
+	Com_Printf("%i lines in %.2f ms, %.2f us per line\n",
+		lines, total / 1000.0, (double)total / lines);
+
+	back = &cmd_alias;
+
+	while ((a = *back) != NULL)
+	{
+		if ((i = Cmd_ExecBenchLine(a->name, 1, lines)) < 0)
+		{
+			back = &a->next;
+			continue;
+		}
+
+		if (saved[i])
+		{
+			Z_Free(a->value);
+			a->value = saved[i];
+			back = &a->next;
+			continue;
+		}
+
+		for (link = &alias_hash[Cmd_HashName(a->name)]; *link != a;
+			link = &(*link)->hash_next)
+		{
+		}
+
+		*link = a->hash_next;
+		*back = a->next;
+
+		Z_Free(a->value);
+		Z_Free(a);
+	}
+
+	for (i = 0; i < lines; i += 4)
+	{
+		Com_sprintf(line, sizeof(line), "execbench_%i", i);
+
+		if (saved[i])
+		{
+			Cvar_Set(line, saved[i]);
+			Z_Free(saved[i]);
+		}
+		else
+		{
+			Cvar_Remove(line);
+		}
+	}
+
+	Z_Free(saved);
+
+	Cmd_RemoveCommand("execbench_nop");
+}
+
 void
 Cmd_Init(void)
 {
@@ -1120,6 +1322,7 @@ Cmd_Init(void)
 	Cmd_AddCommand("echo", Cmd_Echo_f);
 	Cmd_AddCommand("alias", Cmd_Alias_f);
 	Cmd_AddCommand("wait", Cmd_Wait_f);
+	Cmd_AddCommand("execbench", Cmd_ExecBench_f);
 }
 
 void
@@ -1134,4 +1337,6 @@ Cmd_Shutdown(void)
 		Z_Free(cmd_alias);
 		cmd_alias = next;
 	}
+
+	memset(alias_hash, 0, sizeof(alias_hash));
 }
@@ -25,6 +25,7 @@
  * =======================================================================
  */
 
+#include <limits.h>
 #include <stdint.h>
 
 #include "header/common.h"
@@ -46,8 +47,8 @@ typedef struct
 	int			contents;
 	int			cluster;
 	int			area;
-	unsigned short	firstleafbrush;
-	unsigned short	numleafbrushes;
+	unsigned int	firstleafbrush;
+	unsigned int	numleafbrushes;
 } cleaf_t;
 
 typedef struct
@@ -55,7 +56,6 @@ typedef struct
 	int			contents;
 	int			numsides;
 	int			firstbrushside;
-	int			checkcount;	/* to avoid repeated testings */
 } cbrush_t;
 
 typedef struct
@@ -66,28 +66,54 @@ typedef struct
 	int		floodvalid;
 } carea_t;
 
-byte *cmod_base;
-byte map_visibility[MAX_MAP_VISIBILITY];
+/* Everything a trace needs while it walks the tree. CM_BoxTrace()
+   uses cm_trace, traces on other threads bring their own. */
+struct cmtrace_s
+{
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	vec3_t		extents;
+	int			contents;
+	qboolean	ispoint; /* optimized case */
+	trace_t		trace;
+	int			checkcount;
+	int			*brushchecks; /* to avoid repeated testings */
+	int			traces, brushtraces; /* see CM_AddTraceStats() */
+	cmtrace_t	*next; /* all contexts, resized with each map */
+};
+
+/* what the map pointers show while no map is loaded,
+   the leaf functions may be called without one */
+static cleaf_t cmod_noleaf;
+static YQ2_ALIGNAS_TYPE(int32_t) byte cmod_novis[sizeof(dvis_t)];
+static char cmod_noentities[1];
+
+/* all map data is in one block, each array starts on a cache line */
+#define CMOD_ALIGN 64
+static byte *cmod_memory;
+
+static qboolean cmod_qbsp; /* extended format, 32 bit indices */
+
 // DG: is casted to int32_t* in SV_FatPVS() so align accordingly
 static YQ2_ALIGNAS_TYPE(int32_t) byte pvsrow[MAX_MAP_LEAFS / 8];
 byte phsrow[MAX_MAP_LEAFS / 8];
+byte *map_visibility = cmod_novis;
 carea_t	map_areas[MAX_MAP_AREAS];
-cbrush_t map_brushes[MAX_MAP_BRUSHES];
-cbrushside_t map_brushsides[MAX_MAP_BRUSHSIDES];
+cbrush_t *map_brushes;
+cbrushside_t *map_brushsides;
 char map_name[MAX_QPATH];
-char map_entitystring[MAX_MAP_ENTSTRING];
+char *map_entitystring = cmod_noentities;
 cbrush_t *box_brush;
 cleaf_t	*box_leaf;
-cleaf_t	map_leafs[MAX_MAP_LEAFS];
+cleaf_t	*map_leafs = &cmod_noleaf;
 cmodel_t map_cmodels[MAX_MAP_MODELS];
-cnode_t	map_nodes[MAX_MAP_NODES+6]; /* extra for box hull */
+cnode_t	*map_nodes; /* 6 extra for box hull */
 cplane_t *box_planes;
-cplane_t map_planes[MAX_MAP_PLANES+6]; /* extra for box hull */
+cplane_t *map_planes; /* 12 extra for box hull */
 cvar_t *map_noareas;
 dareaportal_t map_areaportals[MAX_MAP_AREAPORTALS];
-dvis_t *map_vis = (dvis_t *)map_visibility;
+dvis_t *map_vis = (dvis_t *)cmod_novis;
 int box_headnode;
-int	checkcount;
 int	emptyleaf, solidleaf;
 int	floodvalid;
 float *leaf_mins, *leaf_maxs;
@@ -107,16 +133,12 @@ int	numnodes;
 int	numplanes;
 int	numtexinfo;
 int	numvisibility;
-int trace_contents;
-mapsurface_t map_surfaces[MAX_MAP_TEXINFO];
+mapsurface_t *map_surfaces;
 mapsurface_t nullsurface;
 qboolean portalopen[MAX_MAP_AREAPORTALS];
-qboolean trace_ispoint; /* optimized case */
-trace_t trace_trace;
-unsigned short	map_leafbrushes[MAX_MAP_LEAFBRUSHES];
-vec3_t trace_start, trace_end;
-vec3_t trace_mins, trace_maxs;
-vec3_t trace_extents;
+unsigned int *map_leafbrushes;
+static cmtrace_t cm_trace;
+static cmtrace_t *cm_tracecontexts = &cm_trace;
 
 #ifndef DEDICATED_ONLY
 int		c_pointcontents;
@@ -325,18 +347,10 @@ CM_InitBoxHull(void)
 	cplane_t *p;
 	cbrushside_t *s;
 
+	/* CMod_AllocMap() left room behind the maps data */
 	box_headnode = numnodes;
 	box_planes = &map_planes[numplanes];
 
-	if ((numnodes + 6 > MAX_MAP_NODES) ||
-		(numbrushes + 1 > MAX_MAP_BRUSHES) ||
-		(numleafbrushes + 1 > MAX_MAP_LEAFBRUSHES) ||
-		(numbrushsides + 6 > MAX_MAP_BRUSHSIDES) ||
-		(numplanes + 12 > MAX_MAP_PLANES))
-	{
-		Com_Error(ERR_DROP, "Not enough room for box tree");
-	}
-
 	box_brush = &map_brushes[numbrushes];
 	box_brush->numsides = 6;
 	box_brush->firstbrushside = numbrushsides;
@@ -591,8 +605,8 @@ CM_TransformedPointContents(vec3_t p, int headnode,
 	return map_leafs[l].contents;
 }
 
-void
-CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
+static void
+CM_ClipBoxToBrush(cmtrace_t *tc, vec3_t mins, vec3_t maxs, vec3_t p1,
 		vec3_t p2, trace_t *trace, cbrush_t *brush)
 {
 	int i, j;
@@ -614,9 +628,7 @@ CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
 		return;
 	}
 
-#ifndef DEDICATED_ONLY
-	c_brush_traces++;
-#endif
+	tc->brushtraces++;
 
 	getout = false;
 	startout = false;
@@ -627,7 +639,7 @@ CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
 		side = &map_brushsides[brush->firstbrushside + i];
 		plane = side->plane;
 
-		if (!trace_ispoint)
+		if (!tc->ispoint)
 		{
 			/* general box case
 			   push the plane out
@@ -740,7 +752,7 @@ CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
 	}
 }
 
-void
+static void
 CM_TestBoxInBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
 		trace_t *trace, cbrush_t *brush)
 {
@@ -795,8 +807,8 @@ CM_TestBoxInBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
 	trace->contents = brush->contents;
 }
 
-void
-CM_TraceToLeaf(int leafnum)
+static void
+CM_TraceToLeaf(cmtrace_t *tc, int leafnum)
 {
 	int k;
 	int brushnum;
@@ -805,7 +817,7 @@ CM_TraceToLeaf(int leafnum)
 
 	leaf = &map_leafs[leafnum];
 
-	if (!(leaf->contents & trace_contents))
+	if (!(leaf->contents & tc->contents))
 	{
 		return;
 	}
@@ -816,30 +828,30 @@ CM_TraceToLeaf(int leafnum)
 		brushnum = map_leafbrushes[leaf->firstleafbrush + k];
 		b = &map_brushes[brushnum];
 
-		if (b->checkcount == checkcount)
+		if (tc->brushchecks[brushnum] == tc->checkcount)
 		{
 			continue; /* already checked this brush in another leaf */
 		}
 
-		b->checkcount = checkcount;
+		tc->brushchecks[brushnum] = tc->checkcount;
 
-		if (!(b->contents & trace_contents))
+		if (!(b->contents & tc->contents))
 		{
 			continue;
 		}
 
-		CM_ClipBoxToBrush(trace_mins, trace_maxs, trace_start,
-				trace_end, &trace_trace, b);
+		CM_ClipBoxToBrush(tc, tc->mins, tc->maxs, tc->start,
+				tc->end, &tc->trace, b);
 
-		if (!trace_trace.fraction)
+		if (!tc->trace.fraction)
 		{
 			return;
 		}
 	}
 }
 
-void
-CM_TestInLeaf(int leafnum)
+static void
+CM_TestInLeaf(cmtrace_t *tc, int leafnum)
 {
 	int k;
 	int brushnum;
@@ -848,7 +860,7 @@ CM_TestInLeaf(int leafnum)
 
 	leaf = &map_leafs[leafnum];
 
-	if (!(leaf->contents & trace_contents))
+	if (!(leaf->contents & tc->contents))
 	{
 		return;
 	}
@@ -859,29 +871,30 @@ CM_TestInLeaf(int leafnum)
 		brushnum = map_leafbrushes[leaf->firstleafbrush + k];
 		b = &map_brushes[brushnum];
 
-		if (b->checkcount == checkcount)
+		if (tc->brushchecks[brushnum] == tc->checkcount)
 		{
 			continue; /* already checked this brush in another leaf */
 		}
 
-		b->checkcount = checkcount;
+		tc->brushchecks[brushnum] = tc->checkcount;
 
-		if (!(b->contents & trace_contents))
+		if (!(b->contents & tc->contents))
 		{
 			continue;
 		}
 
-		CM_TestBoxInBrush(trace_mins, trace_maxs, trace_start, &trace_trace, b);
+		CM_TestBoxInBrush(tc->mins, tc->maxs, tc->start, &tc->trace, b);
 
-		if (!trace_trace.fraction)
+		if (!tc->trace.fraction)
 		{
 			return;
 		}
 	}
 }
 
-void
-CM_RecursiveHullCheck(int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
+static void
+CM_RecursiveHullCheck(cmtrace_t *tc, int num, float p1f, float p2f,
+		vec3_t p1, vec3_t p2)
 {
 	cnode_t *node;
 	cplane_t *plane;
@@ -893,7 +906,7 @@ CM_RecursiveHullCheck(int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 	int side;
 	float midf;
 
-	if (trace_trace.fraction <= p1f)
+	if (tc->trace.fraction <= p1f)
 	{
 		return; /* already hit something nearer */
 	}
@@ -901,7 +914,7 @@ CM_RecursiveHullCheck(int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 	/* if < 0, we are in a leaf node */
 	if (num < 0)
 	{
-		CM_TraceToLeaf(-1 - num);
+		CM_TraceToLeaf(tc, -1 - num);
 		return;
 	}
 
@@ -914,7 +927,7 @@ CM_RecursiveHullCheck(int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 	{
 		t1 = p1[plane->type] - plane->dist;
 		t2 = p2[plane->type] - plane->dist;
-		offset = trace_extents[plane->type];
+		offset = tc->extents[plane->type];
 	}
 
 	else
@@ -922,29 +935,29 @@ CM_RecursiveHullCheck(int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 		t1 = DotProduct(plane->normal, p1) - plane->dist;
 		t2 = DotProduct(plane->normal, p2) - plane->dist;
 
-		if (trace_ispoint)
+		if (tc->ispoint)
 		{
 			offset = 0;
 		}
 
 		else
 		{
-			offset = (float)fabs(trace_extents[0] * plane->normal[0]) +
-					 (float)fabs(trace_extents[1] * plane->normal[1]) +
-					 (float)fabs(trace_extents[2] * plane->normal[2]);
+			offset = (float)fabs(tc->extents[0] * plane->normal[0]) +
+					 (float)fabs(tc->extents[1] * plane->normal[1]) +
+					 (float)fabs(tc->extents[2] * plane->normal[2]);
 		}
 	}
 
 	/* see which sides we need to consider */
 	if ((t1 >= offset) && (t2 >= offset))
 	{
-		CM_RecursiveHullCheck(node->children[0], p1f, p2f, p1, p2);
+		CM_RecursiveHullCheck(tc, node->children[0], p1f, p2f, p1, p2);
 		return;
 	}
 
 	if ((t1 < -offset) && (t2 < -offset))
 	{
-		CM_RecursiveHullCheck(node->children[1], p1f, p2f, p1, p2);
+		CM_RecursiveHullCheck(tc, node->children[1], p1f, p2f, p1, p2);
 		return;
 	}
 
@@ -990,7 +1003,7 @@ CM_RecursiveHullCheck(int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 		mid[i] = p1[i] + frac * (p2[i] - p1[i]);
 	}
 
-	CM_RecursiveHullCheck(node->children[side], p1f, midf, p1, mid);
+	CM_RecursiveHullCheck(tc, node->children[side], p1f, midf, p1, mid);
 
 	/* go past the node */
 	if (frac2 < 0)
@@ -1010,36 +1023,56 @@ CM_RecursiveHullCheck(int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 		mid[i] = p1[i] + frac2 * (p2[i] - p1[i]);
 	}
 
-	CM_RecursiveHullCheck(node->children[side ^ 1], midf, p2f, mid, p2);
+	CM_RecursiveHullCheck(tc, node->children[side ^ 1], midf, p2f, mid, p2);
+}
+
+/*
+ * Sweeps the box through the tree of headnode. Nothing but tc is
+ * written, so traces with their own tc may run on several threads
+ * at once. Not the position test for start == end though, that
+ * goes through CM_BoxLeafnums_headnode() and its globals.
+ */
+/*
+ * Adds the traces counted in a context to c_traces and
+ * c_brush_traces. The contexts count on their own, so the
+ * threads don't race on the globals. Main thread only.
+ */
+void
+CM_AddTraceStats(cmtrace_t *tc)
+{
+#ifndef DEDICATED_ONLY
+	c_traces += tc->traces; /* for statistics, may be zeroed */
+	c_brush_traces += tc->brushtraces;
+#endif
+
+	tc->traces = 0;
+	tc->brushtraces = 0;
 }
 
 trace_t
-CM_BoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs,
-		int headnode, int brushmask)
+CM_BoxTraceContext(cmtrace_t *tc, vec3_t start, vec3_t end,
+		vec3_t mins, vec3_t maxs, int headnode, int brushmask)
 {
 	int i;
 
-	checkcount++; /* for multi-check avoidance */
-
-#ifndef DEDICATED_ONLY
-	c_traces++; /* for statistics, may be zeroed */
-#endif
+	tc->traces++;
+	tc->checkcount++; /* for multi-check avoidance */
 
 	/* fill in a default trace */
-	memset(&trace_trace, 0, sizeof(trace_trace));
-	trace_trace.fraction = 1;
-	trace_trace.surface = &(nullsurface.c);
+	memset(&tc->trace, 0, sizeof(tc->trace));
+	tc->trace.fraction = 1;
+	tc->trace.surface = &(nullsurface.c);
 
 	if (!numnodes)  /* map not loaded */
 	{
-		return trace_trace;
+		return tc->trace;
 	}
 
-	trace_contents = brushmask;
-	VectorCopy(start, trace_start);
-	VectorCopy(end, trace_end);
-	VectorCopy(mins, trace_mins);
-	VectorCopy(maxs, trace_maxs);
+	tc->contents = brushmask;
+	VectorCopy(start, tc->start);
+	VectorCopy(end, tc->end);
+	VectorCopy(mins, tc->mins);
+	VectorCopy(maxs, tc->maxs);
 
 	/* check for position test special case */
 	if ((start[0] == end[0]) && (start[1] == end[1]) && (start[2] == end[2]))
@@ -1063,52 +1096,65 @@ CM_BoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs,
 
 		for (i = 0; i < numleafs; i++)
 		{
-			CM_TestInLeaf(leafs[i]);
+			CM_TestInLeaf(tc, leafs[i]);
 
-			if (trace_trace.allsolid)
+			if (tc->trace.allsolid)
 			{
 				break;
 			}
 		}
 
-		VectorCopy(start, trace_trace.endpos);
-		return trace_trace;
+		VectorCopy(start, tc->trace.endpos);
+		return tc->trace;
 	}
 
 	/* check for point special case */
 	if ((mins[0] == 0) && (mins[1] == 0) && (mins[2] == 0) &&
 		(maxs[0] == 0) && (maxs[1] == 0) && (maxs[2] == 0))
 	{
-		trace_ispoint = true;
-		VectorClear(trace_extents);
+		tc->ispoint = true;
+		VectorClear(tc->extents);
 	}
 
 	else
 	{
-		trace_ispoint = false;
-		trace_extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
-		trace_extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
-		trace_extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
+		tc->ispoint = false;
+		tc->extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
+		tc->extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
+		tc->extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
 	}
 
 	/* general sweeping through world */
-	CM_RecursiveHullCheck(headnode, 0, 1, start, end);
+	CM_RecursiveHullCheck(tc, headnode, 0, 1, start, end);
 
-	if (trace_trace.fraction == 1)
+	if (tc->trace.fraction == 1)
 	{
-		VectorCopy(end, trace_trace.endpos);
+		VectorCopy(end, tc->trace.endpos);
 	}
 
 	else
 	{
 		for (i = 0; i < 3; i++)
 		{
-			trace_trace.endpos[i] = start[i] + trace_trace.fraction *
+			tc->trace.endpos[i] = start[i] + tc->trace.fraction *
 									(end[i] - start[i]);
 		}
 	}
 
-	return trace_trace;
+	return tc->trace;
+}
+
+trace_t
+CM_BoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs,
+		int headnode, int brushmask)
+{
+	trace_t trace;
+
+	trace = CM_BoxTraceContext(&cm_trace, start, end, mins, maxs,
+			headnode, brushmask);
+	CM_AddTraceStats(&cm_trace);
+
+	return trace;
 }
 
 /*
@@ -1116,8 +1162,9 @@ CM_BoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs,
  * rotating entities
  */
 trace_t
-CM_TransformedBoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs,
-		int headnode, int brushmask, vec3_t origin, vec3_t angles)
+CM_TransformedBoxTraceContext(cmtrace_t *tc, vec3_t start, vec3_t end,
+		vec3_t mins, vec3_t maxs, int headnode, int brushmask,
+		vec3_t origin, vec3_t angles)
 {
 	trace_t trace;
 	vec3_t start_l, end_l;
@@ -1126,6 +1173,8 @@ CM_TransformedBoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs,
 	vec3_t temp;
 	qboolean rotated;
 
+	tc->traces++;
+
 	/* subtract origin offset */
 	VectorSubtract(start, origin, start_l);
 	VectorSubtract(end, origin, end_l);
@@ -1158,7 +1207,8 @@ CM_TransformedBoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs,
 	}
 
 	/* sweep the box through the model */
-	trace = CM_BoxTrace(start_l, end_l, mins, maxs, headnode, brushmask);
+	trace = CM_BoxTraceContext(tc, start_l, end_l, mins, maxs,
+			headnode, brushmask);
 
 	if (rotated && (trace.fraction != 1.0))
 	{
@@ -1178,38 +1228,88 @@ CM_TransformedBoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs,
 	return trace;
 }
 
-void
-CMod_LoadSubmodels(lump_t *l)
+trace_t
+CM_TransformedBoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs,
+		int headnode, int brushmask, vec3_t origin, vec3_t angles)
 {
-	dmodel_t *in;
-	cmodel_t *out;
-	int i, j, count;
+	trace_t trace;
 
-	in = (void *)(cmod_base + l->fileofs);
+	trace = CM_TransformedBoxTraceContext(&cm_trace, start, end, mins, maxs,
+			headnode, brushmask, origin, angles);
+	CM_AddTraceStats(&cm_trace);
 
-	if (l->filelen % sizeof(*in))
-	{
-		Com_Error(ERR_DROP, "Mod_LoadSubmodels: funny lump size");
-	}
+	return trace;
+}
+
+/*
+ * A trace context for CM_BoxTraceContext() and
+ * CM_TransformedBoxTraceContext() on another thread.
+ */
+cmtrace_t *
+CM_CreateTraceContext(void)
+{
+	cmtrace_t *tc;
 
-	count = l->filelen / sizeof(*in);
+	tc = Z_Malloc(sizeof(cmtrace_t));
+	tc->brushchecks = Z_Malloc((numbrushes + 1) * sizeof(int));
 
-	if (count < 1)
+	tc->next = cm_tracecontexts;
+	cm_tracecontexts = tc;
+
+	return tc;
+}
+
+void
+CM_FreeTraceContext(cmtrace_t *tc)
+{
+	cmtrace_t **prev;
+
+	for (prev = &cm_tracecontexts; *prev; prev = &(*prev)->next)
 	{
-		Com_Error(ERR_DROP, "Map with no models");
+		if (*prev == tc)
+		{
+			*prev = tc->next;
+			break;
+		}
 	}
 
-	if (count > MAX_MAP_MODELS)
+	Z_Free(tc->brushchecks);
+	Z_Free(tc);
+}
+
+/*
+ * Every context needs a check counter for each brush
+ * of the new map and the box brush behind them.
+ */
+static void
+CM_ResizeTraceContexts(void)
+{
+	cmtrace_t *tc;
+
+	for (tc = cm_tracecontexts; tc; tc = tc->next)
 	{
-		Com_Error(ERR_DROP, "Map has too many models");
+		if (tc->brushchecks)
+		{
+			Z_Free(tc->brushchecks);
+		}
+
+		tc->brushchecks = Z_Malloc((numbrushes + 1) * sizeof(int));
+		tc->checkcount = 0;
 	}
+}
+
+const char *
+CMod_LoadSubmodels(const byte *data, int count)
+{
+	const dmodel_t *in;
+	cmodel_t *out;
+	int i, j;
 
-	numcmodels = count;
+	in = (const dmodel_t *)data;
+	out = map_cmodels;
 
 	for (i = 0; i < count; i++, in++, out++)
 	{
-		out = &map_cmodels[i];
-
 		for (j = 0; j < 3; j++)
 		{
 			/* spread the mins / maxs by a pixel */
@@ -1220,35 +1320,18 @@ CMod_LoadSubmodels(lump_t *l)
 
 		out->headnode = LittleLong(in->headnode);
 	}
+
+	return NULL;
 }
 
-void
-CMod_LoadSurfaces(lump_t *l)
+const char *
+CMod_LoadSurfaces(const byte *data, int count)
 {
-	texinfo_t *in;
+	const texinfo_t *in;
 	mapsurface_t *out;
-	int i, count;
-
-	in = (void *)(cmod_base + l->fileofs);
-
-	if (l->filelen % sizeof(*in))
-	{
-		Com_Error(ERR_DROP, "Mod_LoadSurfaces: funny lump size");
-	}
-
-	count = l->filelen / sizeof(*in);
-
-	if (count < 1)
-	{
-		Com_Error(ERR_DROP, "Map with no surfaces");
-	}
-
-	if (count > MAX_MAP_TEXINFO)
-	{
-		Com_Error(ERR_DROP, "Map has too many surfaces");
-	}
+	int i;
 
-	numtexinfo = count;
+	in = (const texinfo_t *)data;
 	out = map_surfaces;
 
 	for (i = 0; i < count; i++, in++, out++)
@@ -1258,123 +1341,116 @@ CMod_LoadSurfaces(lump_t *l)
 		out->c.flags = LittleLong(in->flags);
 		out->c.value = LittleLong(in->value);
 	}
+
+	return NULL;
 }
 
-void
-CMod_LoadNodes(lump_t *l)
+const char *
+CMod_LoadNodes(const byte *data, int count)
 {
-	dnode_t *in;
+	const dnode_t *in;
 	int child;
 	cnode_t *out;
-	int i, j, count;
-
-	in = (void *)(cmod_base + l->fileofs);
-
-	if (l->filelen % sizeof(*in))
-	{
-		Com_Error(ERR_DROP, "Mod_LoadNodes: funny lump size");
-	}
-
-	count = l->filelen / sizeof(*in);
+	int i, j, planenum;
+	size_t size;
 
-	if (count < 1)
-	{
-		Com_Error(ERR_DROP, "Map has no nodes");
-	}
+	/* planenum and children are the same in both formats,
+	   only the records have a different size */
+	size = cmod_qbsp ? sizeof(dqnode_t) : sizeof(dnode_t);
+	out = map_nodes;
 
-	if (count > MAX_MAP_NODES)
+	for (i = 0; i < count; i++, out++, data += size)
 	{
-		Com_Error(ERR_DROP, "Map has too many nodes");
-	}
+		in = (const dnode_t *)data;
 
-	out = map_nodes;
+		planenum = LittleLong(in->planenum);
 
-	numnodes = count;
+		if ((planenum < 0) || (planenum >= numplanes))
+		{
+			return "bad node plane";
+		}
 
-	for (i = 0; i < count; i++, out++, in++)
-	{
-		out->plane = map_planes + LittleLong(in->planenum);
+		out->plane = map_planes + planenum;
 
 		for (j = 0; j < 2; j++)
 		{
 			child = LittleLong(in->children[j]);
+
+			if ((child >= numnodes) || (-1 - child >= numleafs))
+			{
+				return "bad node child";
+			}
+
 			out->children[j] = child;
 		}
 	}
+
+	return NULL;
 }
 
-void
-CMod_LoadBrushes(lump_t *l)
+const char *
+CMod_LoadBrushes(const byte *data, int count)
 {
-	dbrush_t *in;
+	const dbrush_t *in;
 	cbrush_t *out;
-	int i, count;
-
-	in = (void *)(cmod_base + l->fileofs);
-
-	if (l->filelen % sizeof(*in))
-	{
-		Com_Error(ERR_DROP, "Mod_LoadBrushes: funny lump size");
-	}
-
-	count = l->filelen / sizeof(*in);
-
-	if (count > MAX_MAP_BRUSHES)
-	{
-		Com_Error(ERR_DROP, "Map has too many brushes");
-	}
+	int i;
 
+	in = (const dbrush_t *)data;
 	out = map_brushes;
 
-	numbrushes = count;
-
 	for (i = 0; i < count; i++, out++, in++)
 	{
 		out->firstbrushside = LittleLong(in->firstside);
 		out->numsides = LittleLong(in->numsides);
 		out->contents = LittleLong(in->contents);
+
+		if ((out->firstbrushside < 0) || (out->numsides < 0) ||
+			(out->firstbrushside > numbrushsides - out->numsides))
+		{
+			return "bad brush sides";
+		}
 	}
+
+	return NULL;
 }
 
-void
-CMod_LoadLeafs(lump_t *l)
+const char *
+CMod_LoadLeafs(const byte *data, int count)
 {
 	int i;
 	cleaf_t *out;
-	dleaf_t *in;
-	int count;
-
-	in = (void *)(cmod_base + l->fileofs);
-
-	if (l->filelen % sizeof(*in))
-	{
-		Com_Error(ERR_DROP, "Mod_LoadLeafs: funny lump size");
-	}
 
-	count = l->filelen / sizeof(*in);
+	out = map_leafs;
+	numclusters = 0;
 
-	if (count < 1)
+	for (i = 0; i < count; i++, out++)
 	{
-		Com_Error(ERR_DROP, "Map with no leafs");
-	}
+		if (cmod_qbsp)
+		{
+			const dqleaf_t *in = (const dqleaf_t *)data + i;
 
-	/* need to save space for box planes */
-	if (count > MAX_MAP_PLANES)
-	{
-		Com_Error(ERR_DROP, "Map has too many planes");
-	}
+			out->contents = LittleLong(in->contents);
+			out->cluster = LittleLong(in->cluster);
+			out->area = LittleLong(in->area);
+			out->firstleafbrush = LittleLong(in->firstleafbrush);
+			out->numleafbrushes = LittleLong(in->numleafbrushes);
+		}
+		else
+		{
+			const dleaf_t *in = (const dleaf_t *)data + i;
 
-	out = map_leafs;
-	numleafs = count;
-	numclusters = 0;
+			out->contents = LittleLong(in->contents);
+			out->cluster = LittleShort(in->cluster);
+			out->area = LittleShort(in->area);
+			out->firstleafbrush = LittleShort(in->firstleafbrush) & 0xFFFF;
+			out->numleafbrushes = LittleShort(in->numleafbrushes) & 0xFFFF;
+		}
 
-	for (i = 0; i < count; i++, in++, out++)
-	{
-		out->contents = LittleLong(in->contents);
-		out->cluster = LittleShort(in->cluster);
-		out->area = LittleShort(in->area);
-		out->firstleafbrush = LittleShort(in->firstleafbrush);
-		out->numleafbrushes = LittleShort(in->numleafbrushes);
+		if ((out->firstleafbrush > numleafbrushes) ||
+			(out->numleafbrushes > numleafbrushes - out->firstleafbrush))
+		{
+			return "bad leaf brushes";
+		}
 
 		if (out->cluster >= numclusters)
 		{
@@ -1382,9 +1458,15 @@ CMod_LoadLeafs(lump_t *l)
 		}
 	}
 
+	/* the PVS rows are sent around in fixed buffers */
+	if (numclusters > MAX_MAP_LEAFS)
+	{
+		return "too many clusters";
+	}
+
 	if (map_leafs[0].contents != CONTENTS_SOLID)
 	{
-		Com_Error(ERR_DROP, "Map leaf 0 is not CONTENTS_SOLID");
+		return "leaf 0 not CONTENTS_SOLID";
 	}
 
 	solidleaf = 0;
@@ -1401,41 +1483,22 @@ CMod_LoadLeafs(lump_t *l)
 
 	if (emptyleaf == -1)
 	{
-		Com_Error(ERR_DROP, "Map does not have an empty leaf");
+		return "no empty leaf";
 	}
+
+	return NULL;
 }
 
-void
-CMod_LoadPlanes(lump_t *l)
+const char *
+CMod_LoadPlanes(const byte *data, int count)
 {
 	int i, j;
 	cplane_t *out;
-	dplane_t *in;
-	int count;
+	const dplane_t *in;
 	int bits;
 
-	in = (void *)(cmod_base + l->fileofs);
-
-	if (l->filelen % sizeof(*in))
-	{
-		Com_Error(ERR_DROP, "Mod_LoadPlanes: funny lump size");
-	}
-
-	count = l->filelen / sizeof(*in);
-
-	if (count < 1)
-	{
-		Com_Error(ERR_DROP, "Map with no planes");
-	}
-
-	/* need to save space for box planes */
-	if (count > MAX_MAP_PLANES)
-	{
-		Com_Error(ERR_DROP, "Map has too many planes");
-	}
-
+	in = (const dplane_t *)data;
 	out = map_planes;
-	numplanes = count;
 
 	for (i = 0; i < count; i++, in++, out++)
 	{
@@ -1455,211 +1518,594 @@ CMod_LoadPlanes(lump_t *l)
 		out->type = LittleLong(in->type);
 		out->signbits = bits;
 	}
+
+	return NULL;
 }
 
-void
-CMod_LoadLeafBrushes(lump_t *l)
+const char *
+CMod_LoadLeafBrushes(const byte *data, int count)
 {
 	int i;
-	unsigned short *out;
-	unsigned short *in;
-	int count;
+	unsigned int *out;
 
-	in = (void *)(cmod_base + l->fileofs);
+	out = map_leafbrushes;
 
-	if (l->filelen % sizeof(*in))
+	for (i = 0; i < count; i++, out++)
 	{
-		Com_Error(ERR_DROP, "Mod_LoadLeafBrushes: funny lump size");
+		if (cmod_qbsp)
+		{
+			*out = LittleLong(((const unsigned int *)data)[i]);
+		}
+		else
+		{
+			*out = LittleShort(((const unsigned short *)data)[i]) & 0xFFFF;
+		}
+
+		if (*out >= numbrushes)
+		{
+			return "bad leaf brush";
+		}
 	}
 
-	count = l->filelen / sizeof(*in);
+	return NULL;
+}
 
-	if (count < 1)
-	{
-		Com_Error(ERR_DROP, "Map with no planes");
-	}
+const char *
+CMod_LoadBrushSides(const byte *data, int count)
+{
+	int i, j;
+	cbrushside_t *out;
+	unsigned int num;
+
+	out = map_brushsides;
 
-	/* need to save space for box planes */
-	if (count > MAX_MAP_LEAFBRUSHES)
+	for (i = 0; i < count; i++, out++)
 	{
-		Com_Error(ERR_DROP, "Map has too many leafbrushes");
+		if (cmod_qbsp)
+		{
+			const dqbrushside_t *in = (const dqbrushside_t *)data + i;
+
+			num = LittleLong(in->planenum);
+			j = LittleLong(in->texinfo);
+		}
+		else
+		{
+			const dbrushside_t *in = (const dbrushside_t *)data + i;
+
+			num = LittleShort(in->planenum) & 0xFFFF;
+			j = LittleShort(in->texinfo);
+		}
+
+		if (num >= numplanes)
+		{
+			return "bad brushside plane";
+		}
+
+		out->plane = &map_planes[num];
+
+		if (j >= numtexinfo)
+		{
+			return "bad brushside texinfo";
+		}
+
+		out->surface = (j >= 0) ? &map_surfaces[j] : &nullsurface;
 	}
 
-	out = map_leafbrushes;
-	numleafbrushes = count;
+	return NULL;
+}
+
+const char *
+CMod_LoadAreas(const byte *data, int count)
+{
+	int i;
+	carea_t *out;
+	const darea_t *in;
+
+	in = (const darea_t *)data;
+	out = map_areas;
 
 	for (i = 0; i < count; i++, in++, out++)
 	{
-		*out = LittleShort(*in);
+		out->numareaportals = LittleLong(in->numareaportals);
+		out->firstareaportal = LittleLong(in->firstareaportal);
+		out->floodvalid = 0;
+		out->floodnum = 0;
 	}
+
+	return NULL;
 }
 
-void
-CMod_LoadBrushSides(lump_t *l)
+const char *
+CMod_LoadAreaPortals(const byte *data, int count)
 {
-	int i, j;
-	cbrushside_t *out;
-	dbrushside_t *in;
-	int count;
-	int num;
+	memcpy(map_areaportals, data, sizeof(dareaportal_t) * count);
+
+	return NULL;
+}
+
+const char *
+CMod_LoadVisibility(const byte *data, int count)
+{
+	int i, j, ofs;
 
-	in = (void *)(cmod_base + l->fileofs);
+	memcpy(map_visibility, data, count);
 
-	if (l->filelen % sizeof(*in))
+	if (!count)
 	{
-		Com_Error(ERR_DROP, "Mod_LoadBrushSides: funny lump size");
+		return NULL;
 	}
 
-	count = l->filelen / sizeof(*in);
-
-	/* need to save space for box planes */
-	if (count > MAX_MAP_BRUSHSIDES)
+	if (count < sizeof(map_vis->numclusters))
 	{
-		Com_Error(ERR_DROP, "Map has too many planes");
+		return "bad visibility";
 	}
 
-	out = map_brushsides;
-	numbrushsides = count;
+	map_vis->numclusters = LittleLong(map_vis->numclusters);
 
-	for (i = 0; i < count; i++, in++, out++)
+	/* pvsrow and phsrow hold MAX_MAP_LEAFS clusters */
+	if ((map_vis->numclusters < 0) || (map_vis->numclusters > MAX_MAP_LEAFS) ||
+		(sizeof(map_vis->numclusters) +
+		 (size_t)map_vis->numclusters * sizeof(map_vis->bitofs[0]) > count))
 	{
-		num = LittleShort(in->planenum);
-		out->plane = &map_planes[num];
-		j = LittleShort(in->texinfo);
+		return "bad visibility clusters";
+	}
 
-		if (j >= numtexinfo)
+	for (i = 0; i < map_vis->numclusters; i++)
+	{
+		for (j = 0; j < 2; j++)
 		{
-			Com_Error(ERR_DROP, "Bad brushside texinfo");
+			ofs = LittleLong(map_vis->bitofs[i][j]);
+
+			if ((ofs < 0) || (ofs >= count))
+			{
+				return "bad visibility offset";
+			}
 		}
+	}
 
-		out->surface = (j >= 0) ? &map_surfaces[j] : &nullsurface;
+	return NULL;
+}
+
+/* From kmquake2: an .ent file next to the map replaces its entities */
+static char *cmod_entfile;
+
+const char *
+CMod_LoadEntityString(const byte *data, int count)
+{
+	if (cmod_entfile)
+	{
+		memcpy(map_entitystring, cmod_entfile, numentitychars);
+	}
+	else
+	{
+		memcpy(map_entitystring, data, count);
 	}
+
+	map_entitystring[numentitychars] = 0;
+
+	return NULL;
 }
 
-void
-CMod_LoadAreas(lump_t *l)
+static int
+CMod_LoadEntityFile(char *name)
 {
-	int i;
-	carea_t *out;
-	darea_t *in;
-	int count;
+	char s[MAX_QPATH];
+	char *buffer = NULL;
+	int nameLen, bufLen;
 
-	in = (void *)(cmod_base + l->fileofs);
+	cmod_entfile = NULL;
 
-	if (l->filelen % sizeof(*in))
+	if (!sv_entfile->value)
 	{
-		Com_Error(ERR_DROP, "Mod_LoadAreas: funny lump size");
+		return 0;
 	}
 
-	count = l->filelen / sizeof(*in);
+	nameLen = strlen(name);
+	strcpy(s, name);
+	s[nameLen-3] = 'e';	s[nameLen-2] = 'n';	s[nameLen-1] = 't';
+	bufLen = FS_LoadFile(s, (void **)&buffer);
 
-	if (count > MAX_MAP_AREAS)
+	if (buffer != NULL && bufLen > 1)
 	{
-		Com_Error(ERR_DROP, "Map has too many areas");
+		Com_Printf ("CMod_LoadEntityString: .ent file %s loaded.\n", s);
+		cmod_entfile = buffer;
+		return bufLen;
+	}
+	else if (bufLen != -1)
+	{
+		/* If the .ent file is too small, don't load. */
+		Com_Printf("CMod_LoadEntityString: .ent file %s too small.\n", s);
+		FS_FreeFile(buffer);
 	}
 
-	out = map_areas;
-	numareas = count;
+	return 0;
+}
 
-	for (i = 0; i < count; i++, in++, out++)
+/* The lumps for collision, with the size of their records
+   in both formats. Everything else in the file is skipped. */
+typedef struct
+{
+	int lump;
+	const char *name;
+	int size, qbspsize;
+	int *count;
+	const char *(*load)(const byte *data, int count);
+} cmodlump_t;
+
+static const cmodlump_t cmod_lumps[] = {
+	{LUMP_TEXINFO, "surfaces", sizeof(texinfo_t), sizeof(texinfo_t),
+		&numtexinfo, CMod_LoadSurfaces},
+	{LUMP_LEAFS, "leafs", sizeof(dleaf_t), sizeof(dqleaf_t),
+		&numleafs, CMod_LoadLeafs},
+	{LUMP_LEAFBRUSHES, "leafbrushes", sizeof(unsigned short), sizeof(unsigned int),
+		&numleafbrushes, CMod_LoadLeafBrushes},
+	{LUMP_PLANES, "planes", sizeof(dplane_t), sizeof(dplane_t),
+		&numplanes, CMod_LoadPlanes},
+	{LUMP_BRUSHES, "brushes", sizeof(dbrush_t), sizeof(dbrush_t),
+		&numbrushes, CMod_LoadBrushes},
+	{LUMP_BRUSHSIDES, "brushsides", sizeof(dbrushside_t), sizeof(dqbrushside_t),
+		&numbrushsides, CMod_LoadBrushSides},
+	{LUMP_MODELS, "models", sizeof(dmodel_t), sizeof(dmodel_t),
+		&numcmodels, CMod_LoadSubmodels},
+	{LUMP_NODES, "nodes", sizeof(dnode_t), sizeof(dqnode_t),
+		&numnodes, CMod_LoadNodes},
+	{LUMP_AREAS, "areas", sizeof(darea_t), sizeof(darea_t),
+		&numareas, CMod_LoadAreas},
+	{LUMP_AREAPORTALS, "areaportals", sizeof(dareaportal_t), sizeof(dareaportal_t),
+		&numareaportals, CMod_LoadAreaPortals},
+	{LUMP_VISIBILITY, "visibility", 1, 1,
+		&numvisibility, CMod_LoadVisibility},
+	{LUMP_ENTITIES, "entities", 1, 1,
+		&numentitychars, CMod_LoadEntityString}
+};
+
+#define CMOD_NUMLUMPS (sizeof(cmod_lumps) / sizeof(cmod_lumps[0]))
+
+/* never read less than that at once while skipping */
+#define CMOD_CHUNK 0x10000
+
+/*
+ * Record counts from the lump headers by lump number, NULL
+ * if they are fine. Nothing global changes before that's known.
+ */
+static const char *
+CMod_CountLumps(const dheader_t *header, int length, int *counts)
+{
+	static char error[64];
+	const cmodlump_t *cl;
+	const lump_t *l;
+	int i, size;
+
+	for (i = 0; i < CMOD_NUMLUMPS; i++)
 	{
-		out->numareaportals = LittleLong(in->numareaportals);
-		out->firstareaportal = LittleLong(in->firstareaportal);
-		out->floodvalid = 0;
-		out->floodnum = 0;
+		cl = &cmod_lumps[i];
+		l = &header->lumps[cl->lump];
+		size = cmod_qbsp ? cl->qbspsize : cl->size;
+
+		if ((l->fileofs < 0) || (l->filelen < 0) ||
+			(l->filelen > length - l->fileofs))
+		{
+			Com_sprintf(error, sizeof(error), "%s lump outside of the file", cl->name);
+			return error;
+		}
+
+		if (l->filelen % size)
+		{
+			Com_sprintf(error, sizeof(error), "funny lump size of %s", cl->name);
+			return error;
+		}
+
+		counts[cl->lump] = l->filelen / size;
+	}
+
+	if (counts[LUMP_TEXINFO] < 1)
+	{
+		return "no surfaces";
+	}
+
+	if (counts[LUMP_LEAFS] < 1)
+	{
+		return "no leafs";
 	}
+
+	if (counts[LUMP_LEAFBRUSHES] < 1)
+	{
+		return "no leafbrushes";
+	}
+
+	if (counts[LUMP_PLANES] < 1)
+	{
+		return "no planes";
+	}
+
+	if (counts[LUMP_MODELS] < 1)
+	{
+		return "no models";
+	}
+
+	if (counts[LUMP_NODES] < 1)
+	{
+		return "no nodes";
+	}
+
+	/* inline model numbers, area bits and portal states go over
+	   the network or into savegames, so these stay limited */
+	if (counts[LUMP_MODELS] > MAX_MAP_MODELS)
+	{
+		return "too many models";
+	}
+
+	if (counts[LUMP_AREAS] > MAX_MAP_AREAS)
+	{
+		return "too many areas";
+	}
+
+	if (counts[LUMP_AREAPORTALS] > MAX_MAP_AREAPORTALS)
+	{
+		return "too many areaportals";
+	}
+
+	return NULL;
 }
 
-void
-CMod_LoadAreaPortals(lump_t *l)
+static void
+CMod_FreeMap(void)
 {
-	dareaportal_t *out;
-	dareaportal_t *in;
-	int count;
+	if (cmod_memory)
+	{
+		Z_Free(cmod_memory);
+		cmod_memory = NULL;
+	}
+
+	map_planes = NULL;
+	map_nodes = NULL;
+	map_leafs = &cmod_noleaf;
+	map_leafbrushes = NULL;
+	map_brushes = NULL;
+	map_brushsides = NULL;
+	map_surfaces = NULL;
+	map_visibility = cmod_novis;
+	map_vis = (dvis_t *)cmod_novis;
+	map_entitystring = cmod_noentities;
 
-	in = (void *)(cmod_base + l->fileofs);
+	box_planes = NULL;
+	box_brush = NULL;
+	box_leaf = NULL;
 
-	if (l->filelen % sizeof(*in))
+	numplanes = 0;
+	numnodes = 0;
+	numleafs = 1;
+	numleafbrushes = 0;
+	numbrushes = 0;
+	numbrushsides = 0;
+	numtexinfo = 0;
+	numcmodels = 0;
+	numclusters = 1;
+	numareas = 1;
+	numareaportals = 0;
+	numvisibility = 0;
+	numentitychars = 0;
+	map_name[0] = 0;
+}
+
+/*
+ * Sizes the arrays from the counts, with room for the box hull
+ * behind the maps data. They're all carved from one zone block,
+ * each starting on its own cache line.
+ */
+static const char *
+CMod_AllocMap(void)
+{
+	struct
+	{
+		void **array;
+		size_t size;
+	} arrays[] = {
+		{(void **)&map_planes, (numplanes + 12) * sizeof(cplane_t)},
+		{(void **)&map_nodes, (numnodes + 6) * sizeof(cnode_t)},
+		{(void **)&map_leafs, (numleafs + 1) * sizeof(cleaf_t)},
+		{(void **)&map_leafbrushes, (numleafbrushes + 1) * sizeof(unsigned int)},
+		{(void **)&map_brushes, (numbrushes + 1) * sizeof(cbrush_t)},
+		{(void **)&map_brushsides, (numbrushsides + 6) * sizeof(cbrushside_t)},
+		{(void **)&map_surfaces, numtexinfo * sizeof(mapsurface_t)},
+		{(void **)&map_visibility, (numvisibility > sizeof(dvis_t)) ?
+			numvisibility : sizeof(dvis_t)},
+		{(void **)&map_entitystring, numentitychars + 1}
+	};
+	size_t size;
+	byte *base;
+	int i;
+
+	size = CMOD_ALIGN;
+
+	for (i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++)
+	{
+		size += (arrays[i].size + CMOD_ALIGN - 1) & ~(CMOD_ALIGN - 1);
+	}
+
+	if (size > INT_MAX)
 	{
-		Com_Error(ERR_DROP, "Mod_LoadAreaPortals: funny lump size");
+		return "too much data";
 	}
 
-	count = l->filelen / sizeof(*in);
+	cmod_memory = Z_Malloc((int)size);
+	base = (byte *)(((size_t)cmod_memory + CMOD_ALIGN - 1) & ~(size_t)(CMOD_ALIGN - 1));
 
-	if (count > MAX_MAP_AREAS)
+	for (i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++)
 	{
-		Com_Error(ERR_DROP, "Map has too many areas");
+		*arrays[i].array = base;
+		base += (arrays[i].size + CMOD_ALIGN - 1) & ~(CMOD_ALIGN - 1);
 	}
 
-	out = map_areaportals;
-	numareaportals = count;
+	map_vis = (dvis_t *)map_visibility;
 
-	memcpy(out, in, sizeof(dareaportal_t) * count);
+	return NULL;
 }
 
-void
-CMod_LoadVisibility(lump_t *l)
+/*
+ * The lumps can only be read one after the other if
+ * none of them starts inside another or the header.
+ */
+static qboolean
+CMod_CanStream(const dheader_t *header, const cmodlump_t **order)
 {
-	numvisibility = l->filelen;
+	const cmodlump_t *cl;
+	int i, j, end;
 
-	if (l->filelen > MAX_MAP_VISIBILITY)
+	/* sort by position, it's only a dozen */
+	for (i = 0; i < CMOD_NUMLUMPS; i++)
 	{
-		Com_Error(ERR_DROP, "Map has too large visibility lump");
+		cl = &cmod_lumps[i];
+
+		for (j = i; (j > 0) &&
+				(header->lumps[order[j - 1]->lump].fileofs >
+				 header->lumps[cl->lump].fileofs); j--)
+		{
+			order[j] = order[j - 1];
+		}
+
+		order[j] = cl;
 	}
 
-	memcpy(map_visibility, cmod_base + l->fileofs, l->filelen);
+	end = sizeof(dheader_t);
 
-	map_vis->numclusters = LittleLong(map_vis->numclusters);
+	for (i = 0; i < CMOD_NUMLUMPS; i++)
+	{
+		const lump_t *l = &header->lumps[order[i]->lump];
+
+		if (!l->filelen)
+		{
+			continue;
+		}
+
+		if (l->fileofs < end)
+		{
+			return false;
+		}
+
+		end = l->fileofs + l->filelen;
+	}
+
+	return true;
 }
 
-void
-CMod_LoadEntityString(lump_t *l, char *name)
+/*
+ * Feeds len bytes from f to the checksum, without keeping them.
+ */
+static void
+CMod_SkipBytes(fileHandle_t f, int len, byte *buffer, int buffersize,
+		blockchecksum_t *ctx)
 {
-	if (sv_entfile->value)
+	int n;
+
+	while (len > 0)
 	{
-		char s[MAX_QPATH];
-		char *buffer = NULL;
-		int nameLen, bufLen;
+		n = (len < buffersize) ? len : buffersize;
 
-		nameLen = strlen(name);
-		strcpy(s, name);
-		s[nameLen-3] = 'e';	s[nameLen-2] = 'n';	s[nameLen-1] = 't';
-		bufLen = FS_LoadFile(s, (void **)&buffer);
+		FS_Read(buffer, n, f);
+		Com_BlockChecksumUpdate(ctx, buffer, n);
 
-		if (buffer != NULL && bufLen > 1)
+		len -= n;
+	}
+}
+
+/*
+ * Reads the file front to back, past the header that's already
+ * read, and loads each lump as it comes by. Only the largest
+ * lump needs to fit in memory, never the whole file, and that
+ * works with compressed paks as well. The checksum is taken on
+ * the way over every byte. Returns the first error of a lump
+ * loader, with the buffer already freed.
+ */
+static const char *
+CMod_StreamLumps(fileHandle_t f, int length, const dheader_t *header,
+		const cmodlump_t **order, blockchecksum_t *ctx, unsigned *checksum)
+{
+	const char *error;
+	const lump_t *l;
+	byte *buffer;
+	int buffersize, pos, i;
+
+	buffersize = CMOD_CHUNK;
+
+	for (i = 0; i < CMOD_NUMLUMPS; i++)
+	{
+		l = &header->lumps[cmod_lumps[i].lump];
+
+		if (l->filelen > buffersize)
 		{
-			if (bufLen + 1 > sizeof(map_entitystring))
-			{
-				Com_Printf("CMod_LoadEntityString: .ent file %s too large: %i > %lu.\n", s, bufLen, (unsigned long)sizeof(map_entitystring));
-				FS_FreeFile(buffer);
-			}
-			else
-			{
-				Com_Printf ("CMod_LoadEntityString: .ent file %s loaded.\n", s);
-				numentitychars = bufLen;
-				memcpy(map_entitystring, buffer, bufLen);
-				map_entitystring[bufLen] = 0; /* jit entity bug - null terminate the entity string! */
-				FS_FreeFile(buffer);
-				return;
-			}
+			buffersize = l->filelen;
 		}
-		else if (bufLen != -1)
+	}
+
+	buffer = Z_Malloc(buffersize);
+	pos = sizeof(dheader_t);
+
+	for (i = 0; i < CMOD_NUMLUMPS; i++)
+	{
+		l = &header->lumps[order[i]->lump];
+
+		if (l->filelen)
+		{
+			CMod_SkipBytes(f, l->fileofs - pos, buffer, buffersize, ctx);
+
+			FS_Read(buffer, l->filelen, f);
+			Com_BlockChecksumUpdate(ctx, buffer, l->filelen);
+
+			pos = l->fileofs + l->filelen;
+		}
+
+		if ((error = order[i]->load(buffer, *order[i]->count)) != NULL)
 		{
-			/* If the .ent file is too small, don't load. */
-			Com_Printf("CMod_LoadEntityString: .ent file %s too small.\n", s);
-			FS_FreeFile(buffer);
+			Z_Free(buffer);
+			return error;
 		}
 	}
 
-	numentitychars = l->filelen;
+	CMod_SkipBytes(f, length - pos, buffer, buffersize, ctx);
+
+	Z_Free(buffer);
+
+	*checksum = Com_BlockChecksumEnd(ctx);
+
+	return NULL;
+}
+
+/*
+ * For files with lumps that overlap, those need
+ * to be in memory as a whole.
+ */
+static const char *
+CMod_LoadLumps(char *name, const dheader_t *header, unsigned *checksum)
+{
+	const cmodlump_t *cl;
+	const char *error;
+	byte *buf;
+	int length, i;
+
+	length = FS_LoadFile(name, (void **)&buf);
+
+	if (!buf)
+	{
+		return "vanished while loading";
+	}
+
+	*checksum = Com_BlockChecksum(buf, length);
 
-	if (l->filelen + 1 > sizeof(map_entitystring))
+	for (i = 0; i < CMOD_NUMLUMPS; i++)
 	{
-		Com_Error(ERR_DROP, "Map has too large entity lump");
+		cl = &cmod_lumps[i];
+
+		if ((error = cl->load(buf + header->lumps[cl->lump].fileofs,
+						*cl->count)) != NULL)
+		{
+			break;
+		}
 	}
 
-	memcpy(map_entitystring, cmod_base + l->fileofs, l->filelen);
-	map_entitystring[l->filelen] = 0;
+	FS_FreeFile(buf);
+
+	return error;
 }
 
 /*
@@ -1668,10 +2114,13 @@ CMod_LoadEntityString(lump_t *l, char *name)
 cmodel_t *
 CM_LoadMap(char *name, qboolean clientload, unsigned *checksum)
 {
-	unsigned *buf;
-	int i;
+	const cmodlump_t *order[CMOD_NUMLUMPS];
+	int counts[HEADER_LUMPS];
+	blockchecksum_t ctx;
+	const char *error;
+	fileHandle_t f;
 	dheader_t header;
-	int length;
+	int i, length, entlength;
 	static unsigned last_checksum;
 
 	map_noareas = Cvar_Get("map_noareas", "0", 0);
@@ -1691,35 +2140,37 @@ CM_LoadMap(char *name, qboolean clientload, unsigned *checksum)
 	}
 
 	/* free old stuff */
-	numplanes = 0;
-	numnodes = 0;
-	numleafs = 0;
-	numcmodels = 0;
-	numvisibility = 0;
-	numentitychars = 0;
-	map_entitystring[0] = 0;
-	map_name[0] = 0;
+	CMod_FreeMap();
 
 	if (!name[0])
 	{
-		numleafs = 1;
-		numclusters = 1;
-		numareas = 1;
+		/* cinematic servers won't have anything at all,
+		   but the box hull must be there */
+		CMod_AllocMap();
+		emptyleaf = 0;
+		CM_InitBoxHull();
+		CM_ResizeTraceContexts();
+
 		*checksum = 0;
-		return &map_cmodels[0]; /* cinematic servers won't have anything at all */
+		return &map_cmodels[0];
 	}
 
-	length = FS_LoadFile(name, (void **)&buf);
+	length = FS_FOpenFile(name, &f, false);
 
-	if (!buf)
+	if (length < (int)sizeof(dheader_t))
 	{
+		if (f)
+		{
+			FS_FCloseFile(f);
+		}
+
 		Com_Error(ERR_DROP, "Couldn't load %s", name);
 	}
 
-	last_checksum = LittleLong(Com_BlockChecksum(buf, length));
-	*checksum = last_checksum;
+	FS_Read(&header, sizeof(header), f);
 
-	header = *(dheader_t *)buf;
+	Com_BlockChecksumBegin(&ctx);
+	Com_BlockChecksumUpdate(&ctx, &header, sizeof(header));
 
 	for (i = 0; i < sizeof(dheader_t) / 4; i++)
 	{
@@ -1728,31 +2179,72 @@ CM_LoadMap(char *name, qboolean clientload, unsigned *checksum)
 
 	if (header.version != BSPVERSION)
 	{
+		FS_FCloseFile(f);
 		Com_Error(ERR_DROP,
 				"CMod_LoadBrushModel: %s has wrong version number (%i should be %i)",
 				name, header.version, BSPVERSION);
 	}
 
-	cmod_base = (byte *)buf;
+	cmod_qbsp = (header.ident == QBSPHEADER);
+
+	if ((error = CMod_CountLumps(&header, length, counts)) != NULL)
+	{
+		FS_FCloseFile(f);
+		Com_Error(ERR_DROP, "Map %s has %s", name, error);
+	}
+
+	entlength = CMod_LoadEntityFile(name);
 
 	/* load into heap */
-	CMod_LoadSurfaces(&header.lumps[LUMP_TEXINFO]);
-	CMod_LoadLeafs(&header.lumps[LUMP_LEAFS]);
-	CMod_LoadLeafBrushes(&header.lumps[LUMP_LEAFBRUSHES]);
-	CMod_LoadPlanes(&header.lumps[LUMP_PLANES]);
-	CMod_LoadBrushes(&header.lumps[LUMP_BRUSHES]);
-	CMod_LoadBrushSides(&header.lumps[LUMP_BRUSHSIDES]);
-	CMod_LoadSubmodels(&header.lumps[LUMP_MODELS]);
-	CMod_LoadNodes(&header.lumps[LUMP_NODES]);
-	CMod_LoadAreas(&header.lumps[LUMP_AREAS]);
-	CMod_LoadAreaPortals(&header.lumps[LUMP_AREAPORTALS]);
-	CMod_LoadVisibility(&header.lumps[LUMP_VISIBILITY]);
-	/* From kmquake2: adding an extra parameter for .ent support. */
-	CMod_LoadEntityString(&header.lumps[LUMP_ENTITIES], name);
+	for (i = 0; i < CMOD_NUMLUMPS; i++)
+	{
+		*cmod_lumps[i].count = counts[cmod_lumps[i].lump];
+	}
 
-	FS_FreeFile(buf);
+	if (cmod_entfile)
+	{
+		numentitychars = entlength;
+	}
+
+	/* nothing may jump out from here on until the file,
+	   the .ent file and the loaders buffers are let go */
+	if ((error = CMod_AllocMap()) == NULL)
+	{
+		if (CMod_CanStream(&header, order))
+		{
+			error = CMod_StreamLumps(f, length, &header, order, &ctx,
+					&last_checksum);
+			FS_FCloseFile(f);
+		}
+		else
+		{
+			FS_FCloseFile(f);
+			error = CMod_LoadLumps(name, &header, &last_checksum);
+		}
+	}
+	else
+	{
+		FS_FCloseFile(f);
+	}
+
+	if (cmod_entfile)
+	{
+		FS_FreeFile(cmod_entfile);
+		cmod_entfile = NULL;
+	}
+
+	if (error)
+	{
+		/* half loaded, leave an empty map behind */
+		CMod_FreeMap();
+		Com_Error(ERR_DROP, "Map %s has %s", name, error);
+	}
+
+	last_checksum = LittleLong(last_checksum);
+	*checksum = last_checksum;
 
 	CM_InitBoxHull();
+	CM_ResizeTraceContexts();
 
 	memset(portalopen, 0, sizeof(portalopen));
 	FloodAreaConnections();
@@ -1800,6 +2292,15 @@ CM_EntityString(void)
 	return map_entitystring;
 }
 
+/*
+ * Name of the loaded map, empty if there's none.
+ */
+const char *
+CM_MapName(void)
+{
+	return map_name;
+}
+
 int
 CM_LeafContents(int leafnum)
 {
@@ -1838,10 +2339,12 @@ CM_DecompressVis(byte *in, byte *out)
 {
 	int c;
 	byte *out_p;
+	const byte *end;
 	int row;
 
 	row = (numclusters + 7) >> 3;
 	out_p = out;
+	end = map_visibility + numvisibility;
 
 	if (!in || !numvisibility)
 	{
@@ -1857,13 +2360,20 @@ CM_DecompressVis(byte *in, byte *out)
 
 	do
 	{
+		if (in >= end)
+		{
+			/* truncated row, the rest is visible */
+			memset(out_p, 0xff, row - (out_p - out));
+			return;
+		}
+
 		if (*in)
 		{
 			*out_p++ = *in++;
 			continue;
 		}
 
-		c = in[1];
+		c = (in + 1 < end) ? in[1] : 0;
 		in += 2;
 
 		if ((out_p - out) + c > row)
@@ -1888,6 +2398,11 @@ CM_ClusterPVS(int cluster)
 	{
 		memset(pvsrow, 0, (numclusters + 7) >> 3);
 	}
+	else if (!numvisibility || (cluster >= map_vis->numclusters))
+	{
+		/* the lump is only as large as the map needs */
+		CM_DecompressVis(NULL, pvsrow);
+	}
 	else
 	{
 		CM_DecompressVis(map_visibility +
@@ -1904,7 +2419,10 @@ CM_ClusterPHS(int cluster)
 	{
 		memset(phsrow, 0, (numclusters + 7) >> 3);
 	}
-
+	else if (!numvisibility || (cluster >= map_vis->numclusters))
+	{
+		CM_DecompressVis(NULL, phsrow);
+	}
 	else
 	{
 		CM_DecompressVis(map_visibility +
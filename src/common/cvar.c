@@ -26,7 +26,11 @@
 
 #include "header/common.h"
 
-cvar_t *cvar_vars;
+#define CVAR_HASH_SIZE 1024 /* must be a power of two */
+#define REPLACEMENT_HASH_SIZE 128 /* must be a power of two */
+
+cvar_t *cvar_vars; /* sorted by name, for cvarlist and such */
+static cvar_t *cvar_hash[CVAR_HASH_SIZE];
 
 
 typedef struct
@@ -94,6 +98,62 @@ replacement_t replacements[] = {
 	{"intensity", "gl1_intensity"}
 };
 
+#define NUM_REPLACEMENTS (sizeof(replacements) / sizeof(replacement_t))
+
+/* replacements index + 1 of the chain head, 0 if empty */
+static int replacement_hash[REPLACEMENT_HASH_SIZE];
+static int replacement_hashnext[NUM_REPLACEMENTS];
+static qboolean replacements_hashed;
+
+static unsigned
+Cvar_HashName(const char *name)
+{
+	unsigned hash = 0;
+
+	while (*name)
+	{
+		hash = hash * 31 + (unsigned char)*name++;
+	}
+
+	return hash;
+}
+
+/*
+ * Returns the new name of a replaced cvar,
+ * or NULL if var_name wasn't replaced.
+ */
+static const char *
+Cvar_ReplacedName(const char *var_name)
+{
+	unsigned hash;
+	int i;
+
+	if (!replacements_hashed)
+	{
+		/* insert backwards, so each chain is in table order */
+		for (i = NUM_REPLACEMENTS - 1; i >= 0; i--)
+		{
+			hash = Cvar_HashName(replacements[i].old) & (REPLACEMENT_HASH_SIZE - 1);
+			replacement_hashnext[i] = replacement_hash[hash];
+			replacement_hash[hash] = i + 1;
+		}
+
+		replacements_hashed = true;
+	}
+
+	hash = Cvar_HashName(var_name) & (REPLACEMENT_HASH_SIZE - 1);
+
+	for (i = replacement_hash[hash]; i; i = replacement_hashnext[i - 1])
+	{
+		if (!strcmp(var_name, replacements[i - 1].old))
+		{
+			return replacements[i - 1].new;
+		}
+	}
+
+	return NULL;
+}
+
 
 static qboolean
 Cvar_InfoValidate(const char *s)
@@ -120,20 +180,18 @@ static cvar_t *
 Cvar_FindVar(const char *var_name)
 {
 	cvar_t *var;
-	int i;
+	const char *new;
 
 	/* An ugly hack to rewrite changed CVARs */
-	for (i = 0; i < sizeof(replacements) / sizeof(replacement_t); i++)
+	if ((new = Cvar_ReplacedName(var_name)) != NULL)
 	{
-		if (!strcmp(var_name, replacements[i].old))
-		{
-			Com_Printf("cvar %s is deprecated, use %s instead\n", replacements[i].old, replacements[i].new);
+		Com_Printf("cvar %s is deprecated, use %s instead\n", var_name, new);
 
-			var_name = replacements[i].new;
-		}
+		var_name = new;
 	}
 
-	for (var = cvar_vars; var; var = var->next)
+	for (var = cvar_hash[Cvar_HashName(var_name) & (CVAR_HASH_SIZE - 1)];
+		var; var = var->hash_next)
 	{
 		if (!strcmp(var_name, var->name))
 		{
@@ -216,6 +274,7 @@ Cvar_Get(const char *var_name, char *var_value, int flags)
 {
 	cvar_t *var;
 	cvar_t **pos;
+	unsigned hash;
 
 	if (flags & (CVAR_USERINFO | CVAR_SERVERINFO))
 	{
@@ -284,6 +343,10 @@ Cvar_Get(const char *var_name, char *var_value, int flags)
 	var->next = *pos;
 	*pos = var;
 
+	hash = Cvar_HashName(var->name) & (CVAR_HASH_SIZE - 1);
+	var->hash_next = cvar_hash[hash];
+	cvar_hash[hash] = var;
+
 	var->flags = flags;
 
 	return var;
@@ -528,7 +591,8 @@ void
 Cvar_Set_f(void)
 {
 	char *firstarg;
-	int c, i;
+	const char *new;
+	int c;
 
 	c = Cmd_Argc();
 
@@ -541,12 +605,9 @@ Cvar_Set_f(void)
 	firstarg = Cmd_Argv(1);
 
 	/* An ugly hack to rewrite changed CVARs */
-	for (i = 0; i < sizeof(replacements) / sizeof(replacement_t); i++)
+	if ((new = Cvar_ReplacedName(firstarg)) != NULL)
 	{
-		if (!strcmp(firstarg, replacements[i].old))
-		{
-			firstarg = replacements[i].new;
-		}
+		firstarg = (char *)new;
 	}
 
 	if (c == 4)
@@ -867,6 +928,50 @@ Cvar_Init(void)
 	Cmd_AddCommand("toggle", Cvar_Toggle_f);
 }
 
+/*
+ * Removes a cvar. Only for cvars nobody holds a
+ * pointer to, like the ones created by execbench.
+ */
+void
+Cvar_Remove(const char *var_name)
+{
+	cvar_t *var, **link;
+
+	for (link = &cvar_hash[Cvar_HashName(var_name) & (CVAR_HASH_SIZE - 1)];
+		*link; link = &(*link)->hash_next)
+	{
+		if (!strcmp(var_name, (*link)->name))
+		{
+			break;
+		}
+	}
+
+	if (!*link)
+	{
+		return;
+	}
+
+	var = *link;
+	*link = var->hash_next;
+
+	for (link = &cvar_vars; *link != var; link = &(*link)->next)
+	{
+	}
+
+	*link = var->next;
+
+	Z_Free(var->string);
+	Z_Free(var->name);
+	Z_Free(var->default_string);
+
+	if (var->latched_string)
+	{
+		Z_Free(var->latched_string);
+	}
+
+	Z_Free(var);
+}
+
 /*
  * Free list of cvars
  */
@@ -885,6 +990,9 @@ Cvar_Fini(void)
         var = c;
 	}
 
+	cvar_vars = NULL;
+	memset(cvar_hash, 0, sizeof(cvar_hash));
+
 	Cmd_RemoveCommand("cvarlist");
 	Cmd_RemoveCommand("dec");
 	Cmd_RemoveCommand("inc");
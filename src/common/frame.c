@@ -386,6 +386,7 @@ Qcommon_Init(int argc, char **argv)
 
 	// Start late subsystem.
 	Sys_Init();
+	Com_InitJobs();
 	NET_Init();
 	Netchan_Init();
 	SV_Init();
@@ -814,6 +815,7 @@ Qcommon_Frame(int usec)
 void
 Qcommon_Shutdown(void)
 {
+	Com_ShutdownJobs();
 	FS_ShutdownFilesystem();
 	Cvar_Fini();
 
@@ -496,6 +496,10 @@ void Cvar_WriteVariables(const char *path);
 /* appends lines containing "set variable value" for all variables */
 /* with the archive flag set to true. */
 
+void Cvar_Remove(const char *var_name);
+
+/* frees the variable, nothing may hold a pointer to it */
+
 void Cvar_Init(void);
 
 void Cvar_Fini(void);
@@ -621,6 +625,7 @@ cmodel_t *CM_InlineModel(char *name);       /* *1, *2, etc */
 int CM_NumClusters(void);
 int CM_NumInlineModels(void);
 char *CM_EntityString(void);
+const char *CM_MapName(void);
 
 /* creates a clipping hull for an arbitrary box */
 int CM_HeadnodeForBox(vec3_t mins, vec3_t maxs);
@@ -636,6 +641,20 @@ trace_t CM_TransformedBoxTrace(vec3_t start, vec3_t end,
 		vec3_t mins, vec3_t maxs, int headnode,
 		int brushmask, vec3_t origin, vec3_t angles);
 
+/* the same for several threads, each with its own context. Only
+   while nobody loads a map or calls CM_HeadnodeForBox(), and
+   start must differ from end. */
+typedef struct cmtrace_s cmtrace_t;
+
+cmtrace_t *CM_CreateTraceContext(void);
+void CM_FreeTraceContext(cmtrace_t *tc);
+void CM_AddTraceStats(cmtrace_t *tc);
+trace_t CM_BoxTraceContext(cmtrace_t *tc, vec3_t start, vec3_t end,
+		vec3_t mins, vec3_t maxs, int headnode, int brushmask);
+trace_t CM_TransformedBoxTraceContext(cmtrace_t *tc, vec3_t start,
+		vec3_t end, vec3_t mins, vec3_t maxs, int headnode,
+		int brushmask, vec3_t origin, vec3_t angles);
+
 byte *CM_ClusterPVS(int cluster);
 byte *CM_ClusterPHS(int cluster);
 
@@ -769,6 +788,19 @@ int Com_ServerState(void);              /* this should have just been a cvar...
 void Com_SetServerState(int state);
 
 unsigned Com_BlockChecksum(void *buffer, int length);
+
+/* the same checksum over data that comes in pieces */
+typedef struct
+{
+	unsigned state[4];
+	byte block[64];
+	int blocklen;
+	unsigned length;
+} blockchecksum_t;
+
+void Com_BlockChecksumBegin(blockchecksum_t *ctx);
+void Com_BlockChecksumUpdate(blockchecksum_t *ctx, const void *buffer, int length);
+unsigned Com_BlockChecksumEnd(blockchecksum_t *ctx);
 byte COM_BlockSequenceCRCByte(byte *base, int length, int sequence);
 
 extern cvar_t *developer;
@@ -807,6 +839,17 @@ void *Z_Malloc(int size);           /* returns 0 filled memory */
 void *Z_TagMalloc(int size, int tag);
 void Z_FreeTags(int tag);
 
+/* JOBS - worker threads, see jobs.c */
+
+#define MAX_JOB_THREADS 8
+
+typedef void (*jobfunc_t)(void *job, int thread);
+
+void Com_InitJobs(void);
+void Com_ShutdownJobs(void);
+int Com_NumJobThreads(void);
+void Com_RunJobs(jobfunc_t func, void *jobs, int numjobs, size_t jobsize);
+
 void Qcommon_Init(int argc, char **argv);
 void Qcommon_ExecConfigs(qboolean addEarlyCmds);
 const char* Qcommon_GetInitialGame(void);
@@ -822,6 +865,7 @@ void SCR_DebugGraph(float value, int color);
 
 void CL_Init(void);
 void CL_Drop(void);
+qboolean CL_Disconnected(void);
 void CL_Shutdown(void);
 void CL_Frame(int packetdelta, int renderdelta, int timedelta, qboolean packetframe, qboolean renderframe);
 void Con_Print(char *text);
@@ -855,6 +899,13 @@ void Sys_UnloadGame(void);
 void Sys_GetWorkDir(char *buffer, size_t len);
 qboolean Sys_SetWorkDir(char *path);
 qboolean Sys_Realpath(const char *in, char *out, size_t size);
+void *Sys_CreateThread(int (*func)(void *data), void *data);
+void Sys_WaitThread(void *thread);
+void *Sys_CreateSemaphore(void);
+void Sys_DestroySemaphore(void *sem);
+void Sys_SemaphoreWait(void *sem);
+void Sys_SemaphorePost(void *sem);
+int Sys_GetNumCores(void);
 
 // Windows only (system.c)
 #ifdef _WIN32
@@ -232,10 +232,13 @@ typedef struct m32tex_s
 /* .BSP file format */
 
 #define IDBSPHEADER (('P' << 24) + ('S' << 16) + ('B' << 8) + 'I') /* little-endian "IBSP" */
+#define QBSPHEADER (('P' << 24) + ('S' << 16) + ('B' << 8) + 'Q') /* little-endian "QBSP" */
 #define BSPVERSION 38
 
 /* upper design bounds: leaffaces, leafbrushes, planes, and 
- * verts are still bounded by 16 bit short limits */
+ * verts are still bounded by 16 bit short limits. QBSP maps
+ * lift these, the engine sizes everything from the lumps and
+ * only areas, areaportals, models and clusters stay limited */
 #define MAX_MAP_MODELS 1024
 #define MAX_MAP_BRUSHES 8192
 #define MAX_MAP_ENTITIES 2048
@@ -450,6 +453,61 @@ typedef struct
 	int contents;
 } dbrush_t;
 
+/* QBSP (QBISM) maps have the same lumps, but 32 bit
+ * indices and float bounds in these. The rest is the
+ * same as in IBSP. leaffaces and leafbrushes are
+ * unsigned int instead of unsigned short. */
+typedef struct
+{
+	int planenum;
+	int children[2];
+	float mins[3];
+	float maxs[3];
+	unsigned int firstface;
+	unsigned int numfaces;
+} dqnode_t;
+
+typedef struct
+{
+	unsigned int v[2];
+} dqedge_t;
+
+typedef struct
+{
+	unsigned int planenum;
+	int side;
+
+	int firstedge;
+	int numedges;
+	int texinfo;
+
+	byte styles[MAXLIGHTMAPS];
+	int lightofs;
+} dqface_t;
+
+typedef struct
+{
+	int contents;
+
+	int cluster;
+	int area;
+
+	float mins[3];
+	float maxs[3];
+
+	unsigned int firstleafface;
+	unsigned int numleaffaces;
+
+	unsigned int firstleafbrush;
+	unsigned int numleafbrushes;
+} dqleaf_t;
+
+typedef struct
+{
+	unsigned int planenum;
+	int texinfo;
+} dqbrushside_t;
+
 #define ANGLE_UP -1
 #define ANGLE_DOWN -2
 
@@ -479,5 +537,38 @@ typedef struct
 	int firstareaportal;
 } darea_t;
 
+/* .DM2 demos are a sequence of messages, each prefixed
+ * by its length, and end with a length of -1. Demos
+ * recorded with cl_demoindex have an index behind that,
+ * old readers stop before it. The index points to
+ * keyframes, messages that bring the client into the
+ * state it had at a given time of the demo. */
+
+#define IDDEMOHEADER (('X' << 24) + ('D' << 16) + ('M' << 8) + 'D') /* little-endian "DMDX" */
+#define DEMOINDEX_VERSION 1
+
+typedef struct
+{
+	int time;   /* milliseconds since the first frame */
+	int offset; /* of the first message after the keyframe */
+	int keyofs; /* keyframe messages */
+	int keylen;
+} ddemokey_t;
+
+typedef struct
+{
+	int ident;
+	int version;
+	int resetofs; /* configstrings that changed during the demo, */
+	int resetlen; /* set back to their initial values */
+	int numkeys;
+} ddemoindex_t; /* followed by numkeys ddemokey_t */
+
+typedef struct
+{
+	int indexofs;
+	int ident; /* == IDDEMOHEADER */
+} ddemotrailer_t; /* the last bytes of the file */
+
 #endif
 
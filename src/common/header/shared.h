@@ -440,6 +440,7 @@ typedef struct cvar_s
 
 	/* Added by YQ2. Must be at the end to preserve ABI. */
 	char *default_string;
+	struct cvar_s *hash_next; /* next cvar in the same hash bucket */
 } cvar_t;
 
 #endif /* CVAR */
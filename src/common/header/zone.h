@@ -27,6 +27,11 @@
 #ifndef CO_ZONE_H
 #define CO_ZONE_H
 
+/* The game has a copy of this in g_misc.c
+   (func_clock_format_countdown), so the layout
+   and size must not change. Blocks cut from an
+   arena chunk have next NULL and their chunk in
+   prev. */
 typedef struct zhead_s
 {
 	struct zhead_s	*prev, *next;
@@ -35,6 +40,26 @@ typedef struct zhead_s
 	int		size;
 } zhead_t;
 
+/* Blocks with a tag other than 0 are cut from
+   chunks that belong to the arena of their tag. */
+typedef struct zchunk_s
+{
+	struct zchunk_s	*prev, *next;
+	int		size; /* bytes after the chunk header */
+	int		used; /* bump pointer */
+	int		live; /* blocks that weren't freed yet */
+	int		pad;
+} zchunk_t;
+
+typedef struct
+{
+	short	tag;
+	zchunk_t	chunks; /* the first one is allocated from */
+	zhead_t	blocks; /* blocks too big for a chunk */
+	int		numchunks;
+	int		count, bytes;
+} zarena_t;
+
 void Z_Stats_f (void);
 
 #endif
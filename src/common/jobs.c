@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * =======================================================================
+ *
+ * A small pool of worker threads, shared by everything that has work
+ * to split up: the servers line of sight traces, the clients sound
+ * decoding during registration and the software renderers particles.
+ * The main thread hands it an array of jobs and waits until all of
+ * them are done, working on the array itself in the meantime. It's
+ * built on the Sys_ thread functions and not on SDL, so that the
+ * dedicated server has it, too.
+ *
+ * Images aren't decoded here yet. The renderers look them up one at
+ * a time while they register models and walls, each needs its size
+ * right away, so they'd first have to be collected into batches like
+ * the sounds in S_EndRegistration().
+ *
+ * Jobs get the number of the thread they run on, 0 is the main
+ * thread, so they can pick per thread state like their own collision
+ * trace context. Jobs must not touch the filesystem, the zone
+ * allocator, cvars or print anything, none of that is thread safe.
+ *
+ * =======================================================================
+ */
+
+#include "header/common.h"
+
+static cvar_t *sys_threads;
+
+static void *job_threads[MAX_JOB_THREADS];
+static int num_job_threads; /* not counting the main thread */
+static void *job_start[MAX_JOB_THREADS], *job_done;
+static qboolean job_quit;
+
+/* the batch that's being worked on */
+static jobfunc_t job_func;
+static byte *job_array;
+static int job_count;
+static size_t job_size;
+static int job_stride; /* threads working on it */
+
+/*
+ * Thread t does the jobs t, t + job_stride, t + 2 * job_stride
+ * and so on. No atomics needed that way, and with more jobs than
+ * threads that's balanced well enough. Each thread has its own
+ * start semaphore, so exactly the first job_stride ones run.
+ */
+static void
+Com_DoJobs(int thread)
+{
+	int i;
+
+	for (i = thread; i < job_count; i += job_stride)
+	{
+		job_func(job_array + i * job_size, thread);
+	}
+}
+
+static int
+Com_JobThread(void *data)
+{
+	int thread = (int)(size_t)data;
+
+	for (;;)
+	{
+		Sys_SemaphoreWait(job_start[thread - 1]);
+
+		if (job_quit)
+		{
+			break;
+		}
+
+		Com_DoJobs(thread);
+
+		Sys_SemaphorePost(job_done);
+	}
+
+	return 0;
+}
+
+static void
+Com_StopJobThreads(void)
+{
+	int i;
+
+	job_quit = true;
+
+	for (i = 0; i < num_job_threads; i++)
+	{
+		Sys_SemaphorePost(job_start[i]);
+		Sys_WaitThread(job_threads[i]);
+		job_threads[i] = NULL;
+	}
+
+	for (i = 0; i < MAX_JOB_THREADS; i++)
+	{
+		if (job_start[i])
+		{
+			Sys_DestroySemaphore(job_start[i]);
+			job_start[i] = NULL;
+		}
+	}
+
+	if (job_done)
+	{
+		Sys_DestroySemaphore(job_done);
+		job_done = NULL;
+	}
+
+	num_job_threads = 0;
+	job_quit = false;
+}
+
+/*
+ * sys_threads 0 picks one thread per core,
+ * 1 runs everything on the main thread.
+ */
+static void
+Com_StartJobThreads(void)
+{
+	int count, i;
+
+	Com_StopJobThreads();
+
+	count = (int)sys_threads->value;
+
+	if (count <= 0)
+	{
+		count = Sys_GetNumCores();
+	}
+
+	/* the main thread works as well */
+	count--;
+
+	if (count > MAX_JOB_THREADS)
+	{
+		count = MAX_JOB_THREADS;
+	}
+
+	if (count <= 0)
+	{
+		return;
+	}
+
+	if ((job_done = Sys_CreateSemaphore()) == NULL)
+	{
+		Com_Printf("%s: Couldn't create semaphore\n", __func__);
+		return;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if ((job_start[i] = Sys_CreateSemaphore()) == NULL)
+		{
+			Com_Printf("%s: Couldn't create semaphore\n", __func__);
+			break;
+		}
+
+		/* thread 0 is the main thread */
+		job_threads[i] = Sys_CreateThread(Com_JobThread, (void *)(size_t)(i + 1));
+
+		if (!job_threads[i])
+		{
+			Com_Printf("%s: Couldn't create thread\n", __func__);
+			break;
+		}
+
+		num_job_threads++;
+	}
+}
+
+/*
+ * Number of threads Com_RunJobs() uses, including the main
+ * thread. Jobs get thread numbers below that.
+ */
+int
+Com_NumJobThreads(void)
+{
+	if (sys_threads->modified)
+	{
+		sys_threads->modified = false;
+		Com_StartJobThreads();
+	}
+
+	return num_job_threads + 1;
+}
+
+/*
+ * Calls func for each of the numjobs jobs of jobsize
+ * bytes in jobs and returns when all are finished.
+ */
+void
+Com_RunJobs(jobfunc_t func, void *jobs, int numjobs, size_t jobsize)
+{
+	int i;
+
+	if (numjobs <= 0)
+	{
+		return;
+	}
+
+	/* starts the threads if sys_threads changed */
+	Com_NumJobThreads();
+
+	job_func = func;
+	job_array = jobs;
+	job_count = numjobs;
+	job_size = jobsize;
+
+	/* no need to wake up threads that won't get a job */
+	job_stride = (numjobs - 1 < num_job_threads) ? numjobs : num_job_threads + 1;
+
+	for (i = 0; i < job_stride - 1; i++)
+	{
+		Sys_SemaphorePost(job_start[i]);
+	}
+
+	Com_DoJobs(0);
+
+	for ( ; i > 0; i--)
+	{
+		Sys_SemaphoreWait(job_done);
+	}
+}
+
+void
+Com_InitJobs(void)
+{
+	/* the threads are started by the first batch */
+	sys_threads = Cvar_Get("sys_threads", "0", CVAR_ARCHIVE);
+	sys_threads->modified = true;
+}
+
+void
+Com_ShutdownJobs(void)
+{
+	Com_StopJobThreads();
+}
@@ -7,6 +7,9 @@
  */
 
 #include <inttypes.h>
+#include <string.h>
+
+#include "header/common.h"
 
 #define ROTATELEFT32(x, s) (((x) << (s)) | ((x) >> (32 - (s))))
 
@@ -30,19 +33,25 @@
 		a = ROTATELEFT32(a, s);	\
 	}
 
-static uint32_t X[16];
-static uint32_t A, AA;
-static uint32_t B, BB;
-static uint32_t C, CC;
-static uint32_t D, DD;
-
 static void
-DoMD4()
+DoMD4(uint32_t *state, const unsigned char *ptr)
 {
-	AA = A;
-	BB = B;
-	CC = C;
-	DD = D;
+	uint32_t X[16];
+	uint32_t A, B, C, D;
+	int j;
+
+	for (j = 0; j < 16; j++)
+	{
+		X[j] = ((ptr[0] << 0) | (ptr[1] << 8) |
+				(ptr[2] << 16) | ((uint32_t)ptr[3] << 24));
+
+		ptr += 4;
+	}
+
+	A = state[0];
+	B = state[1];
+	C = state[2];
+	D = state[3];
 
 	S(A, B, C, D, 0, 3);
 	S(D, A, B, C, 1, 7);
@@ -95,130 +104,114 @@ DoMD4()
 	U(C, D, A, B, 7, 11);
 	U(B, C, D, A, 15, 15);
 
-	A += AA;
-	B += BB;
-	C += CC;
-	D += DD;
+	state[0] += A;
+	state[1] += B;
+	state[2] += C;
+	state[3] += D;
 }
 
-static void
-PerformMD4(const unsigned char *buf, int length, unsigned char *digest)
+void
+Com_BlockChecksumBegin(blockchecksum_t *ctx)
 {
-	int len = length / 64; /* number of full blocks */
-	int rem = length % 64; /* number of left over bytes */
+	/* initialize the MD buffer */
+	ctx->state[0] = 0x67452301;
+	ctx->state[1] = 0xEFCDAB89;
+	ctx->state[2] = 0x98BADCFE;
+	ctx->state[3] = 0x10325476;
 
-	int i, j;
-	const unsigned char *ptr = buf;
+	ctx->blocklen = 0;
+	ctx->length = 0;
+}
 
-	/* initialize the MD buffer */
-	A = 0x67452301;
-	B = 0xEFCDAB89;
-	C = 0x98BADCFE;
-	D = 0x10325476;
+/*
+ * Adds the next length bytes, so files can be
+ * checksummed while they are read in pieces.
+ */
+void
+Com_BlockChecksumUpdate(blockchecksum_t *ctx, const void *buffer, int length)
+{
+	const unsigned char *ptr = buffer;
+	int n;
+
+	ctx->length += length;
 
-	for (i = 0; i < len; i++)
+	/* fill up what's left over from the last call */
+	if (ctx->blocklen)
 	{
-		for (j = 0; j < 16; j++)
-		{
-			X[j] = ((ptr[0] << 0) | (ptr[1] << 8) |
-					(ptr[2] << 16) | (ptr[3] << 24));
+		n = 64 - ctx->blocklen;
 
-			ptr += 4;
+		if (n > length)
+		{
+			n = length;
 		}
 
-		DoMD4();
-	}
+		memcpy(ctx->block + ctx->blocklen, ptr, n);
+		ctx->blocklen += n;
+		ptr += n;
+		length -= n;
 
-	i = rem / 4;
-
-	for (j = 0; j < i; j++)
-	{
-		X[j] = ((ptr[0] << 0) | (ptr[1] << 8) |
-				(ptr[2] << 16) | (ptr[3] << 24));
+		if (ctx->blocklen < 64)
+		{
+			return;
+		}
 
-		ptr += 4;
+		DoMD4(ctx->state, ctx->block);
+		ctx->blocklen = 0;
 	}
 
-	switch (rem % 4)
+	/* full blocks straight from the buffer */
+	for ( ; length >= 64; length -= 64, ptr += 64)
 	{
-		case 0:
-			X[j] = 0x80U;
-			break;
-		case 1:
-			X[j] = ((ptr[0] << 0) | ((0x80U) << 8));
-			break;
-		case 2:
-			X[j] = ((ptr[0] << 0) | (ptr[1] << 8) | ((0x80U) << 16));
-			break;
-		case 3:
-			X[j] =
-				((ptr[0] <<
-				  0) | (ptr[1] << 8) | (ptr[2] << 16) | ((0x80U) << 24));
-			break;
+		DoMD4(ctx->state, ptr);
 	}
 
-	j++;
-
-	if (j > 14)
-	{
-		for ( ; j < 16; j++)
-		{
-			X[j] = 0;
-		}
+	memcpy(ctx->block, ptr, length);
+	ctx->blocklen = length;
+}
 
-		DoMD4();
+unsigned
+Com_BlockChecksumEnd(blockchecksum_t *ctx)
+{
+	unsigned char *block = ctx->block;
+	uint32_t bits[2];
+	int i;
 
-		j = 0;
-	}
+	/* pad with 0x80 and zeros to 56 bytes, that may take another block */
+	block[ctx->blocklen++] = 0x80;
 
-	for ( ; j < 14; j++)
+	if (ctx->blocklen > 56)
 	{
-		X[j] = 0;
+		memset(block + ctx->blocklen, 0, 64 - ctx->blocklen);
+		DoMD4(ctx->state, block);
+		ctx->blocklen = 0;
 	}
 
-	X[14] = (length & 0x1FFFFFFF) << 3;
-	X[15] = (length & ~0x1FFFFFFF) >> 29;
-
-	DoMD4();
-
-	digest[0] = (A & 0x000000FF) >> 0;
-	digest[1] = (A & 0x0000FF00) >> 8;
-	digest[2] = (A & 0x00FF0000) >> 16;
-	digest[3] = (A & 0xFF000000) >> 24;
-	digest[4] = (B & 0x000000FF) >> 0;
-	digest[5] = (B & 0x0000FF00) >> 8;
-	digest[6] = (B & 0x00FF0000) >> 16;
-	digest[7] = (B & 0xFF000000) >> 24;
-	digest[8] = (C & 0x000000FF) >> 0;
-	digest[9] = (C & 0x0000FF00) >> 8;
-	digest[10] = (C & 0x00FF0000) >> 16;
-	digest[11] = (C & 0xFF000000) >> 24;
-	digest[12] = (D & 0x000000FF) >> 0;
-	digest[13] = (D & 0x0000FF00) >> 8;
-	digest[14] = (D & 0x00FF0000) >> 16;
-	digest[15] = (D & 0xFF000000) >> 24;
-
-	A = AA = 0;
-	B = BB = 0;
-	C = CC = 0;
-	D = DD = 0;
+	memset(block + ctx->blocklen, 0, 56 - ctx->blocklen);
 
-	for (j = 0; j < 16; j++)
+	/* length in bits */
+	bits[0] = (ctx->length & 0x1FFFFFFF) << 3;
+	bits[1] = (ctx->length & ~0x1FFFFFFF) >> 29;
+
+	for (i = 0; i < 2; i++)
 	{
-		X[j] = 0;
+		block[56 + i * 4 + 0] = (bits[i] >> 0) & 0xFF;
+		block[56 + i * 4 + 1] = (bits[i] >> 8) & 0xFF;
+		block[56 + i * 4 + 2] = (bits[i] >> 16) & 0xFF;
+		block[56 + i * 4 + 3] = (bits[i] >> 24) & 0xFF;
 	}
+
+	DoMD4(ctx->state, block);
+
+	return ctx->state[0] ^ ctx->state[1] ^ ctx->state[2] ^ ctx->state[3];
 }
 
 unsigned
 Com_BlockChecksum(void *buffer, int length)
 {
-	uint32_t digest[4];
-	unsigned val;
+	blockchecksum_t ctx;
 
-	PerformMD4((unsigned char *)buffer, length, (unsigned char *)digest);
+	Com_BlockChecksumBegin(&ctx);
+	Com_BlockChecksumUpdate(&ctx, buffer, length);
 
-	val = digest[0] ^ digest[1] ^ digest[2] ^ digest[3];
-
-	return val;
+	return Com_BlockChecksumEnd(&ctx);
 }
-
@@ -19,7 +19,12 @@
  *
  * =======================================================================
  *
- * Zone malloc. It's just a normal malloc with tags.
+ * Zone malloc. Blocks with tag 0 are just a normal malloc. Blocks
+ * with any other tag are cut from 64 KB chunks that belong to that
+ * tag, so Z_FreeTags() only has to free the chunks. Z_Free() works
+ * on those blocks as well, a chunk is freed once all of its blocks
+ * are. Once there are more tags than arenas, blocks of the rest
+ * go into the chain of tag 0 blocks, like all of them did before.
  *
  * =======================================================================
  */
@@ -28,13 +33,126 @@
 #include "header/zone.h"
 
 #define Z_MAGIC 0x1d1d
+#define Z_MAGIC_FREED 0x1d1e /* arena blocks after Z_Free() */
 
-zhead_t z_chain;
+#define Z_MAX_ARENAS 32
+#define Z_CHUNK_SIZE (64 * 1024)
+#define Z_MAX_CHUNK_BLOCK (Z_CHUNK_SIZE / 8) /* bigger ones get their own malloc() */
+#define Z_ALIGN 8
+#define Z_MAX_SPARE_CHUNKS 64 /* kept for the next level instead of free()d */
+
+zhead_t z_chain; /* blocks with tag 0 and tags without an arena */
 int z_count, z_bytes;
 
+static zarena_t z_arenas[Z_MAX_ARENAS];
+static int z_numarenas;
+
+/* unused chunks, linked through next */
+static zchunk_t *z_sparechunks;
+static int z_numsparechunks;
+
+/*
+ * The chunk a block was cut from, NULL
+ * if it was malloc()ed on its own.
+ */
+static zchunk_t *
+Z_BlockChunk(const zhead_t *z)
+{
+	return z->next ? NULL : (zchunk_t *)z->prev;
+}
+
+static void
+Z_Unlink(zhead_t *z)
+{
+	z->prev->next = z->next;
+	z->next->prev = z->prev;
+}
+
+static void
+Z_Link(zhead_t *list, zhead_t *z)
+{
+	z->next = list->next;
+	z->prev = list;
+	list->next->prev = z;
+	list->next = z;
+}
+
+/*
+ * Returns the arena of tag, creating it if create
+ * is set and it's missing. NULL if there's none
+ * and no room for another one. The tag's blocks
+ * go into z_chain then.
+ */
+static zarena_t *
+Z_FindArena(int tag, qboolean create)
+{
+	static zarena_t *last;
+	zarena_t *arena;
+	int i;
+
+	if (last && (last->tag == (short)tag))
+	{
+		return last;
+	}
+
+	for (i = 0; i < z_numarenas; i++)
+	{
+		if (z_arenas[i].tag == (short)tag)
+		{
+			last = &z_arenas[i];
+			return last;
+		}
+	}
+
+	if (!create)
+	{
+		return NULL;
+	}
+
+	if (z_numarenas == Z_MAX_ARENAS)
+	{
+		return NULL;
+	}
+
+	arena = &z_arenas[z_numarenas++];
+	memset(arena, 0, sizeof(*arena));
+	arena->tag = tag;
+	arena->chunks.next = arena->chunks.prev = &arena->chunks;
+	arena->blocks.next = arena->blocks.prev = &arena->blocks;
+
+	last = arena;
+	return arena;
+}
+
+/*
+ * A few chunks are kept, so that freeing and
+ * allocating a level's worth of blocks doesn't
+ * give the memory back to the OS in between.
+ */
+static void
+Z_FreeChunk(zarena_t *arena, zchunk_t *chunk)
+{
+	chunk->prev->next = chunk->next;
+	chunk->next->prev = chunk->prev;
+	arena->numchunks--;
+
+	if (z_numsparechunks < Z_MAX_SPARE_CHUNKS)
+	{
+		chunk->next = z_sparechunks;
+		z_sparechunks = chunk;
+		z_numsparechunks++;
+	}
+	else
+	{
+		free(chunk);
+	}
+}
+
 void
 Z_Free(void *ptr)
 {
+	zarena_t *arena;
+	zchunk_t *chunk;
 	zhead_t *z;
 
 	z = ((zhead_t *)ptr) - 1;
@@ -45,60 +163,198 @@ Z_Free(void *ptr)
 		abort();
 	}
 
-	z->prev->next = z->next;
-	z->next->prev = z->prev;
-
 	z_count--;
 	z_bytes -= z->size;
-	free(z);
+
+	arena = z->tag ? Z_FindArena(z->tag, false) : NULL;
+
+	if (arena)
+	{
+		arena->count--;
+		arena->bytes -= z->size;
+	}
+
+	chunk = Z_BlockChunk(z);
+
+	if (!chunk)
+	{
+		Z_Unlink(z);
+		free(z);
+		return;
+	}
+
+	/* the memory comes back when the whole chunk is unused */
+	z->magic = Z_MAGIC_FREED;
+
+	if (--chunk->live == 0)
+	{
+		if (chunk == arena->chunks.next)
+		{
+			chunk->used = 0;
+		}
+		else
+		{
+			Z_FreeChunk(arena, chunk);
+		}
+	}
 }
 
 void
 Z_Stats_f(void)
 {
+	zarena_t *arena;
+	int i;
+
 	Com_Printf("%i bytes in %i blocks\n", z_bytes, z_count);
+
+	for (i = 0; i < z_numarenas; i++)
+	{
+		arena = &z_arenas[i];
+
+		Com_Printf("  tag %i: %i bytes in %i blocks, %i chunks of %i KB\n",
+			arena->tag, arena->bytes, arena->count, arena->numchunks,
+			Z_CHUNK_SIZE / 1024);
+	}
+
+	Com_Printf("  %i spare chunks\n", z_numsparechunks);
 }
 
+/*
+ * Frees all blocks of a tag. For tags with an arena
+ * that's O(chunks), no matter how many blocks there are.
+ */
 void
 Z_FreeTags(int tag)
 {
+	zarena_t *arena;
 	zhead_t *z, *next;
 
-	for (z = z_chain.next; z != &z_chain; z = next)
+	arena = tag ? Z_FindArena(tag, false) : NULL;
+
+	if (!arena)
+	{
+		for (z = z_chain.next; z != &z_chain; z = next)
+		{
+			next = z->next;
+
+			if (z->tag == (short)tag)
+			{
+				Z_Free((void *)(z + 1));
+			}
+		}
+
+		return;
+	}
+
+	while (arena->chunks.next != &arena->chunks)
+	{
+		Z_FreeChunk(arena, arena->chunks.next);
+	}
+
+	for (z = arena->blocks.next; z != &arena->blocks; z = next)
 	{
 		next = z->next;
+		free(z);
+	}
+
+	arena->blocks.next = arena->blocks.prev = &arena->blocks;
 
-		if (z->tag == tag)
+	z_count -= arena->count;
+	z_bytes -= arena->bytes;
+	arena->count = 0;
+	arena->bytes = 0;
+}
+
+/*
+ * Cuts a block of size bytes, header included,
+ * from the current chunk of the arena.
+ */
+static zhead_t *
+Z_ChunkAlloc(zarena_t *arena, int size)
+{
+	zchunk_t *chunk;
+	zhead_t *z;
+
+	size = (size + Z_ALIGN - 1) & ~(Z_ALIGN - 1);
+	chunk = arena->chunks.next;
+
+	if ((chunk == &arena->chunks) || (chunk->used + size > chunk->size))
+	{
+		if (z_sparechunks)
 		{
-			Z_Free((void *)(z + 1));
+			chunk = z_sparechunks;
+			z_sparechunks = chunk->next;
+			z_numsparechunks--;
 		}
+		else
+		{
+			chunk = malloc(sizeof(zchunk_t) + Z_CHUNK_SIZE);
+
+			if (!chunk)
+			{
+				Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes",
+					(int)(sizeof(zchunk_t) + Z_CHUNK_SIZE));
+			}
+		}
+
+		chunk->size = Z_CHUNK_SIZE;
+		chunk->used = 0;
+		chunk->live = 0;
+
+		chunk->next = arena->chunks.next;
+		chunk->prev = &arena->chunks;
+		arena->chunks.next->prev = chunk;
+		arena->chunks.next = chunk;
+		arena->numchunks++;
 	}
+
+	z = (zhead_t *)((byte *)(chunk + 1) + chunk->used);
+	chunk->used += size;
+	chunk->live++;
+
+	memset(z, 0, size);
+	z->prev = (zhead_t *)chunk;
+
+	return z;
 }
 
 void *
 Z_TagMalloc(int size, int tag)
 {
+	zarena_t *arena;
 	zhead_t *z;
 
 	size = size + sizeof(zhead_t);
-	z = malloc(size);
+	arena = tag ? Z_FindArena(tag, true) : NULL;
 
-	if (!z)
+	if (arena && (size <= Z_MAX_CHUNK_BLOCK))
 	{
-		Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes", size);
+		z = Z_ChunkAlloc(arena, size);
+	}
+	else
+	{
+		z = malloc(size);
+
+		if (!z)
+		{
+			Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes", size);
+		}
+
+		memset(z, 0, size);
+		Z_Link(arena ? &arena->blocks : &z_chain, z);
 	}
 
-	memset(z, 0, size);
 	z_count++;
 	z_bytes += size;
 	z->magic = Z_MAGIC;
 	z->tag = tag;
 	z->size = size;
 
-	z->next = z_chain.next;
-	z->prev = &z_chain;
-	z_chain.next->prev = z;
-	z_chain.next = z;
+	if (arena)
+	{
+		arena->count++;
+		arena->bytes += size;
+	}
 
 	return (void *)(z + 1);
 }
@@ -108,4 +364,3 @@ Z_Malloc(int size)
 {
 	return Z_TagMalloc(size, 0);
 }
-
@@ -36,6 +36,31 @@ static float enemy_yaw;
 qboolean FindTarget(edict_t *self);
 qboolean ai_checkattack(edict_t *self);
 
+/* Line of sight checks of all monsters, traced at once by
+   AI_CheckSights() at the start of the frame. visible() takes
+   its answer from here while neither entity has moved since
+   and no brush model in between was linked or unlinked. */
+#define MAX_SIGHT_CHECKS 4096
+#define MAX_SIGHT_BLOCKERS 64
+
+static int sight_framenum;
+static int num_sight_checks;
+static edict_t *sight_selfs[MAX_SIGHT_CHECKS]; /* sorted, see AI_CheckSights() */
+static edict_t *sight_others[MAX_SIGHT_CHECKS];
+static vec3_t sight_starts[MAX_SIGHT_CHECKS];
+static vec3_t sight_ends[MAX_SIGHT_CHECKS];
+static trace_t sight_traces[MAX_SIGHT_CHECKS];
+
+/* where brush models were linked or unlinked since, more
+   than MAX_SIGHT_BLOCKERS throws all checks away */
+static int num_sight_blockers;
+static vec3_t sight_blockmins[MAX_SIGHT_BLOCKERS];
+static vec3_t sight_blockmaxs[MAX_SIGHT_BLOCKERS];
+
+/* the engines functions behind gi.linkentity and gi.unlinkentity */
+static void (*sight_linkentity)(edict_t *ent);
+static void (*sight_unlinkentity)(edict_t *ent);
+
 /*
  * Called once each frame to set level.sight_client
  * to the player to be checked for in findtarget.
@@ -88,6 +113,281 @@ AI_SetSightClient(void)
 	}
 }
 
+static void
+AI_SightSpots(edict_t *self, edict_t *other, vec3_t spot1, vec3_t spot2)
+{
+	VectorCopy(self->s.origin, spot1);
+	spot1[2] += self->viewheight;
+	VectorCopy(other->s.origin, spot2);
+	spot2[2] += other->viewheight;
+}
+
+static void
+AI_AddSightCheck(edict_t *self, edict_t *other)
+{
+	int i;
+
+	if (!other || !other->inuse || (other == self))
+	{
+		return;
+	}
+
+	if (num_sight_checks == MAX_SIGHT_CHECKS)
+	{
+		return;
+	}
+
+	/* the checks of self are the last ones */
+	for (i = num_sight_checks - 1; (i >= 0) && (sight_selfs[i] == self); i--)
+	{
+		if (sight_others[i] == other)
+		{
+			return;
+		}
+	}
+
+	i = num_sight_checks++;
+	sight_selfs[i] = self;
+	sight_others[i] = other;
+	AI_SightSpots(self, other, sight_starts[i], sight_ends[i]);
+}
+
+/*
+ * Called once each frame after AI_SetSightClient().
+ * Traces the line of sight from all monsters to whatever
+ * FindTarget() and ai_checkattack() are likely to look at.
+ * Goes through gi.LineTraces(), which may spread them over
+ * several threads. Nothing changes while they run, so that's
+ * the same as tracing them one by one.
+ */
+void
+AI_CheckSights(void)
+{
+	edict_t *ent;
+	int i;
+
+	num_sight_checks = 0;
+	num_sight_blockers = 0;
+	sight_framenum = level.framenum;
+
+	if (sv_gameimport->value < GAME_IMPORT_LINETRACES)
+	{
+		return;
+	}
+
+	/* in edict order, so sight_selfs is sorted */
+	for (i = game.maxclients + 1; i < globals.num_edicts; i++)
+	{
+		ent = &g_edicts[i];
+
+		if (!ent->inuse || !(ent->svflags & SVF_MONSTER) ||
+			(ent->health <= 0))
+		{
+			continue;
+		}
+
+		/* FindTarget() doesn't look that far */
+		if (level.sight_client && (range(ent, level.sight_client) != RANGE_FAR))
+		{
+			AI_AddSightCheck(ent, level.sight_client);
+		}
+
+		if (level.sight_entity_framenum >= (level.framenum - 1))
+		{
+			AI_AddSightCheck(ent, level.sight_entity);
+		}
+
+		AI_AddSightCheck(ent, ent->enemy);
+
+		if (ent->monsterinfo.aiflags & AI_SOUND_TARGET)
+		{
+			AI_AddSightCheck(ent, ent->goalentity);
+		}
+	}
+
+	if (num_sight_checks)
+	{
+		gi.LineTraces(sight_traces, sight_starts, sight_ends,
+				sight_selfs, num_sight_checks, MASK_OPAQUE);
+	}
+}
+
+/*
+ * A brush model moved, appeared or went away somewhere in the
+ * box of mins and maxs. Line of sight checks through it have
+ * to be traced again.
+ */
+static void
+AI_SightBlockerMoved(vec3_t mins, vec3_t maxs)
+{
+	if (num_sight_blockers < MAX_SIGHT_BLOCKERS)
+	{
+		VectorCopy(mins, sight_blockmins[num_sight_blockers]);
+		VectorCopy(maxs, sight_blockmaxs[num_sight_blockers]);
+	}
+
+	num_sight_blockers++;
+}
+
+/*
+ * Only brush models can block MASK_OPAQUE, the box hulls of
+ * everything else are CONTENTS_MONSTER. A brush model that's
+ * in the world now may have been solid, so it counts as well,
+ * even if it's SOLID_NOT by now.
+ */
+static qboolean
+AI_IsSightBlocker(edict_t *ent)
+{
+	if (!ent->model || (ent->model[0] != '*'))
+	{
+		return false;
+	}
+
+	return (ent->solid == SOLID_BSP) || ent->area.prev;
+}
+
+/*
+ * Takes the place of gi.linkentity. Doors, trains and platforms
+ * moving, walls toggled between SOLID_BSP and SOLID_NOT and
+ * brush models relinked in place all come by here.
+ */
+static void
+AI_LinkEntity(edict_t *ent)
+{
+	vec3_t mins, maxs;
+
+	if (!AI_IsSightBlocker(ent))
+	{
+		sight_linkentity(ent);
+		return;
+	}
+
+	ClearBounds(mins, maxs);
+
+	if (ent->area.prev)
+	{
+		AddPointToBounds(ent->absmin, mins, maxs);
+		AddPointToBounds(ent->absmax, mins, maxs);
+	}
+
+	sight_linkentity(ent);
+
+	AddPointToBounds(ent->absmin, mins, maxs);
+	AddPointToBounds(ent->absmax, mins, maxs);
+	AI_SightBlockerMoved(mins, maxs);
+}
+
+/*
+ * Takes the place of gi.unlinkentity, for
+ * brush models that are freed or hidden.
+ */
+static void
+AI_UnlinkEntity(edict_t *ent)
+{
+	if (ent->area.prev && AI_IsSightBlocker(ent))
+	{
+		AI_SightBlockerMoved(ent->absmin, ent->absmax);
+	}
+
+	sight_unlinkentity(ent);
+}
+
+/*
+ * Called by GetGameAPI(). Hooks linking and unlinking of
+ * entities, whatever changes the world the checks were
+ * traced in goes through these.
+ */
+void
+AI_HookSightBlockers(void)
+{
+	sight_linkentity = gi.linkentity;
+	sight_unlinkentity = gi.unlinkentity;
+
+	gi.linkentity = AI_LinkEntity;
+	gi.unlinkentity = AI_UnlinkEntity;
+}
+
+/*
+ * Looks up the line of sight from spot1 of self to spot2 of
+ * other in the checks of this frame. Returns false if there's
+ * none or if it might be stale.
+ */
+static qboolean
+AI_CheckedSight(edict_t *self, edict_t *other, vec3_t spot1, vec3_t spot2,
+		qboolean *vis)
+{
+	vec3_t mins, maxs;
+	int lo, hi, mid, i, j;
+
+	if ((sight_framenum != level.framenum) || !num_sight_checks ||
+		(num_sight_blockers > MAX_SIGHT_BLOCKERS))
+	{
+		return false;
+	}
+
+	/* find the first check of self */
+	lo = 0;
+	hi = num_sight_checks;
+
+	while (lo < hi)
+	{
+		mid = (lo + hi) / 2;
+
+		if (sight_selfs[mid] < self)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	for (i = lo; (i < num_sight_checks) && (sight_selfs[i] == self); i++)
+	{
+		if (sight_others[i] == other)
+		{
+			break;
+		}
+	}
+
+	if ((i == num_sight_checks) || (sight_selfs[i] != self))
+	{
+		return false;
+	}
+
+	/* moved since */
+	if (!VectorCompare(spot1, sight_starts[i]) ||
+		!VectorCompare(spot2, sight_ends[i]))
+	{
+		return false;
+	}
+
+	if (num_sight_blockers)
+	{
+		ClearBounds(mins, maxs);
+		AddPointToBounds(spot1, mins, maxs);
+		AddPointToBounds(spot2, mins, maxs);
+
+		for (j = 0; j < num_sight_blockers; j++)
+		{
+			if ((sight_blockmins[j][0] <= maxs[0]) &&
+				(sight_blockmins[j][1] <= maxs[1]) &&
+				(sight_blockmins[j][2] <= maxs[2]) &&
+				(sight_blockmaxs[j][0] >= mins[0]) &&
+				(sight_blockmaxs[j][1] >= mins[1]) &&
+				(sight_blockmaxs[j][2] >= mins[2]))
+			{
+				return false;
+			}
+		}
+	}
+
+	*vis = (sight_traces[i].fraction == 1.0);
+
+	return true;
+}
+
 /*
  * Move the specified distance at current facing.
  */
@@ -341,16 +641,20 @@ visible(edict_t *self, edict_t *other)
 	vec3_t spot1;
 	vec3_t spot2;
 	trace_t trace;
+	qboolean vis;
 
 	if (!self || !other)
 	{
 		return false;
 	}
 
-	VectorCopy(self->s.origin, spot1);
-	spot1[2] += self->viewheight;
-	VectorCopy(other->s.origin, spot2);
-	spot2[2] += other->viewheight;
+	AI_SightSpots(self, other, spot1, spot2);
+
+	if (AI_CheckedSight(self, other, spot1, spot2, &vis))
+	{
+		return vis;
+	}
+
 	trace = gi.trace(spot1, vec3_origin, vec3_origin, spot2, self, MASK_OPAQUE);
 
 	if (trace.fraction == 1.0)
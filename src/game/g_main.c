@@ -91,6 +91,8 @@ cvar_t *g_machinegun_norecoil;
 cvar_t *g_quick_weap;
 cvar_t *g_swap_speed;
 
+cvar_t *sv_gameimport;
+
 void G_RunFrame(void);
 
 /* =================================================================== */
@@ -149,6 +151,10 @@ GetGameAPI(game_import_t *import)
 {
 	gi = *import;
 
+	/* the line of sight checks need to know of brush models
+	   that are linked or unlinked */
+	AI_HookSightBlockers();
+
 	globals.apiversion = GAME_API_VERSION;
 	globals.Init = InitGame;
 	globals.Shutdown = ShutdownGame;
@@ -466,6 +472,9 @@ G_RunFrame(void)
 		return;
 	}
 
+	/* trace the monsters line of sight checks in one go */
+	AI_CheckSights();
+
 	/* treat each object in turn
 	   even the world gets a chance
 	   to think */
@@ -26,6 +26,8 @@
 
 #include "header/local.h"
 
+#define MAX_PELLET_BATCH 32 /* pellets traced with one gi.BoxTraces() call */
+
 /*
  * This is a support routine used when a client is firing
  * a non-instant attack weapon.  It checks to see if a
@@ -167,109 +169,86 @@ fire_hit(edict_t *self, vec3_t aim, int damage, int kick)
 }
 
 /*
- * This is an internal support routine
- * used for bullet/pellet based weapons.
+ * The rest of fire_lead() after the first trace from start
+ * to end: goes on through water and deals the damage. tr is
+ * blocked if the way from the shooter to start was blocked.
+ * Returns the entity that took damage, if any.
  */
-void
-fire_lead(edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick,
+static edict_t *
+fire_lead_finish(edict_t *self, vec3_t start, vec3_t aimdir, vec3_t end,
+		trace_t tr, qboolean blocked, qboolean water, int damage, int kick,
 		int te_impact, int hspread, int vspread, int mod)
 {
-	trace_t tr;
 	vec3_t dir;
 	vec3_t forward, right, up;
-	vec3_t end;
 	float r;
 	float u;
 	vec3_t water_start;
-	qboolean water = false;
-	int content_mask = MASK_SHOT | MASK_WATER;
+	edict_t *damaged = NULL;
 
-	if (!self)
+	if (water)
 	{
-		return;
+		VectorCopy(start, water_start);
 	}
 
-	tr = gi.trace(self->s.origin, NULL, NULL, start, self, MASK_SHOT);
-
-	if (!(tr.fraction < 1.0))
+	/* see if we hit water */
+	if (!blocked && (tr.contents & MASK_WATER))
 	{
-		vectoangles(aimdir, dir);
-		AngleVectors(dir, forward, right, up);
-
-		r = crandom() * hspread;
-		u = crandom() * vspread;
-		VectorMA(start, 8192, forward, end);
-		VectorMA(end, r, right, end);
-		VectorMA(end, u, up, end);
-
-		if (gi.pointcontents(start) & MASK_WATER)
-		{
-			water = true;
-			VectorCopy(start, water_start);
-			content_mask &= ~MASK_WATER;
-		}
+		int color;
 
-		tr = gi.trace(start, NULL, NULL, end, self, content_mask);
+		water = true;
+		VectorCopy(tr.endpos, water_start);
 
-		/* see if we hit water */
-		if (tr.contents & MASK_WATER)
+		if (!VectorCompare(start, tr.endpos))
 		{
-			int color;
-
-			water = true;
-			VectorCopy(tr.endpos, water_start);
-
-			if (!VectorCompare(start, tr.endpos))
+			if (tr.contents & CONTENTS_WATER)
 			{
-				if (tr.contents & CONTENTS_WATER)
+				if (strcmp(tr.surface->name, "*brwater") == 0)
 				{
-					if (strcmp(tr.surface->name, "*brwater") == 0)
-					{
-						color = SPLASH_BROWN_WATER;
-					}
-					else
-					{
-						color = SPLASH_BLUE_WATER;
-					}
-				}
-				else if (tr.contents & CONTENTS_SLIME)
-				{
-					color = SPLASH_SLIME;
-				}
-				else if (tr.contents & CONTENTS_LAVA)
-				{
-					color = SPLASH_LAVA;
+					color = SPLASH_BROWN_WATER;
 				}
 				else
 				{
-					color = SPLASH_UNKNOWN;
-				}
-
-				if (color != SPLASH_UNKNOWN)
-				{
-					gi.WriteByte(svc_temp_entity);
-					gi.WriteByte(TE_SPLASH);
-					gi.WriteByte(8);
-					gi.WritePosition(tr.endpos);
-					gi.WriteDir(tr.plane.normal);
-					gi.WriteByte(color);
-					gi.multicast(tr.endpos, MULTICAST_PVS);
+					color = SPLASH_BLUE_WATER;
 				}
+			}
+			else if (tr.contents & CONTENTS_SLIME)
+			{
+				color = SPLASH_SLIME;
+			}
+			else if (tr.contents & CONTENTS_LAVA)
+			{
+				color = SPLASH_LAVA;
+			}
+			else
+			{
+				color = SPLASH_UNKNOWN;
+			}
 
-				/* change bullet's course when it enters water */
-				VectorSubtract(end, start, dir);
-				vectoangles(dir, dir);
-				AngleVectors(dir, forward, right, up);
-				r = crandom() * hspread * 2;
-				u = crandom() * vspread * 2;
-				VectorMA(water_start, 8192, forward, end);
-				VectorMA(end, r, right, end);
-				VectorMA(end, u, up, end);
+			if (color != SPLASH_UNKNOWN)
+			{
+				gi.WriteByte(svc_temp_entity);
+				gi.WriteByte(TE_SPLASH);
+				gi.WriteByte(8);
+				gi.WritePosition(tr.endpos);
+				gi.WriteDir(tr.plane.normal);
+				gi.WriteByte(color);
+				gi.multicast(tr.endpos, MULTICAST_PVS);
 			}
 
-			/* re-trace ignoring water this time */
-			tr = gi.trace(water_start, NULL, NULL, end, self, MASK_SHOT);
+			/* change bullet's course when it enters water */
+			VectorSubtract(end, start, dir);
+			vectoangles(dir, dir);
+			AngleVectors(dir, forward, right, up);
+			r = crandom() * hspread * 2;
+			u = crandom() * vspread * 2;
+			VectorMA(water_start, 8192, forward, end);
+			VectorMA(end, r, right, end);
+			VectorMA(end, u, up, end);
 		}
+
+		/* re-trace ignoring water this time */
+		tr = gi.trace(water_start, NULL, NULL, end, self, MASK_SHOT);
 	}
 
 	/* send gun puff / flash */
@@ -279,6 +258,7 @@ fire_lead(edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick,
 		{
 			if (tr.ent->takedamage)
 			{
+				damaged = tr.ent;
 				T_Damage(tr.ent, self, self, aimdir, tr.endpos, tr.plane.normal,
 						damage, kick, DAMAGE_BULLET, mod);
 			}
@@ -329,6 +309,72 @@ fire_lead(edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick,
 		gi.WritePosition(tr.endpos);
 		gi.multicast(pos, MULTICAST_PVS);
 	}
+
+	return damaged;
+}
+
+/*
+ * Picks a random end point for a bullet
+ * fired from start into aimdir.
+ */
+static void
+fire_lead_end(vec3_t start, vec3_t aimdir, int hspread, int vspread,
+		vec3_t end)
+{
+	vec3_t dir;
+	vec3_t forward, right, up;
+	float r;
+	float u;
+
+	vectoangles(aimdir, dir);
+	AngleVectors(dir, forward, right, up);
+
+	r = crandom() * hspread;
+	u = crandom() * vspread;
+	VectorMA(start, 8192, forward, end);
+	VectorMA(end, r, right, end);
+	VectorMA(end, u, up, end);
+}
+
+/*
+ * This is an internal support routine
+ * used for bullet/pellet based weapons.
+ */
+void
+fire_lead(edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick,
+		int te_impact, int hspread, int vspread, int mod)
+{
+	trace_t tr;
+	vec3_t end;
+	qboolean water = false;
+	int content_mask = MASK_SHOT | MASK_WATER;
+
+	if (!self)
+	{
+		return;
+	}
+
+	tr = gi.trace(self->s.origin, NULL, NULL, start, self, MASK_SHOT);
+
+	if (tr.fraction < 1.0)
+	{
+		fire_lead_finish(self, start, aimdir, start, tr, true, false,
+				damage, kick, te_impact, hspread, vspread, mod);
+		return;
+	}
+
+	fire_lead_end(start, aimdir, hspread, vspread, end);
+
+	if (gi.pointcontents(start) & MASK_WATER)
+	{
+		water = true;
+		content_mask &= ~MASK_WATER;
+	}
+
+	tr = gi.trace(start, NULL, NULL, end, self, content_mask);
+
+	fire_lead_finish(self, start, aimdir, end, tr, false, water,
+			damage, kick, te_impact, hspread, vspread, mod);
 }
 
 /*
@@ -356,17 +402,86 @@ void
 fire_shotgun(edict_t *self, vec3_t start, vec3_t aimdir, int damage,
 		int kick, int hspread, int vspread, int count, int mod)
 {
-	int i;
+	trace_t tr, traces[MAX_PELLET_BATCH];
+	vec3_t ends[MAX_PELLET_BATCH];
+	qboolean water = false, changed = false;
+	int content_mask = MASK_SHOT | MASK_WATER;
+	int i, j, n;
 
 	if (!self)
 	{
 		return;
 	}
 
-	for (i = 0; i < count; i++)
+	/* without BoxTraces every pellet is traced on its own */
+	if ((sv_gameimport->value < GAME_IMPORT_BOXTRACES) || (count < 2))
 	{
-		fire_lead(self, start, aimdir, damage, kick, TE_SHOTGUN,
-				hspread, vspread, mod);
+		for (i = 0; i < count; i++)
+		{
+			fire_lead(self, start, aimdir, damage, kick, TE_SHOTGUN,
+					hspread, vspread, mod);
+		}
+
+		return;
+	}
+
+	/* the same for all pellets */
+	tr = gi.trace(self->s.origin, NULL, NULL, start, self, MASK_SHOT);
+
+	if (tr.fraction < 1.0)
+	{
+		for (i = 0; i < count; i++)
+		{
+			fire_lead_finish(self, start, aimdir, start, tr, true, false,
+					damage, kick, TE_SHOTGUN, hspread, vspread, mod);
+		}
+
+		return;
+	}
+
+	if (gi.pointcontents(start) & MASK_WATER)
+	{
+		water = true;
+		content_mask &= ~MASK_WATER;
+	}
+
+	for (i = 0; i < count; i += n)
+	{
+		n = Q_min(count - i, MAX_PELLET_BATCH);
+
+		for (j = 0; j < n; j++)
+		{
+			fire_lead_end(start, aimdir, hspread, vspread, ends[j]);
+		}
+
+		if (!changed)
+		{
+			gi.BoxTraces(traces, start, NULL, NULL, ends, n, self,
+					content_mask);
+		}
+
+		for (j = 0; j < n; j++)
+		{
+			edict_t *hit;
+
+			/* once a pellet killed something, the following ones
+			   may hit something else than the batch found. From
+			   there on they're traced one by one again. */
+			if (changed)
+			{
+				traces[j] = gi.trace(start, NULL, NULL, ends[j], self,
+						content_mask);
+			}
+
+			hit = fire_lead_finish(self, start, aimdir, ends[j], traces[j],
+					false, water, damage, kick, TE_SHOTGUN, hspread, vspread,
+					mod);
+
+			if (hit && (!hit->inuse || (hit->health <= 0)))
+			{
+				changed = true;
+			}
+		}
 	}
 }
 
@@ -36,6 +36,14 @@
 
 #define GAME_API_VERSION 3
 
+/* Functions added to the end of game_import_t. The engine
+   sets the sv_gameimport cvar to this before it loads the
+   game. Older engines don't have them, so the game must
+   check sv_gameimport before it calls one of them. */
+#define GAME_IMPORT_BOXTRACES 1
+#define GAME_IMPORT_LINETRACES 2
+#define GAME_IMPORT_EXTENSIONS GAME_IMPORT_LINETRACES
+
 #define SVF_NOCLIENT 0x00000001 /* don't send entity to clients, even if it has effects */
 #define SVF_DEADMONSTER 0x00000002 /* treat as CONTENTS_DEADMONSTER for collision */
 #define SVF_MONSTER 0x00000004 /* treat as CONTENTS_MONSTER for collision */
@@ -181,6 +189,22 @@ typedef struct
 	void (*AddCommandString)(char *text);
 
 	void (*DebugGraph)(float value, int color);
+
+	/* Added by YQ2. Must be at the end to preserve ABI. */
+
+	/* GAME_IMPORT_BOXTRACES: like trace, for numtraces rays from start
+	   to each of ends[]. The entities they might hit are looked
+	   up once for all of them, instead of once per ray. */
+	void (*BoxTraces)(trace_t *traces, vec3_t start, vec3_t mins,
+			vec3_t maxs, vec3_t *ends, int numtraces, edict_t *passent,
+			int contentmask);
+
+	/* GAME_IMPORT_LINETRACES: like trace without mins and maxs, from
+	   starts[i] to ends[i] passing passents[i]. The engine may
+	   run them on several threads, nothing must change between
+	   them anyway. For line of sight checks and the like. */
+	void (*LineTraces)(trace_t *traces, vec3_t *starts, vec3_t *ends,
+			edict_t **passents, int numtraces, int contentmask);
 } game_import_t;
 
 /* functions exported by the game subsystem */
@@ -554,6 +554,8 @@ extern cvar_t *g_machinegun_norecoil;
 extern cvar_t *g_quick_weap;
 extern cvar_t *g_swap_speed;
 
+extern cvar_t *sv_gameimport;
+
 #define world (&g_edicts[0])
 
 /* item spawnflags */
@@ -721,6 +723,8 @@ void BecomeExplosion1(edict_t *self);
 
 /* g_ai.c */
 void AI_SetSightClient(void);
+void AI_CheckSights(void);
+void AI_HookSightBlockers(void);
 
 void ai_stand(edict_t *self, float dist);
 void ai_move(edict_t *self, float dist);
@@ -202,6 +202,7 @@ InitGame(void)
 
 	/* noset vars */
 	dedicated = gi.cvar("dedicated", "0", CVAR_NOSET);
+	sv_gameimport = gi.cvar("sv_gameimport", "0", CVAR_NOSET);
 
 	/* latched vars */
 	sv_cheats = gi.cvar("cheats", "0", CVAR_SERVERINFO | CVAR_LATCH);
@@ -60,6 +60,13 @@ typedef enum
 	ss_pic
 } server_state_t;
 
+/* a run of demo messages */
+typedef struct
+{
+	int pos;
+	int end;
+} demoblock_t;
+
 typedef struct
 {
 	server_state_t state;           /* precache commands are only valid during load */
@@ -82,7 +89,14 @@ typedef struct
 	byte multicast_buf[MAX_MSGLEN];
 
 	/* demo server information */
-	fileHandle_t demofile;
+	byte *demofile;                 /* the whole demo */
+	demoblock_t demostream;
+	demoblock_t demoseek[2];        /* sent before the stream continues */
+	demoblock_t demoreset;
+	ddemokey_t *demokeys;           /* NULL if the demo has no index */
+	int numdemokeys;
+	int demostart;                  /* timedemo seeks here after signon */
+	int demostop;                   /* timedemo ends at this offset */
 	qboolean timedemo; /* don't time sync */
 } server_t;
 
@@ -192,6 +206,9 @@ extern cvar_t *sv_noreload;                 /* don't reload level state when ree
 extern cvar_t *sv_airaccelerate;            /* don't reload level state when reentering */
 											/* development tool */
 extern cvar_t *sv_enforcetime;
+extern cvar_t *sv_timedemo;
+extern cvar_t *sv_timedemo_start;
+extern cvar_t *sv_timedemo_end;
 extern cvar_t *sv_downloadserver;			/* Download server. */
 
 extern client_t *sv_client;
@@ -226,6 +243,8 @@ extern char sv_outputbuf[SV_OUTPUTBUF_LENGTH];
 
 void SV_FlushRedirect(int sv_redirected, char *outputbuf);
 
+void SV_EndDemoserver(void);
+void SV_SeekDemo(int time);
 void SV_DemoCompleted(void);
 void SV_SendClientMessages(void);
 
@@ -283,5 +302,23 @@ int SV_PointContents(vec3_t p);
 trace_t SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs,
 		vec3_t end, edict_t *passedict, int contentmask);
 
+/* SV_Trace() from start to each of ends, with
+   one entity lookup for all of the traces */
+void SV_BoxTraces(trace_t *traces, vec3_t start, vec3_t mins,
+		vec3_t maxs, vec3_t *ends, int numtraces, edict_t *passedict,
+		int contentmask);
+
+/* SV_Trace() with point sized boxes from starts[i] to ends[i],
+   spread over the job threads where that's safe */
+void SV_LineTraces(trace_t *traces, vec3_t *starts, vec3_t *ends,
+		edict_t **passedicts, int numtraces, int contentmask);
+
+/* pmove recording and replay, see sv_pmove.c */
+void SV_Pmove(pmove_t *pm);
+void SV_StopPmoveRecord(void);
+void SV_PmoveRecord_f(void);
+void SV_PmoveStop_f(void);
+void SV_PmoveBench_f(void);
+
 #endif
 
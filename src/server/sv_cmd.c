@@ -159,6 +159,21 @@ SV_DemoMap_f(void)
 	SV_Map(true, Cmd_Argv(1), false, false);
 }
 
+/*
+ * Jumps to a time in the demo that's playing
+ */
+void
+SV_DemoSeek_f(void)
+{
+	if (Cmd_Argc() != 2)
+	{
+		Com_Printf("USAGE: demoseek <milliseconds>\n");
+		return;
+	}
+
+	SV_SeekDemo((int)strtol(Cmd_Argv(1), (char **)NULL, 10));
+}
+
 /*
  * Saves the state of the map just being exited and goes to a new map.
  *
@@ -764,6 +779,7 @@ SV_InitOperatorCommands(void)
 	Cmd_AddCommand("map", SV_Map_f);
 	Cmd_AddCommand("listmaps", SV_ListMaps_f);
 	Cmd_AddCommand("demomap", SV_DemoMap_f);
+	Cmd_AddCommand("demoseek", SV_DemoSeek_f);
 	Cmd_AddCommand("gamemap", SV_GameMap_f);
 	Cmd_AddCommand("setmaster", SV_SetMaster_f);
 
@@ -775,6 +791,10 @@ SV_InitOperatorCommands(void)
 	Cmd_AddCommand("serverrecord", SV_ServerRecord_f);
 	Cmd_AddCommand("serverstop", SV_ServerStop_f);
 
+	Cmd_AddCommand("pmoverecord", SV_PmoveRecord_f);
+	Cmd_AddCommand("pmovestop", SV_PmoveStop_f);
+	Cmd_AddCommand("pmovebench", SV_PmoveBench_f);
+
 	Cmd_AddCommand("save", SV_Savegame_f);
 	Cmd_AddCommand("load", SV_Loadgame_f);
 
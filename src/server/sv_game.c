@@ -408,7 +408,7 @@ SV_InitGameProgs(void)
 	import.setmodel = PF_setmodel;
 	import.inPVS = PF_inPVS;
 	import.inPHS = PF_inPHS;
-	import.Pmove = Pmove;
+	import.Pmove = SV_Pmove;
 
 	import.modelindex = SV_ModelIndex;
 	import.soundindex = SV_SoundIndex;
@@ -448,6 +448,13 @@ SV_InitGameProgs(void)
 	import.SetAreaPortalState = CM_SetAreaPortalState;
 	import.AreasConnected = CM_AreasConnected;
 
+	import.BoxTraces = SV_BoxTraces;
+	import.LineTraces = SV_LineTraces;
+
+	/* tell the game which of the functions
+	   at the end of import it may call */
+	Cvar_FullSet("sv_gameimport", va("%i", GAME_IMPORT_EXTENSIONS), CVAR_NOSET);
+
 	ge = (game_export_t *)Sys_GetGameAPI(&import);
 
 	if (!ge)
@@ -196,10 +196,7 @@ SV_SpawnServer(char *server, char *spawnpoint, server_state_t serverstate,
 	Com_Printf("------- server initialization ------\n");
 	Com_DPrintf("SpawnServer: %s\n", server);
 
-	if (sv.demofile)
-	{
-		FS_FCloseFile(sv.demofile);
-	}
+	SV_EndDemoserver();
 
 	svs.spawncount++; /* any partially connected client will be restarted */
 	sv.state = ss_dead;
@@ -34,6 +34,8 @@ client_t *sv_client; /* current client */
 
 cvar_t *sv_paused;
 cvar_t *sv_timedemo;
+cvar_t *sv_timedemo_start;
+cvar_t *sv_timedemo_end;
 cvar_t *sv_enforcetime;
 cvar_t *timeout; /* seconds without any message */
 cvar_t *zombietime; /* seconds to sink messages after disconnect */
@@ -591,6 +593,8 @@ SV_Init(void)
 	sv_showclamp = Cvar_Get("showclamp", "0", 0);
 	sv_paused = Cvar_Get("paused", "0", 0);
 	sv_timedemo = Cvar_Get("timedemo", "0", 0);
+	sv_timedemo_start = Cvar_Get("timedemo_start", "0", 0);
+	sv_timedemo_end = Cvar_Get("timedemo_end", "0", 0);
 	sv_enforcetime = Cvar_Get("sv_enforcetime", "0", 0);
 	allow_download = Cvar_Get("allow_download", "1", CVAR_ARCHIVE);
 	allow_download_players = Cvar_Get("allow_download_players", "0", CVAR_ARCHIVE);
@@ -680,12 +684,10 @@ SV_Shutdown(char *finalmsg, qboolean reconnect)
 
 	Master_Shutdown();
 	SV_ShutdownGameProgs();
+	SV_StopPmoveRecord();
 
 	/* free current level */
-	if (sv.demofile)
-	{
-		FS_FCloseFile(sv.demofile);
-	}
+	SV_EndDemoserver();
 
 	memset(&sv, 0, sizeof(sv));
 	Com_SetServerState(sv.state);
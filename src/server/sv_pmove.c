@@ -0,0 +1,431 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * =======================================================================
+ *
+ * Recording and offline replay of player movement. While pmoverecord
+ * runs, every Pmove() the game does through the import is written to
+ * pmove/<name>.pmv, with what went in and what came out. pmovebench
+ * replays such a recording against the world of the map alone and
+ * reports how fast that is and whether the results are still the
+ * same, bit for bit. That's the tool to check changes to pmove.c or
+ * the collision code. The records are raw structs, so they can only
+ * be compared between builds for the same platform.
+ *
+ * =======================================================================
+ */
+
+#include "header/server.h"
+
+#define PMOVE_IDENT (('V' << 24) + ('M' << 16) + ('P' << 8) + 'Y') /* little-endian "YPMV" */
+#define PMOVE_VERSION 1
+
+typedef struct
+{
+	int ident;
+	int version;
+	char mapname[MAX_QPATH];
+	float airaccelerate;
+} pmoveheader_t;
+
+/* everything Pmove() sets that's part of the
+   players state, padding is always zero */
+typedef struct
+{
+	pmove_state_t s;
+	vec3_t viewangles;
+	float viewheight;
+	vec3_t mins, maxs;
+	int watertype;
+	int waterlevel;
+	qboolean onground;
+} pmoveresult_t;
+
+typedef struct
+{
+	pmove_state_t in;
+	usercmd_t cmd;
+	qboolean snapinitial;
+	qboolean touchedents; /* hit more than the world, not replayable */
+	pmoveresult_t out;
+} pmoverecord_t;
+
+static FILE *pmove_file;
+
+/* the games trace functions while recording */
+static trace_t (*pmove_gametrace)(vec3_t start, vec3_t mins,
+		vec3_t maxs, vec3_t end);
+static int (*pmove_gamepointcontents)(vec3_t point);
+static qboolean pmove_touchedents;
+
+/* the replay */
+static int pmove_mask;
+static int pmove_traces, pmove_points;
+
+static void
+SV_PmoveCopyState(pmove_state_t *to, const pmove_state_t *from)
+{
+	int i;
+
+	/* field by field to keep the padding of to zeroed */
+	to->pm_type = from->pm_type;
+
+	for (i = 0; i < 3; i++)
+	{
+		to->origin[i] = from->origin[i];
+		to->velocity[i] = from->velocity[i];
+		to->delta_angles[i] = from->delta_angles[i];
+	}
+
+	to->pm_flags = from->pm_flags;
+	to->pm_time = from->pm_time;
+	to->gravity = from->gravity;
+}
+
+static void
+SV_PmoveResult(pmove_t *pm, pmoveresult_t *r)
+{
+	memset(r, 0, sizeof(*r));
+
+	SV_PmoveCopyState(&r->s, &pm->s);
+	VectorCopy(pm->viewangles, r->viewangles);
+	r->viewheight = pm->viewheight;
+	VectorCopy(pm->mins, r->mins);
+	VectorCopy(pm->maxs, r->maxs);
+	r->watertype = pm->watertype;
+	r->waterlevel = pm->waterlevel;
+	r->onground = (pm->groundentity != NULL);
+}
+
+static trace_t
+SV_PmoveRecordTrace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end)
+{
+	trace_t trace;
+
+	trace = pmove_gametrace(start, mins, maxs, end);
+
+	if (trace.ent && (trace.ent != ge->edicts))
+	{
+		pmove_touchedents = true;
+	}
+
+	return trace;
+}
+
+static int
+SV_PmoveRecordPointContents(vec3_t point)
+{
+	int contents;
+
+	contents = pmove_gamepointcontents(point);
+
+	/* water brush models and the like, the replay won't see them */
+	if (contents != CM_PointContents(point, 0))
+	{
+		pmove_touchedents = true;
+	}
+
+	return contents;
+}
+
+/*
+ * Pmove() for the game, records it while pmoverecord runs.
+ */
+void
+SV_Pmove(pmove_t *pm)
+{
+	pmoverecord_t rec;
+
+	if (!pmove_file)
+	{
+		Pmove(pm);
+		return;
+	}
+
+	memset(&rec, 0, sizeof(rec));
+	SV_PmoveCopyState(&rec.in, &pm->s);
+	rec.cmd = pm->cmd;
+	rec.snapinitial = pm->snapinitial;
+
+	pmove_gametrace = pm->trace;
+	pmove_gamepointcontents = pm->pointcontents;
+	pmove_touchedents = false;
+	pm->trace = SV_PmoveRecordTrace;
+	pm->pointcontents = SV_PmoveRecordPointContents;
+
+	Pmove(pm);
+
+	pm->trace = pmove_gametrace;
+	pm->pointcontents = pmove_gamepointcontents;
+
+	rec.touchedents = pmove_touchedents;
+	SV_PmoveResult(pm, &rec.out);
+
+	if (fwrite(&rec, sizeof(rec), 1, pmove_file) != 1)
+	{
+		Com_Printf("Couldn't write pmove record, stopped.\n");
+		SV_StopPmoveRecord();
+	}
+}
+
+void
+SV_StopPmoveRecord(void)
+{
+	if (pmove_file)
+	{
+		fclose(pmove_file);
+		pmove_file = NULL;
+	}
+}
+
+void
+SV_PmoveRecord_f(void)
+{
+	char name[MAX_OSPATH];
+	pmoveheader_t header;
+
+	if (Cmd_Argc() != 2)
+	{
+		Com_Printf("pmoverecord <name>\n");
+		return;
+	}
+
+	if (pmove_file)
+	{
+		Com_Printf("Already recording.\n");
+		return;
+	}
+
+	if (sv.state != ss_game)
+	{
+		Com_Printf("You must be in a level to record.\n");
+		return;
+	}
+
+	if (strstr(Cmd_Argv(1), "..") ||
+		strstr(Cmd_Argv(1), "/") ||
+		strstr(Cmd_Argv(1), "\\"))
+	{
+		Com_Printf("Illegal filename.\n");
+		return;
+	}
+
+	Com_sprintf(name, sizeof(name), "%s/pmove/%s.pmv", FS_Gamedir(), Cmd_Argv(1));
+
+	Com_Printf("recording pmoves to %s.\n", name);
+	FS_CreatePath(name);
+	pmove_file = Q_fopen(name, "wb");
+
+	if (!pmove_file)
+	{
+		Com_Printf("ERROR: couldn't open.\n");
+		return;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.ident = PMOVE_IDENT;
+	header.version = PMOVE_VERSION;
+	Q_strlcpy(header.mapname, sv.configstrings[CS_MODELS + 1], sizeof(header.mapname));
+	header.airaccelerate = pm_airaccelerate;
+
+	if (fwrite(&header, sizeof(header), 1, pmove_file) != 1)
+	{
+		Com_Printf("ERROR: couldn't write.\n");
+		SV_StopPmoveRecord();
+	}
+}
+
+void
+SV_PmoveStop_f(void)
+{
+	if (!pmove_file)
+	{
+		Com_Printf("Not recording pmoves.\n");
+		return;
+	}
+
+	SV_StopPmoveRecord();
+	Com_Printf("Recording pmoves completed.\n");
+}
+
+/*
+ * The world only, like the game would see it with no entities.
+ * The world is hit by every trace there, the entity just needs
+ * to be something that's not NULL.
+ */
+static trace_t
+SV_PmoveBenchTrace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end)
+{
+	trace_t trace;
+
+	pmove_traces++;
+
+	trace = CM_BoxTrace(start, end, mins, maxs, 0, pmove_mask);
+	trace.ent = (struct edict_s *)1;
+
+	return trace;
+}
+
+static int
+SV_PmoveBenchPointContents(vec3_t point)
+{
+	pmove_points++;
+
+	return CM_PointContents(point, 0);
+}
+
+void
+SV_PmoveBench_f(void)
+{
+	char name[MAX_OSPATH], mapname[MAX_QPATH];
+	pmoveheader_t *header;
+	pmoverecord_t *recs;
+	pmoveresult_t *results;
+	pmove_t pm;
+	float oldairaccelerate;
+	unsigned checksum;
+	int len, numrecs, passes, pass, i;
+	int skipped, differ;
+	long long start, time;
+	byte *buf;
+
+	if ((Cmd_Argc() != 2) && (Cmd_Argc() != 3))
+	{
+		Com_Printf("Usage: %s <name> [passes]\n", Cmd_Argv(0));
+		return;
+	}
+
+	/* the collision model is shared by client and server,
+	   the benchmark can't load its map into it under them */
+	if ((Com_ServerState() != ss_dead) || CM_MapName()[0])
+	{
+		Com_Printf("Can't \"%s\" while a map is loaded.\n", Cmd_Argv(0));
+		return;
+	}
+
+#ifndef DEDICATED_ONLY
+	if (!CL_Disconnected())
+	{
+		Com_Printf("Can't \"%s\" while connected.\n", Cmd_Argv(0));
+		return;
+	}
+#endif
+
+	passes = (Cmd_Argc() == 3) ? (int)strtol(Cmd_Argv(2), NULL, 10) : 1;
+
+	if (passes < 1)
+	{
+		passes = 1;
+	}
+
+	Com_sprintf(name, sizeof(name), "pmove/%s.pmv", Cmd_Argv(1));
+	len = FS_LoadFile(name, (void **)&buf);
+
+	if (!buf)
+	{
+		Com_Printf("Couldn't load %s.\n", name);
+		return;
+	}
+
+	header = (pmoveheader_t *)buf;
+	numrecs = (len - (int)sizeof(pmoveheader_t)) / (int)sizeof(pmoverecord_t);
+
+	if ((len < (int)sizeof(pmoveheader_t)) || (header->ident != PMOVE_IDENT) ||
+		(header->version != PMOVE_VERSION) || (numrecs <= 0))
+	{
+		Com_Printf("%s is not a pmove recording of this build.\n", name);
+		FS_FreeFile(buf);
+		return;
+	}
+
+	Q_strlcpy(mapname, header->mapname, sizeof(mapname));
+
+	CM_LoadMap(mapname, true, &checksum);
+
+	recs = (pmoverecord_t *)(buf + sizeof(pmoveheader_t));
+	results = Z_Malloc(numrecs * sizeof(pmoveresult_t));
+
+	oldairaccelerate = pm_airaccelerate;
+	pm_airaccelerate = header->airaccelerate;
+
+	pmove_traces = pmove_points = 0;
+	time = 0;
+
+	for (pass = 0; pass < passes; pass++)
+	{
+		start = Sys_Microseconds();
+
+		for (i = 0; i < numrecs; i++)
+		{
+			memset(&pm, 0, sizeof(pm));
+			pm.s = recs[i].in;
+			pm.cmd = recs[i].cmd;
+			pm.snapinitial = recs[i].snapinitial;
+			pm.trace = SV_PmoveBenchTrace;
+			pm.pointcontents = SV_PmoveBenchPointContents;
+
+			/* like the game's PM_trace() */
+			pmove_mask = (pm.s.pm_type >= PM_DEAD) ? MASK_DEADSOLID : MASK_PLAYERSOLID;
+
+			Pmove(&pm);
+
+			if (pass == 0)
+			{
+				SV_PmoveResult(&pm, &results[i]);
+			}
+		}
+
+		time += Sys_Microseconds() - start;
+	}
+
+	pm_airaccelerate = oldairaccelerate;
+
+	skipped = differ = 0;
+
+	for (i = 0; i < numrecs; i++)
+	{
+		if (recs[i].touchedents)
+		{
+			skipped++;
+		}
+		else if (memcmp(&results[i], &recs[i].out, sizeof(pmoveresult_t)))
+		{
+			differ++;
+		}
+	}
+
+	Com_Printf("%s: %i pmoves on %s, %i passes\n", name, numrecs,
+		mapname, passes);
+	Com_Printf("  %.0f pmoves/s, %.2f us/pmove\n",
+		(double)numrecs * passes * 1000000.0 / (time ? time : 1),
+		(double)time / ((double)numrecs * passes));
+	Com_Printf("  %.2f traces, %.2f pointcontents per pmove\n",
+		(double)pmove_traces / ((double)numrecs * passes),
+		(double)pmove_points / ((double)numrecs * passes));
+	Com_Printf("  %i differ from the recording, %i touched entities\n",
+		differ, skipped);
+	Com_Printf("  end state checksum %08x\n",
+		Com_BlockChecksum(results, numrecs * sizeof(pmoveresult_t)));
+
+	Z_Free(results);
+	FS_FreeFile(buf);
+
+	/* nothing was loaded before */
+	CM_LoadMap("", true, &checksum);
+}
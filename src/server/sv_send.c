@@ -477,12 +477,7 @@ SV_SendClientDatagram(client_t *client)
 void
 SV_DemoCompleted(void)
 {
-	if (sv.demofile)
-	{
-		FS_FCloseFile(sv.demofile);
-		sv.demofile = 0;
-	}
-
+	SV_EndDemoserver();
 	SV_Nextserver();
 }
 
@@ -519,6 +514,48 @@ SV_RateDrop(client_t *c)
 	return false;
 }
 
+/*
+ * Returns the length of the next message in block,
+ * -1 if the block is used up or the demo ends.
+ */
+static int
+SV_ReadDemoMessage(demoblock_t *block, byte *msgbuf)
+{
+	int msglen;
+
+	if (block->pos + 4 > block->end)
+	{
+		block->pos = block->end;
+		return -1;
+	}
+
+	memcpy(&msglen, sv.demofile + block->pos, 4);
+	msglen = LittleLong(msglen);
+
+	if (msglen == -1)
+	{
+		block->pos = block->end;
+		return -1;
+	}
+
+	if (msglen > MAX_MSGLEN)
+	{
+		Com_Error(ERR_DROP,
+				"SV_SendClientMessages: msglen > MAX_MSGLEN");
+	}
+
+	if ((msglen < 0) || (msglen > block->end - block->pos - 4))
+	{
+		block->pos = block->end;
+		return -1;
+	}
+
+	memcpy(msgbuf, sv.demofile + block->pos + 4, msglen);
+	block->pos += 4 + msglen;
+
+	return msglen;
+}
+
 void
 SV_SendClientMessages(void)
 {
@@ -526,48 +563,51 @@ SV_SendClientMessages(void)
 	client_t *c;
 	int msglen;
 	byte msgbuf[MAX_MSGLEN];
-	size_t r;
 
 	msglen = 0;
 
 	/* read the next demo message if needed */
 	if (sv.demofile && (sv.state == ss_demo))
 	{
-		if (sv_paused->value)
+		msglen = -1;
+
+		/* a timedemo of a segment skips ahead once the signon
+		   is through, the first keyframe comes right after it */
+		if (sv.demostart && (sv.demostream.pos >= sv.demokeys[0].offset))
 		{
-			msglen = 0;
+			SV_SeekDemo(sv.demostart);
+			sv.demostart = 0;
 		}
-		else
-		{
-			/* get the next message */
-			r = FS_FRead(&msglen, 4, 1, sv.demofile);
-
-			if (r != 4)
-			{
-				SV_DemoCompleted();
-				return;
-			}
 
-			msglen = LittleLong(msglen);
+		/* after a seek the keyframe goes out first,
+		   even when paused to show where we are */
+		for (i = 0; i < 2 && msglen < 0; i++)
+		{
+			msglen = SV_ReadDemoMessage(&sv.demoseek[i], msgbuf);
+		}
 
-			if (msglen == -1)
+		if (msglen < 0)
+		{
+			if (sv_paused->value)
 			{
-				SV_DemoCompleted();
-				return;
+				msglen = 0;
 			}
-
-			if (msglen > MAX_MSGLEN)
+			else
 			{
-				Com_Error(ERR_DROP,
-						"SV_SendClientMessages: msglen > MAX_MSGLEN");
-			}
+				if (sv.demostop && (sv.demostream.pos >= sv.demostop))
+				{
+					SV_DemoCompleted();
+					return;
+				}
 
-			r = FS_FRead(msgbuf, msglen, 1, sv.demofile);
+				/* get the next message */
+				msglen = SV_ReadDemoMessage(&sv.demostream, msgbuf);
 
-			if (r != msglen)
-			{
-				SV_DemoCompleted();
-				return;
+				if (msglen < 0)
+				{
+					SV_DemoCompleted();
+					return;
+				}
 			}
 		}
 	}
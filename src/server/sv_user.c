@@ -30,18 +30,228 @@
 
 edict_t *sv_player;
 
+static qboolean
+SV_ValidDemoBlock(int ofs, int len, int end)
+{
+	return (ofs >= 0) && (len >= 0) && (ofs <= end) && (len <= end - ofs);
+}
+
+/*
+ * Reads the index of demos recorded with cl_demoindex.
+ * Demos without one play fine, they just can't seek.
+ */
+static void
+SV_ReadDemoIndex(int len)
+{
+	ddemotrailer_t trailer;
+	ddemoindex_t index;
+	ddemokey_t *key;
+	int indexofs;
+	int i;
+
+	if (len < sizeof(trailer))
+	{
+		return;
+	}
+
+	memcpy(&trailer, sv.demofile + len - sizeof(trailer), sizeof(trailer));
+
+	if (LittleLong(trailer.ident) != IDDEMOHEADER)
+	{
+		return;
+	}
+
+	/* everything is in front of the trailer */
+	len -= sizeof(trailer);
+	indexofs = LittleLong(trailer.indexofs);
+
+	if (!SV_ValidDemoBlock(indexofs, sizeof(index), len))
+	{
+		goto bad;
+	}
+
+	memcpy(&index, sv.demofile + indexofs, sizeof(index));
+
+	index.version = LittleLong(index.version);
+	index.resetofs = LittleLong(index.resetofs);
+	index.resetlen = LittleLong(index.resetlen);
+	index.numkeys = LittleLong(index.numkeys);
+
+	if ((LittleLong(index.ident) != IDDEMOHEADER) ||
+		(index.version != DEMOINDEX_VERSION) ||
+		(index.numkeys <= 0) ||
+		(index.numkeys > (len - indexofs - (int)sizeof(index)) / (int)sizeof(ddemokey_t)) ||
+		!SV_ValidDemoBlock(index.resetofs, index.resetlen, indexofs))
+	{
+		goto bad;
+	}
+
+	sv.demokeys = Z_Malloc(index.numkeys * sizeof(ddemokey_t));
+	memcpy(sv.demokeys, sv.demofile + indexofs + sizeof(index),
+			index.numkeys * sizeof(ddemokey_t));
+
+	for (i = 0, key = sv.demokeys; i < index.numkeys; i++, key++)
+	{
+		key->time = LittleLong(key->time);
+		key->offset = LittleLong(key->offset);
+		key->keyofs = LittleLong(key->keyofs);
+		key->keylen = LittleLong(key->keylen);
+
+		if ((key->offset < 0) || (key->offset >= indexofs) ||
+			!SV_ValidDemoBlock(key->keyofs, key->keylen, indexofs) ||
+			(i && (key->time < key[-1].time)))
+		{
+			Z_Free(sv.demokeys);
+			sv.demokeys = NULL;
+			goto bad;
+		}
+	}
+
+	sv.numdemokeys = index.numkeys;
+	sv.demoreset.pos = index.resetofs;
+	sv.demoreset.end = index.resetofs + index.resetlen;
+
+	return;
+
+bad:
+	Com_Printf("demos/%s has a broken index, seeking disabled.\n", sv.name);
+}
+
+/*
+ * Limits a timedemo to the part of the demo between
+ * timedemo_start and timedemo_end milliseconds, as
+ * far as the keyframes allow.
+ */
+static void
+SV_SetupTimedemoSegment(void)
+{
+	int i;
+
+	if (!sv_timedemo->value ||
+		((sv_timedemo_start->value <= 0) && (sv_timedemo_end->value <= 0)))
+	{
+		return;
+	}
+
+	if (!sv.demokeys)
+	{
+		Com_Printf("demos/%s has no index, timing all of it.\n", sv.name);
+		return;
+	}
+
+	sv.demostart = (int)sv_timedemo_start->value;
+
+	if (sv_timedemo_end->value > 0)
+	{
+		/* stop at the first keyframe at or after the end */
+		for (i = 0; i < sv.numdemokeys; i++)
+		{
+			if (sv.demokeys[i].time >= sv_timedemo_end->value)
+			{
+				sv.demostop = sv.demokeys[i].offset;
+				break;
+			}
+		}
+	}
+}
+
 void
 SV_BeginDemoserver(void)
 {
 	char name[MAX_OSPATH];
+	int len;
+
+	SV_EndDemoserver();
 
 	Com_sprintf(name, sizeof(name), "demos/%s", sv.name);
-	FS_FOpenFile(name, &sv.demofile, false);
+	len = FS_LoadFile(name, (void **)&sv.demofile);
 
 	if (!sv.demofile)
 	{
 		Com_Error(ERR_DROP, "Couldn't open %s\n", name);
 	}
+
+	sv.demostream.pos = 0;
+	sv.demostream.end = len;
+
+	SV_ReadDemoIndex(len);
+	SV_SetupTimedemoSegment();
+}
+
+void
+SV_EndDemoserver(void)
+{
+	if (sv.demofile)
+	{
+		FS_FreeFile(sv.demofile);
+		sv.demofile = NULL;
+	}
+
+	if (sv.demokeys)
+	{
+		Z_Free(sv.demokeys);
+		sv.demokeys = NULL;
+	}
+
+	sv.numdemokeys = 0;
+	sv.demostart = 0;
+	sv.demostop = 0;
+	memset(sv.demoseek, 0, sizeof(sv.demoseek));
+}
+
+/*
+ * Jumps to the last keyframe at or before time
+ * milliseconds into the demo that's playing.
+ */
+void
+SV_SeekDemo(int time)
+{
+	ddemokey_t *key;
+	int lo, hi, mid;
+
+	if ((sv.state != ss_demo) || !sv.demofile)
+	{
+		Com_Printf("Not playing a demo.\n");
+		return;
+	}
+
+	if (!sv.demokeys)
+	{
+		Com_Printf("demos/%s has no index.\n", sv.name);
+		return;
+	}
+
+	/* binary search for the last key not after time */
+	lo = 0;
+	hi = sv.numdemokeys - 1;
+
+	while (lo < hi)
+	{
+		mid = (lo + hi + 1) / 2;
+
+		if (sv.demokeys[mid].time <= time)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+
+	key = &sv.demokeys[lo];
+
+	/* configstrings go back to the start of the demo,
+	   then the keyframe brings everything up to date */
+	sv.demoseek[0] = sv.demoreset;
+	sv.demoseek[1].pos = key->keyofs;
+	sv.demoseek[1].end = key->keyofs + key->keylen;
+	sv.demostream.pos = key->offset;
+
+	Com_Printf("Demo at %i:%02i of %i:%02i.\n",
+			key->time / 60000, (key->time / 1000) % 60,
+			sv.demokeys[sv.numdemokeys - 1].time / 60000,
+			(sv.demokeys[sv.numdemokeys - 1].time / 1000) % 60);
 }
 
 /*
@@ -554,95 +554,134 @@ SV_HullForEntity(edict_t *ent)
 	return CM_HeadnodeForBox(ent->mins, ent->maxs);
 }
 
-void
-SV_ClipMoveToEntities(moveclip_t *clip)
+/*
+ * Returns false if the trace of clip can't hit touch. That
+ * doesn't depend on where the trace goes, so SV_BoxTraces()
+ * checks it only once for all of its traces.
+ */
+static qboolean
+SV_ClipCandidate(moveclip_t *clip, edict_t *touch)
 {
-	int i, num;
-	edict_t *touchlist[MAX_EDICTS], *touch;
-	trace_t trace;
-	int headnode;
-	float *angles;
-
-	num = SV_AreaEdicts(clip->boxmins, clip->boxmaxs, touchlist,
-			MAX_EDICTS, AREA_SOLID);
+	if (touch->solid == SOLID_NOT)
+	{
+		return false;
+	}
 
-	/* be careful, it is possible to have an entity in this
-	   list removed before we get to it (killtriggered) */
-	for (i = 0; i < num; i++)
+	if (touch == clip->passedict)
 	{
-		touch = touchlist[i];
+		return false;
+	}
 
-		if (touch->solid == SOLID_NOT)
+	if (clip->passedict)
+	{
+		if (touch->owner == clip->passedict)
 		{
-			continue;
+			return false; /* don't clip against own missiles */
 		}
 
-		if (touch == clip->passedict)
+		if (clip->passedict->owner == touch)
 		{
-			continue;
+			return false; /* don't clip against owner */
 		}
+	}
 
-		if (clip->trace.allsolid)
-		{
-			return;
-		}
+	if (!(clip->contentmask & CONTENTS_DEADMONSTER) &&
+		(touch->svflags & SVF_DEADMONSTER))
+	{
+		return false;
+	}
 
-		if (clip->passedict)
-		{
-			if (touch->owner == clip->passedict)
-			{
-				continue; /* don't clip against own missiles */
-			}
+	return true;
+}
 
-			if (clip->passedict->owner == touch)
-			{
-				continue; /* don't clip against owner */
-			}
-		}
+/*
+ * With a trace context tc this may run on a job thread,
+ * as long as touch is a SOLID_BSP entity.
+ */
+static void
+SV_ClipToEntity(cmtrace_t *tc, moveclip_t *clip, edict_t *touch)
+{
+	trace_t trace;
+	int headnode;
+	float *angles;
+	float *mins, *maxs;
 
-		if (!(clip->contentmask & CONTENTS_DEADMONSTER) &&
-			(touch->svflags & SVF_DEADMONSTER))
-		{
-			continue;
-		}
+	/* might intersect, so do an exact clip */
+	headnode = SV_HullForEntity(touch);
+	angles = touch->s.angles;
 
-		/* might intersect, so do an exact clip */
-		headnode = SV_HullForEntity(touch);
-		angles = touch->s.angles;
+	if (touch->solid != SOLID_BSP)
+	{
+		angles = vec3_origin; /* boxes don't rotate */
+	}
 
-		if (touch->solid != SOLID_BSP)
-		{
-			angles = vec3_origin; /* boxes don't rotate */
-		}
+	if (touch->svflags & SVF_MONSTER)
+	{
+		mins = clip->mins2;
+		maxs = clip->maxs2;
+	}
+	else
+	{
+		mins = clip->mins;
+		maxs = clip->maxs;
+	}
+
+	if (tc)
+	{
+		trace = CM_TransformedBoxTraceContext(tc, clip->start, clip->end,
+				mins, maxs, headnode, clip->contentmask,
+				touch->s.origin, angles);
+	}
+	else
+	{
+		trace = CM_TransformedBoxTrace(clip->start, clip->end,
+				mins, maxs, headnode, clip->contentmask,
+				touch->s.origin, angles);
+	}
 
-		if (touch->svflags & SVF_MONSTER)
+	if (trace.allsolid || trace.startsolid ||
+		(trace.fraction < clip->trace.fraction))
+	{
+		trace.ent = touch;
+
+		if (clip->trace.startsolid)
 		{
-			trace = CM_TransformedBoxTrace(clip->start, clip->end,
-					clip->mins2, clip->maxs2, headnode, clip->contentmask,
-					touch->s.origin, angles);
+			clip->trace = trace;
+			clip->trace.startsolid = true;
 		}
 		else
 		{
-			trace = CM_TransformedBoxTrace(clip->start, clip->end,
-					clip->mins, clip->maxs, headnode, clip->contentmask,
-					touch->s.origin, angles);
+			clip->trace = trace;
 		}
+	}
+}
+
+void
+SV_ClipMoveToEntities(moveclip_t *clip)
+{
+	int i, num;
+	edict_t *touchlist[MAX_EDICTS], *touch;
+
+	num = SV_AreaEdicts(clip->boxmins, clip->boxmaxs, touchlist,
+			MAX_EDICTS, AREA_SOLID);
 
-		if (trace.allsolid || trace.startsolid ||
-			(trace.fraction < clip->trace.fraction))
+	/* be careful, it is possible to have an entity in this
+	   list removed before we get to it (killtriggered) */
+	for (i = 0; i < num; i++)
+	{
+		touch = touchlist[i];
+
+		if (!SV_ClipCandidate(clip, touch))
 		{
-			trace.ent = touch;
+			continue;
+		}
 
-			if (clip->trace.startsolid)
-			{
-				clip->trace = trace;
-				clip->trace.startsolid = true;
-			}
-			else
-			{
-				clip->trace = trace;
-			}
+		if (clip->trace.allsolid)
+		{
+			return;
 		}
+
+		SV_ClipToEntity(NULL, clip, touch);
 	}
 }
 
@@ -718,3 +757,319 @@ SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
 	return clip.trace;
 }
 
+
+/*
+ * Does the same as calling SV_Trace() from start to each of
+ * ends. The entities are looked up once for the box around all
+ * traces. Each trace then only clips against those that touch
+ * its own box, in the order SV_AreaEdicts() would return them.
+ * Used for shotgun pellets and such. Unlike SV_LineTraces() this
+ * stays on the main thread: shots trace against monsters, whose
+ * box hulls share the state of CM_HeadnodeForBox(), and a shot
+ * has too few pellets to pay for waking the job threads.
+ */
+void
+SV_BoxTraces(trace_t *traces, vec3_t start, vec3_t mins, vec3_t maxs,
+		vec3_t *ends, int numtraces, edict_t *passedict, int contentmask)
+{
+	edict_t *touchlist[MAX_EDICTS], *touch;
+	vec3_t boxmins, boxmaxs;
+	moveclip_t clip;
+	int i, j, num;
+
+	if (numtraces <= 0)
+	{
+		return;
+	}
+
+	if (!mins)
+	{
+		mins = vec3_origin;
+	}
+
+	if (!maxs)
+	{
+		maxs = vec3_origin;
+	}
+
+	memset(&clip, 0, sizeof(moveclip_t));
+
+	clip.contentmask = contentmask;
+	clip.start = start;
+	clip.mins = mins;
+	clip.maxs = maxs;
+	clip.passedict = passedict;
+
+	VectorCopy(mins, clip.mins2);
+	VectorCopy(maxs, clip.maxs2);
+
+	/* the box around all traces */
+	SV_TraceBounds(start, clip.mins2, clip.maxs2, ends[0], boxmins, boxmaxs);
+
+	for (i = 1; i < numtraces; i++)
+	{
+		SV_TraceBounds(start, clip.mins2, clip.maxs2,
+				ends[i], clip.boxmins, clip.boxmaxs);
+		AddPointToBounds(clip.boxmins, boxmins, boxmaxs);
+		AddPointToBounds(clip.boxmaxs, boxmins, boxmaxs);
+	}
+
+	num = SV_AreaEdicts(boxmins, boxmaxs, touchlist, MAX_EDICTS, AREA_SOLID);
+
+	/* drop the ones that no trace can hit */
+	for (i = 0, j = 0; i < num; i++)
+	{
+		if (SV_ClipCandidate(&clip, touchlist[i]))
+		{
+			touchlist[j++] = touchlist[i];
+		}
+	}
+
+	num = j;
+
+	for (i = 0; i < numtraces; i++)
+	{
+		/* clip to world */
+		clip.trace = CM_BoxTrace(start, ends[i], mins, maxs, 0, contentmask);
+		clip.trace.ent = ge->edicts;
+
+		if (clip.trace.fraction == 0)
+		{
+			traces[i] = clip.trace;
+			continue; /* blocked by the world */
+		}
+
+		clip.end = ends[i];
+		SV_TraceBounds(start, clip.mins2, clip.maxs2,
+				ends[i], clip.boxmins, clip.boxmaxs);
+
+		for (j = 0; (j < num) && !clip.trace.allsolid; j++)
+		{
+			touch = touchlist[j];
+
+			if ((touch->absmin[0] > clip.boxmaxs[0]) ||
+				(touch->absmin[1] > clip.boxmaxs[1]) ||
+				(touch->absmin[2] > clip.boxmaxs[2]) ||
+				(touch->absmax[0] < clip.boxmins[0]) ||
+				(touch->absmax[1] < clip.boxmins[1]) ||
+				(touch->absmax[2] < clip.boxmins[2]))
+			{
+				continue; /* not touching this trace */
+			}
+
+			SV_ClipToEntity(NULL, &clip, touch);
+		}
+
+		traces[i] = clip.trace;
+	}
+}
+
+/*
+ * SV_LineTraces() spreads its traces over the job threads. The
+ * world and brush models are only read, everything a trace
+ * writes lives in the trace context of its thread. Bounding box
+ * entities can't go that way, their hull is shared. They are
+ * CONTENTS_MONSTER though, so they're skipped for masks without
+ * it and only such traces are run on the threads.
+ */
+
+#define LINETRACE_MAXJOBS 256
+#define LINETRACE_MINCHUNK 16 /* traces per job */
+
+typedef struct
+{
+	int first, count;
+} linetracejob_t;
+
+static cmtrace_t *sv_tracecontexts[MAX_JOB_THREADS + 1];
+
+/* the batch that's being traced */
+static trace_t *linetrace_traces;
+static vec3_t *linetrace_starts, *linetrace_ends;
+static edict_t **linetrace_passedicts;
+static int linetrace_contentmask;
+static edict_t *linetrace_touch[MAX_EDICTS];
+static int linetrace_numtouch;
+
+static qboolean
+SV_IsPositionTest(vec3_t start, vec3_t end)
+{
+	return (start[0] == end[0]) && (start[1] == end[1]) &&
+		(start[2] == end[2]);
+}
+
+static void
+SV_LineTraceJob(void *data, int thread)
+{
+	linetracejob_t *job = data;
+	cmtrace_t *tc = sv_tracecontexts[thread];
+	edict_t *touch;
+	moveclip_t clip;
+	int i, j;
+
+	memset(&clip, 0, sizeof(moveclip_t));
+
+	clip.contentmask = linetrace_contentmask;
+	clip.mins = vec3_origin;
+	clip.maxs = vec3_origin;
+
+	for (i = job->first; i < job->first + job->count; i++)
+	{
+		clip.start = linetrace_starts[i];
+		clip.end = linetrace_ends[i];
+
+		if (SV_IsPositionTest(clip.start, clip.end))
+		{
+			continue; /* done by the main thread */
+		}
+
+		/* clip to world */
+		clip.trace = CM_BoxTraceContext(tc, clip.start, clip.end,
+				vec3_origin, vec3_origin, 0, linetrace_contentmask);
+		clip.trace.ent = ge->edicts;
+
+		if (clip.trace.fraction == 0)
+		{
+			linetrace_traces[i] = clip.trace;
+			continue; /* blocked by the world */
+		}
+
+		clip.passedict = linetrace_passedicts[i];
+		SV_TraceBounds(clip.start, clip.mins2, clip.maxs2,
+				clip.end, clip.boxmins, clip.boxmaxs);
+
+		for (j = 0; (j < linetrace_numtouch) && !clip.trace.allsolid; j++)
+		{
+			touch = linetrace_touch[j];
+
+			if ((touch->absmin[0] > clip.boxmaxs[0]) ||
+				(touch->absmin[1] > clip.boxmaxs[1]) ||
+				(touch->absmin[2] > clip.boxmaxs[2]) ||
+				(touch->absmax[0] < clip.boxmins[0]) ||
+				(touch->absmax[1] < clip.boxmins[1]) ||
+				(touch->absmax[2] < clip.boxmins[2]))
+			{
+				continue; /* not touching this trace */
+			}
+
+			if (!SV_ClipCandidate(&clip, touch))
+			{
+				continue;
+			}
+
+			SV_ClipToEntity(tc, &clip, touch);
+		}
+
+		linetrace_traces[i] = clip.trace;
+	}
+}
+
+/*
+ * Does the same as calling SV_Trace() with no mins and maxs from
+ * starts[i] to ends[i], passing passedicts[i], for each i. Meant
+ * for line of sight checks, like those of all monsters at the
+ * start of a game frame.
+ */
+void
+SV_LineTraces(trace_t *traces, vec3_t *starts, vec3_t *ends,
+		edict_t **passedicts, int numtraces, int contentmask)
+{
+	linetracejob_t jobs[LINETRACE_MAXJOBS];
+	vec3_t boxmins, boxmaxs, mins, maxs;
+	int i, num, numjobs, numthreads, chunk;
+	edict_t *touch;
+
+	if (numtraces <= 0)
+	{
+		return;
+	}
+
+	if (contentmask & CONTENTS_MONSTER)
+	{
+		/* hits bounding boxes, not for the threads */
+		for (i = 0; i < numtraces; i++)
+		{
+			traces[i] = SV_Trace(starts[i], NULL, NULL, ends[i],
+					passedicts[i], contentmask);
+		}
+
+		return;
+	}
+
+	/* the box around all traces, position tests
+	   are done here because they aren't thread safe */
+	ClearBounds(boxmins, boxmaxs);
+
+	for (i = 0; i < numtraces; i++)
+	{
+		if (SV_IsPositionTest(starts[i], ends[i]))
+		{
+			traces[i] = SV_Trace(starts[i], NULL, NULL, ends[i],
+					passedicts[i], contentmask);
+			continue;
+		}
+
+		SV_TraceBounds(starts[i], vec3_origin, vec3_origin,
+				ends[i], mins, maxs);
+		AddPointToBounds(mins, boxmins, boxmaxs);
+		AddPointToBounds(maxs, boxmins, boxmaxs);
+	}
+
+	if (boxmins[0] > boxmaxs[0])
+	{
+		return; /* nothing but position tests */
+	}
+
+	/* only brush models, bounding boxes can't be hit. Looking
+	   up their hull catches broken ones before the threads do */
+	num = SV_AreaEdicts(boxmins, boxmaxs, linetrace_touch,
+			MAX_EDICTS, AREA_SOLID);
+
+	for (i = 0, linetrace_numtouch = 0; i < num; i++)
+	{
+		touch = linetrace_touch[i];
+
+		if (touch->solid == SOLID_BSP)
+		{
+			SV_HullForEntity(touch);
+			linetrace_touch[linetrace_numtouch++] = touch;
+		}
+	}
+
+	/* one trace context per thread */
+	numthreads = Com_NumJobThreads();
+
+	for (i = 0; i < numthreads; i++)
+	{
+		if (!sv_tracecontexts[i])
+		{
+			sv_tracecontexts[i] = CM_CreateTraceContext();
+		}
+	}
+
+	linetrace_traces = traces;
+	linetrace_starts = starts;
+	linetrace_ends = ends;
+	linetrace_passedicts = passedicts;
+	linetrace_contentmask = contentmask;
+
+	chunk = (numtraces + LINETRACE_MAXJOBS - 1) / LINETRACE_MAXJOBS;
+
+	if (chunk < LINETRACE_MINCHUNK)
+	{
+		chunk = LINETRACE_MINCHUNK;
+	}
+
+	for (i = 0, numjobs = 0; i < numtraces; i += chunk, numjobs++)
+	{
+		jobs[numjobs].first = i;
+		jobs[numjobs].count = (numtraces - i < chunk) ? numtraces - i : chunk;
+	}
+
+	Com_RunJobs(SV_LineTraceJob, jobs, numjobs, sizeof(linetracejob_t));
+
+	for (i = 0; i < numthreads; i++)
+	{
+		CM_AddTraceStats(sv_tracecontexts[i]);
+	}
+}
@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+#
+# Local HTTP download server for testing the clients cURL
+# downloads. Builds a small tree with filelists, paks and
+# loose files for the mod 'dltest' and serves it with HTTP/1.1
+# keep-alive. Every request is logged with the connection it
+# came in on, so reused connections can be told apart from new
+# ones. See README.md next to this script.
+#
+# Usage: serve.py --map <some.bsp> [--port 8000] [--dir <tree>]
+
+import argparse
+import os
+import shutil
+import socketserver
+import struct
+import sys
+import tempfile
+import threading
+
+from http.server import SimpleHTTPRequestHandler, ThreadingHTTPServer
+
+GAME = "dltest"
+LOOSE_FILES = 32
+PAK_FILES = 2
+PAK_SIZE = 2 * 1024 * 1024
+
+
+def write_pak(path, entries):
+    """Writes a Quake II pak with the given (name, data) entries."""
+    with open(path, "wb") as f:
+        f.write(b"\0" * 12)
+        directory = b""
+
+        for name, data in entries:
+            directory += struct.pack("<56sii", name.encode(), f.tell(), len(data))
+            f.write(data)
+
+        dirofs = f.tell()
+        f.write(directory)
+        f.seek(0)
+        f.write(struct.pack("<4sii", b"PACK", dirofs, len(directory)))
+
+
+def build_tree(root, bsp):
+    game = os.path.join(root, GAME)
+    os.makedirs(os.path.join(game, "maps"), exist_ok=True)
+    os.makedirs(os.path.join(game, "docs"), exist_ok=True)
+
+    shutil.copyfile(bsp, os.path.join(game, "maps", GAME + ".bsp"))
+
+    lines = []
+
+    for i in range(PAK_FILES):
+        name = "%s%d.pak" % (GAME, i)
+        filler = bytes((i * 7 + j) & 0xff for j in range(256)) * (PAK_SIZE // 256)
+        write_pak(os.path.join(game, name),
+                  [("docs/pak%d.txt" % i, b"from pak %d\n" % i),
+                   ("docs/pak%d.dat" % i, filler)])
+        lines.append(name)
+
+    for i in range(LOOSE_FILES):
+        name = "docs/file%02d.txt" % i
+        with open(os.path.join(game, name), "wb") as f:
+            f.write((b"loose file %d\n" % i) * (1024 * (i + 1)))
+        lines.append(name)
+
+    filelist = ("\n".join(lines) + "\n").encode()
+
+    # map specific list, and the generic lists of r1q2 and q2pro style servers
+    for path in (os.path.join(game, "maps", GAME + ".filelist"),
+                 os.path.join(root, ".filelist"),
+                 os.path.join(game, ".filelist")):
+        with open(path, "wb") as f:
+            f.write(filelist)
+
+
+class Handler(SimpleHTTPRequestHandler):
+    # keep-alive, so the client can reuse its connections
+    protocol_version = "HTTP/1.1"
+
+    lock = threading.Lock()
+    connections = {}
+    requests = 0
+
+    def handle(self):
+        with Handler.lock:
+            Handler.connections[self.client_address] = 0
+
+        super().handle()
+
+    def log_request(self, code="-", size="-"):
+        with Handler.lock:
+            Handler.connections[self.client_address] += 1
+            Handler.requests += 1
+            count = Handler.connections[self.client_address]
+
+        sys.stderr.write("%s:%d #%d %s %s\n" % (self.client_address[0],
+            self.client_address[1], count, code, self.path))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Serves a canned download tree.")
+    parser.add_argument("--map", required=True,
+                        help="any .bsp, it's served as maps/%s.bsp" % GAME)
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--dir", help="where to build the tree, a temporary directory by default")
+    args = parser.parse_args()
+
+    root = args.dir or tempfile.mkdtemp(prefix="yq2-httpdl-")
+    build_tree(root, args.map)
+
+    print("Serving %s on http://127.0.0.1:%d/" % (root, args.port))
+    print("Stop with Ctrl+C to see how many connections were used.")
+
+    os.chdir(root)
+    socketserver.TCPServer.allow_reuse_address = True
+    server = ThreadingHTTPServer(("127.0.0.1", args.port), Handler)
+
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+    print("\n%d requests over %d connections" % (Handler.requests,
+        len(Handler.connections)))
+
+
+if __name__ == "__main__":
+    main()
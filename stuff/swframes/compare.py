@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+#
+# Compares the frames the software renderer draws in two builds.
+# Both builds play the same demo with sw_headless 1, every Nth
+# frame is dumped through sw_headless_dump and the dumps are
+# compared pixel by pixel. Used to check that optimizations of
+# the software renderer, like the batched alias model transform
+# in R_AliasTransformFinalVerts(), don't change the output.
+#
+# Usage: compare.py --old <quake2> --new <quake2> --demo <name.dm2>
+#                   [--dump 1] [--mode 4] [--keep]
+#
+# The binaries are the quake2 executables of both builds, each
+# with ref_soft next to it. The demo is searched in the normal
+# game data. Each build gets its own configuration directory,
+# ~/.yq2-frames-old and ~/.yq2-frames-new on Linux.
+
+import argparse
+import glob
+import os
+import shutil
+import subprocess
+import sys
+
+CFGDIRS = {"old": ".yq2-frames-old", "new": ".yq2-frames-new"}
+
+
+def frame_dir(cfgdir):
+    return os.path.join(os.path.expanduser("~"), cfgdir, "baseq2", "scrnshot")
+
+
+def read_ppm(path):
+    """Returns (width, height, pixels) of a binary PPM as written by RE_DumpFrame()."""
+    with open(path, "rb") as f:
+        data = f.read()
+
+    magic, size, maxval, pixels = data.split(b"\n", 3)
+
+    if magic != b"P6" or maxval != b"255":
+        raise ValueError("%s: not a PPM written by sw_headless_dump" % path)
+
+    width, height = (int(x) for x in size.split())
+    return width, height, pixels
+
+
+def run(binary, cfgdir, args):
+    frames = frame_dir(cfgdir)
+    shutil.rmtree(frames, ignore_errors=True)
+    os.makedirs(frames)
+
+    env = dict(os.environ)
+
+    # No display is needed, the window is hidden anyway
+    if not env.get("DISPLAY") and not env.get("WAYLAND_DISPLAY"):
+        env.setdefault("SDL_VIDEODRIVER", "offscreen")
+
+    env.setdefault("SDL_AUDIODRIVER", "dummy")
+
+    # timedemo draws one frame per demo packet, fixedtime
+    # makes the client time advance the same in both runs.
+    cmd = [binary, "-cfgdir", cfgdir,
+           "+set", "vid_renderer", "soft",
+           "+set", "r_mode", str(args.mode),
+           "+set", "vid_fullscreen", "0",
+           "+set", "sw_headless", "1",
+           "+set", "sw_headless_dump", str(args.dump),
+           "+set", "timedemo", "1",
+           "+set", "fixedtime", "16667",
+           "+set", "nextdemo", "quit",
+           "+demomap", args.demo]
+
+    print("Running %s" % " ".join(cmd))
+    subprocess.run(cmd, env=env, check=True)
+
+    return sorted(os.path.basename(p) for p in glob.glob(os.path.join(frames, "frame_*.ppm")))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compares software renderer frames of two builds.")
+    parser.add_argument("--old", required=True, help="quake2 binary of the reference build")
+    parser.add_argument("--new", required=True, help="quake2 binary of the build to check")
+    parser.add_argument("--demo", required=True, help="demo to play, e.g. demo1.dm2")
+    parser.add_argument("--dump", type=int, default=1, help="dump every Nth frame")
+    parser.add_argument("--mode", type=int, default=4, help="r_mode for both runs")
+    parser.add_argument("--keep", action="store_true", help="keep the dumped frames")
+    args = parser.parse_args()
+
+    old = run(args.old, CFGDIRS["old"], args)
+    new = run(args.new, CFGDIRS["new"], args)
+
+    if not old:
+        sys.exit("No frames were dumped, is the demo there?")
+
+    if old != new:
+        print("Frame count differs: old %d, new %d" % (len(old), len(new)))
+
+    different = 0
+
+    for name in sorted(set(old) & set(new)):
+        ow, oh, opix = read_ppm(os.path.join(frame_dir(CFGDIRS["old"]), name))
+        nw, nh, npix = read_ppm(os.path.join(frame_dir(CFGDIRS["new"]), name))
+
+        if (ow, oh) != (nw, nh):
+            print("%s: size differs, %dx%d vs %dx%d" % (name, ow, oh, nw, nh))
+            different += 1
+            continue
+
+        if opix != npix:
+            pixels = sum(1 for i in range(0, len(opix), 3) if opix[i:i + 3] != npix[i:i + 3])
+            print("%s: %d of %d pixels differ" % (name, pixels, ow * oh))
+            different += 1
+
+    print("%d frames compared, %d differ" % (len(set(old) & set(new)), different))
+
+    if not args.keep:
+        for cfgdir in CFGDIRS.values():
+            shutil.rmtree(frame_dir(cfgdir), ignore_errors=True)
+    else:
+        print("Frames kept in %s and %s" % (frame_dir(CFGDIRS["old"]), frame_dir(CFGDIRS["new"])))
+
+    sys.exit(1 if different or old != new else 0)
+
+
+if __name__ == "__main__":
+    main()